@@ -0,0 +1,496 @@
+/***************************************************************************//**
+ * @file acq.c
+ * @brief Continuous RHS2116 acquisition streamed over BLE.
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "acq.h"
+#include "acq_timer.h"
+#include "byteorder.h"
+#include "config.h"
+#include "conn_tuning.h"
+#include "delta_pack.h"
+#include "detect.h"
+#include "dlog.h"
+#include "em_core.h"
+#include "em_device.h"
+#include "gatt_db.h"
+#include "power.h"
+#include "rhs2116.h"
+#include "session.h"
+#include "sl_sleeptimer.h"
+#include "tasks.h"
+
+#define ACQ_NO_CONNECTION       0xFF
+#define ACQ_ATT_HEADER_SIZE     3       // opcode and handle of a notification
+#define ACQ_LATENCY_SWEEPS \
+	((uint32_t) ((uint64_t) ACQ_FRAME_LATENCY_MS * ACQ_SAMPLE_RATE_HZ / 1000))
+
+_Static_assert(ACQ_FRAME_MAX_SWEEPS <= UINT8_MAX,
+		"sweep count is one byte in the frame header");
+_Static_assert(ACQ_FRAME_MAX_SWEEPS <= ACQ_RING_SWEEPS,
+		"a frame is packed from the ring");
+_Static_assert(RHS2116_CHANNELS <= DELTA_PACK_MAX_CHANNELS,
+		"every channel must be packable");
+_Static_assert(SESSION_MAX_CONNECTIONS <= 8,
+		"frameUnsent has one bit per subscriber");
+_Static_assert(RHS2116_CHANNELS <= RHS2116_BATCH_MAX,
+		"a sweep must fit one batch");
+#ifdef gattdb_acq_stats
+_Static_assert(ACQ_STATS_MAX_SIZE >= ACQ_STATS_SIZE,
+		"acq stats characteristic must hold the record");
+#endif
+
+// One sweep in flight on the bus.
+typedef struct {
+	rhs2116_batch_t batch;
+	uint16_t samples[RHS2116_CHANNELS];
+	uint32_t sweep;
+	uint32_t cycles;        // cycle count at the sweep clock tick
+	uint8_t session;
+	volatile bool busy;     // set by the sweep clock, cleared by onSweep()
+} acq_buffer_t;
+
+static acq_buffer_t buffers[2];
+static uint8_t nextBuffer;
+static uint8_t channelList[RHS2116_CHANNELS];
+static uint8_t channels;
+static uint8_t session;         // tells a late sweep from an old session
+static volatile uint32_t nextSweep;
+static volatile uint32_t overruns;
+
+// Finished sweeps in arrival order; only touched from the superloop.
+static uint16_t ring[ACQ_RING_SWEEPS][RHS2116_CHANNELS];
+static uint32_t ringSweep[ACQ_RING_SWEEPS];
+static uint16_t ringHead;
+static uint16_t ringCount;
+// Sweeps waiting when the packer last decided a frame was not due.
+static uint16_t ringChecked;
+
+static uint16_t scratch[ACQ_FRAME_MAX_SWEEPS * RHS2116_CHANNELS];
+static uint8_t frame[ACQ_STREAM_MAX_SIZE];
+static size_t frameLen;         // non-zero while a frame awaits TX buffers
+static size_t frameRawBytes;
+static uint16_t frameSeq;
+static uint8_t frameUnsent;     // subscriber slots still owed the frame
+static bool frameDelivered;     // taken by at least one subscriber
+
+// Centrals subscribed to acq_stream, ACQ_NO_CONNECTION if unused. All get
+// the same frames.
+static uint8_t subscribers[SESSION_MAX_CONNECTIONS];
+static uint8_t subscriberCount;
+static bool streaming;          // sweeps run, sent while anyone subscribes
+static bool closedLoop;         // detectors keep the sweeps running
+static uint32_t detectNext;     // sweep the detectors expect next
+static acq_stats_t stats;
+static uint64_t startTick;      // sleeptimer tick the session started at
+static uint64_t stopTick;       // and ended at, while not streaming
+static sl_sleeptimer_timer_handle_t statsTimer;
+static volatile bool statsDue;
+
+static void onSweep(rhs2116_batch_t *batch, sl_status_t status,
+		void *context);
+
+// Sweep clock interrupt: convert every channel into the next free buffer.
+static void onSweepClock(void) {
+	uint32_t sweep = nextSweep++;
+	acq_buffer_t *b = &buffers[nextBuffer];
+
+	if (b->busy) {
+		// The superloop has not taken the previous sweep out yet.
+		overruns++;
+		return;
+	}
+	rhs2116_batch_init(&b->batch);
+	for (uint8_t i = 0; i < channels; i++) {
+		rhs2116_batch_convert(&b->batch, channelList[i], &b->samples[i]);
+	}
+	b->sweep = sweep;
+	b->cycles = DWT->CYCCNT;
+	b->session = session;
+	b->busy = true;
+	if (rhs2116_submit(&b->batch, onSweep, b) != SL_STATUS_OK) {
+		b->busy = false;
+		overruns++;
+		return;
+	}
+	nextBuffer ^= 1;
+}
+
+// Batch completion, from rhs2116_process_action().
+static void onSweep(rhs2116_batch_t *batch, sl_status_t status,
+		void *context) {
+	(void) batch;
+	acq_buffer_t *b = context;
+
+	if (!streaming || b->session != session) {
+		// Left over from the last session.
+		b->busy = false;
+		return;
+	}
+	if (closedLoop && status == SL_STATUS_OK) {
+		// Filters need every sweep; start over after a gap.
+		if (b->sweep != detectNext) {
+			detect_restart();
+		}
+		detectNext = b->sweep + 1;
+		detect_on_sweep(b->samples, b->cycles);
+	}
+	if (subscriberCount == 0 && status == SL_STATUS_OK) {
+		// Only the detectors want this sweep.
+		stats.sweepsAcquired++;
+	} else if (status != SL_STATUS_OK || ringCount == ACQ_RING_SWEEPS) {
+		stats.sweepsDropped++;
+	} else {
+		uint16_t slot = (uint16_t) ((ringHead + ringCount) % ACQ_RING_SWEEPS);
+		memcpy(ring[slot], b->samples, channels * sizeof(uint16_t));
+		ringSweep[slot] = b->sweep;
+		ringCount++;
+		if (ringCount > stats.ringHighWater) {
+			stats.ringHighWater = ringCount;
+		}
+		stats.sweepsAcquired++;
+	}
+	b->busy = false;
+}
+
+static void onStatsTimer(sl_sleeptimer_timer_handle_t *handle, void *data) {
+	(void) handle;
+	(void) data;
+	statsDue = true;
+	tasks_wake(TASKS_ACQ);
+}
+
+static void publishStats(void) {
+#ifdef gattdb_acq_stats
+	uint8_t record[ACQ_STATS_SIZE];
+	size_t len = acq_encode_stats(record, sizeof(record));
+	sl_status_t sc = sl_bt_gatt_server_write_attribute_value(gattdb_acq_stats,
+			0, len, record);
+	if (sc != SL_STATUS_OK) {
+		DLOG(DLOG_ACQ_STATS_FAILED, sc);
+	}
+#endif
+}
+
+static void dropOldest(uint16_t n) {
+	ringHead = (uint16_t) ((ringHead + n) % ACQ_RING_SWEEPS);
+	ringCount = (uint16_t) (ringCount - n);
+	ringChecked = 0;
+}
+
+// Bitstream bytes that fit one notification to every subscriber.
+static size_t payloadBudget(void) {
+	size_t mtu = SIZE_MAX;
+	for (size_t i = 0; i < SESSION_MAX_CONNECTIONS; i++) {
+		if (subscribers[i] != ACQ_NO_CONNECTION
+				&& conn_tuning_get(subscribers[i])->mtu < mtu) {
+			mtu = conn_tuning_get(subscribers[i])->mtu;
+		}
+	}
+	size_t value = mtu > ACQ_ATT_HEADER_SIZE ? mtu - ACQ_ATT_HEADER_SIZE : 0;
+	if (value > ACQ_STREAM_MAX_SIZE) {
+		value = ACQ_STREAM_MAX_SIZE;
+	}
+	return value > ACQ_FRAME_HEADER_SIZE ? value - ACQ_FRAME_HEADER_SIZE : 0;
+}
+
+// Pack the oldest sweeps into frame[] once a frame is due.
+static bool packFrame(void) {
+	if (ringCount == 0) {
+		return false;
+	}
+	uint32_t first = ringSweep[ringHead];
+	bool late = nextSweep - first > ACQ_LATENCY_SWEEPS;
+	if (ringCount == ringChecked && !late) {
+		return false;
+	}
+
+	// Longest run of consecutive sweeps from the oldest.
+	size_t run = 1;
+	while (run < ringCount && run < ACQ_FRAME_MAX_SWEEPS
+			&& ringSweep[(ringHead + run) % ACQ_RING_SWEEPS] == first + run) {
+		run++;
+	}
+	bool gap = run < ringCount && run < ACQ_FRAME_MAX_SWEEPS;
+	for (size_t s = 0; s < run; s++) {
+		memcpy(&scratch[s * channels], ring[(ringHead + s) % ACQ_RING_SWEEPS],
+				channels * sizeof(uint16_t));
+	}
+
+	size_t budget = payloadBudget();
+	size_t fit = delta_pack_fit(scratch, channels, run, budget);
+	if (fit == 0) {
+		// Not even one sweep fits this MTU.
+		stats.sweepsDropped++;
+		dropOldest(1);
+		return false;
+	}
+	if (fit == run && run < ACQ_FRAME_MAX_SWEEPS && !gap && !late) {
+		// Wait for more sweeps.
+		ringChecked = ringCount;
+		return false;
+	}
+
+	size_t len = delta_pack_encode(scratch, channels, fit,
+			frame + ACQ_FRAME_HEADER_SIZE, budget);
+	put_le16(frame, frameSeq);
+	put_le32(frame + 2, first);
+	frame[6] = (uint8_t) fit;
+	put_le16(frame + 7, ACQ_CHANNEL_MASK);
+	frameLen = ACQ_FRAME_HEADER_SIZE + len;
+	frameRawBytes = fit * channels * sizeof(uint16_t);
+	frameUnsent = 0;
+	for (size_t i = 0; i < SESSION_MAX_CONNECTIONS; i++) {
+		if (subscribers[i] != ACQ_NO_CONNECTION) {
+			frameUnsent |= (uint8_t) (1u << i);
+		}
+	}
+	frameDelivered = false;
+	dropOldest((uint16_t) fit);
+	return true;
+}
+
+// Send the packed frame to every subscriber still owed it; false if it
+// must wait for TX buffers. Counted once, as sent if anyone took it.
+static bool sendFrame(void) {
+	for (size_t i = 0; i < SESSION_MAX_CONNECTIONS; i++) {
+		if (!(frameUnsent & (1u << i))) {
+			continue;
+		}
+#ifdef gattdb_acq_stream
+		sl_status_t sc = sl_bt_gatt_server_send_notification(subscribers[i],
+				gattdb_acq_stream, frameLen, frame);
+#else
+		sl_status_t sc = SL_STATUS_NOT_SUPPORTED;
+#endif
+		if (sc == SL_STATUS_NO_MORE_RESOURCE) {
+			stats.backpressure++;
+			return false;
+		}
+		frameUnsent &= (uint8_t) ~(1u << i);
+		frameDelivered |= sc == SL_STATUS_OK;
+	}
+	if (frameDelivered) {
+		stats.framesSent++;
+		stats.rawBytes += frameRawBytes;
+		stats.packedBytes += frameLen - ACQ_FRAME_HEADER_SIZE;
+	} else {
+		stats.framesDropped++;
+	}
+	frameSeq++;
+	frameLen = 0;
+	return true;
+}
+
+static void stop(void) {
+	if (!streaming) {
+		return;
+	}
+	acq_timer_stop();
+	streaming = false;
+	stopTick = sl_sleeptimer_get_tick_count64();
+	sl_sleeptimer_stop_timer(&statsTimer);
+	statsDue = false;
+	power_release(POWER_CLIENT_ACQ);
+	publishStats();
+	DLOG(DLOG_ACQ_STOPPED, stats.sweepsAcquired, stats.framesSent);
+}
+
+// Start a new stream for the current subscribers, or for the detectors
+// alone.
+static void start(void) {
+	stop();
+	memset(&stats, 0, sizeof(stats));
+	channels = 0;
+	for (uint8_t c = 0; c < RHS2116_CHANNELS; c++) {
+		if (ACQ_CHANNEL_MASK & (1u << c)) {
+			channelList[channels++] = c;
+		}
+	}
+	stats.configuredSamplesPerSecond = ACQ_SAMPLE_RATE_HZ * channels;
+	// Buffers still on the bus from the last session stay busy until their
+	// callback discards them.
+	session++;
+	nextSweep = 0;
+	detectNext = 0;
+	detect_restart();
+	overruns = 0;
+	ringHead = ringCount = ringChecked = 0;
+	frameLen = 0;
+	frameSeq = 0;
+	streaming = true;
+	startTick = sl_sleeptimer_get_tick_count64();
+
+	// TIMER and USART stop in EM2.
+	power_hold(POWER_CLIENT_ACQ);
+	sl_status_t sc = acq_timer_start(ACQ_SAMPLE_RATE_HZ, onSweepClock);
+	if (sc != SL_STATUS_OK) {
+		DLOG(DLOG_ACQ_START_FAILED, sc);
+		stop();
+		return;
+	}
+	sl_sleeptimer_start_periodic_timer_ms(&statsTimer, ACQ_STATS_INTERVAL_MS,
+			onStatsTimer, NULL, 0, 0);
+	DLOG(DLOG_ACQ_STARTED, channels, ACQ_SAMPLE_RATE_HZ);
+}
+
+static bool addSubscriber(uint8_t conn) {
+	uint8_t *free = NULL;
+
+	for (size_t i = 0; i < SESSION_MAX_CONNECTIONS; i++) {
+		if (subscribers[i] == conn) {
+			return true;
+		}
+		if (free == NULL && subscribers[i] == ACQ_NO_CONNECTION) {
+			free = &subscribers[i];
+		}
+	}
+	if (free == NULL) {
+		return false;
+	}
+	*free = conn;
+	subscriberCount++;
+	return true;
+}
+
+// The central no longer wants the stream; the last one to leave stops it,
+// and the detectors keep the sweeps.
+static void release(uint8_t conn) {
+	for (size_t i = 0; i < SESSION_MAX_CONNECTIONS; i++) {
+		if (subscribers[i] != conn) {
+			continue;
+		}
+		subscribers[i] = ACQ_NO_CONNECTION;
+		subscriberCount--;
+		frameUnsent &= (uint8_t) ~(1u << i);
+		if (subscriberCount == 0) {
+			stop();
+			if (closedLoop) {
+				start();
+			}
+		}
+		return;
+	}
+}
+
+// A subscriber joins the running stream. Only the controller, or the first
+// subscriber, starts a new one: sequence numbers and stats start over.
+static void subscribe(uint8_t conn) {
+	bool first = subscriberCount == 0;
+
+	if (!addSubscriber(conn)) {
+		return;
+	}
+	if (first || session_role(conn) == SESSION_ROLE_CONTROLLER) {
+		start();
+	}
+}
+
+void acq_init(void) {
+	memset(&stats, 0, sizeof(stats));
+	memset(buffers, 0, sizeof(buffers));
+	nextBuffer = 0;
+	streaming = false;
+	closedLoop = false;
+	memset(subscribers, ACQ_NO_CONNECTION, sizeof(subscribers));
+	subscriberCount = 0;
+	frameUnsent = 0;
+	statsDue = false;
+}
+
+void acq_on_event(const sl_bt_msg_t *evt) {
+	switch (SL_BT_MSG_ID(evt->header)) {
+	case sl_bt_evt_gatt_server_characteristic_status_id: {
+		const sl_bt_evt_gatt_server_characteristic_status_t *status =
+				&evt->data.evt_gatt_server_characteristic_status;
+#ifdef gattdb_acq_stream
+		if (status->characteristic != gattdb_acq_stream
+				|| status->status_flags != sl_bt_gatt_server_client_config) {
+			break;
+		}
+		if (status->client_config_flags & sl_bt_gatt_server_notification) {
+			subscribe(status->connection);
+		} else {
+			release(status->connection);
+		}
+#else
+		(void) status;
+#endif
+		break;
+	}
+
+	case sl_bt_evt_connection_closed_id:
+		release(evt->data.evt_connection_closed.connection);
+		break;
+
+	default:
+		break;
+	}
+}
+
+void acq_process_action(void) {
+	if (statsDue) {
+		statsDue = false;
+		publishStats();
+	}
+	if (!streaming || subscriberCount == 0) {
+		return;
+	}
+	for (;;) {
+		if (frameLen == 0 && !packFrame()) {
+			break;
+		}
+		if (frameLen && !sendFrame()) {
+			break;
+		}
+	}
+}
+
+void acq_set_closed_loop(bool on) {
+	closedLoop = on;
+	if (on && !streaming) {
+		start();
+	} else if (!on && streaming && subscriberCount == 0) {
+		stop();
+	}
+}
+
+void acq_get_stats(acq_stats_t *out) {
+	uint64_t end = streaming ? sl_sleeptimer_get_tick_count64() : stopTick;
+	uint64_t elapsed = end - startTick;
+
+	*out = stats;
+	out->streaming = streaming && subscriberCount != 0;
+	out->overruns = overruns;
+	out->samplesPerSecond = elapsed ? (uint32_t) ((uint64_t)
+			stats.sweepsAcquired * channels
+			* sl_sleeptimer_get_timer_frequency() / elapsed) : 0;
+}
+
+size_t acq_encode_stats(uint8_t *out, size_t size) {
+	acq_stats_t s;
+
+	if (size < ACQ_STATS_SIZE) {
+		return 0;
+	}
+	acq_get_stats(&s);
+	memset(out, 0, ACQ_STATS_SIZE);
+	out[0] = ACQ_STATS_VERSION;
+	out[1] = s.streaming ? ACQ_STATS_FLAG_STREAMING : 0;
+	put_le16(out + 2, s.ringHighWater);
+	put_le32(out + 4, s.configuredSamplesPerSecond);
+	put_le32(out + 8, s.sweepsAcquired);
+	put_le32(out + 12, s.framesSent);
+	put_le32(out + 16, s.framesDropped);
+	put_le32(out + 20, s.sweepsDropped);
+	put_le32(out + 24, s.overruns);
+	put_le32(out + 28, s.backpressure);
+	uint64_t ratio = s.packedBytes ? s.rawBytes * 100 / s.packedBytes : 0;
+	put_le16(out + 32, (uint16_t) (ratio > UINT16_MAX ? UINT16_MAX : ratio));
+	put_le32(out + 36, s.samplesPerSecond);
+	return ACQ_STATS_SIZE;
+}
@@ -0,0 +1,128 @@
+/***************************************************************************//**
+ * @file acq.h
+ * @brief Continuous RHS2116 acquisition streamed over BLE.
+ *
+ * While a central is subscribed to notifications on the acq_stream
+ * characteristic, the sweep clock (acq_timer.h) converts every channel in
+ * ACQ_CHANNEL_MASK at ACQ_SAMPLE_RATE_HZ. Each sweep is one RHS2116 batch;
+ * two batches are used in turn, so one fills by DMA while the other's
+ * samples are being copied out. A sweep that finds both still busy is an
+ * overrun and is skipped.
+ *
+ * Finished sweeps wait in a ring until the packer in acq_process_action()
+ * has enough of them to fill one notification, compresses them with
+ * delta_pack.h and sends the frame. A frame also goes out when the sweep
+ * after it is missing, or when its oldest sweep has waited
+ * ACQ_FRAME_LATENCY_MS. Without TX buffers the frame is kept and retried
+ * while the ring absorbs new sweeps; once the ring is full, sweeps are
+ * dropped.
+ *
+ * Frame, little-endian:
+ *
+ *   offset  size  field
+ *   0       2     sequence number, +1 per frame sent
+ *   2       4     index of the first sweep since streaming started
+ *   6       1     sweeps in the frame
+ *   7       2     channel mask, channels in ascending order
+ *   9       n     delta_pack.h bitstream
+ *
+ * Missing sweep indices between frames are the overruns and drops.
+ *
+ * Every subscriber receives the same frames, each sized to fit the
+ * smallest ATT MTU among them. The first subscriber starts a stream, and
+ * so does the session controller when it subscribes: the sweep index,
+ * sequence number and stats start over. An observer subscribing to a
+ * running stream joins it with the next frame. The stream stops when the
+ * last subscriber leaves.
+ *
+ * Every sweep is also passed to the closed-loop detectors (detect.h) while
+ * any is armed; acq_set_closed_loop() keeps the sweep clock running for
+ * them without a subscriber, and frames are then not packed.
+ *
+ * Stats record, published on the acq_stats characteristic when the GATT
+ * database has one:
+ *
+ *   offset  size  field
+ *   0       1     ACQ_STATS_VERSION
+ *   1       1     ACQ_STATS_FLAG_* mask
+ *   2       2     ring high-water mark, sweeps
+ *   4       4     configured samples per second, all channels
+ *   8       4     sweeps acquired
+ *   12      4     frames sent
+ *   16      4     frames dropped by the stack
+ *   20      4     sweeps dropped: ring full, bus error, or frame too small
+ *   24      4     sweep clock overruns
+ *   28      4     sends retried for lack of TX buffers
+ *   32      2     compression ratio x 100, raw over packed
+ *   34      2     reserved
+ *   36      4     achieved samples per second, all channels
+ *
+ * Counters cover the current or last streaming session. The achieved rate
+ * is the sweeps acquired over the sleeptimer time since the session
+ * started, up to now or to its end.
+ ******************************************************************************/
+#ifndef ACQ_H
+#define ACQ_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sl_bluetooth.h"
+
+#define ACQ_FRAME_HEADER_SIZE   9
+#define ACQ_STATS_VERSION       2
+#define ACQ_STATS_SIZE          40
+
+#define ACQ_STATS_FLAG_STREAMING 0x01
+
+typedef struct {
+	bool streaming;
+	uint16_t ringHighWater;     ///< Most sweeps waiting at once.
+	uint32_t configuredSamplesPerSecond;
+	uint32_t samplesPerSecond;  ///< Achieved, from sweeps acquired.
+	uint32_t sweepsAcquired;
+	uint32_t framesSent;
+	uint32_t framesDropped;
+	uint32_t sweepsDropped;
+	uint32_t overruns;
+	uint32_t backpressure;
+	uint64_t rawBytes;          ///< Sample bytes sent, before packing.
+	uint64_t packedBytes;       ///< Bitstream bytes sent.
+} acq_stats_t;
+
+/**
+ * @brief Reset the counters. Call once, after power_init().
+ */
+void acq_init(void);
+
+/**
+ * @brief Pass every stack event; starts and stops streaming with the
+ *        subscription to acq_stream.
+ */
+void acq_on_event(const sl_bt_msg_t *evt);
+
+/**
+ * @brief Collect finished sweeps, pack and send frames, and refresh the
+ *        stats. Call from the superloop after rhs2116_process_action().
+ */
+void acq_process_action(void);
+
+/**
+ * @brief Keep sweeping for the detectors, with or without a subscriber.
+ *        Call from the acquisition task.
+ */
+void acq_set_closed_loop(bool on);
+
+/**
+ * @brief Counters of the current or last session.
+ */
+void acq_get_stats(acq_stats_t *stats);
+
+/**
+ * @brief Encode the stats record.
+ *
+ * @return ACQ_STATS_SIZE, or 0 if out is too small.
+ */
+size_t acq_encode_stats(uint8_t *out, size_t size);
+
+#endif // ACQ_H
@@ -0,0 +1,67 @@
+/***************************************************************************//**
+ * @file acq_timer.c
+ * @brief Sweep clock for RHS2116 acquisition (EFR32 series 2).
+ ******************************************************************************/
+#include <stddef.h>
+#include <stdint.h>
+
+#include "acq_timer.h"
+#include "config.h"
+#include "em_cmu.h"
+#include "em_timer.h"
+
+#define ACQ_TIMER_PRESCALE_MAX  1024
+
+static volatile acq_timer_callback_t onSweep;
+
+sl_status_t acq_timer_start(uint32_t hz, acq_timer_callback_t callback) {
+	if (hz == 0 || callback == NULL) {
+		return SL_STATUS_INVALID_PARAMETER;
+	}
+	acq_timer_stop();
+	CMU_ClockEnable(ACQ_TIMER_CLOCK, true);
+
+	// Smallest prescaler that brings one period within the counter.
+	uint32_t clock = CMU_ClockFreqGet(ACQ_TIMER_CLOCK);
+	uint64_t span = (uint64_t) TIMER_MaxCount(ACQ_TIMER) + 1u;
+	uint32_t prescale = (uint32_t) ((clock / hz + span - 1) / span);
+	if (prescale == 0) {
+		prescale = 1;
+	}
+	uint32_t top = (clock / prescale + hz / 2) / hz;
+	if (prescale > ACQ_TIMER_PRESCALE_MAX || top < 2) {
+		return SL_STATUS_INVALID_RANGE;
+	}
+
+	onSweep = callback;
+	TIMER_Init_TypeDef init = TIMER_INIT_DEFAULT;
+	init.enable = false;
+	init.prescale = (TIMER_Prescale_TypeDef) (prescale - 1);
+	TIMER_Init(ACQ_TIMER, &init);
+	TIMER_TopSet(ACQ_TIMER, top - 1);
+	TIMER_CounterSet(ACQ_TIMER, 0);
+	TIMER_IntClear(ACQ_TIMER, TIMER_IF_OF);
+	TIMER_IntEnable(ACQ_TIMER, TIMER_IF_OF);
+	NVIC_ClearPendingIRQ(ACQ_TIMER_IRQn);
+	NVIC_EnableIRQ(ACQ_TIMER_IRQn);
+	TIMER_Enable(ACQ_TIMER, true);
+	return SL_STATUS_OK;
+}
+
+void acq_timer_stop(void) {
+	TIMER_Enable(ACQ_TIMER, false);
+	TIMER_IntDisable(ACQ_TIMER, TIMER_IF_OF);
+	NVIC_DisableIRQ(ACQ_TIMER_IRQn);
+	NVIC_ClearPendingIRQ(ACQ_TIMER_IRQn);
+	onSweep = NULL;
+}
+
+void ACQ_TIMER_IRQHandler(void) {
+	uint32_t flags = TIMER_IntGetEnabled(ACQ_TIMER);
+	TIMER_IntClear(ACQ_TIMER, flags);
+
+	acq_timer_callback_t callback = onSweep;
+	if ((flags & TIMER_IF_OF) && callback != NULL) {
+		callback();
+	}
+}
@@ -0,0 +1,31 @@
+/***************************************************************************//**
+ * @file acq_timer.h
+ * @brief Sweep clock for RHS2116 acquisition.
+ *
+ * ACQ_TIMER overflows once per sweep and calls back from its interrupt.
+ * The timer stops in EM2; the caller holds EM1 while it runs.
+ ******************************************************************************/
+#ifndef ACQ_TIMER_H
+#define ACQ_TIMER_H
+
+#include <stdint.h>
+#include "sl_status.h"
+
+typedef void (*acq_timer_callback_t)(void);
+
+/**
+ * @brief Start calling back at a rate, replacing any running clock.
+ *
+ * @param[in] callback Runs in interrupt context.
+ * @return SL_STATUS_OK, SL_STATUS_INVALID_PARAMETER for a zero rate or
+ *         NULL callback, or SL_STATUS_INVALID_RANGE for a rate the timer
+ *         cannot divide down to.
+ */
+sl_status_t acq_timer_start(uint32_t hz, acq_timer_callback_t callback);
+
+/**
+ * @brief Stop the clock. No callback runs after this returns.
+ */
+void acq_timer_stop(void);
+
+#endif // ACQ_TIMER_H
@@ -0,0 +1,217 @@
+/***************************************************************************//**
+ * @file adv_policy.c
+ * @brief Staged advertising: fast after boot or a dropout, slow when idle.
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "adv_policy.h"
+#include "app_assert.h"
+#include "byteorder.h"
+#include "config.h"
+#include "dlog.h"
+#include "nvm3_default.h"
+#include "power.h"
+#include "sl_sleeptimer.h"
+
+static const adv_policy_t defaults = {
+	.stageCount = 3,
+	.stages = {
+		{ ADV_POLICY_FAST_INTERVAL, ADV_POLICY_FAST_MS },
+		{ ADV_POLICY_MEDIUM_INTERVAL, ADV_POLICY_MEDIUM_MS },
+		{ ADV_POLICY_SLOW_INTERVAL, 0 },
+	},
+};
+
+static adv_policy_t policy;
+static uint8_t advertisingSet = 0xff;
+static int stage = -1;
+static uint8_t connections;
+static sl_sleeptimer_timer_handle_t stageTimer;
+static volatile bool stageDone;
+
+static bool isValid(const adv_policy_t *p) {
+	if (p->stageCount == 0 || p->stageCount > ADV_POLICY_MAX_STAGES) {
+		return false;
+	}
+	for (uint8_t i = 0; i < p->stageCount; i++) {
+		if (p->stages[i].interval < ADV_POLICY_INTERVAL_MIN
+				|| p->stages[i].interval > ADV_POLICY_INTERVAL_MAX) {
+			return false;
+		}
+		// Only the last stage may last forever.
+		if (i + 1 < p->stageCount && p->stages[i].durationMs == 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void onStageTimer(sl_sleeptimer_timer_handle_t *handle, void *data) {
+	(void) handle;
+	(void) data;
+	stageDone = true;
+}
+
+// (Re)start the advertiser at stage s of the policy.
+static void enterStage(int s) {
+	const adv_policy_stage_t *st = &policy.stages[s];
+	sl_status_t sc;
+
+	sl_sleeptimer_stop_timer(&stageTimer);
+	stageDone = false;
+	if (stage >= 0) {
+		sl_bt_advertiser_stop(advertisingSet);
+	}
+	sc = sl_bt_advertiser_set_timing(advertisingSet, st->interval, st->interval,
+			0, 0);
+	app_assert_status(sc);
+	sc = sl_bt_legacy_advertiser_start(advertisingSet,
+			sl_bt_legacy_advertiser_connectable);
+	app_assert_status(sc);
+	stage = s;
+	power_advertising(st->interval);
+
+	if (s + 1 < policy.stageCount) {
+		sc = sl_sleeptimer_start_timer_ms(&stageTimer, st->durationMs,
+				onStageTimer, NULL, 0, 0);
+		if (sc != SL_STATUS_OK) {
+			DLOG(DLOG_ADV_TIMER_FAILED, sc);
+		}
+	}
+}
+
+void adv_policy_init(void) {
+	uint8_t record[ADV_POLICY_RECORD_MAX_SIZE];
+	uint32_t type;
+	size_t len;
+
+	policy = defaults;
+	stage = -1;
+	connections = 0;
+	stageDone = false;
+	if (nvm3_getObjectInfo(nvm3_defaultHandle, ADV_POLICY_NVM3_KEY, &type,
+			&len) == ECODE_NVM3_OK && type == NVM3_OBJECTTYPE_DATA
+			&& len <= sizeof(record)
+			&& nvm3_readData(nvm3_defaultHandle, ADV_POLICY_NVM3_KEY, record,
+					len) == ECODE_NVM3_OK) {
+		adv_policy_t stored;
+		if (adv_policy_decode(record, len, &stored) == SL_STATUS_OK
+				&& isValid(&stored)) {
+			policy = stored;
+		}
+	}
+}
+
+void adv_policy_on_event(const sl_bt_msg_t *evt) {
+	sl_status_t sc;
+
+	switch (SL_BT_MSG_ID(evt->header)) {
+	case sl_bt_evt_system_boot_id:
+		sc = sl_bt_advertiser_create_set(&advertisingSet);
+		app_assert_status(sc);
+		// The stack keeps the generated data with the set, so it is built
+		// once per boot rather than on every restart.
+		sc = sl_bt_legacy_advertiser_generate_data(advertisingSet,
+				sl_bt_advertiser_general_discoverable);
+		app_assert_status(sc);
+		stage = -1;
+		enterStage(0);
+		break;
+
+	case sl_bt_evt_connection_opened_id:
+		// Connectable legacy advertising stops when a central connects.
+		// Below the connection limit it resumes at the last stage, so an
+		// observer can still find the device without taxing the link.
+		connections++;
+		sl_sleeptimer_stop_timer(&stageTimer);
+		stageDone = false;
+		stage = -1;
+		if (connections < SESSION_MAX_CONNECTIONS) {
+			enterStage(policy.stageCount - 1);
+		} else {
+			power_advertising(0);
+		}
+		break;
+
+	case sl_bt_evt_connection_closed_id:
+		if (connections) {
+			connections--;
+		}
+		// Fast again once the last central has gone: it is most likely
+		// trying to reconnect. Others still connected keep the last stage.
+		enterStage(connections ? policy.stageCount - 1 : 0);
+		break;
+
+	default:
+		break;
+	}
+}
+
+void adv_policy_process_action(void) {
+	if (stageDone && stage >= 0 && stage + 1 < policy.stageCount) {
+		DLOG(DLOG_ADV_STAGE, (uint32_t) stage + 1);
+		enterStage(stage + 1);
+	}
+}
+
+sl_status_t adv_policy_set(const adv_policy_t *p) {
+	uint8_t record[ADV_POLICY_RECORD_MAX_SIZE];
+
+	if (!isValid(p)) {
+		return SL_STATUS_INVALID_PARAMETER;
+	}
+	size_t len = adv_policy_encode(p, record, sizeof(record));
+	if (nvm3_writeData(nvm3_defaultHandle, ADV_POLICY_NVM3_KEY, record, len)
+			!= ECODE_NVM3_OK) {
+		return SL_STATUS_FAIL;
+	}
+	policy = *p;
+	if (stage >= 0) {
+		enterStage(connections ? policy.stageCount - 1 : 0);
+	}
+	return SL_STATUS_OK;
+}
+
+const adv_policy_t* adv_policy_get(void) {
+	return &policy;
+}
+
+int adv_policy_stage(void) {
+	return stage;
+}
+
+sl_status_t adv_policy_decode(const uint8_t *data, size_t len,
+		adv_policy_t *p) {
+	if (len < 1) {
+		return SL_STATUS_INVALID_PARAMETER;
+	}
+	uint8_t count = data[0];
+	if (count == 0 || count > ADV_POLICY_MAX_STAGES
+			|| len != 1u + count * ADV_POLICY_STAGE_SIZE) {
+		return SL_STATUS_INVALID_PARAMETER;
+	}
+	p->stageCount = count;
+	const uint8_t *q = data + 1;
+	for (uint8_t i = 0; i < count; i++, q += ADV_POLICY_STAGE_SIZE) {
+		p->stages[i].interval = get_le16(q);
+		p->stages[i].durationMs = get_le32(q + 2);
+	}
+	return SL_STATUS_OK;
+}
+
+size_t adv_policy_encode(const adv_policy_t *p, uint8_t *out, size_t size) {
+	size_t len = 1u + p->stageCount * ADV_POLICY_STAGE_SIZE;
+
+	if (p->stageCount > ADV_POLICY_MAX_STAGES || size < len) {
+		return 0;
+	}
+	out[0] = p->stageCount;
+	uint8_t *q = out + 1;
+	for (uint8_t i = 0; i < p->stageCount; i++, q += ADV_POLICY_STAGE_SIZE) {
+		put_le16(q, p->stages[i].interval);
+		put_le32(q + 2, p->stages[i].durationMs);
+	}
+	return len;
+}
@@ -0,0 +1,101 @@
+/***************************************************************************//**
+ * @file adv_policy.h
+ * @brief Staged advertising: fast after boot or a dropout, slow when idle.
+ *
+ * Advertising runs through a list of stages, each an interval and how long
+ * to stay at it. The first stage starts on boot and after every disconnect,
+ * so a central that lost the link finds the device quickly; later stages
+ * back off to save power while nobody is looking for it. The last stage
+ * lasts until the next connection. While fewer than SESSION_MAX_CONNECTIONS
+ * centrals are connected, advertising goes on at the last stage so more
+ * centrals can join (see session.h).
+ *
+ * The stage list can be replaced over nodeRx with CMD_OP_ADV_POLICY and is
+ * kept in NVM3. Wire and storage record:
+ *
+ *   offset  size  field
+ *   0       1     stage count, 1 .. ADV_POLICY_MAX_STAGES
+ *   1       6n    stages: interval (0.625 ms units, uint16),
+ *                 duration (ms, uint32; ignored for the last stage)
+ ******************************************************************************/
+#ifndef ADV_POLICY_H
+#define ADV_POLICY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sl_bluetooth.h"
+#include "sl_status.h"
+
+#define ADV_POLICY_MAX_STAGES     4
+#define ADV_POLICY_STAGE_SIZE     6
+#define ADV_POLICY_RECORD_MAX_SIZE \
+	(1 + ADV_POLICY_MAX_STAGES * ADV_POLICY_STAGE_SIZE)
+#define ADV_POLICY_INTERVAL_MIN   0x20    // 20 ms, legacy advertising floor
+#define ADV_POLICY_INTERVAL_MAX   0x4000  // 10.24 s
+
+typedef struct {
+	uint16_t interval;      ///< 0.625 ms units.
+	uint32_t durationMs;    ///< Time at this interval before the next stage.
+} adv_policy_stage_t;
+
+typedef struct {
+	uint8_t stageCount;
+	adv_policy_stage_t stages[ADV_POLICY_MAX_STAGES];
+} adv_policy_t;
+
+/**
+ * @brief Load the stored policy, or the defaults from config.h.
+ */
+void adv_policy_init(void);
+
+/**
+ * @brief Pass every stack event. Creates the advertising set on boot and
+ *        restarts at the first stage on boot and disconnect, and at the
+ *        last stage on a connection that leaves room for another.
+ */
+void adv_policy_on_event(const sl_bt_msg_t *evt);
+
+/**
+ * @brief Move to the next stage when the current one has run out. Call
+ *        from the superloop.
+ */
+void adv_policy_process_action(void);
+
+/**
+ * @brief Validate, store and apply a policy. An advertiser that is running
+ *        restarts at the first stage of the new policy, or at its last
+ *        while a central is connected.
+ *
+ * @return SL_STATUS_OK, SL_STATUS_INVALID_PARAMETER for an empty list or
+ *         an interval out of range, or the NVM3 error.
+ */
+sl_status_t adv_policy_set(const adv_policy_t *policy);
+
+/**
+ * @brief Policy in effect.
+ */
+const adv_policy_t* adv_policy_get(void);
+
+/**
+ * @brief Index of the stage advertising now, or -1 if not advertising.
+ */
+int adv_policy_stage(void);
+
+/**
+ * @brief Decode a record.
+ *
+ * @return SL_STATUS_OK, or SL_STATUS_INVALID_PARAMETER if the length does
+ *         not match the stage count or the count is out of range.
+ */
+sl_status_t adv_policy_decode(const uint8_t *data, size_t len,
+		adv_policy_t *policy);
+
+/**
+ * @brief Encode a record.
+ *
+ * @return Record length, or 0 if out is too small.
+ */
+size_t adv_policy_encode(const adv_policy_t *policy, uint8_t *out,
+		size_t size);
+
+#endif // ADV_POLICY_H
@@ -6,61 +6,182 @@
 // Standard library includes
 #include <stdbool.h>
 #include <stdint.h>
-#include <stdlib.h>
-#include <stdio.h>
 #include <string.h>
 
 // Silicon Labs specific includes
 #include "em_common.h"
 #include "sl_bluetooth.h"
 #include "sl_simple_led_instances.h"
-#include "sl_spidrv_instances.h"
 
 // Application specific includes
+#include "acq.h"
+#include "adv_policy.h"
 #include "app.h"
 #include "app_assert.h"
-#include "app_log.h"
 //#include "blink.h"
+#include "boot.h"
+#include "cmd_proto.h"
 #include "config.h"
+#include "conn_tuning.h"
+#include "detect.h"
+#include "dlog.h"
 #include "gatt_db.h"
-//#include "rhs2116.h"
+#include "notify.h"
+#include "ota_delta.h"
+#include "power.h"
+#include "prof.h"
+#include "protocol.h"
+#include "rhs2116.h"
+#include "sequencer.h"
+#include "session.h"
+#include "settings_store.h"
+#include "stim.h"
+#include "stim_schedule.h"
+#include "tasks.h"
+#include "telemetry.h"
+#include "trace.h"
 
 // BLE
-#define COMMAND_STR_MAX_SIZE 20 // should match nodeTx characteristic size
-static uint8_t advertising_set_handle = 0xff;
+#define COMMAND_STR_MAX_SIZE 20 // legacy ASCII reply, fits nodeTx
+
+_Static_assert(NODE_RX_MAX_SIZE >= CMD_FRAME_MAX_SIZE,
+		"nodeRx must hold the largest binary command frame");
+_Static_assert(NODE_RX_MAX_SIZE >= CONN_TUNING_MAX_MTU - 3,
+		"nodeRx must take a batch filling one MTU-sized write");
+_Static_assert(NOTIFY_MAX_VALUE_SIZE >= NODE_TX_MAX_SIZE,
+		"notify.c must hold a nodeTx value");
+_Static_assert(NODE_TX_MAX_SIZE >= CMD_STATE_FRAME_SIZE
+		&& NODE_TX_MAX_SIZE >= COMMAND_STR_MAX_SIZE,
+		"nodeTx must hold either reply encoding");
 
 // App
-static uint8_t activateOnDisconnect = 0;
-static int amplitude = 0;
-static int frequency = 0;
-static int pulseWidth = 0;
+static cmd_settings_t settings;
+// Compiled from settings; double buffered because DMA reads the active one.
+// Written and read on the stimulation task only, see compileOnStim().
+static stim_schedule_t schedules[2];
+static uint8_t activeSchedule;
+static bool scheduleValid;
+// Pulses of the running train if a detector started it, 0 if it runs until
+// stopped.
+static uint32_t trainPulses;
+// Settings restored and the boot protocol started; see bringUp().
+static bool broughtUp;
 
 // Functions
-void
-handleNodeRxChange(uint8_t *data, size_t len);
-void
-compileCommandString(char *commandStr);
+static void
+updateNodeTx(const cmd_t *cmd, cmd_status_t status);
+static void
+replyNodeTx(uint8_t connection, const cmd_t *cmd, cmd_status_t status);
+static sl_status_t
+startStimulation(void);
+static void
+toPattern(const cmd_settings_t *candidate, stim_pattern_t *pattern);
+static cmd_status_t
+checkSettings(const cmd_settings_t *candidate);
+static cmd_status_t
+compileSchedule(const cmd_settings_t *candidate);
+static bool
+readLongWrite(size_t end, const uint8_t **data, size_t *len);
+static cmd_status_t
+handleCommandFrom(uint8_t connection, const uint8_t *data, size_t len,
+		cmd_t *cmd);
+static cmd_status_t
+applyCommand(const cmd_t *cmd);
+static cmd_status_t
+handleProtocolCommand(const cmd_t *cmd);
+static void
+autorun(uint8_t trigger);
+static sl_status_t
+stopAll(void *arg);
+static sl_status_t
+controllerLost(void *arg);
+static sl_status_t
+compileOnStim(void *candidate);
+static sl_status_t
+retimeRunning(void *arg);
+static sl_status_t
+stopProtocol(void *slot);
+static sl_status_t
+runProtocol(void *slot);
+static sl_status_t
+forwardToAcq(void *evt);
+static sl_status_t
+setDetector(void *config);
+static sl_status_t
+fireDetection(uint32_t pulses);
+static void
+restoreSettings(void);
+static sl_status_t
+restoreAndAutorun(void *arg);
+static void
+bringUp(void);
 
 /**************************************************************************//**
  * Application Init.
  *****************************************************************************/
 SL_WEAK void app_init(void) {
 //	blink_init();
-	sl_led_turn_on(LED_INSTANCE);
-//	rhs2116_init(sl_spidrv_spi_inst_handle);
-//	uint32_t chipId = rhs2116_readRegister(RHS_CHIP_ID);
-//	while (chipId != 32) {
-//		chipId = rhs2116_readRegister(RHS_CHIP_ID);
-//	}
-	sl_led_turn_off(LED_INSTANCE);
+	prof_init();
+	dlog_init();
+	trace_init();
+	boot_init();
+	conn_tuning_init();
+	power_init();
+	adv_policy_init();
+	cmd_settings_init(&settings);
+	notify_init();
+	notify_register(gattdb_node_tx);
+	session_init();
+	telemetry_init();
+	stim_init();
+	acq_init();
+	detect_init(fireDetection);
+	ota_delta_init();
+	tasks_init();
+	broughtUp = false;
+	// Settings, the boot protocol and the RHS2116 follow; see boot.h.
+	boot_start();
 }
 
 /**************************************************************************//**
  * Application Process Action.
  *****************************************************************************/
 SL_WEAK void app_process_action(void) {
+	PROF_BEGIN(start);
 //	blink_process_action();
+	// Acquisition first, so a trigger it finds fires in this pass.
+	app_acq_process_action();
+	app_stim_process_action();
+	app_control_process_action();
 	// other application processes
+	PROF_END(PROF_APP_PROCESS, start);
+}
+
+void app_stim_process_action(void) {
+	stim_process_action();
+	sequencer_process_action();
+	detect_process_action();
+}
+
+void app_acq_process_action(void) {
+	rhs2116_process_action();
+	PROF_BEGIN(acqStart);
+	acq_process_action();
+	PROF_END(PROF_ACQ_PROCESS, acqStart);
+}
+
+void app_control_process_action(void) {
+	bringUp();
+	boot_process_action();
+	power_process_action();
+	telemetry_process_action();
+	settings_store_process_action();
+	adv_policy_process_action();
+	ota_delta_process_action();
+	notify_process_action();
+	dlog_process_action();
+	trace_process_action();
+	prof_process_action();
 }
 
 /**************************************************************************//**
@@ -70,100 +191,134 @@ SL_WEAK void app_process_action(void) {
  * @param[in] evt Event coming from the Bluetooth stack.
  *****************************************************************************/
 void sl_bt_on_event(sl_bt_msg_t *evt) {
-	sl_status_t sc;
+	// Write-to-apply latency starts here, before any handler or queue.
+	conn_tuning_write_received(evt);
+	// In the kernel build the control task handles a copy; see tasks.h.
+	if (!tasks_post_event(evt)) {
+		app_on_event(evt);
+	}
+}
+
+void app_on_event(sl_bt_msg_t *evt) {
+	PROF_BEGIN(start);
+	// Records the event as received, for host/trace_replay
+	trace_record(evt);
+
+	// PHY, data length, MTU and interval negotiation
+	conn_tuning_on_event(evt);
+	// Subscriptions, confirmations and closed connections for notify.c
+	notify_on_event(evt);
+	// Connection residency for the power report
+	power_on_event(evt);
+	// Stimulation delivered and link, for the telemetry characteristic
+	telemetry_on_event(evt);
+	// Advertising starts with the restored settings in place.
+	if (SL_BT_MSG_ID(evt->header) == sl_bt_evt_system_boot_id) {
+		bringUp();
+	}
+	// Creates, starts and restarts advertising; see adv_policy.h
+	adv_policy_on_event(evt);
+	// Boot phase timing, and the device information after advertising
+	boot_on_event(evt);
+	// Streams acquisition while acq_stream is subscribed
+	tasks_call(TASKS_ACQ, forwardToAcq, evt);
+	// Drains the log to a subscriber of the dlog characteristic
+	dlog_on_event(evt);
+	// Reports the profile to a subscriber of the profile characteristic
+	prof_on_event(evt);
+	// Rebuilds an update from a patch written to ota_delta
+	ota_delta_on_event(evt);
+	// Sends the trace to a subscriber of the trace characteristic
+	trace_on_event(evt);
 
 	switch (SL_BT_MSG_ID(evt->header)) {
 	// -------------------------------
 	// This event indicates the device has started and the radio is ready.
 	// Do not call any stack command before receiving this boot event!
 	case sl_bt_evt_system_boot_id:
-		// Create an advertising set.
-		sc = sl_bt_advertiser_create_set(&advertising_set_handle);
-		app_assert_status(sc);
-
-		// Generate data for advertising
-		sc = sl_bt_legacy_advertiser_generate_data(advertising_set_handle,
-				sl_bt_advertiser_general_discoverable);
-		app_assert_status(sc);
-
-		// Set advertising interval to 100ms.
-		sc = sl_bt_advertiser_set_timing(advertising_set_handle, 160, // min. adv. interval (milliseconds * 1.6)
-				160, // max. adv. interval (milliseconds * 1.6)
-				0,   // adv. duration
-				0);  // max. num. adv. events
-		app_assert_status(sc);
-
-		// Start advertising and enable connections.
-		sc = sl_bt_legacy_advertiser_start(advertising_set_handle,
-				sl_bt_legacy_advertiser_connectable);
-		app_assert_status(sc);
+		// Advertising is started by adv_policy_on_event().
 		break;
 
 		// -------------------------------
 		// This event indicates that a new connection was opened.
 	case sl_bt_evt_connection_opened_id:
-		app_log_info("Connection opened.\n");
+		DLOG(DLOG_CONN_OPENED);
 
-		activateOnDisconnect = 0; // reset
-//		stop_blinking();
+		// A central taking control starts from a known state; an observer
+		// joining leaves the controller's stimulation alone.
+		if (session_open(evt->data.evt_connection_opened.connection)
+				!= SESSION_ROLE_CONTROLLER) {
+			break;
+		}
+		settings.activateOnDisconnect = 0; // reset
+		settings_store_save(&settings);
+		tasks_call(TASKS_STIM, stopAll, NULL);
 		sl_led_turn_off(LED_INSTANCE); // known state
 		break;
 
 		// -------------------------------
 		// This event indicates that a connection was closed.
 	case sl_bt_evt_connection_closed_id:
-		app_log_info("Connection closed.\n");
+		DLOG(DLOG_CONN_CLOSED, evt->data.evt_connection_closed.reason);
 
-		sl_led_turn_off(LED_INSTANCE); // known state
-		if (activateOnDisconnect) {
-//			start_blinking();
+		// Only losing the controller arms the disconnect triggers.
+		if (session_close(evt->data.evt_connection_closed.connection)
+				!= SESSION_ROLE_CONTROLLER) {
+			break;
 		}
-
-		// Generate data for advertising
-		sc = sl_bt_legacy_advertiser_generate_data(advertising_set_handle,
-				sl_bt_advertiser_general_discoverable);
-		app_assert_status(sc);
-
-		// Restart advertising after client has disconnected.
-		sc = sl_bt_legacy_advertiser_start(advertising_set_handle,
-				sl_bt_legacy_advertiser_connectable);
-		app_assert_status(sc);
+		sl_led_turn_off(LED_INSTANCE); // known state
+		// What the central left is what a reset should come back to.
+		settings_store_flush();
+		tasks_call(TASKS_STIM, controllerLost, NULL);
+		// adv_policy_on_event() restarts advertising at the fast stage.
 		break;
 
 		// -------------------------------
 		// This event indicates that the value of an attribute in the local GATT
 		// database was changed by a remote GATT client.
 	case sl_bt_evt_gatt_server_attribute_value_id:
-		// The value of the gattdb_led_control characteristic was changed.
-
 		// Check if the attribute written is gattdb_node_rx
 		if (evt->data.evt_gatt_server_attribute_value.attribute
 				== gattdb_node_rx) {
-			// Read the updated value
-			uint8_t buffer[20]; // Adjust the size as needed
-			size_t len = 0;
-			sc = sl_bt_gatt_server_read_attribute_value(
-			gattdb_node_rx, 0, sizeof(buffer), &len, buffer);
-
-			if (sc == SL_STATUS_OK) {
-				// Trigger your function here and pass the buffer and len as parameters
-				handleNodeRxChange(buffer, len);
-
-				// get command string and set nodeTxx
-				char commandStr[COMMAND_STR_MAX_SIZE];
-				compileCommandString(commandStr);
-				// Write attribute in the local GATT database.
-				sc = sl_bt_gatt_server_write_attribute_value(
-				gattdb_node_tx, 0, sizeof(commandStr), (uint8_t*) commandStr);
+			// The event carries the written value; decode it in place.
+			const uint8_t *data =
+					evt->data.evt_gatt_server_attribute_value.value.data;
+			size_t len = evt->data.evt_gatt_server_attribute_value.value.len;
+			cmd_t cmd;
+
+			// A long write is reported one fragment per event once it has
+			// been executed; decode the whole value after the last one.
+			if (evt->data.evt_gatt_server_attribute_value.att_opcode
+					== sl_bt_gatt_execute_write_request
+					|| evt->data.evt_gatt_server_attribute_value.offset) {
+				if (!readLongWrite(
+						evt->data.evt_gatt_server_attribute_value.offset + len,
+						&data, &len)) {
+					conn_tuning_write_applied(false);
+					break;
+				}
+			}
+			uint8_t connection =
+					evt->data.evt_gatt_server_attribute_value.connection;
+			PROF_BEGIN(rxStart);
+			cmd_status_t status = handleCommandFrom(connection, data, len, &cmd);
+			PROF_END(PROF_NODE_RX, rxStart);
+			conn_tuning_write_applied(true);
+
+			// Reply on nodeTx in the encoding of the request; what the
+			// controller does is seen by every subscriber, an observer's
+			// reply only by the observer.
+			if (session_role(connection) == SESSION_ROLE_CONTROLLER) {
+				updateNodeTx(&cmd, status);
 			} else {
-				// Handle error
+				replyNodeTx(connection, &cmd, status);
 			}
 		}
 		break;
 
 		// -------------------------------
 		// This event occurs when the remote device enabled or disabled the
-		// notification.
+		// notification. Tracked by notify_on_event().
 	case sl_bt_evt_gatt_server_characteristic_status_id:
 		break;
 
@@ -176,59 +331,416 @@ void sl_bt_on_event(sl_bt_msg_t *evt) {
 	default:
 		break;
 	}
+	PROF_END(PROF_BT_EVENT, start);
+	PROF_END_EVENT(SL_BT_MSG_ID(evt->header), start);
 }
 
 void compileCommandString(char *commandStr) {
 	if (commandStr != NULL) {
 		// Initialize the entire buffer with null characters
 		memset(commandStr, 0, COMMAND_STR_MAX_SIZE);
-		// Format the string with the global variable values
-		sprintf(commandStr, "_A%u,F%u,P%u,G%u", amplitude, frequency,
-				pulseWidth, activateOnDisconnect);
+		cmd_format_ascii(&settings, commandStr, COMMAND_STR_MAX_SIZE);
 	}
 }
 
-void handleNodeRxChange(uint8_t *data, size_t len) {
-	if (len == 0 || data[0] != '_') {
-		return; // No valid data or does not start with '_'
+cmd_status_t handleNodeRxChange(const uint8_t *data, size_t len, cmd_t *cmd) {
+	cmd_status_t status = cmd_decode(data, len, cmd);
+	if (status != CMD_OK) {
+		return status;
 	}
+	return applyCommand(cmd);
+}
 
-	// Convert data to null-terminated string
-	char str[len + 1]; // +1 for null terminator
-	memset(str, 0, len + 1); // Initialize buffer to zero
-	memcpy(str, data, len);
-	str[len] = '\0';
+// Decode a command and apply it if the connection's role allows.
+static cmd_status_t handleCommandFrom(uint8_t connection, const uint8_t *data,
+		size_t len, cmd_t *cmd) {
+	cmd_status_t status = cmd_decode(data, len, cmd);
+	if (status != CMD_OK) {
+		return status;
+	}
+	if (cmd->opcode == CMD_OP_SESSION) {
+		sl_status_t sc = session_request(connection, cmd->body[0]);
+		if (sc == SL_STATUS_PERMISSION) {
+			return CMD_ERR_PERMISSION;
+		}
+		return sc == SL_STATUS_OK ? CMD_OK : CMD_ERR_RANGE;
+	}
+	// Observers may only read the state.
+	bool allowed = session_role(connection) == SESSION_ROLE_CONTROLLER
+			|| (cmd->format == CMD_FORMAT_BINARY && cmd->opcode == CMD_OP_GET);
+	session_count_command(connection, !allowed);
+	if (!allowed) {
+		DLOG(DLOG_SESSION_DENIED, cmd->opcode, connection);
+		return CMD_ERR_PERMISSION;
+	}
+	return applyCommand(cmd);
+}
 
-	// Tokenize the string
-	char *token = strtok(str + 1, ","); // Start from str + 1 to skip '_'
-	while (token != NULL) {
-		char settingType = token[0];
-		int value = atoi(token + 1); // Convert string to integer
+static cmd_status_t applyCommand(const cmd_t *cmd) {
+	cmd_status_t status = CMD_OK;
 
-		switch (settingType) {
-		case 'A':
-			amplitude = value;
-			break;
-		case 'F':
-			frequency = value;
-			break;
-		case 'P':
-			pulseWidth = value;
-			break;
-		case 'L':
-			if (value) {
-				sl_led_toggle(LED_INSTANCE);
-			}
-			break;
-		case 'G':
-			activateOnDisconnect = value;
-			break;
-		default:
-			// Handle unknown setting
-			break;
+	if (cmd->opcode == CMD_OP_SESSION) {
+		return CMD_ERR_OPCODE; // needs a connection; see handleCommandFrom()
+	}
+	if (cmd->opcode == CMD_OP_PROTOCOL_WRITE
+			|| cmd->opcode == CMD_OP_PROTOCOL_RUN) {
+		return handleProtocolCommand(cmd);
+	}
+	if (cmd->opcode == CMD_OP_ADV_POLICY) {
+		adv_policy_t policy;
+		if (adv_policy_decode(cmd->body, cmd->bodyLen, &policy)
+				!= SL_STATUS_OK) {
+			return CMD_ERR_FORMAT;
+		}
+		sl_status_t sc = adv_policy_set(&policy);
+		if (sc == SL_STATUS_INVALID_PARAMETER) {
+			return CMD_ERR_RANGE;
+		}
+		return sc == SL_STATUS_OK ? CMD_OK : CMD_ERR_STORAGE;
+	}
+	if (cmd->opcode == CMD_OP_DETECT) {
+		detect_config_t config;
+		if (detect_decode(cmd->body, cmd->bodyLen, &config) != SL_STATUS_OK) {
+			return CMD_ERR_FORMAT;
+		}
+		return tasks_call(TASKS_ACQ, setDetector, &config) == SL_STATUS_OK ?
+				CMD_OK : CMD_ERR_RANGE;
+	}
+
+	// Validate and compile on a copy so a rejected command changes nothing.
+	// A batch is applied entry by entry in order, then judged as a whole.
+	cmd_settings_t candidate = settings;
+	bool toggleLed = false;
+	size_t pos = 0;
+	cmd_t sub;
+	while (cmd_next(cmd, &pos, &sub)) {
+		toggleLed ^= cmd_apply(&sub, &candidate);
+	}
+	status = checkSettings(&candidate);
+	if (status != CMD_OK) {
+		return status;
+	}
+	bool retime = (cmd->opcode == CMD_OP_SET || cmd->opcode == CMD_OP_BATCH)
+			&& (cmd->mask & CMD_FIELD_TIMING);
+	if (retime && tasks_call(TASKS_STIM, compileOnStim, &candidate)
+			!= SL_STATUS_OK) {
+		return CMD_ERR_RANGE;
+	}
+	settings = candidate;
+	settings_store_save(&settings);
+	if (toggleLed) {
+		sl_led_toggle(LED_INSTANCE);
+	}
+	if (retime) {
+		tasks_call(TASKS_STIM, retimeRunning, NULL);
+	}
+	return status;
+}
+
+// The functions taking void * run on the stimulation task, which owns the
+// engine and the sequencer; see tasks.h.
+
+static sl_status_t stopAll(void *arg) {
+	(void) arg;
+	sequencer_stop();
+	stim_stop();
+	return SL_STATUS_OK;
+}
+
+static sl_status_t controllerLost(void *arg) {
+	(void) arg;
+	// A stored protocol armed for disconnect takes precedence over G.
+	autorun(PROTOCOL_TRIGGER_DISCONNECT);
+	if (!sequencer_is_running() && settings.activateOnDisconnect) {
+		sl_status_t sc = startStimulation();
+		if (sc != SL_STATUS_OK) {
+			DLOG(DLOG_STIM_NOT_STARTED, sc);
+		}
+	}
+	return SL_STATUS_OK;
+}
+
+// The schedules, activeSchedule and scheduleValid belong to this task:
+// fireDetection() and retimeRunning() read them here too.
+static sl_status_t compileOnStim(void *candidate) {
+	return compileSchedule(candidate) == CMD_OK ?
+			SL_STATUS_OK : SL_STATUS_INVALID_RANGE;
+}
+
+// A running train picks up the new schedule immediately; a running
+// protocol gives way to the live settings.
+static sl_status_t retimeRunning(void *arg) {
+	(void) arg;
+	if (sequencer_is_running()) {
+		sequencer_stop();
+	} else if (stim_is_running()) {
+		// A train started by a detector keeps the pulses it has left.
+		uint32_t done = stim_pulses_delivered();
+		sl_status_t sc = SL_STATUS_INVALID_STATE;
+		if (trainPulses == 0) {
+			sc = startStimulation();
+		} else if (scheduleValid && done < trainPulses) {
+			sc = stim_start(&schedules[activeSchedule], trainPulses - done);
+			trainPulses -= done;
+		}
+		if (sc != SL_STATUS_OK) {
+			stim_stop();
+		}
+	}
+	return SL_STATUS_OK;
+}
+
+// Stops the protocol if it runs from *slot, or any with PROTOCOL_NO_SLOT.
+static sl_status_t stopProtocol(void *slot) {
+	uint8_t runningSlot, epoch;
+	uint8_t s = *(const uint8_t*) slot;
+
+	if (s == PROTOCOL_NO_SLOT
+			|| (sequencer_position(&runningSlot, &epoch) && runningSlot == s)) {
+		sequencer_stop();
+	}
+	return SL_STATUS_OK;
+}
+
+static sl_status_t runProtocol(void *slot) {
+	stim_stop();
+	return sequencer_start(*(const uint8_t*) slot);
+}
+
+static sl_status_t forwardToAcq(void *evt) {
+	acq_on_event(evt);
+	return SL_STATUS_OK;
+}
+
+// On the acquisition task, which owns the detectors and the sweep clock.
+static sl_status_t setDetector(void *config) {
+	sl_status_t sc = detect_set(config);
+	acq_set_closed_loop(detect_armed());
+	return sc;
+}
+
+// A detector triggered; on the stimulation task. Live settings, a train
+// already running, and a protocol take precedence.
+static sl_status_t fireDetection(uint32_t pulses) {
+	if (sequencer_is_running() || stim_is_running()) {
+		return SL_STATUS_BUSY;
+	}
+	if (!scheduleValid) {
+		return SL_STATUS_INVALID_STATE;
+	}
+	sl_status_t sc = stim_start(&schedules[activeSchedule], pulses);
+	if (sc == SL_STATUS_OK) {
+		trainPulses = pulses;
+	}
+	return sc;
+}
+
+// Restore the settings of the last session, kept only if they compile.
+static void restoreSettings(void) {
+	cmd_settings_t candidate = settings;
+
+	settings_store_init();
+	sl_status_t sc = settings_store_load(&candidate);
+	if (sc == SL_STATUS_NOT_FOUND) {
+		return;
+	}
+	if (sc != SL_STATUS_OK || checkSettings(&candidate) != CMD_OK
+			|| compileSchedule(&candidate) != CMD_OK) {
+		DLOG(DLOG_SETTINGS_NOT_RESTORED, sc);
+		return;
+	}
+	settings = candidate;
+	DLOG(DLOG_SETTINGS_RESTORED, settings.amplitude, settings.frequency,
+			settings.pulseWidth);
+}
+
+static sl_status_t restoreAndAutorun(void *arg) {
+	(void) arg;
+	restoreSettings();
+	autorun(PROTOCOL_TRIGGER_BOOT);
+	return SL_STATUS_OK;
+}
+
+// Out of app_init() so the NVM3 reads overlap the stack starting up.
+static void bringUp(void) {
+	if (broughtUp) {
+		return;
+	}
+	broughtUp = true;
+	tasks_call(TASKS_STIM, restoreAndAutorun, NULL);
+	boot_mark(BOOT_PHASE_SETTINGS);
+}
+
+static void toPattern(const cmd_settings_t *candidate,
+		stim_pattern_t *pattern) {
+	pattern->amplitude = candidate->amplitude;
+	pattern->frequency = candidate->frequency;
+	pattern->pulseWidth = candidate->pulseWidth;
+	pattern->phases = candidate->phases;
+	pattern->interphaseGap = candidate->interphaseGap;
+	pattern->burstCount = candidate->burstCount;
+	pattern->burstRest = candidate->burstRest;
+}
+
+// Every field within the limits of stim_schedule.h, also while F0 or P0
+// leaves stimulation unconfigured and nothing is compiled.
+static cmd_status_t checkSettings(const cmd_settings_t *candidate) {
+	stim_pattern_t pattern;
+
+	toPattern(candidate, &pattern);
+	return stim_schedule_check(&pattern) == SL_STATUS_OK ?
+			CMD_OK : CMD_ERR_RANGE;
+}
+
+static cmd_status_t compileSchedule(const cmd_settings_t *candidate) {
+	// F0 or P0 leaves stimulation unconfigured, which is not an error.
+	if (candidate->frequency == 0 || candidate->pulseWidth == 0) {
+		scheduleValid = false;
+		return CMD_OK;
+	}
+	stim_pattern_t pattern;
+	toPattern(candidate, &pattern);
+	uint8_t next = activeSchedule ^ 1;
+	sl_status_t sc = stim_schedule_compile(&pattern, stim_clock_hz(),
+			stim_counter_max(), &schedules[next]);
+	if (sc != SL_STATUS_OK) {
+		return CMD_ERR_RANGE;
+	}
+	activeSchedule = next;
+	scheduleValid = true;
+	return CMD_OK;
+}
+
+static sl_status_t startStimulation(void) {
+	if (!scheduleValid) {
+		return SL_STATUS_INVALID_STATE;
+	}
+	trainPulses = 0;
+	return stim_start(&schedules[activeSchedule], 0); // until the next connection
+}
+
+static cmd_status_t handleProtocolCommand(const cmd_t *cmd) {
+	uint8_t slot = cmd->body[0];
+	protocol_t protocol;
+	sl_status_t sc;
+
+	if (cmd->opcode == CMD_OP_PROTOCOL_WRITE) {
+		if (slot >= PROTOCOL_SLOTS
+				|| protocol_decode(cmd->body + 1, cmd->bodyLen - 1u, &protocol)
+						!= SL_STATUS_OK) {
+			return CMD_ERR_FORMAT;
+		}
+		if (sequencer_validate(&protocol) != SL_STATUS_OK) {
+			return CMD_ERR_RANGE;
 		}
+		// Replacing the running protocol stops it.
+		tasks_call(TASKS_STIM, stopProtocol, &slot);
+		if (protocol_store_save(slot, &protocol) != SL_STATUS_OK) {
+			return CMD_ERR_STORAGE;
+		}
+		DLOG(DLOG_PROTOCOL_STORED, slot, protocol.epochCount);
+		return CMD_OK;
+	}
 
-		token = strtok(NULL, ","); // Get next token
+	// CMD_OP_PROTOCOL_RUN; slot PROTOCOL_NO_SLOT stops and disarms.
+	uint8_t triggers = cmd->body[1];
+	protocol_autorun_t armed = { PROTOCOL_NO_SLOT, 0 };
+	if (slot == PROTOCOL_NO_SLOT) {
+		tasks_call(TASKS_STIM, stopProtocol, &slot);
+		return protocol_store_set_autorun(&armed) == SL_STATUS_OK ?
+				CMD_OK : CMD_ERR_STORAGE;
+	}
+	if (slot >= PROTOCOL_SLOTS) {
+		return CMD_ERR_FORMAT;
+	}
+	sc = protocol_store_load(slot, &protocol);
+	if (sc == SL_STATUS_NOT_FOUND) {
+		return CMD_ERR_NOT_FOUND;
+	} else if (sc != SL_STATUS_OK) {
+		return CMD_ERR_STORAGE;
+	}
+	armed.triggers = triggers
+			& (PROTOCOL_TRIGGER_BOOT | PROTOCOL_TRIGGER_DISCONNECT);
+	if (armed.triggers) {
+		armed.slot = slot;
+	}
+	if (protocol_store_set_autorun(&armed) != SL_STATUS_OK) {
+		return CMD_ERR_STORAGE;
+	}
+	if ((triggers & PROTOCOL_TRIGGER_NOW)
+			&& tasks_call(TASKS_STIM, runProtocol, &slot) != SL_STATUS_OK) {
+		return CMD_ERR_RANGE;
+	}
+	return CMD_OK;
+}
+
+static void autorun(uint8_t trigger) {
+	protocol_autorun_t armed;
+
+	protocol_store_get_autorun(&armed);
+	if (armed.slot == PROTOCOL_NO_SLOT || !(armed.triggers & trigger)) {
+		return;
+	}
+	sl_status_t sc = sequencer_start(armed.slot);
+	if (sc != SL_STATUS_OK) {
+		DLOG(DLOG_PROTOCOL_NOT_STARTED, armed.slot, sc);
 	}
 }
 
+static bool readLongWrite(size_t end, const uint8_t **data, size_t *len) {
+	static uint8_t value[NODE_RX_MAX_SIZE];
+	size_t valueLen;
+
+	sl_status_t sc = sl_bt_gatt_server_read_attribute_value(gattdb_node_rx, 0,
+			sizeof(value), &valueLen, value);
+	if (sc != SL_STATUS_OK) {
+		DLOG(DLOG_NODE_RX_READ_FAILED, sc);
+		return false;
+	}
+	if (end < valueLen) {
+		return false; // more fragments follow
+	}
+	*data = value;
+	*len = valueLen;
+	return true;
+}
+
+static size_t encodeNodeTx(const cmd_t *cmd, cmd_status_t status,
+		uint8_t *value) {
+	if (cmd->format == CMD_FORMAT_BINARY) {
+		return cmd_encode_state(cmd->seq, status, &settings, value,
+				NODE_TX_MAX_SIZE);
+	}
+	// get command string and set nodeTx
+	compileCommandString((char*) value);
+	return COMMAND_STR_MAX_SIZE;
+}
+
+static void replyNodeTx(uint8_t connection, const cmd_t *cmd,
+		cmd_status_t status) {
+	uint8_t value[NODE_TX_MAX_SIZE];
+	size_t len = encodeNodeTx(cmd, status, value);
+
+	// The shared attribute keeps the controller's last reply.
+	sl_status_t sc = notify_send_to(connection, gattdb_node_tx, value, len);
+	if (sc != SL_STATUS_OK && sc != SL_STATUS_NOT_FOUND) {
+		DLOG(DLOG_NOTIFY_FAILED, connection, sc);
+	}
+}
+
+static void updateNodeTx(const cmd_t *cmd, cmd_status_t status) {
+	sl_status_t sc;
+
+	uint8_t value[NODE_TX_MAX_SIZE];
+	size_t len = encodeNodeTx(cmd, status, value);
+
+	sc = sl_bt_gatt_server_write_attribute_value(gattdb_node_tx, 0, len, value);
+	if (sc != SL_STATUS_OK) {
+		DLOG(DLOG_NODE_TX_FAILED, sc);
+	}
+	// Subscribers get the value pushed, coalesced per connection event.
+	sc = notify_publish(gattdb_node_tx, value, len);
+	if (sc != SL_STATUS_OK) {
+		DLOG(DLOG_NODE_TX_FAILED, sc);
+	}
+}
@@ -33,6 +33,9 @@
 #ifndef APP_H
 #define APP_H
 
+#include "cmd_proto.h"
+#include "sl_bluetooth.h"
+
 /**************************************************************************//**
  * Application Init.
  *****************************************************************************/
@@ -43,4 +46,39 @@ void app_init(void);
  *****************************************************************************/
 void app_process_action(void);
 
+/**************************************************************************//**
+ * The parts of app_process_action() owned by each task of the kernel build
+ * (see tasks.h): stimulation and the sequencer, RHS2116 and acquisition,
+ * and everything else.
+ *****************************************************************************/
+void app_stim_process_action(void);
+void app_acq_process_action(void);
+void app_control_process_action(void);
+
+/**************************************************************************//**
+ * Handle a Bluetooth event. sl_bt_on_event() calls it directly, or the
+ * control task with a copy in the kernel build.
+ *****************************************************************************/
+void app_on_event(sl_bt_msg_t *evt);
+
+/**************************************************************************//**
+ * Decode and apply a command written to the nodeRx characteristic.
+ *
+ * Applies it whatever the sender's role; the nodeRx handler checks the
+ * role first (see session.h).
+ *
+ * @param[in] data Raw attribute value, ASCII or binary (see cmd_proto.h).
+ * @param[in] len Number of valid bytes in data.
+ * @param[out] cmd Decoded command, used to build the nodeTx reply.
+ * @return CMD_OK if the command was applied.
+ *****************************************************************************/
+cmd_status_t handleNodeRxChange(const uint8_t *data, size_t len, cmd_t *cmd);
+
+/**************************************************************************//**
+ * Render the applied settings as the nodeTx command string.
+ *
+ * @param[out] commandStr Buffer of at least COMMAND_STR_MAX_SIZE bytes.
+ *****************************************************************************/
+void compileCommandString(char *commandStr);
+
 #endif // APP_H
@@ -0,0 +1,338 @@
+/***************************************************************************//**
+ * @file boot.c
+ * @brief Boot sequence and its timing, from reset to connectable.
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "adv_policy.h"
+#include "boot.h"
+#include "byteorder.h"
+#include "config.h"
+#include "dlog.h"
+#include "em_rmu.h"
+#include "gatt_db.h"
+#include "sl_simple_led_instances.h"
+#include "sl_sleeptimer.h"
+#include "sl_spidrv_instances.h"
+#include "tasks.h"
+
+#if defined(gattdb_firmware_revision_string)
+#include "sl_gsdk_version.h"
+#endif
+
+#define BOOT_BEFORE_CONNECTED   ((1u << BOOT_PHASE_CONNECTED) - 1)
+#define BOOT_BOARD_NAME         "CAP"
+#define BOOT_BOARD_REV          "1"
+
+_Static_assert(BOOT_PHASE_COUNT <= 8, "phase masks are one byte");
+_Static_assert(BOOT_RHS2116_ATTEMPTS > 0, "identify the chip at least once");
+#ifdef gattdb_boot_report
+_Static_assert(BOOT_REPORT_MAX_SIZE >= BOOT_REPORT_SIZE,
+		"boot report characteristic must hold the record");
+#endif
+
+typedef enum {
+	RHS_WAITING,                // for an answer, rhsTimer is the timeout
+	RHS_BACKOFF,                // rhsTimer starts the next attempt
+	RHS_SETTLED,                // found, or given up
+} rhs_state_t;
+
+static boot_report_t report;
+static bool stackUp;
+static bool deviceInfoDue;
+static bool done;
+static bool published;          // the characteristic holds the record
+static rhs_state_t rhsState;
+static uint8_t attempts;        // RHS2116 identifications submitted
+
+// From the sleeptimer callbacks and the RHS2116 callback in the
+// acquisition task to boot_process_action().
+static volatile bool stackLate;
+static volatile bool rhsTimerFired;
+static volatile bool rhsAnswered;
+static volatile sl_status_t rhsStatus;
+
+static sl_sleeptimer_timer_handle_t stackTimer;
+static sl_sleeptimer_timer_handle_t rhsTimer;
+
+static uint32_t nowUs(void) {
+	uint64_t ticks = sl_sleeptimer_get_tick_count64();
+	return (uint32_t) (ticks * 1000000u
+			/ sl_sleeptimer_get_timer_frequency());
+}
+
+static boot_reset_t resetCause(uint32_t cause) {
+	if (cause & (EMU_RSTCAUSE_DVDDBOD | EMU_RSTCAUSE_DVDDLEBOD
+			| EMU_RSTCAUSE_DECBOD | EMU_RSTCAUSE_AVDDBOD
+			| EMU_RSTCAUSE_IOVDD0BOD)) {
+		return BOOT_RESET_BROWN_OUT;
+	}
+	if (cause & EMU_RSTCAUSE_WDOG0) {
+		return BOOT_RESET_WATCHDOG;
+	}
+	if (cause & EMU_RSTCAUSE_LOCKUP) {
+		return BOOT_RESET_LOCKUP;
+	}
+	if (cause & EMU_RSTCAUSE_SYSREQ) {
+		return BOOT_RESET_SOFTWARE;
+	}
+	if (cause & EMU_RSTCAUSE_PIN) {
+		return BOOT_RESET_PIN;
+	}
+	if (cause & EMU_RSTCAUSE_POR) {
+		return BOOT_RESET_POWER_ON;
+	}
+	if (cause & EMU_RSTCAUSE_EM4) {
+		return BOOT_RESET_EM4;
+	}
+	return BOOT_RESET_UNKNOWN;
+}
+
+static void onStackTimer(sl_sleeptimer_timer_handle_t *handle, void *data) {
+	(void) handle;
+	(void) data;
+	stackLate = true;
+	tasks_wake(TASKS_CONTROL);
+}
+
+static void onRhsTimer(sl_sleeptimer_timer_handle_t *handle, void *data) {
+	(void) handle;
+	(void) data;
+	rhsTimerFired = true;
+	tasks_wake(TASKS_CONTROL);
+}
+
+static void fail(boot_phase_t phase, sl_status_t sc) {
+	uint8_t bit = (uint8_t) (1u << phase);
+
+	if (!(report.reached & bit) && !(report.failed & bit)) {
+		report.failed |= bit;
+		published = false;
+		DLOG(DLOG_BOOT_PHASE_FAILED, phase, sc);
+	}
+}
+
+static void writeDeviceInfo(void) {
+	sl_status_t sc = SL_STATUS_OK;
+
+#if defined(gattdb_model_number_string)
+	if (sc == SL_STATUS_OK) {
+		sc = sl_bt_gatt_server_write_attribute_value(
+				gattdb_model_number_string, 0, sizeof(BOOT_BOARD_NAME) - 1,
+				(const uint8_t*) BOOT_BOARD_NAME);
+	}
+#endif
+#if defined(gattdb_hardware_revision_string)
+	if (sc == SL_STATUS_OK) {
+		sc = sl_bt_gatt_server_write_attribute_value(
+				gattdb_hardware_revision_string, 0,
+				sizeof(BOOT_BOARD_REV) - 1, (const uint8_t*) BOOT_BOARD_REV);
+	}
+#endif
+#if defined(gattdb_firmware_revision_string)
+	if (sc == SL_STATUS_OK) {
+		sc = sl_bt_gatt_server_write_attribute_value(
+				gattdb_firmware_revision_string, 0,
+				sizeof(SL_GSDK_VERSION_STR) - 1,
+				(const uint8_t*) SL_GSDK_VERSION_STR);
+	}
+#endif
+#if defined(gattdb_system_id)
+	if (sc == SL_STATUS_OK) {
+		bd_addr address;
+		uint8_t type;
+		sc = sl_bt_system_get_identity_address(&address, &type);
+		if (sc == SL_STATUS_OK) {
+			// EUI-64 from the 48-bit address, most significant byte first.
+			const uint8_t id[] = {
+				address.addr[5], address.addr[4], address.addr[3], 0xFF, 0xFE,
+				address.addr[2], address.addr[1], address.addr[0],
+			};
+			sc = sl_bt_gatt_server_write_attribute_value(gattdb_system_id, 0,
+					sizeof(id), id);
+		}
+	}
+#endif
+	if (sc == SL_STATUS_OK) {
+		boot_mark(BOOT_PHASE_DEVICE_INFO);
+	} else {
+		fail(BOOT_PHASE_DEVICE_INFO, sc);
+	}
+}
+
+static void identify(void) {
+	attempts++;
+	sl_status_t sc = attempts == 1 ?
+			rhs2116_init(sl_spidrv_spi_inst_handle, boot_rhs2116_identified,
+					NULL) :
+			rhs2116_identify(boot_rhs2116_identified, NULL);
+	if (sc != SL_STATUS_OK) {
+		DLOG(DLOG_RHS2116_INIT_FAILED, sc);
+		fail(BOOT_PHASE_RHS2116, sc);
+		rhsState = RHS_SETTLED;
+		return;
+	}
+	rhsState = RHS_WAITING;
+	sl_sleeptimer_start_timer_ms(&rhsTimer, BOOT_RHS2116_TIMEOUT_MS,
+			onRhsTimer, NULL, 0, 0);
+}
+
+static void publish(void) {
+#ifdef gattdb_boot_report
+	uint8_t record[BOOT_REPORT_SIZE];
+	size_t len = boot_encode(record, sizeof(record));
+	sl_status_t sc = sl_bt_gatt_server_write_attribute_value(
+			gattdb_boot_report, 0, len, record);
+	if (sc != SL_STATUS_OK) {
+		DLOG(DLOG_BOOT_REPORT_FAILED, sc);
+	}
+#endif
+	published = true;
+}
+
+void boot_init(void) {
+	memset(&report, 0, sizeof(report));
+	report.reset = resetCause(RMU_ResetCauseGet());
+	RMU_ResetCauseClear();
+	stackUp = false;
+	deviceInfoDue = false;
+	done = false;
+	published = false;
+	attempts = 0;
+	stackLate = rhsTimerFired = rhsAnswered = false;
+	sl_led_turn_on(LED_INSTANCE);
+}
+
+void boot_start(void) {
+	boot_mark(BOOT_PHASE_APP_INIT);
+	sl_sleeptimer_start_timer_ms(&stackTimer, BOOT_STACK_TIMEOUT_MS,
+			onStackTimer, NULL, 0, 0);
+	identify();
+}
+
+void boot_mark(boot_phase_t phase) {
+	uint8_t bit = (uint8_t) (1u << phase);
+
+	if (report.reached & bit) {
+		return;
+	}
+	report.us[phase] = nowUs();
+	report.reached |= bit;
+	// A late arrival still counts.
+	report.failed &= (uint8_t) ~bit;
+	published = false;
+}
+
+void boot_rhs2116_identified(rhs2116_batch_t *batch, sl_status_t status,
+		void *context) {
+	(void) batch;
+	(void) context;
+	rhsStatus = status;
+	rhsAnswered = true;
+	tasks_wake(TASKS_CONTROL);
+}
+
+void boot_on_event(const sl_bt_msg_t *evt) {
+	switch (SL_BT_MSG_ID(evt->header)) {
+	case sl_bt_evt_system_boot_id:
+		stackUp = true;
+		sl_sleeptimer_stop_timer(&stackTimer);
+		boot_mark(BOOT_PHASE_STACK);
+		if (adv_policy_stage() >= 0) {
+			boot_mark(BOOT_PHASE_ADVERTISING);
+			sl_led_turn_off(LED_INSTANCE);
+		} else {
+			fail(BOOT_PHASE_ADVERTISING, SL_STATUS_FAIL);
+		}
+		// Off the path to connectable, on the next pass.
+		deviceInfoDue = true;
+		tasks_wake(TASKS_CONTROL);
+		break;
+
+	case sl_bt_evt_connection_opened_id:
+		boot_mark(BOOT_PHASE_CONNECTED);
+		break;
+
+	default:
+		break;
+	}
+}
+
+void boot_process_action(void) {
+	if (stackLate) {
+		stackLate = false;
+		// Reached after all if the boot event comes later. The LED stays on.
+		fail(BOOT_PHASE_STACK, SL_STATUS_TIMEOUT);
+		fail(BOOT_PHASE_ADVERTISING, SL_STATUS_TIMEOUT);
+		fail(BOOT_PHASE_DEVICE_INFO, SL_STATUS_TIMEOUT);
+	}
+	if (deviceInfoDue) {
+		deviceInfoDue = false;
+		writeDeviceInfo();
+	}
+	if (rhsAnswered) {
+		rhsAnswered = false;
+		if (rhsStatus == SL_STATUS_OK) {
+			// Possibly after the timeout gave up on it.
+			boot_mark(BOOT_PHASE_RHS2116);
+			rhsState = RHS_SETTLED;
+		} else if (rhsState == RHS_WAITING
+				&& attempts < BOOT_RHS2116_ATTEMPTS) {
+			rhsState = RHS_BACKOFF;
+			sl_sleeptimer_start_timer_ms(&rhsTimer, BOOT_RHS2116_RETRY_MS,
+					onRhsTimer, NULL, 0, 0);
+		} else {
+			fail(BOOT_PHASE_RHS2116, rhsStatus);
+			rhsState = RHS_SETTLED;
+		}
+		if (rhsState == RHS_SETTLED) {
+			sl_sleeptimer_stop_timer(&rhsTimer);
+		}
+	}
+	if (rhsTimerFired) {
+		rhsTimerFired = false;
+		if (rhsState == RHS_BACKOFF) {
+			identify();
+		} else if (rhsState == RHS_WAITING) {
+			// Still queued or on the bus. Another attempt would only
+			// queue behind it.
+			fail(BOOT_PHASE_RHS2116, SL_STATUS_TIMEOUT);
+			rhsState = RHS_SETTLED;
+		}
+	}
+
+	if (!done && boot_complete()) {
+		done = true;
+		DLOG(DLOG_BOOT_DONE, report.us[BOOT_PHASE_ADVERTISING],
+				nowUs(), report.reset);
+	}
+	if (stackUp && !published) {
+		publish();
+	}
+}
+
+bool boot_complete(void) {
+	return ((report.reached | report.failed) & BOOT_BEFORE_CONNECTED)
+			== BOOT_BEFORE_CONNECTED;
+}
+
+void boot_get(boot_report_t *out) {
+	*out = report;
+}
+
+size_t boot_encode(uint8_t *out, size_t size) {
+	if (size < BOOT_REPORT_SIZE) {
+		return 0;
+	}
+	out[0] = BOOT_REPORT_VERSION;
+	out[1] = (uint8_t) report.reset;
+	out[2] = report.reached;
+	out[3] = report.failed;
+	for (size_t i = 0; i < BOOT_PHASE_COUNT; i++) {
+		put_le32(out + 4 + 4 * i, report.us[i]);
+	}
+	return BOOT_REPORT_SIZE;
+}
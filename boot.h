@@ -0,0 +1,137 @@
+/***************************************************************************//**
+ * @file boot.h
+ * @brief Boot sequence and its timing, from reset to connectable.
+ *
+ * app_init() only starts things. Settings restore, the boot protocol and
+ * the RHS2116 identification proceed from the superloop while the stack
+ * starts, and nothing waits without a bound:
+ *
+ *   BOOT_PHASE_APP_INIT     app_init() returned
+ *   BOOT_PHASE_SETTINGS     settings restored and the boot protocol
+ *                           started, on the first superloop pass or before
+ *                           the stack's boot event is handled
+ *   BOOT_PHASE_STACK        boot event; missing after BOOT_STACK_TIMEOUT_MS
+ *                           it is logged as failed
+ *   BOOT_PHASE_ADVERTISING  connectable advertising started, in the boot
+ *                           event; the LED, on since app_init(), goes off
+ *   BOOT_PHASE_DEVICE_INFO  device information attributes written, after
+ *                           advertising has started
+ *   BOOT_PHASE_RHS2116      chip identified; a chip that does not answer,
+ *                           for example with its supply still ramping after
+ *                           a brown-out, is asked again every
+ *                           BOOT_RHS2116_RETRY_MS, BOOT_RHS2116_ATTEMPTS
+ *                           times, each given BOOT_RHS2116_TIMEOUT_MS
+ *   BOOT_PHASE_CONNECTED    first connection opened
+ *
+ * Each phase is stamped on the sleeptimer, which starts in sl_system_init()
+ * a few hundred microseconds after reset. Once every phase before
+ * BOOT_PHASE_CONNECTED is reached or failed, DLOG_BOOT_DONE logs the time
+ * to connectable and to complete with the reset cause.
+ *
+ * After the boot event the record below is kept in the boot_report
+ * characteristic (Read, BOOT_REPORT_MAX_SIZE). Little-endian:
+ *
+ *   offset  size  field
+ *   0       1     BOOT_REPORT_VERSION
+ *   1       1     boot_reset_t
+ *   2       1     phases reached, bit n for boot_phase_t n
+ *   3       1     phases failed
+ *   4       4n    time of each phase since the sleeptimer started, us;
+ *                 0 if not reached
+ ******************************************************************************/
+#ifndef BOOT_H
+#define BOOT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "rhs2116.h"
+#include "sl_bluetooth.h"
+#include "sl_status.h"
+
+#define BOOT_REPORT_VERSION     1
+
+typedef enum {
+	BOOT_PHASE_APP_INIT = 0,
+	BOOT_PHASE_SETTINGS,
+	BOOT_PHASE_STACK,
+	BOOT_PHASE_ADVERTISING,
+	BOOT_PHASE_DEVICE_INFO,
+	BOOT_PHASE_RHS2116,
+	BOOT_PHASE_CONNECTED,
+	BOOT_PHASE_COUNT,
+} boot_phase_t;
+
+#define BOOT_REPORT_SIZE        (4 + 4 * BOOT_PHASE_COUNT)
+
+typedef enum {
+	BOOT_RESET_UNKNOWN = 0,
+	BOOT_RESET_POWER_ON,
+	BOOT_RESET_BROWN_OUT,
+	BOOT_RESET_WATCHDOG,
+	BOOT_RESET_LOCKUP,
+	BOOT_RESET_SOFTWARE,    ///< NVIC_SystemReset(), e.g. after an update.
+	BOOT_RESET_PIN,
+	BOOT_RESET_EM4,
+} boot_reset_t;
+
+typedef struct {
+	boot_reset_t reset;
+	uint8_t reached;        ///< Bit n for boot_phase_t n.
+	uint8_t failed;
+	uint32_t us[BOOT_PHASE_COUNT];
+} boot_report_t;
+
+/**
+ * @brief Read and clear the reset cause and turn the LED on. Call early in
+ *        app_init().
+ */
+void boot_init(void);
+
+/**
+ * @brief Start the RHS2116 identification and the stack timeout, and stamp
+ *        BOOT_PHASE_APP_INIT. Call last thing in app_init().
+ */
+void boot_start(void);
+
+/**
+ * @brief Stamp a phase as reached. Later calls for the same phase are
+ *        ignored.
+ */
+void boot_mark(boot_phase_t phase);
+
+/**
+ * @brief Identification result; retries a chip that was not found.
+ */
+void boot_rhs2116_identified(rhs2116_batch_t *batch, sl_status_t status,
+		void *context);
+
+/**
+ * @brief Pass every stack event, after adv_policy_on_event().
+ */
+void boot_on_event(const sl_bt_msg_t *evt);
+
+/**
+ * @brief Run the deferred phases and the timeouts. Call from the superloop.
+ */
+void boot_process_action(void);
+
+/**
+ * @brief True once every phase before BOOT_PHASE_CONNECTED is reached or
+ *        failed.
+ */
+bool boot_complete(void);
+
+/**
+ * @brief Copy the phases so far.
+ */
+void boot_get(boot_report_t *report);
+
+/**
+ * @brief Encode the boot report.
+ *
+ * @return BOOT_REPORT_SIZE, or 0 if out is too small.
+ */
+size_t boot_encode(uint8_t *out, size_t size);
+
+#endif // BOOT_H
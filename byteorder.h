@@ -0,0 +1,57 @@
+/***************************************************************************//**
+ * @file byteorder.h
+ * @brief Little- and big-endian field access for records and packets.
+ *
+ * Every wire and storage record of the firmware is little-endian except
+ * the RHS2116 SPI words, which are big-endian. The helpers assemble values
+ * byte by byte, so they work at any alignment and on any host; compilers
+ * turn them into single loads and stores where the target allows.
+ ******************************************************************************/
+#ifndef BYTEORDER_H
+#define BYTEORDER_H
+
+#include <stdint.h>
+
+static inline uint16_t get_le16(const uint8_t *p) {
+	return (uint16_t) (p[0] | (p[1] << 8));
+}
+
+static inline uint32_t get_le32(const uint8_t *p) {
+	return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16)
+			| ((uint32_t) p[3] << 24);
+}
+
+static inline uint64_t get_le64(const uint8_t *p) {
+	return get_le32(p) | ((uint64_t) get_le32(p + 4) << 32);
+}
+
+static inline void put_le16(uint8_t *p, uint16_t v) {
+	p[0] = (uint8_t) v;
+	p[1] = (uint8_t) (v >> 8);
+}
+
+static inline void put_le32(uint8_t *p, uint32_t v) {
+	p[0] = (uint8_t) v;
+	p[1] = (uint8_t) (v >> 8);
+	p[2] = (uint8_t) (v >> 16);
+	p[3] = (uint8_t) (v >> 24);
+}
+
+static inline void put_le64(uint8_t *p, uint64_t v) {
+	put_le32(p, (uint32_t) v);
+	put_le32(p + 4, (uint32_t) (v >> 32));
+}
+
+static inline uint32_t get_be32(const uint8_t *p) {
+	return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16)
+			| ((uint32_t) p[2] << 8) | (uint32_t) p[3];
+}
+
+static inline void put_be32(uint8_t *p, uint32_t v) {
+	p[0] = (uint8_t) (v >> 24);
+	p[1] = (uint8_t) (v >> 16);
+	p[2] = (uint8_t) (v >> 8);
+	p[3] = (uint8_t) v;
+}
+
+#endif // BYTEORDER_H
@@ -0,0 +1,510 @@
+/***************************************************************************//**
+ * @file cmd_proto.c
+ * @brief nodeRx/nodeTx command protocol.
+ *
+ * Decoding works directly on the attribute buffer and uses no libc string
+ * functions, so it is safe to call from the Bluetooth event handler.
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "byteorder.h"
+#include "cmd_proto.h"
+
+static const uint16_t crc16_table[256] = {
+	0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+	0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+	0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6,
+	0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
+	0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485,
+	0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
+	0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4,
+	0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC,
+	0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823,
+	0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B,
+	0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12,
+	0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A,
+	0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41,
+	0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
+	0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70,
+	0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78,
+	0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F,
+	0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067,
+	0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E,
+	0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256,
+	0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D,
+	0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+	0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C,
+	0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634,
+	0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB,
+	0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3,
+	0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A,
+	0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
+	0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9,
+	0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1,
+	0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8,
+	0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0,
+};
+
+// Field letters for the ASCII encoding, indexed by field bit.
+static const char field_letters[CMD_FIELD_COUNT] = { 'A', 'F', 'P', 'G', 'L',
+		'S', 'I', '\0', 'B', 'R' };
+
+uint16_t cmd_crc16(const uint8_t *data, size_t len) {
+	uint16_t crc = 0xFFFF;
+	while (len--) {
+		crc = (uint16_t) ((crc << 8) ^ crc16_table[(crc >> 8) ^ *data++]);
+	}
+	return crc;
+}
+
+static inline uint8_t popcount16(uint16_t v) {
+	uint8_t n = 0;
+	for (; v; v &= (uint16_t) (v - 1)) {
+		n++;
+	}
+	return n;
+}
+
+// Size of the encoded field mask for the given fields.
+static inline size_t mask_size(uint16_t mask) {
+	return (mask >> 8) ? 2 : 1;
+}
+
+static uint8_t* put_mask(uint8_t *p, uint16_t mask) {
+	if (mask >> 8) {
+		*p++ = (uint8_t) (mask | CMD_MASK_EXT);
+		*p++ = (uint8_t) (mask >> 8);
+	} else {
+		*p++ = (uint8_t) mask;
+	}
+	return p;
+}
+
+static uint8_t* put_values(uint8_t *p, uint16_t mask, const uint32_t *values) {
+	for (int i = 0; i < CMD_FIELD_COUNT; i++) {
+		if (mask & (1u << i)) {
+			put_le32(p, values[i]);
+			p += CMD_VALUE_SIZE;
+		}
+	}
+	return p;
+}
+
+static int field_index(char letter) {
+	for (int i = 0; i < CMD_FIELD_COUNT; i++) {
+		if (letter != '\0' && field_letters[i] == letter) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/*
+ * Legacy syntax. Matches the previous strtok/atoi parser: empty tokens are
+ * skipped, unknown letters ignored, parsing stops at a NUL byte, and a value
+ * is the leading decimal digits of the token (0 if there are none). Values
+ * saturate at UINT32_MAX.
+ *
+ * Parses one command starting at data[i], up to the next ';', and returns
+ * the index after it.
+ */
+static size_t decode_ascii_fields(const uint8_t *data, size_t i, size_t len,
+		cmd_t *cmd) {
+	cmd->opcode = CMD_OP_SET;
+	cmd->count = 1;
+	cmd->mask = 0;
+	if (i < len && data[i] == CMD_ASCII_SOF) {
+		i++;
+	}
+	while (i < len && data[i] != '\0' && data[i] != CMD_ASCII_SEPARATOR) {
+		if (data[i] == ',') {
+			i++;
+			continue;
+		}
+		int field = field_index((char) data[i++]);
+		uint32_t value = 0;
+		bool digits = true;
+		while (i < len && data[i] != ',' && data[i] != '\0'
+				&& data[i] != CMD_ASCII_SEPARATOR) {
+			uint8_t c = data[i++];
+			if (digits && c >= '0' && c <= '9') {
+				uint32_t d = (uint32_t) (c - '0');
+				value = (value > (UINT32_MAX - d) / 10) ?
+						UINT32_MAX : value * 10 + d;
+			} else {
+				digits = false;
+			}
+		}
+		if (field >= 0) {
+			cmd->mask |= (uint16_t) (1u << field);
+			cmd->value[field] = value;
+		}
+	}
+	return i < len && data[i] == CMD_ASCII_SEPARATOR ? i + 1 : len;
+}
+
+static bool ascii_at_end(const uint8_t *data, size_t i, size_t len) {
+	return i >= len || data[i] == '\0';
+}
+
+static cmd_status_t decode_ascii(const uint8_t *data, size_t len, cmd_t *cmd) {
+	size_t i = decode_ascii_fields(data, 1, len, cmd); // skip '_'
+	if (ascii_at_end(data, i, len)) {
+		return CMD_OK;
+	}
+
+	// More than one command: a batch. Keep the union for the caller.
+	cmd_t sub;
+	cmd->opcode = CMD_OP_BATCH;
+	cmd->body = data + 1;
+	cmd->bodyLen = (uint16_t) (len - 1);
+	while (!ascii_at_end(data, i, len)) {
+		if (++cmd->count > CMD_BATCH_MAX) {
+			return CMD_ERR_LENGTH;
+		}
+		i = decode_ascii_fields(data, i, len, &sub);
+		cmd->mask |= sub.mask;
+		for (int f = 0; f < CMD_FIELD_COUNT; f++) {
+			if (sub.mask & (1u << f)) {
+				cmd->value[f] = sub.value[f];
+			}
+		}
+	}
+	return CMD_OK;
+}
+
+/*
+ * One SET payload at p: field mask then values. With exact set, the
+ * payload must be exactly len bytes; otherwise it may be followed by more.
+ * Stores the bytes used in *used.
+ */
+static cmd_status_t decode_set_body(const uint8_t *p, size_t len, bool exact,
+		cmd_t *cmd, size_t *used) {
+	size_t maskLen = (len && (p[0] & CMD_MASK_EXT)) ? 2 : 1;
+	if (len < maskLen) {
+		return CMD_ERR_LENGTH;
+	}
+	cmd->opcode = CMD_OP_SET;
+	cmd->count = 1;
+	cmd->mask = p[0] & (uint8_t) ~CMD_MASK_EXT;
+	if (maskLen == 2) {
+		cmd->mask |= (uint16_t) (p[1] << 8);
+	}
+	if (cmd->mask & ~CMD_FIELD_ALL) {
+		return CMD_ERR_FORMAT;
+	}
+	*used = maskLen + popcount16(cmd->mask) * CMD_VALUE_SIZE;
+	if (exact ? len != *used : len < *used) {
+		return CMD_ERR_LENGTH;
+	}
+	p += maskLen;
+	for (int i = 0; i < CMD_FIELD_COUNT; i++) {
+		if (cmd->mask & (1u << i)) {
+			cmd->value[i] = get_le32(p);
+			p += CMD_VALUE_SIZE;
+		}
+	}
+	return CMD_OK;
+}
+
+static cmd_status_t decode_binary(const uint8_t *data, size_t len, cmd_t *cmd) {
+	const uint8_t *p;
+	size_t payload;
+	size_t used;
+
+	if (len < CMD_HEADER_SIZE + CMD_CRC_SIZE) {
+		return CMD_ERR_LENGTH;
+	}
+	if (data[1] != CMD_PROTO_VERSION) {
+		return CMD_ERR_VERSION;
+	}
+	cmd->opcode = data[2];
+	cmd->seq = data[3];
+
+	uint16_t crc = get_le16(data + len - 2);
+	if (cmd_crc16(data, len - CMD_CRC_SIZE) != crc) {
+		return CMD_ERR_CRC;
+	}
+
+	p = data + CMD_HEADER_SIZE;
+	payload = len - CMD_HEADER_SIZE - CMD_CRC_SIZE;
+
+	switch (cmd->opcode) {
+	case CMD_OP_SET:
+		return decode_set_body(p, payload, true, cmd, &used);
+
+	case CMD_OP_GET:
+		cmd->count = 1;
+		return payload == 0 ? CMD_OK : CMD_ERR_LENGTH;
+
+	case CMD_OP_BATCH: {
+		cmd_t sub;
+		cmd->body = p;
+		cmd->bodyLen = (uint16_t) payload;
+		if (payload == 0) {
+			return CMD_ERR_EMPTY;
+		}
+		// Validate every entry now so applying cannot fail half way.
+		for (size_t off = 0; off < payload; off += used) {
+			if (++cmd->count > CMD_BATCH_MAX) {
+				return CMD_ERR_LENGTH;
+			}
+			cmd_status_t status = decode_set_body(p + off, payload - off,
+					false, &sub, &used);
+			if (status != CMD_OK) {
+				return status;
+			}
+			cmd->mask |= sub.mask;
+			for (int f = 0; f < CMD_FIELD_COUNT; f++) {
+				if (sub.mask & (1u << f)) {
+					cmd->value[f] = sub.value[f];
+				}
+			}
+		}
+		cmd->opcode = CMD_OP_BATCH;
+		return CMD_OK;
+	}
+
+	case CMD_OP_PROTOCOL_WRITE:
+	case CMD_OP_PROTOCOL_RUN:
+		// Slot plus a record or a trigger mask; the content is checked by
+		// the protocol module.
+		cmd->body = p;
+		cmd->bodyLen = (uint16_t) payload;
+		cmd->count = 1;
+		if (cmd->opcode == CMD_OP_PROTOCOL_RUN) {
+			return payload == 2 ? CMD_OK : CMD_ERR_LENGTH;
+		}
+		return payload > 2 ? CMD_OK : CMD_ERR_LENGTH;
+
+	case CMD_OP_ADV_POLICY:
+	case CMD_OP_DETECT:
+		cmd->body = p;
+		cmd->bodyLen = (uint16_t) payload;
+		cmd->count = 1;
+		return payload ? CMD_OK : CMD_ERR_LENGTH;
+
+	case CMD_OP_SESSION:
+		cmd->body = p;
+		cmd->bodyLen = (uint16_t) payload;
+		cmd->count = 1;
+		return payload == 1 ? CMD_OK : CMD_ERR_LENGTH;
+
+	default:
+		return CMD_ERR_OPCODE;
+	}
+}
+
+cmd_status_t cmd_decode(const uint8_t *data, size_t len, cmd_t *cmd) {
+	cmd->format = CMD_FORMAT_NONE;
+	cmd->opcode = 0;
+	cmd->seq = 0;
+	cmd->mask = 0;
+	cmd->count = 0;
+	cmd->body = NULL;
+	cmd->bodyLen = 0;
+
+	if (len == 0) {
+		return CMD_ERR_EMPTY;
+	}
+	switch (data[0]) {
+	case CMD_ASCII_SOF:
+		cmd->format = CMD_FORMAT_ASCII;
+		return decode_ascii(data, len, cmd);
+	case CMD_PROTO_SOF:
+		cmd->format = CMD_FORMAT_BINARY;
+		return decode_binary(data, len, cmd);
+	default:
+		return CMD_ERR_FORMAT;
+	}
+}
+
+bool cmd_next(const cmd_t *cmd, size_t *pos, cmd_t *sub) {
+	size_t used;
+
+	if (cmd->opcode != CMD_OP_BATCH) {
+		if (*pos != 0) {
+			return false;
+		}
+		*sub = *cmd;
+		*pos = 1;
+		return true;
+	}
+	if (*pos >= cmd->bodyLen
+			|| (cmd->format == CMD_FORMAT_ASCII
+					&& ascii_at_end(cmd->body, *pos, cmd->bodyLen))) {
+		return false;
+	}
+	sub->format = cmd->format;
+	sub->seq = cmd->seq;
+	sub->body = NULL;
+	sub->bodyLen = 0;
+	if (cmd->format == CMD_FORMAT_ASCII) {
+		*pos = decode_ascii_fields(cmd->body, *pos, cmd->bodyLen, sub);
+		return true;
+	}
+	if (decode_set_body(cmd->body + *pos, cmd->bodyLen - *pos, false, sub,
+			&used) != CMD_OK) {
+		return false;
+	}
+	*pos += used;
+	return true;
+}
+
+void cmd_settings_init(cmd_settings_t *settings) {
+	*settings = (cmd_settings_t ) { .phases = 1 };
+}
+
+bool cmd_apply(const cmd_t *cmd, cmd_settings_t *settings) {
+	if (cmd->opcode != CMD_OP_SET) {
+		return false;
+	}
+	if (cmd->mask & CMD_FIELD_AMPLITUDE) {
+		settings->amplitude = cmd->value[0];
+	}
+	if (cmd->mask & CMD_FIELD_FREQUENCY) {
+		settings->frequency = cmd->value[1];
+	}
+	if (cmd->mask & CMD_FIELD_PULSE_WIDTH) {
+		settings->pulseWidth = cmd->value[2];
+	}
+	if (cmd->mask & CMD_FIELD_GATE) {
+		settings->activateOnDisconnect = cmd->value[3] ? 1 : 0;
+	}
+	if (cmd->mask & CMD_FIELD_PHASES) {
+		settings->phases = cmd->value[5] > 0xFF ? 0xFF : (uint8_t) cmd->value[5];
+	}
+	if (cmd->mask & CMD_FIELD_GAP) {
+		settings->interphaseGap = cmd->value[6];
+	}
+	if (cmd->mask & CMD_FIELD_BURST) {
+		settings->burstCount = cmd->value[8];
+	}
+	if (cmd->mask & CMD_FIELD_BURST_REST) {
+		settings->burstRest = cmd->value[9];
+	}
+	return (cmd->mask & CMD_FIELD_LED) && cmd->value[4];
+}
+
+static size_t put_crc(uint8_t *out, uint8_t *p) {
+	uint16_t crc = cmd_crc16(out, (size_t) (p - out));
+	*p++ = (uint8_t) crc;
+	*p++ = (uint8_t) (crc >> 8);
+	return (size_t) (p - out);
+}
+
+size_t cmd_encode_set(uint8_t seq, const cmd_t *cmd, uint8_t *out,
+		size_t size) {
+	uint16_t mask = cmd->mask & CMD_FIELD_ALL;
+	uint8_t *p = out;
+
+	if (size < CMD_HEADER_SIZE + mask_size(mask)
+			+ popcount16(mask) * CMD_VALUE_SIZE + CMD_CRC_SIZE) {
+		return 0;
+	}
+	*p++ = CMD_PROTO_SOF;
+	*p++ = CMD_PROTO_VERSION;
+	*p++ = CMD_OP_SET;
+	*p++ = seq;
+	p = put_mask(p, mask);
+	p = put_values(p, mask, cmd->value);
+	return put_crc(out, p);
+}
+
+size_t cmd_encode_batch(uint8_t seq, const cmd_t *cmds, size_t count,
+		uint8_t *out, size_t size) {
+	size_t need = CMD_HEADER_SIZE + CMD_CRC_SIZE;
+	uint8_t *p = out;
+
+	if (count == 0 || count > CMD_BATCH_MAX) {
+		return 0;
+	}
+	for (size_t i = 0; i < count; i++) {
+		uint16_t mask = cmds[i].mask & CMD_FIELD_ALL;
+		need += mask_size(mask) + popcount16(mask) * CMD_VALUE_SIZE;
+	}
+	if (size < need) {
+		return 0;
+	}
+	*p++ = CMD_PROTO_SOF;
+	*p++ = CMD_PROTO_VERSION;
+	*p++ = CMD_OP_BATCH;
+	*p++ = seq;
+	for (size_t i = 0; i < count; i++) {
+		uint16_t mask = cmds[i].mask & CMD_FIELD_ALL;
+		p = put_mask(p, mask);
+		p = put_values(p, mask, cmds[i].value);
+	}
+	return put_crc(out, p);
+}
+
+size_t cmd_encode_state(uint8_t seq, cmd_status_t status,
+		const cmd_settings_t *settings, uint8_t *out, size_t size) {
+	uint32_t values[CMD_FIELD_COUNT] = { 0 };
+	uint8_t *p = out;
+
+	if (size < CMD_STATE_FRAME_SIZE) {
+		return 0;
+	}
+	values[0] = settings->amplitude;
+	values[1] = settings->frequency;
+	values[2] = settings->pulseWidth;
+	values[3] = settings->activateOnDisconnect;
+	values[5] = settings->phases;
+	values[6] = settings->interphaseGap;
+	values[8] = settings->burstCount;
+	values[9] = settings->burstRest;
+
+	*p++ = CMD_PROTO_SOF;
+	*p++ = CMD_PROTO_VERSION;
+	*p++ = CMD_OP_STATE;
+	*p++ = seq;
+	*p++ = (uint8_t) status;
+	p = put_mask(p, CMD_FIELD_STATE);
+	p = put_values(p, CMD_FIELD_STATE, values);
+	return put_crc(out, p);
+}
+
+static size_t put_u32_dec(char *out, uint32_t v) {
+	char tmp[10];
+	size_t n = 0;
+	do {
+		tmp[n++] = (char) ('0' + v % 10);
+		v /= 10;
+	} while (v);
+	for (size_t i = 0; i < n; i++) {
+		out[i] = tmp[n - 1 - i];
+	}
+	return n;
+}
+
+size_t cmd_format_ascii(const cmd_settings_t *settings, char *out,
+		size_t size) {
+	// Longest possible rendering: "_A" + 3 x ",X" + 4 x 10 digits
+	char tmp[1 + 4 * 11];
+	const uint32_t values[4] = { settings->amplitude, settings->frequency,
+			settings->pulseWidth, settings->activateOnDisconnect };
+	size_t n = 0;
+
+	if (size == 0) {
+		return 0;
+	}
+	tmp[n++] = CMD_ASCII_SOF;
+	for (int i = 0; i < 4; i++) {
+		if (i) {
+			tmp[n++] = ',';
+		}
+		tmp[n++] = field_letters[i];
+		n += put_u32_dec(&tmp[n], values[i]);
+	}
+	if (n > size - 1) {
+		n = size - 1;
+	}
+	for (size_t i = 0; i < n; i++) {
+		out[i] = tmp[i];
+	}
+	out[n] = '\0';
+	return n;
+}
@@ -0,0 +1,238 @@
+/***************************************************************************//**
+ * @file cmd_proto.h
+ * @brief nodeRx/nodeTx command protocol.
+ *
+ * Two encodings are accepted on nodeRx:
+ *
+ * ASCII (legacy): "_A100,F20,P200,G1" - '_' followed by comma separated
+ * fields, each a type letter and a decimal value.
+ *
+ * Binary (version 1), all multi-byte values little-endian:
+ *
+ *   offset  size  field
+ *   0       1     CMD_PROTO_SOF
+ *   1       1     CMD_PROTO_VERSION
+ *   2       1     opcode (cmd_opcode_t)
+ *   3       1     sequence number, echoed in the reply
+ *   4       n     opcode payload
+ *   4+n     2     CRC-16/CCITT-FALSE over bytes 0 .. 3+n
+ *
+ * CMD_OP_SET payload:   field mask, then one uint32 per set bit (bit order).
+ * CMD_OP_GET payload:   empty.
+ * CMD_OP_BATCH payload: one or more SET payloads back to back.
+ * CMD_OP_STATE payload: status, field mask, then one uint32 per set bit.
+ * CMD_OP_PROTOCOL_WRITE payload: slot, then a protocol record.
+ * CMD_OP_PROTOCOL_RUN payload:   slot, then a trigger mask.
+ * CMD_OP_ADV_POLICY payload:     advertising stage record.
+ * CMD_OP_SESSION payload:        session_action_t, one byte.
+ * CMD_OP_DETECT payload:         detector record.
+ *
+ * The protocol record and trigger mask are described in protocol.h, the
+ * stage record in adv_policy.h, the session actions in session.h, the
+ * detector record in detect.h. They are binary only and carried in cmd_t
+ * body/bodyLen.
+ *
+ * The field mask is one byte for fields 0-6. If bit 7 (CMD_MASK_EXT) is set,
+ * a second byte follows carrying fields 8-15.
+ *
+ * In ASCII, commands separated by ';' form a batch: "_A100,F20;P200;G1".
+ *
+ * The commands of a batch are applied in order, all or none, and answered
+ * with one reply whose status covers the whole batch.
+ *
+ * Replies on nodeTx use the encoding of the request that produced them.
+ ******************************************************************************/
+#ifndef CMD_PROTO_H
+#define CMD_PROTO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CMD_PROTO_SOF           0xB5
+#define CMD_PROTO_VERSION       1
+#define CMD_ASCII_SOF           '_'
+#define CMD_ASCII_SEPARATOR     ';'
+
+#define CMD_HEADER_SIZE         4
+#define CMD_CRC_SIZE            2
+#define CMD_VALUE_SIZE          4
+
+// Field mask bits, in payload order. The bit number is the field index.
+#define CMD_FIELD_AMPLITUDE     (1u << 0) // 'A'
+#define CMD_FIELD_FREQUENCY     (1u << 1) // 'F', Hz
+#define CMD_FIELD_PULSE_WIDTH   (1u << 2) // 'P', us per phase
+#define CMD_FIELD_GATE          (1u << 3) // 'G', activate on disconnect
+#define CMD_FIELD_LED           (1u << 4) // 'L', toggle LED when non-zero
+#define CMD_FIELD_PHASES        (1u << 5) // 'S', 1 mono- or 2 biphasic
+#define CMD_FIELD_GAP           (1u << 6) // 'I', interphase gap, us
+#define CMD_MASK_EXT            (1u << 7) // second mask byte follows
+#define CMD_FIELD_BURST         (1u << 8) // 'B', pulses per burst, 0 = none
+#define CMD_FIELD_BURST_REST    (1u << 9) // 'R', pause after a burst, us
+#define CMD_FIELD_COUNT         10
+#define CMD_FIELD_ALL           (((1u << CMD_FIELD_COUNT) - 1) & ~CMD_MASK_EXT)
+#define CMD_FIELD_STATE         (CMD_FIELD_ALL & ~CMD_FIELD_LED)
+// Fields that change the compiled stimulation schedule.
+#define CMD_FIELD_TIMING        (CMD_FIELD_AMPLITUDE | CMD_FIELD_FREQUENCY \
+                                 | CMD_FIELD_PULSE_WIDTH | CMD_FIELD_PHASES \
+                                 | CMD_FIELD_GAP | CMD_FIELD_BURST \
+                                 | CMD_FIELD_BURST_REST)
+#define CMD_STATE_FIELD_COUNT   8
+
+// Largest binary frame: SET with every field present.
+#define CMD_FRAME_MAX_SIZE      (CMD_HEADER_SIZE + 2 \
+                                 + (CMD_FIELD_COUNT - 1) * CMD_VALUE_SIZE \
+                                 + CMD_CRC_SIZE)
+// Most commands accepted in one batch.
+#define CMD_BATCH_MAX           32
+
+// STATE reply with every state field present.
+#define CMD_STATE_FRAME_SIZE    (CMD_HEADER_SIZE + 3 \
+                                 + CMD_STATE_FIELD_COUNT * CMD_VALUE_SIZE \
+                                 + CMD_CRC_SIZE)
+
+typedef enum {
+	CMD_OP_SET = 0x01,
+	CMD_OP_GET = 0x02,
+	CMD_OP_BATCH = 0x03,
+	CMD_OP_PROTOCOL_WRITE = 0x04,
+	CMD_OP_PROTOCOL_RUN = 0x05,
+	CMD_OP_ADV_POLICY = 0x06,
+	CMD_OP_SESSION = 0x07,
+	CMD_OP_DETECT = 0x08,
+	CMD_OP_STATE = 0x81,
+} cmd_opcode_t;
+
+typedef enum {
+	CMD_OK = 0,
+	CMD_ERR_EMPTY,
+	CMD_ERR_FORMAT,
+	CMD_ERR_VERSION,
+	CMD_ERR_LENGTH,
+	CMD_ERR_CRC,
+	CMD_ERR_OPCODE,
+	CMD_ERR_RANGE,
+	CMD_ERR_NOT_FOUND,
+	CMD_ERR_STORAGE,
+	CMD_ERR_PERMISSION,
+} cmd_status_t;
+
+typedef enum {
+	CMD_FORMAT_NONE = 0,
+	CMD_FORMAT_ASCII,
+	CMD_FORMAT_BINARY,
+} cmd_format_t;
+
+/**
+ * @brief Stimulation settings carried by the protocol.
+ */
+typedef struct {
+	uint32_t amplitude;
+	uint32_t frequency;
+	uint32_t pulseWidth;
+	uint8_t activateOnDisconnect;
+	uint8_t phases;
+	uint32_t interphaseGap;
+	uint32_t burstCount;
+	uint32_t burstRest;
+} cmd_settings_t;
+
+/**
+ * @brief A decoded command.
+ *
+ * value[i] is valid when bit i of mask is set. For a batch, mask is the
+ * union of the entries' masks and value[i] the last value given for field
+ * i; walk the entries with cmd_next() to apply them.
+ */
+typedef struct {
+	cmd_format_t format;
+	uint8_t opcode;
+	uint8_t seq;
+	uint16_t mask;
+	uint8_t count;         ///< Commands carried: 1 for SET, entries for BATCH.
+	uint16_t bodyLen;      ///< Batch entries, in the buffer given to
+	const uint8_t *body;   ///< cmd_decode(), which must outlive cmd_next().
+	uint32_t value[CMD_FIELD_COUNT];
+} cmd_t;
+
+/**
+ * @brief Decode one nodeRx write.
+ *
+ * Reads the value in place; neither copies nor modifies data.
+ *
+ * @param[in] data Attribute value.
+ * @param[in] len Number of bytes in data.
+ * @param[out] cmd Decoded command. format is set whenever the encoding was
+ *                 recognised, even if decoding later failed.
+ * @return CMD_OK or the reason the write was rejected.
+ */
+cmd_status_t cmd_decode(const uint8_t *data, size_t len, cmd_t *cmd);
+
+/**
+ * @brief Step through the commands carried by a decoded write.
+ *
+ * A SET yields itself once; a BATCH yields each entry, as a SET, in order.
+ * Entries were validated by cmd_decode().
+ *
+ * @param[in] cmd Command returned by cmd_decode() with CMD_OK.
+ * @param[in,out] pos Iterator state, 0 before the first call.
+ * @param[out] sub Next command.
+ * @return false once every command has been returned.
+ */
+bool cmd_next(const cmd_t *cmd, size_t *pos, cmd_t *sub);
+
+/**
+ * @brief Settings after a reset: stimulation unconfigured, monophasic.
+ */
+void cmd_settings_init(cmd_settings_t *settings);
+
+/**
+ * @brief Apply the fields of a decoded SET command to settings.
+ *
+ * @return true if the LED field requested a toggle.
+ */
+bool cmd_apply(const cmd_t *cmd, cmd_settings_t *settings);
+
+/**
+ * @brief Encode a binary SET frame from cmd->mask and cmd->value.
+ *
+ * Used by host-side clients; the firmware only decodes SET frames.
+ *
+ * @return Frame length, or 0 if out is too small.
+ */
+size_t cmd_encode_set(uint8_t seq, const cmd_t *cmd, uint8_t *out,
+		size_t size);
+
+/**
+ * @brief Encode a binary BATCH frame from the masks and values of cmds.
+ *
+ * @return Frame length, or 0 if out is too small or count exceeds
+ *         CMD_BATCH_MAX.
+ */
+size_t cmd_encode_batch(uint8_t seq, const cmd_t *cmds, size_t count,
+		uint8_t *out, size_t size);
+
+/**
+ * @brief Encode a binary STATE reply.
+ *
+ * @return Frame length, or 0 if out is too small.
+ */
+size_t cmd_encode_state(uint8_t seq, cmd_status_t status,
+		const cmd_settings_t *settings, uint8_t *out, size_t size);
+
+/**
+ * @brief Format settings as the legacy "_A%u,F%u,P%u,G%u" string.
+ *
+ * The output is NUL terminated and truncated to fit size.
+ *
+ * @return String length, excluding the terminator.
+ */
+size_t cmd_format_ascii(const cmd_settings_t *settings, char *out,
+		size_t size);
+
+/**
+ * @brief CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF).
+ */
+uint16_t cmd_crc16(const uint8_t *data, size_t len);
+
+#endif // CMD_PROTO_H
@@ -5,4 +5,182 @@
 #define LED_INSTANCE            SL_SIMPLE_LED_INSTANCE(0)
 #define TOOGLE_DELAY_MS         500
 
+// BLE characteristic sizes. Requirements on the project's GATT configuration
+// (gatt_configuration.btconf, not in this tree): nodeRx and nodeTx must be
+// declared at least this long, or the stack truncates longer writes.
+#define NODE_RX_MAX_SIZE        255 // batches, see cmd_proto.h
+#define NODE_TX_MAX_SIZE        48
+#define DIAGNOSTICS_MAX_SIZE    32 // optional, see conn_tuning.h
+
+// Concurrent centrals (session.c): one controller, the others observers
+#define SESSION_MAX_CONNECTIONS    4  // SL_BT_CONFIG_MAX_CONNECTIONS
+
+// Coalesced notifications (notify.c)
+#define NOTIFY_MAX_CONNECTIONS     SESSION_MAX_CONNECTIONS
+#define NOTIFY_MAX_CHARACTERISTICS 1  // registered: nodeTx
+#define NOTIFY_MAX_VALUE_SIZE      NODE_TX_MAX_SIZE
+
+// Kernel build tasks (tasks.c), with the FreeRTOS kernel component only.
+// CMSIS-RTOS2 priorities; stacks come from the heap (SL_HEAP_SIZE).
+#define TASKS_STIM_PRIORITY     osPriorityRealtime
+#define TASKS_STIM_STACK_SIZE   1536    // bytes; NVM3 reads on protocol start
+#define TASKS_ACQ_PRIORITY      osPriorityHigh
+#define TASKS_ACQ_STACK_SIZE    1024
+#define TASKS_ACQ_POLL_MS       5       // partial frames and TX buffer retries
+#define TASKS_CONTROL_PRIORITY  osPriorityNormal
+#define TASKS_CONTROL_STACK_SIZE 2560
+#define TASKS_CONTROL_POLL_MS   10      // timers polled by the superloop
+#define TASKS_EVENT_QUEUE_LENGTH 4      // power of two, Bluetooth events
+#define TASKS_REPORT_INTERVAL_MS 10000
+
+// Deferred binary log (dlog.c)
+#define DLOG_RING_WORDS         512     // power of two, 4 bytes each
+#define DLOG_STREAM_MAX_SIZE    244     // optional, see dlog.h
+
+// Bluetooth event trace (trace.c); 0 compiles the recording out
+#ifndef TRACE_ENABLE
+#define TRACE_ENABLE            0
+#endif
+#ifndef TRACE_VCOM
+#define TRACE_VCOM              0       // 1: the trace, not the log, on VCOM
+#endif
+#define TRACE_BUFFER_SIZE       16384   // bytes of RAM
+#define TRACE_STREAM_MAX_SIZE   244     // optional, see trace.h
+
+// Cycle-count profiler (prof.c); 0 compiles the instrumentation out
+#ifndef PROF_ENABLE
+#define PROF_ENABLE             0
+#endif
+#define PROF_MAX_EVENTS         16      // distinct Bluetooth event IDs
+#define PROF_REPORT_INTERVAL_MS 2000
+#define PROF_MAX_SIZE           56      // optional, see prof.h
+
+// CRC-32 kernel (crc32.c): 1 uses a 1 KB flash table, 8 adds 7 KB of RAM
+// tables for about four times the throughput. CRC32_GPCRC feeds the GPCRC
+// peripheral a word at a time instead (target only, emlib_gpcrc).
+#ifndef CRC32_SLICES
+#define CRC32_SLICES            1
+#endif
+#ifndef CRC32_GPCRC
+#define CRC32_GPCRC             1
+#endif
+
+// Boot sequence (boot.c)
+#define BOOT_STACK_TIMEOUT_MS   2000    // boot event, else logged as failed
+#define BOOT_RHS2116_TIMEOUT_MS 100     // per identification
+#define BOOT_RHS2116_ATTEMPTS   5
+#define BOOT_RHS2116_RETRY_MS   50      // between identifications
+#define BOOT_REPORT_MAX_SIZE    32      // optional, see boot.h
+
+// Stimulation telemetry (telemetry.c)
+#define TELEMETRY_STEP_NA       1000    // stimulation current per DAC code
+#define TELEMETRY_SLACK_US      100     // train start-up, not counted missed
+#define TELEMETRY_REPORT_INTERVAL_MS 2000 // refresh while connected
+#define TELEMETRY_MAX_SIZE      64      // optional, see telemetry.h
+
+// Delta OTA (ota_delta.c), written to bootloader storage slot 0
+#define OTA_DELTA_MAX_SIZE      244     // optional, CONN_TUNING_MAX_MTU - 3
+#define OTA_DELTA_FIFO_SIZE     2048    // power of two, patch bytes in flight
+#define OTA_DELTA_STEP_BYTES    1024    // flash written per superloop pass
+#define OTA_DELTA_SLOT          0
+#define OTA_DELTA_REBOOT_DELAY_MS 500
+
+// RHS2116 on the spi_inst SPIDRV instance (rhs2116.c); must match
+// SL_SPIDRV_SPI_INST_BITRATE
+#define RHS2116_SPI_BITRATE     12000000
+
+// RHS2116 acquisition streamed on acq_stream (acq.c)
+#define ACQ_SAMPLE_RATE_HZ      1000    // sweeps per second
+#define ACQ_CHANNEL_MASK        0xFFFF  // channels converted every sweep
+#define ACQ_RING_SWEEPS         128     // sweeps waiting for the packer
+#define ACQ_FRAME_MAX_SWEEPS    64
+#define ACQ_FRAME_LATENCY_MS    50      // send a partial frame after this
+#define ACQ_STATS_INTERVAL_MS   1000
+#define ACQ_STREAM_MAX_SIZE     244     // CONN_TUNING_MAX_MTU - 3
+#define ACQ_STATS_MAX_SIZE      40      // optional, see acq.h
+#define ACQ_TIMER               TIMER2            // 16-bit sweep clock
+#define ACQ_TIMER_CLOCK         cmuClock_TIMER2
+#define ACQ_TIMER_IRQn          TIMER2_IRQn
+#define ACQ_TIMER_IRQHandler    TIMER2_IRQHandler
+
+// Closed-loop detectors on the acquired channels (detect.c); a block adds
+// up to DETECT_BLOCK_SWEEPS - 1 sweeps to the trigger latency
+#define DETECT_MAX_DETECTORS    2
+#define DETECT_BLOCK_SWEEPS     4       // even
+#define DETECT_MIN_REFRACTORY_MS 20
+
+// Filter kernels (dsp.c): 1 uses the Cortex-M33 DSP instructions, 0 the
+// reference C
+#ifndef DSP_SIMD
+#if defined(__ARM_FEATURE_DSP)
+#define DSP_SIMD                1
+#else
+#define DSP_SIMD                0
+#endif
+#endif
+
+// Power budget (power.c). Typical currents for the charge estimate, nA;
+// calibrate per board with a power analyzer.
+#define POWER_EM0_NA            1040000 // 38.4 MHz from flash
+#define POWER_EM1_NA            660000
+#define POWER_EM2_NA            1400    // LFXO sleeptimer, full RAM retention
+#define POWER_STIM_NA           80000   // engine timers and LDMA, without load
+#define POWER_ADV_EVENT_NC      6000    // one legacy advertising event, 0 dBm
+#define POWER_CONNECTED_NA      120000  // 15 ms interval, 2M PHY, idle link
+#define POWER_REPORT_INTERVAL_MS 5000   // refresh while connected
+#define POWER_REPORT_MAX_SIZE   40      // optional, see power.h
+
+// Advertising stages (adv_policy.c), intervals in 0.625 ms units; defaults
+// until replaced with CMD_OP_ADV_POLICY
+#define ADV_POLICY_FAST_INTERVAL   32     // 20 ms
+#define ADV_POLICY_FAST_MS         30000
+#define ADV_POLICY_MEDIUM_INTERVAL 244    // 152.5 ms
+#define ADV_POLICY_MEDIUM_MS       90000
+#define ADV_POLICY_SLOW_INTERVAL   1636   // 1022.5 ms, until connected
+#define ADV_POLICY_NVM3_KEY        0x01010
+
+// Settings store (settings_store.c): commit once writes pause, but within
+// the maximum delay of the first change
+#define SETTINGS_STORE_NVM3_KEY     0x01011
+#define SETTINGS_STORE_QUIET_MS     500
+#define SETTINGS_STORE_MAX_DELAY_MS 5000
+
+// Protocol store (protocol.c), in the NVM3 application key range
+#define PROTOCOL_NVM3_KEY_BASE  0x01000
+
+// Connection targets requested from the central (conn_tuning.c)
+#define CONN_TUNING_PHY          0x2  // preferred: 2M
+#define CONN_TUNING_PHY_ACCEPTED 0xFF // accept whatever the central insists on
+#define CONN_TUNING_TX_OCTETS    251  // data length extension maximum
+#define CONN_TUNING_TX_TIME_US   2120 // 251 octets on 1M, the safe upper bound
+#define CONN_TUNING_MAX_MTU      247  // 244-byte notifications/writes
+#define CONN_TUNING_INTERVAL_MIN 6    // 7.5 ms (x 1.25 ms)
+#define CONN_TUNING_INTERVAL_MAX 12   // 15 ms
+#define CONN_TUNING_LATENCY      0
+#define CONN_TUNING_TIMEOUT      100  // 1 s (x 10 ms)
+// nodeRx writes stamped on arrival and not yet handled; power of two, more
+// than TASKS_EVENT_QUEUE_LENGTH
+#define CONN_TUNING_STAMPS       8
+
+// Stimulation pulse engine (stim.c)
+#define STIM_TIMER              TIMER0            // 32-bit, PWM on CC1/CC2
+#define STIM_TIMER_CLOCK        cmuClock_TIMER0
+#define STIM_COUNTER            TIMER1            // pulse counter
+#define STIM_COUNTER_CLOCK      cmuClock_TIMER1
+#define STIM_COUNTER_IRQn       TIMER1_IRQn
+#define STIM_COUNTER_IRQHandler TIMER1_IRQHandler
+#define STIM_OUT_PORT           gpioPortA
+#define STIM_OUT_PIN            5                 // phase A
+#define STIM_OUT_B_PORT         gpioPortA
+#define STIM_OUT_B_PIN          6                 // phase B
+#define STIM_PRS_CH_PULSE       0
+#define STIM_PRS_CH_STOP        1
+#define STIM_PRS_SIGNAL_PULSE   prsSignalTIMER0_CC1
+#define STIM_PRS_SIGNAL_PULSE_B prsSignalTIMER0_CC2
+#define STIM_PRS_SIGNAL_STOP    prsSignalTIMER1_OF
+#define STIM_LDMA_SIGNAL        ldmaPeripheralSignal_TIMER0_UFOF
+#define STIM_LDMA_CH_TOP        0
+#define STIM_LDMA_CH_CC_A       1
+#define STIM_LDMA_CH_CC_B       2
+
 #endif // CONFIG_H
@@ -0,0 +1,279 @@
+/***************************************************************************//**
+ * @file conn_tuning.c
+ * @brief Connection parameter negotiation and link diagnostics.
+ ******************************************************************************/
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "byteorder.h"
+#include "config.h"
+#include "conn_tuning.h"
+#include "dlog.h"
+#include "em_device.h"
+#include "gatt_db.h"
+#include "session.h"
+#include "sl_bluetooth.h"
+
+#ifdef gattdb_diagnostics
+_Static_assert(DIAGNOSTICS_MAX_SIZE >= CONN_DIAG_SIZE,
+		"diagnostics characteristic must hold the record");
+#endif
+
+_Static_assert((CONN_TUNING_STAMPS & (CONN_TUNING_STAMPS - 1)) == 0,
+		"CONN_TUNING_STAMPS must be a power of two");
+_Static_assert(CONN_TUNING_STAMPS > TASKS_EVENT_QUEUE_LENGTH,
+		"a stamp for every queued write and the one being handled");
+
+typedef struct {
+	uint32_t cycles;
+	uint8_t connection;
+} stamp_t;
+
+// One entry per open connection. A closed one keeps its values, marked
+// CONN_TUNING_NO_CONNECTION, until the entry is reused.
+static conn_tuning_stats_t links[SESSION_MAX_CONNECTIONS];
+// The entry opened or closed last, reported while there is no controller.
+static conn_tuning_stats_t *recent;
+// What a connection has before it negotiates anything.
+static const conn_tuning_stats_t initial = {
+	.connection = CONN_TUNING_NO_CONNECTION, .phy = 1, .mtu = 23,
+	.txOctets = 27, .rxOctets = 27
+};
+// Each nodeRx write on arrival, in arrival order. Written by the stack's
+// event context, read where the events are handled; a stamp overwritten
+// before it is handled is not measured.
+static stamp_t stamps[CONN_TUNING_STAMPS];
+static _Atomic uint32_t stamped;
+static uint32_t handled;        // consumer only
+
+static conn_tuning_stats_t* find(uint8_t connection) {
+	if (connection == CONN_TUNING_NO_CONNECTION) {
+		return NULL;
+	}
+	for (size_t i = 0; i < SESSION_MAX_CONNECTIONS; i++) {
+		if (links[i].connection == connection) {
+			return &links[i];
+		}
+	}
+	return NULL;
+}
+
+static void publish(void) {
+#ifdef gattdb_diagnostics
+	uint8_t record[CONN_DIAG_SIZE];
+	size_t len = conn_tuning_encode(record, sizeof(record));
+	sl_status_t sc = sl_bt_gatt_server_write_attribute_value(
+			gattdb_diagnostics, 0, len, record);
+	if (sc != SL_STATUS_OK) {
+		DLOG(DLOG_DIAG_FAILED, sc);
+	}
+#endif
+}
+
+// Ask the central for the configured targets. Each request is independent;
+// a refusal only means that parameter stays at the central's choice.
+static void requestTargets(uint8_t connection) {
+	sl_status_t sc;
+
+	sc = sl_bt_connection_set_preferred_phy(connection, CONN_TUNING_PHY,
+			CONN_TUNING_PHY_ACCEPTED);
+	if (sc != SL_STATUS_OK) {
+		DLOG(DLOG_PHY_REQUEST_FAILED, sc);
+	}
+	sc = sl_bt_connection_set_data_length(connection, CONN_TUNING_TX_OCTETS,
+			CONN_TUNING_TX_TIME_US);
+	if (sc != SL_STATUS_OK) {
+		DLOG(DLOG_DLE_REQUEST_FAILED, sc);
+	}
+	sc = sl_bt_connection_set_parameters(connection,
+			CONN_TUNING_INTERVAL_MIN, CONN_TUNING_INTERVAL_MAX,
+			CONN_TUNING_LATENCY, CONN_TUNING_TIMEOUT, 0, 0xFFFF);
+	if (sc != SL_STATUS_OK) {
+		DLOG(DLOG_INTERVAL_REQUEST_FAILED, sc);
+	}
+}
+
+void conn_tuning_init(void) {
+	// Latency is timed on the cycle counter, with or without prof.c.
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	for (size_t i = 0; i < SESSION_MAX_CONNECTIONS; i++) {
+		links[i] = initial;
+	}
+	recent = &links[0];
+	stamped = 0;
+	handled = 0;
+}
+
+void conn_tuning_on_event(const sl_bt_msg_t *evt) {
+	conn_tuning_stats_t *link;
+	sl_status_t sc;
+
+	switch (SL_BT_MSG_ID(evt->header)) {
+	case sl_bt_evt_system_boot_id: {
+		// The MTU exchange is started by the central; offer our largest.
+		uint16_t maxMtu;
+		sc = sl_bt_gatt_server_set_max_mtu(CONN_TUNING_MAX_MTU, &maxMtu);
+		if (sc != SL_STATUS_OK) {
+			DLOG(DLOG_MTU_NOT_SET, sc);
+		}
+		publish();
+		break;
+	}
+
+	case sl_bt_evt_connection_opened_id: {
+		uint8_t connection = evt->data.evt_connection_opened.connection;
+		// A free entry; the stack refuses connections beyond its table.
+		link = find(connection);
+		for (size_t i = 0; link == NULL && i < SESSION_MAX_CONNECTIONS; i++) {
+			if (links[i].connection == CONN_TUNING_NO_CONNECTION) {
+				link = &links[i];
+			}
+		}
+		if (link == NULL) {
+			break;
+		}
+		*link = initial;
+		link->connection = connection;
+		recent = link;
+		requestTargets(connection);
+		publish();
+		break;
+	}
+
+	case sl_bt_evt_connection_closed_id:
+		link = find(evt->data.evt_connection_closed.connection);
+		if (link) {
+			// Keep the last values readable until the entry is reused.
+			link->connection = CONN_TUNING_NO_CONNECTION;
+			recent = link;
+			publish();
+		}
+		break;
+
+	case sl_bt_evt_connection_parameters_id:
+		link = find(evt->data.evt_connection_parameters.connection);
+		if (link) {
+			link->interval = evt->data.evt_connection_parameters.interval;
+			link->latency = evt->data.evt_connection_parameters.latency;
+			link->timeout = evt->data.evt_connection_parameters.timeout;
+			DLOG(DLOG_CONN_INTERVAL, link->interval, link->latency);
+			publish();
+		}
+		break;
+
+	case sl_bt_evt_connection_phy_status_id:
+		link = find(evt->data.evt_connection_phy_status.connection);
+		if (link) {
+			link->phy = evt->data.evt_connection_phy_status.phy;
+			DLOG(DLOG_CONN_PHY, link->phy);
+			publish();
+		}
+		break;
+
+	case sl_bt_evt_connection_data_length_id:
+		link = find(evt->data.evt_connection_data_length.connection);
+		if (link) {
+			link->txOctets = evt->data.evt_connection_data_length.tx_data_len;
+			link->rxOctets = evt->data.evt_connection_data_length.rx_data_len;
+			DLOG(DLOG_CONN_DATA_LENGTH, link->txOctets, link->rxOctets);
+			publish();
+		}
+		break;
+
+	case sl_bt_evt_gatt_mtu_exchanged_id:
+		link = find(evt->data.evt_gatt_mtu_exchanged.connection);
+		if (link) {
+			link->mtu = evt->data.evt_gatt_mtu_exchanged.mtu;
+			DLOG(DLOG_CONN_MTU, link->mtu);
+			publish();
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+void conn_tuning_write_received(const sl_bt_msg_t *evt) {
+	if (SL_BT_MSG_ID(evt->header) != sl_bt_evt_gatt_server_attribute_value_id
+			|| evt->data.evt_gatt_server_attribute_value.attribute
+					!= gattdb_node_rx) {
+		return;
+	}
+	uint32_t n = atomic_load_explicit(&stamped, memory_order_relaxed);
+	stamp_t *stamp = &stamps[n & (CONN_TUNING_STAMPS - 1)];
+	stamp->cycles = DWT->CYCCNT;
+	stamp->connection = evt->data.evt_gatt_server_attribute_value.connection;
+	atomic_store_explicit(&stamped, n + 1, memory_order_release);
+}
+
+void conn_tuning_write_applied(bool applied) {
+	uint32_t n = atomic_load_explicit(&stamped, memory_order_acquire);
+	uint32_t h = handled;
+
+	if (n == h) {
+		return; // not stamped, e.g. handled without sl_bt_on_event()
+	}
+	stamp_t stamp = stamps[h & (CONN_TUNING_STAMPS - 1)];
+	uint32_t now = DWT->CYCCNT;
+	handled = h + 1;
+	// The slot is read first, then checked for reuse meanwhile.
+	if (!applied || atomic_load_explicit(&stamped, memory_order_acquire) - h
+			> CONN_TUNING_STAMPS) {
+		return;
+	}
+	// Rounded up: a write that took any time at all never reads as 0.
+	uint32_t mhz = SystemCoreClockGet() / 1000000u;
+	uint32_t cycles = now - stamp.cycles;
+	uint32_t us = mhz ? cycles / mhz + (cycles % mhz != 0) : cycles;
+	conn_tuning_stats_t *link = find(stamp.connection);
+
+	if (link == NULL) {
+		return;
+	}
+	link->lastLatencyUs = us;
+	if (link->samples == 0 || us < link->minLatencyUs) {
+		link->minLatencyUs = us;
+	}
+	if (us > link->maxLatencyUs) {
+		link->maxLatencyUs = us;
+	}
+	link->samples++;
+	publish();
+}
+
+const conn_tuning_stats_t* conn_tuning_get(uint8_t connection) {
+	const conn_tuning_stats_t *link = find(connection);
+	return link ? link : &initial;
+}
+
+const conn_tuning_stats_t* conn_tuning_get_controller(void) {
+	const conn_tuning_stats_t *link = find(session_controller());
+	return link ? link : recent;
+}
+
+size_t conn_tuning_encode(uint8_t *out, size_t size) {
+	if (size < CONN_DIAG_SIZE) {
+		return 0;
+	}
+	const conn_tuning_stats_t *stats = conn_tuning_get_controller();
+
+	memset(out, 0, CONN_DIAG_SIZE);
+	out[0] = CONN_DIAG_VERSION;
+	out[1] = stats->connection;
+	out[2] = stats->phy;
+	put_le16(&out[4], stats->interval);
+	put_le16(&out[6], stats->latency);
+	put_le16(&out[8], stats->timeout);
+	put_le16(&out[10], stats->mtu);
+	put_le16(&out[12], stats->txOctets);
+	put_le16(&out[14], stats->rxOctets);
+	put_le32(&out[16], stats->lastLatencyUs);
+	put_le32(&out[20], stats->minLatencyUs);
+	put_le32(&out[24], stats->maxLatencyUs);
+	put_le32(&out[28], stats->samples);
+	return CONN_DIAG_SIZE;
+}
@@ -0,0 +1,115 @@
+/***************************************************************************//**
+ * @file conn_tuning.h
+ * @brief Connection parameter negotiation and link diagnostics.
+ *
+ * On every new connection the peripheral asks the central for the targets in
+ * config.h: 2M PHY, data length extension, the largest ATT MTU and a short
+ * connection interval. What the central actually grants is recorded from
+ * the stack events, together with the time from a nodeRx write event to
+ * the command taking effect, and published on the diagnostics
+ * characteristic when the GATT database has one.
+ *
+ * The write-to-apply time runs on the DWT cycle counter from the moment
+ * sl_bt_on_event() receives the write, before any other handler runs or
+ * the kernel build queues the event for the control task, until the
+ * command has been applied, rounded up to whole microseconds.
+ *
+ * Every connection has its own values, so a stream is sized by the MTU of
+ * the connection it is sent on. The diagnostics record and the telemetry
+ * describe the controller's connection (session.h), or without one the
+ * connection that opened or closed last.
+ ******************************************************************************/
+#ifndef CONN_TUNING_H
+#define CONN_TUNING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sl_bluetooth.h"
+
+#define CONN_TUNING_NO_CONNECTION 0xFF
+
+/**
+ * Diagnostics record of the controller's connection, little-endian:
+ *
+ *   offset  size  field
+ *   0       1     CONN_DIAG_VERSION
+ *   1       1     connection handle, CONN_TUNING_NO_CONNECTION if none
+ *   2       1     PHY (1 = 1M, 2 = 2M, 4 = coded)
+ *   3       1     reserved
+ *   4       2     connection interval, 1.25 ms units
+ *   6       2     peripheral latency, connection events
+ *   8       2     supervision timeout, 10 ms units
+ *   10      2     ATT MTU
+ *   12      2     link layer TX payload, octets
+ *   14      2     link layer RX payload, octets
+ *   16      4     last write-to-apply latency, us
+ *   20      4     minimum write-to-apply latency, us
+ *   24      4     maximum write-to-apply latency, us
+ *   28      4     writes measured
+ */
+#define CONN_DIAG_VERSION       1
+#define CONN_DIAG_SIZE          32
+
+/**
+ * @brief Parameters in effect on a connection.
+ */
+typedef struct {
+	uint8_t connection;     ///< CONN_TUNING_NO_CONNECTION once closed.
+	uint8_t phy;            ///< sl_bt_gap_phy_t of the TX direction.
+	uint16_t interval;      ///< 1.25 ms units.
+	uint16_t latency;       ///< Connection events the peripheral may skip.
+	uint16_t timeout;       ///< 10 ms units.
+	uint16_t mtu;           ///< ATT MTU.
+	uint16_t txOctets;      ///< Link layer TX payload.
+	uint16_t rxOctets;      ///< Link layer RX payload.
+	uint32_t lastLatencyUs; ///< Most recent write-to-apply time.
+	uint32_t minLatencyUs;
+	uint32_t maxLatencyUs;
+	uint32_t samples;       ///< Writes measured on this connection.
+} conn_tuning_stats_t;
+
+/**
+ * @brief Clear the connections and start the cycle counter. Call once from
+ *        app_init().
+ */
+void conn_tuning_init(void);
+
+/**
+ * @brief Pass every stack event. Requests the targets on connection
+ *        opened and records the negotiated values as they are reported.
+ */
+void conn_tuning_on_event(const sl_bt_msg_t *evt);
+
+/**
+ * @brief Stamp a nodeRx write as it arrives; other events are ignored.
+ *        Call first thing in sl_bt_on_event().
+ */
+void conn_tuning_write_received(const sl_bt_msg_t *evt);
+
+/**
+ * @brief The oldest stamped nodeRx write has been handled. With applied,
+ *        record the time since its stamp; call without for a long write
+ *        fragment that does not complete the value.
+ */
+void conn_tuning_write_applied(bool applied);
+
+/**
+ * @brief Values for an open connection; for any other handle, those of a
+ *        connection that has negotiated nothing yet (MTU 23, 1M PHY).
+ */
+const conn_tuning_stats_t* conn_tuning_get(uint8_t connection);
+
+/**
+ * @brief Values for the controller's connection, or for the connection that
+ *        opened or closed last when there is no controller.
+ */
+const conn_tuning_stats_t* conn_tuning_get_controller(void);
+
+/**
+ * @brief Encode the diagnostics record.
+ *
+ * @return CONN_DIAG_SIZE, or 0 if out is too small.
+ */
+size_t conn_tuning_encode(uint8_t *out, size_t size);
+
+#endif // CONN_TUNING_H
@@ -0,0 +1,35 @@
+/***************************************************************************//**
+ * @file crc32.h
+ * @brief CRC-32 (IEEE 802.3, reflected poly 0xEDB88320) as used by GBL files.
+ *
+ * crc32() continues a running value the way zlib does: start with 0 and
+ * feed the data in as many pieces as convenient. The table kernel looks
+ * up one byte at a time in a 1 KB constant table. With CRC32_SLICES set to
+ * 8 in config.h it processes eight bytes per step with seven more tables
+ * built in RAM on first use (7 KB), several times faster on hosts and on
+ * large images. With CRC32_GPCRC, the default on the target, the GPCRC
+ * peripheral computes it a word at a time instead; crc32() then uses the
+ * peripheral and must only be called from one task at a time.
+ ******************************************************************************/
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Continue a CRC-32 over data, with the configured kernel.
+ *
+ * @param[in] crc Value returned for the preceding data, 0 to start.
+ * @return CRC-32 of everything fed so far.
+ */
+uint32_t crc32(uint32_t crc, const void *data, size_t len);
+
+/**
+ * @brief Reference kernels, one bit and one table lookup per byte.
+ *        Same results as crc32(); for tests and benchmarks.
+ */
+uint32_t crc32_bitwise(uint32_t crc, const void *data, size_t len);
+uint32_t crc32_bytewise(uint32_t crc, const void *data, size_t len);
+
+#endif // CRC32_H
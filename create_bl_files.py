@@ -7,6 +7,10 @@ import shutil
 import time
 import argparse
 import builtins
+import hashlib
+import json
+import threading
+from concurrent.futures import ThreadPoolExecutor, FIRST_COMPLETED, wait
 import tkinter as tk
 from tkinter import filedialog as fd
 from pathlib import Path
@@ -27,6 +31,8 @@ COMPRESS_GBLS = True
 PURGE_SRECS = True
 VERBOSE = False
 OUTDIR = 'output_gbl'
+JOBS = os.cpu_count() or 1         # parallel commander calls
+CACHE_F = '.gbl_cache.json'        # in OUTDIR, see build_all()
 
 # Artifacts the script will looking for
 BOOT_S1_F = 'bootloader-second-stage.s37'
@@ -70,6 +76,12 @@ class lvl:
 BOOT_EXIST = False
 ENCRYPT_KEY_EXIST = False
 
+# Build graph, filled by generate_gbls() and run by build_all()
+STEPS = []           # in planning order
+STEP_RECIPES = {}    # recipe hash -> step, so an srec is derived only once
+STEP_OUTPUTS = {}    # output path -> step, including deduplicated names
+PRINT_LOCK = threading.Lock()
+
 # Functions
 def print(level, *args, **kwargs):
     """Print function
@@ -77,21 +89,24 @@ def print(level, *args, **kwargs):
     Override built in print function to display information in the following format (with colors):
     [   OK   ] Operation Finished.
     
+    Lines from parallel build steps are kept whole.
+
     :param level: INFO, OK, WARNING or ERROR levels, see definition of lvl class
     :type level: lvl enumerator class
     """
-    if level == lvl.INFO:
-        builtins.print(" " * 12, end="")
-    else:
-        builtins.print("[", end="")
-        if level == lvl.OKAY:
-            builtins.print(ansi.gn + "   OK   ", end="")
-        elif level == lvl.WARN:
-            builtins.print(ansi.yl + "WARNING ", end="")
-        elif level == lvl.ERR:
-            builtins.print(ansi.rd + " ERROR  ", end="")
-        builtins.print(ansi.cl + "]: ", end="")
-    builtins.print(*args, **kwargs, flush=True)
+    with PRINT_LOCK:
+        if level == lvl.INFO:
+            builtins.print(" " * 12, end="")
+        else:
+            builtins.print("[", end="")
+            if level == lvl.OKAY:
+                builtins.print(ansi.gn + "   OK   ", end="")
+            elif level == lvl.WARN:
+                builtins.print(ansi.yl + "WARNING ", end="")
+            elif level == lvl.ERR:
+                builtins.print(ansi.rd + " ERROR  ", end="")
+            builtins.print(ansi.cl + "]: ", end="")
+        builtins.print(*args, **kwargs, flush=True)
 
 
 def print_question(question, delay=0.5):
@@ -524,22 +539,24 @@ def extract_to_srec(srec_name, remove_sections, out_path, only_section=False):
 
 
 def convert_srec(srec_list, srec_out_name, signature=None, with_crc=False):
-    """Converter function that converts and/or merges srec file(s) into new srec.
+    """Converter step that converts and/or merges srec file(s) into new srec.
 
     Merge a list of srec files into one.
     Optionally converts unprotected srec files to crc-protected srec or signed srec files.
     These two types required to generate crc-protected or signed GBLs.
+    The conversion is only queued, see add_step(). Asking twice for the same conversion
+    returns the first step, so e.g. the signed srec is made once for all GBLs that use it.
 
-    :param srec_list: list of the input .srec filepaths that has to be merged
-    :type srec_list: str list
+    :param srec_list: list of the input .srec filepaths or build steps that has to be merged
+    :type srec_list: lst
     :param srec_out_name: the name of the output .srec file (without extension)
     :type srec_out_name: str
     :param signature: signature .pem filepath, defaults to None
     :type signature: str, optional
     :param with_crc: enable crc32 protect for output .srec, defaults to False
     :type with_crc: bool, optional
-    :return: output .srec filepath
-    :rtype: str
+    :return: build step of the output .srec
+    :rtype: build_step
     """
     srec_out = reformat_path(os.path.join(OUTDIR, srec_out_name))
     cmd = [COMMANDER, 'convert']
@@ -552,55 +569,32 @@ def convert_srec(srec_list, srec_out_name, signature=None, with_crc=False):
         srec_out += '-signed'
         cmd.extend(['--secureboot', '--keyfile', signature])
     srec_out += '.srec'
-    cmd.extend(['-o', srec_out])
-    response = run_cmd(cmd, verbose=VERBOSE)
-    match_res = re.search(r'Writing to', response)
-    if match_res and is_file_exist(srec_out):
-        print(lvl.INFO, " ".join(srec_list) + " converted to " + srec_out)
-        return srec_out
-    else:
-        print(lvl.WARN, "Could not convert " + " ".join(srec_list) + " to " + srec_out)
-        print(lvl.INFO, "command response:", response)
-        return None
+    cmd.append('-o')
+    return add_step(srec_out, cmd, r'Writing to')
 
 
 def convert_srec_uartdfu(srec_list, srec_out_name):
     """Merge .srec files specialized for UARTDFU GBLs
 
     Convert/merge .srec file(s) for specialized UARTDFU GBLs.
+    The inputs are outputs of steps queued before, looked up by their path.
 
     :param srec_list: list of input .srec filepaths
     :type srec_list: str list
     :param srec_out_name: name of the output .srec file (without extension)
     :type srec_out_name: str
-    :return: output .srec
-    :rtype: str
+    :return: build step of the output .srec, or None if there is nothing to merge
+    :rtype: build_step
     """
     if len(srec_list) == 2:
-        applo_srec = srec_list[0]
-        app_srec = srec_list[1]
-        if is_file_exist(applo_srec) and is_file_exist(app_srec):
-            out_srec = convert_srec([applo_srec, app_srec], srec_out_name)
-            if is_file_exist(out_srec):
-                print(lvl.OKAY, f"{applo_srec} and {app_srec} converted to {out_srec}.")
-                return out_srec
-            else:
-                print(lvl.WARN, f"Failed to convert {applo_srec} and {app_srec} to {out_srec}!")
-                return None
-        elif not is_file_exist(applo_srec) and is_file_exist(app_srec):
-            out_srec = reformat_path(os.path.join(OUTDIR, srec_out_name + '.srec'))
-            try:
-                shutil.copy(app_srec, out_srec)
-                print(lvl.OKAY, f"{app_srec} converted to {out_srec}.")
-                return out_srec
-            except shutil.SameFileError:
-                print(lvl.ERR, "Source and destination files are the same! Aborting.")
-            except PermissionError:
-                print(lvl.ERR, "Permission denied!")
-            except Exception as ex:
-                print(lvl.ERR, f"Exception occured during execution of shutil.copy()!")
-                print(lvl.ERR, f"{ex}\n")
-            return None
+        applo_srec = STEP_OUTPUTS.get(srec_list[0])
+        app_srec = STEP_OUTPUTS.get(srec_list[1])
+        if applo_srec is not None and app_srec is not None:
+            return convert_srec([applo_srec, app_srec], srec_out_name)
+        elif applo_srec is None and app_srec is not None:
+            # Without an apploader the application srec is the whole image.
+            print(lvl.INFO, f"No {srec_list[0]}, {srec_list[1]} used as it is.")
+            return app_srec
         else:
             print(lvl.INFO, "Invalid .srec file list! None of the record contains actual files!")
             return None
@@ -653,15 +647,16 @@ def key_gen(key_name, encrypt_type='aes-ccm'):
 def create_gbl_file(gbl_name, app_data, app_encrypt=None, app_sign=None, boot=None, cpress_a='', crc=False):
     """Create GBL file function
 
-    Builds up and initiates GBL generator command for simplicity commander based on the input parameters.
+    Builds up and queues the GBL generator command for simplicity commander based on the input parameters.
     It is capable of the generation of: signed, encrypted, compressed and crc-protected GBL files.
+    The GBL is written by build_all().
 
 
     :param gbl_name: Base name of the output gbl file (without extension), postfixes will be added automatically: 
                      signed, encrypted versions will get -signed and/or -encrypted postfixes etc.
     :type gbl_name: str
-    :param app_data: application data filepath (.srec or .gbl)
-    :type app_data: str
+    :param app_data: application data filepath (.srec or .gbl) or the build step making it
+    :type app_data: str or build_step
     :param app_encrypt: encrypt-key filepath, defaults to None
     :type app_encrypt: str, optional
     :param app_sign: signature-key filepath, defaults to None
@@ -672,11 +667,11 @@ def create_gbl_file(gbl_name, app_data, app_encrypt=None, app_sign=None, boot=No
     :type cpress_a: str, optional
     :param crc: generate protected GBL files with crc32 as well, defaults to False
     :type crc: bool, optional
-    :return: filepath to the output gbl file or None in case of errors
-    :rtype: str
+    :return: build step of the output gbl file or None in case of errors
+    :rtype: build_step
     """
     if app_data is None and boot is None:
-        print(lvl.ERR,"Could not find " + app_data + "! Aborting GBL generation!")
+        print(lvl.ERR,f"No application data for {gbl_name}! Aborting GBL generation!")
         return None
     cmd = [COMMANDER, 'gbl', 'create']
     
@@ -697,33 +692,223 @@ def create_gbl_file(gbl_name, app_data, app_encrypt=None, app_sign=None, boot=No
         cmd.extend(['--compress', cpress_a])
     gbl_name += '.gbl'
     gbl_file = reformat_path(os.path.join(OUTDIR, gbl_name))
-    cmd.insert(3, gbl_file)
-    
-    if is_file_exist(gbl_file):
-        print(lvl.WARN, ansi.yl + f"{gbl_name}" + ansi.cl + " already exists!")
-        backup_text = '_bkp' + dt.now().strftime("%Y-%m-%d-%H-%M-%S")
-        os.rename(reformat_path(os.path.join(OUTDIR, gbl_name)), 
-                  reformat_path(os.path.join(OUTDIR, gbl_name + backup_text)))
-        print(lvl.INFO, f"{gbl_name} renamed to {gbl_name + backup_text}.")
-        gbl_name = "New " + ansi.gn + gbl_name + ansi.cl
+    return add_step(gbl_file, cmd, r'Writing GBL file', target=True, out_at=3)
+
+
+class build_step:
+    """One commander call of the GBL build graph
+
+    :param output: path of the file the step writes
+    :param cmd: command, with the output path in place
+    :param deps: steps whose outputs are inputs of this one
+    :param key: hash of everything that determines the output, see add_step()
+    :param done_re: regex matched on the command response on success
+    :param target: True for GBLs, False for intermediate srecs
+    """
+    def __init__(self, output, cmd, deps, key, done_re, target):
+        self.output = output
+        self.cmd = cmd
+        self.deps = deps
+        self.key = key
+        self.done_re = done_re
+        self.target = target
+
+
+FILE_DIGESTS = {}
+
+
+def file_digest(path):
+    """sha256 of a file's content, computed once per run
+
+    :param path: filepath
+    :type path: str
+    :return: hex digest
+    :rtype: str
+    """
+    if path not in FILE_DIGESTS:
+        h = hashlib.sha256()
+        with open(path, 'rb') as f:
+            for chunk in iter(lambda: f.read(1 << 16), b''):
+                h.update(chunk)
+        FILE_DIGESTS[path] = h.hexdigest()
+    return FILE_DIGESTS[path]
+
+
+def add_step(output, cmd, done_re, target=False, out_at=None):
+    """Queue a commander call in the build graph
+
+    Build steps in cmd are replaced with their output path and become dependencies.
+    The key of the step hashes the command, the keys of the dependencies and the content
+    of every other argument that names an existing file (srecs from objcopy, keys,
+    bootloader images), so it changes whenever anything that goes into the output does.
+    An intermediate srec with the same key as an earlier one is not queued again.
+
+    :param output: output filepath
+    :type output: str
+    :param cmd: command list; the output is appended, or inserted at out_at
+    :type cmd: lst
+    :param done_re: regex of the successful command response
+    :type done_re: str
+    :param target: True for a GBL that shall be built, defaults to False
+    :type target: bool, optional
+    :param out_at: index of the output path in cmd, defaults to the end
+    :type out_at: int, optional
+    :return: build step
+    :rtype: build_step
+    """
+    deps = []
+    recipe = []
+    for i, arg in enumerate(cmd):
+        if isinstance(arg, build_step):
+            deps.append(arg)
+            recipe.append(arg.key)
+            cmd[i] = arg.output
+        elif i > 0 and os.path.isfile(arg):
+            recipe.append(file_digest(arg))
+        else:
+            recipe.append(arg)
+    key = hashlib.sha256(json.dumps(recipe).encode('utf-8')).hexdigest()
+
+    if not target and key in STEP_RECIPES:
+        step = STEP_RECIPES[key]
+        STEP_OUTPUTS[output] = step
+        return step
+    if out_at is None:
+        cmd.append(output)
     else:
-        gbl_name = ansi.gn + gbl_name + ansi.cl
-    
-    response = run_cmd(cmd, verbose=VERBOSE)
-    match_res = re.search(r'Writing GBL file', response)
-    if match_res:
-        print(lvl.OKAY, gbl_name + " generated.\n")
-        return gbl_file
+        cmd.insert(out_at, output)
+    step = build_step(output, cmd, deps, key, done_re, target)
+    STEPS.append(step)
+    STEP_OUTPUTS[output] = step
+    if not target:
+        STEP_RECIPES[key] = step
+    return step
+
+
+def run_step(step):
+    """Run the commander call of a build step, see build_all()
+
+    An existing GBL that is about to be rebuilt is kept with a backup postfix.
+
+    :param step: build step
+    :type step: build_step
+    :return: True if the output has been written
+    :rtype: bool
+    """
+    name = os.path.basename(step.output)
+    if step.target and is_file_exist(step.output):
+        print(lvl.WARN, ansi.yl + f"{name}" + ansi.cl + " already exists!")
+        backup_text = '_bkp' + dt.now().strftime("%Y-%m-%d-%H-%M-%S")
+        os.rename(step.output, step.output + backup_text)
+        print(lvl.INFO, f"{name} renamed to {name + backup_text}.")
+        name = "New " + ansi.gn + name + ansi.cl
     else:
-        return None
+        name = ansi.gn + name + ansi.cl
+
+    response = run_cmd(step.cmd, verbose=VERBOSE)
+    if re.search(step.done_re, response or '') and is_file_exist(step.output):
+        print(lvl.OKAY, name + (" generated." if step.target else " converted."))
+        return True
+    print(lvl.WARN, "Could not create " + step.output)
+    print(lvl.INFO, "command response:", response)
+    return False
+
+
+def build_all(jobs=JOBS, use_cache=True):
+    """Run the queued build steps
+
+    GBLs whose key matches the one recorded in OUTDIR/CACHE_F when they were last written are
+    up to date and skipped, and so are the srecs that only they need. The remaining steps run
+    on a pool of jobs workers as soon as their inputs are ready; a failed step skips every
+    step that depends on it.
+
+    :param jobs: number of parallel commander calls, defaults to JOBS
+    :type jobs: int, optional
+    :param use_cache: skip up to date GBLs, defaults to True
+    :type use_cache: bool, optional
+    :return: number of failed steps
+    :rtype: int
+    """
+    start = time.monotonic()
+    cache_path = reformat_path(os.path.join(OUTDIR, CACHE_F))
+    cache = {}
+    if use_cache:
+        try:
+            with open(cache_path, 'r') as f:
+                cache = json.load(f)
+        except (OSError, ValueError):
+            cache = {}
+
+    def fresh(step):
+        return cache.get(step.output) == step.key and os.path.isfile(step.output)
+
+    # Walk back from the stale GBLs to the srecs they need.
+    needed = set()
+
+    def need(step):
+        if step in needed or fresh(step):
+            return
+        needed.add(step)
+        for d in step.deps:
+            need(d)
+
+    targets = [s for s in STEPS if s.target]
+    for t in targets:
+        need(t)
+    for t in targets:
+        if t not in needed:
+            print(lvl.OKAY, ansi.gn + os.path.basename(t.output) + ansi.cl + " up to date.")
+
+    pending = {s: {d for d in s.deps if d in needed} for s in STEPS if s in needed}
+    running = {}
+    failed = []
+
+    def drop(step):
+        failed.append(step)
+        cache.pop(step.output, None)
+        for other in [o for o, waits in pending.items() if step in waits]:
+            del pending[other]
+            print(lvl.WARN, f"Skipping {os.path.basename(other.output)}!")
+            drop(other)
+
+    with ThreadPoolExecutor(max_workers=max(1, jobs)) as pool:
+        while pending or running:
+            for s in [s for s, waits in pending.items() if not waits]:
+                del pending[s]
+                running[pool.submit(run_step, s)] = s
+            done, _ = wait(running, return_when=FIRST_COMPLETED)
+            for f in done:
+                s = running.pop(f)
+                if f.result():
+                    cache[s.output] = s.key
+                    for waits in pending.values():
+                        waits.discard(s)
+                else:
+                    drop(s)
+
+    try:
+        with open(cache_path, 'w') as f:
+            json.dump(cache, f, indent=1)
+    except OSError:
+        print(lvl.WARN, f"Could not write {cache_path}!")
+
+    built = len([s for s in needed if s.target]) - len([s for s in failed if s.target])
+    msg = f"{built} GBLs built, {len(targets) - len(needed & set(targets))} up to date"
+    if failed:
+        msg += ", " + ansi.rd + f"{len(failed)} steps failed" + ansi.cl
+    print(lvl.OKAY if not failed else lvl.WARN, msg + f" in {time.monotonic() - start:.1f} s.")
+    STEPS.clear()
+    STEP_RECIPES.clear()
+    STEP_OUTPUTS.clear()
+    return len(failed)
 
 
 def generate_gbls(name, srec, s1=True, boot_img=None, encrypt_k=None, sign_k=None,
                   cpress=True, cpress_m='both', uartdfu=False):
     """Generate multiple GBL files
 
-    Generate all GBL files that can be generated based on the input parameters.
-    It also differentiate between Series-1 and Series-2 devices.
+    Queue all GBL files that can be generated based on the input parameters; build_all()
+    generates them. It also differentiate between Series-1 and Series-2 devices.
     Apploader GBLs for example can only be used for Series-1 devices!
 
     :param name: base name for the GBL files
@@ -771,7 +956,7 @@ def generate_gbls(name, srec, s1=True, boot_img=None, encrypt_k=None, sign_k=Non
         app_srec = reformat_path(os.path.join(OUTDIR, APPLI_N + '-crc.srec'))
 
         srec_crc = convert_srec_uartdfu([apploader_srec, app_srec], name + '-crc')
-        if not is_file_exist(srec_crc):
+        if srec_crc is None:
             print(lvl.WARN,f"Skipping {name}-crc.gbl generation!\n")
         else:
             # full-crc.gbl
@@ -781,7 +966,7 @@ def generate_gbls(name, srec, s1=True, boot_img=None, encrypt_k=None, sign_k=Non
         app_s_srec = reformat_path(os.path.join(OUTDIR, APPLI_N + '-signed.srec'))
 
         srec_signed = convert_srec_uartdfu([apploader_s_srec, app_s_srec], name + '-signed')
-        if srec_signed is None or not is_file_exist(srec_signed):
+        if srec_signed is None:
             print(lvl.WARN,f"Skipping {name}-signed.gbl generation!\n")
         else:
             # full-signed.gbl
@@ -929,6 +1114,10 @@ def main():
     parser.add_argument("-u", "--uartdfu", dest="uartdfu", action="store_true", help="create GBLs for UART DFU")
     parser.add_argument("-cpr", "--compress", dest="compress", choices=["lz4", "lzma", "both"], 
                         help="Compress GBLs with the chosen method")
+    parser.add_argument("-j", "--jobs", dest="jobs", type=int, default=JOBS, metavar="N",
+                        help=f"run N commander calls in parallel (default: {JOBS})")
+    parser.add_argument("-f", "--force", dest="force", action="store_true",
+                        help="rebuild GBLs even if their inputs have not changed")
     args = parser.parse_args()
             
     if args.outdir is not None and os.path.isdir(args.outdir):
@@ -1002,7 +1191,7 @@ def main():
     if args.interactive == True:
         SIGN, ENCRYPT, CPRESS, CPRESS_METHOD, UARTDFU = interactive_menu(separator)
     elif args.interactive == False:
-        if all(v is None or v == False for v in vars(args).values()):
+        if all(v is None or v == False for k, v in vars(args).items() if k != 'jobs'):
             print(lvl.WARN, "No argument specified, using " + ansi.yl + "--all" + ansi.cl + " meaning:")
             AUTO_KEYGEN = True
             SIGN = True
@@ -1228,6 +1417,12 @@ def main():
         generate_gbls(UARTDFU_N, uartdfu_srec, encrypt_k=ENCRYPT_F, sign_k=SIGN_F, cpress=CPRESS, 
                       cpress_m=CPRESS_METHOD, uartdfu=True)
 
+    builtins.print("")
+    print(lvl.INFO, separator)
+    print(lvl.INFO, f"Build GBLs with {args.jobs} parallel jobs ...")
+    print(lvl.INFO, separator)
+    failed = build_all(args.jobs, use_cache=not args.force)
+
     if PURGE_SRECS:
         builtins.print("")
         print(lvl.INFO,separator)
@@ -1243,6 +1438,9 @@ def main():
                 print(lvl.WARN,f"Could not erase {file}!")
         print(lvl.INFO,"Finished.")
 
+    if failed:
+        sys.exit(1)
+
 
 if __name__ == "__main__":
     main()
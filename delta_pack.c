@@ -0,0 +1,177 @@
+/***************************************************************************//**
+ * @file delta_pack.c
+ * @brief Delta and bit-pack compression of multichannel sample blocks.
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "delta_pack.h"
+
+#define HEADER_BITS (16 + 5)    // first sample and width, per channel
+
+typedef struct {
+	uint8_t *out;
+	size_t size;
+	size_t pos;                 // bytes completed
+	uint32_t acc;
+	unsigned int bits;          // pending bits in acc
+} bit_writer_t;
+
+typedef struct {
+	const uint8_t *data;
+	size_t len;
+	size_t pos;
+	uint32_t acc;
+	unsigned int bits;
+} bit_reader_t;
+
+static inline uint16_t zigzag(uint16_t cur, uint16_t prev) {
+	int16_t d = (int16_t) (uint16_t) (cur - prev);
+	return (uint16_t) ((uint16_t) (d << 1) ^ (uint16_t) (d >> 15));
+}
+
+static inline uint16_t unzigzag(uint16_t z) {
+	return (uint16_t) ((z >> 1) ^ (uint16_t) -(z & 1));
+}
+
+static inline unsigned int widthOf(uint16_t z) {
+	return z ? 32u - (unsigned int) __builtin_clz(z) : 0u;
+}
+
+// Width each channel needs for its first sweeps differences.
+static void widths(const uint16_t *samples, size_t channels, size_t sweeps,
+		uint8_t *w) {
+	memset(w, 0, channels);
+	for (size_t s = 1; s < sweeps; s++) {
+		const uint16_t *cur = samples + s * channels;
+		const uint16_t *prev = cur - channels;
+		for (size_t c = 0; c < channels; c++) {
+			unsigned int n = widthOf(zigzag(cur[c], prev[c]));
+			if (n > w[c]) {
+				w[c] = (uint8_t) n;
+			}
+		}
+	}
+}
+
+static inline void put(bit_writer_t *bw, uint32_t value, unsigned int n) {
+	bw->acc |= value << bw->bits;
+	bw->bits += n;
+	while (bw->bits >= 8) {
+		bw->out[bw->pos++] = (uint8_t) bw->acc;
+		bw->acc >>= 8;
+		bw->bits -= 8;
+	}
+}
+
+static inline bool get(bit_reader_t *br, unsigned int n, uint32_t *value) {
+	while (br->bits < n) {
+		if (br->pos >= br->len) {
+			return false;
+		}
+		br->acc |= (uint32_t) br->data[br->pos++] << br->bits;
+		br->bits += 8;
+	}
+	*value = br->acc & ((1u << n) - 1u);
+	br->acc >>= n;
+	br->bits -= n;
+	return true;
+}
+
+size_t delta_pack_fit(const uint16_t *samples, size_t channels,
+		size_t max_sweeps, size_t size) {
+	uint8_t w[DELTA_PACK_MAX_CHANNELS] = { 0 };
+	size_t budget = size * 8;
+	size_t bits = channels * HEADER_BITS;
+	size_t widthSum = 0;
+
+	if (channels == 0 || channels > DELTA_PACK_MAX_CHANNELS
+			|| max_sweeps == 0 || bits > budget) {
+		return 0;
+	}
+	// Widths only grow, so stop at the first sweep that does not fit.
+	for (size_t s = 1; s < max_sweeps; s++) {
+		const uint16_t *cur = samples + s * channels;
+		const uint16_t *prev = cur - channels;
+		for (size_t c = 0; c < channels; c++) {
+			unsigned int n = widthOf(zigzag(cur[c], prev[c]));
+			if (n > w[c]) {
+				widthSum += n - w[c];
+				w[c] = (uint8_t) n;
+			}
+		}
+		if (channels * HEADER_BITS + s * widthSum > budget) {
+			return s;
+		}
+	}
+	return max_sweeps;
+}
+
+size_t delta_pack_size(const uint16_t *samples, size_t channels,
+		size_t sweeps) {
+	uint8_t w[DELTA_PACK_MAX_CHANNELS];
+	size_t bits = channels * HEADER_BITS;
+
+	if (channels == 0 || channels > DELTA_PACK_MAX_CHANNELS || sweeps == 0) {
+		return 0;
+	}
+	widths(samples, channels, sweeps, w);
+	for (size_t c = 0; c < channels; c++) {
+		bits += (sweeps - 1) * w[c];
+	}
+	return (bits + 7) / 8;
+}
+
+size_t delta_pack_encode(const uint16_t *samples, size_t channels,
+		size_t sweeps, uint8_t *out, size_t size) {
+	uint8_t w[DELTA_PACK_MAX_CHANNELS];
+	size_t len = delta_pack_size(samples, channels, sweeps);
+
+	if (len == 0 || len > size) {
+		return 0;
+	}
+	widths(samples, channels, sweeps, w);
+	bit_writer_t bw = { .out = out, .size = size };
+	for (size_t c = 0; c < channels; c++) {
+		const uint16_t *p = samples + c;
+		put(&bw, p[0], 16);
+		put(&bw, w[c], 5);
+		if (w[c] == 0) {
+			continue;
+		}
+		for (size_t s = 1; s < sweeps; s++, p += channels) {
+			put(&bw, zigzag(p[channels], p[0]), w[c]);
+		}
+	}
+	if (bw.bits) {
+		out[bw.pos++] = (uint8_t) bw.acc;
+	}
+	return bw.pos;
+}
+
+sl_status_t delta_pack_decode(const uint8_t *data, size_t len,
+		size_t channels, size_t sweeps, uint16_t *samples) {
+	bit_reader_t br = { .data = data, .len = len };
+	uint32_t v, w;
+
+	if (channels == 0 || channels > DELTA_PACK_MAX_CHANNELS || sweeps == 0) {
+		return SL_STATUS_INVALID_PARAMETER;
+	}
+	for (size_t c = 0; c < channels; c++) {
+		uint16_t *p = samples + c;
+		if (!get(&br, 16, &v) || !get(&br, 5, &w) || w > 16) {
+			return SL_STATUS_INVALID_PARAMETER;
+		}
+		p[0] = (uint16_t) v;
+		for (size_t s = 1; s < sweeps; s++, p += channels) {
+			v = 0;
+			if (w && !get(&br, w, &v)) {
+				return SL_STATUS_INVALID_PARAMETER;
+			}
+			p[channels] = (uint16_t) (p[0] + unzigzag((uint16_t) v));
+		}
+	}
+	return SL_STATUS_OK;
+}
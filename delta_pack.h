@@ -0,0 +1,61 @@
+/***************************************************************************//**
+ * @file delta_pack.h
+ * @brief Delta and bit-pack compression of multichannel sample blocks.
+ *
+ * A block is a run of sweeps, each one 16-bit sample per channel, stored
+ * sweep by sweep. Each channel is coded on its own: the first sample raw,
+ * then the differences between consecutive samples, zigzag mapped so small
+ * changes of either sign become small numbers, and packed at the smallest
+ * width that holds the largest of them.
+ *
+ * Bitstream, LSB first, for each channel in order:
+ *
+ *   16 bits          first sample
+ *   5 bits           width w, 0 .. 16
+ *   (sweeps - 1) x w differences
+ *
+ * Differences wrap at 16 bits, so any input round-trips exactly.
+ ******************************************************************************/
+#ifndef DELTA_PACK_H
+#define DELTA_PACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sl_status.h"
+
+#define DELTA_PACK_MAX_CHANNELS 16
+
+/**
+ * @brief Largest number of leading sweeps, up to max_sweeps, whose
+ *        encoding fits in size bytes.
+ *
+ * @return Sweep count, 0 if not even one sweep fits.
+ */
+size_t delta_pack_fit(const uint16_t *samples, size_t channels,
+		size_t max_sweeps, size_t size);
+
+/**
+ * @brief Encoded size of a block, in bytes.
+ */
+size_t delta_pack_size(const uint16_t *samples, size_t channels,
+		size_t sweeps);
+
+/**
+ * @brief Encode a block.
+ *
+ * @return Bytes written, or 0 if out is too small or channels is out of
+ *         range.
+ */
+size_t delta_pack_encode(const uint16_t *samples, size_t channels,
+		size_t sweeps, uint8_t *out, size_t size);
+
+/**
+ * @brief Decode a block of known shape.
+ *
+ * @return SL_STATUS_OK, or SL_STATUS_INVALID_PARAMETER if the data is too
+ *         short or a width is out of range.
+ */
+sl_status_t delta_pack_decode(const uint8_t *data, size_t len,
+		size_t channels, size_t sweeps, uint16_t *samples);
+
+#endif // DELTA_PACK_H
@@ -0,0 +1,267 @@
+/***************************************************************************//**
+ * @file detect.c
+ * @brief Closed-loop stimulation from detectors on the acquired channels.
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "byteorder.h"
+#include "config.h"
+#include "detect.h"
+#include "dlog.h"
+#include "dsp.h"
+#include "em_device.h"
+#include "prof.h"
+#include "tasks.h"
+
+_Static_assert(DETECT_BLOCK_SWEEPS >= 2 && DETECT_BLOCK_SWEEPS % 2 == 0,
+		"DETECT_BLOCK_SWEEPS must be even, the kernels take sample pairs");
+_Static_assert(DETECT_MIN_REFRACTORY_MS > 0,
+		"a detector must not trigger on every block");
+
+typedef struct {
+	detect_config_t config;
+	uint8_t position;           // of the channel within a sweep
+	dsp_biquad_t highpass;
+	dsp_biquad_t lowpass;
+	uint32_t thresholdSq;
+	uint32_t weight;            // envelope smoothing per block, of 65536
+	uint32_t envelope;          // smoothed mean square, counts^2
+	uint32_t refractory;        // sweeps
+	uint32_t hold;              // sweeps left before the next trigger
+	bool spent;                 // threshold mode: not yet back below half
+	int16_t last;               // last filtered sample, for crossings
+	int16_t block[DETECT_BLOCK_SWEEPS];
+} detector_t;
+
+static detector_t detectors[DETECT_MAX_DETECTORS];
+static uint32_t blockCycles[DETECT_BLOCK_SWEEPS];
+static uint8_t blockFill;
+static detect_fire_t fireTrain;
+static detect_stats_t stats;
+
+// Handed from the acquisition task to the stimulation task.
+static volatile bool triggered[DETECT_MAX_DETECTORS];
+static volatile uint32_t triggerCycles[DETECT_MAX_DETECTORS];
+
+static uint32_t sweepsOf(uint32_t ms) {
+	return (uint32_t) (((uint64_t) ms * ACQ_SAMPLE_RATE_HZ + 999) / 1000);
+}
+
+static void trigger(detector_t *d, size_t at) {
+	size_t i = (size_t) (d - detectors);
+
+	stats.triggers++;
+	d->hold = d->refractory;
+	if (triggered[i]) {
+		// The last one has not been fired yet.
+		stats.busy++;
+		return;
+	}
+	triggerCycles[i] = blockCycles[at];
+	triggered[i] = true;
+	tasks_wake(TASKS_STIM);
+}
+
+// First zero crossing in the wanted direction, or n if none.
+static size_t crossing(const detector_t *d, size_t n) {
+	int16_t prev = d->last;
+
+	for (size_t i = 0; i < n; i++) {
+		int16_t cur = d->block[i];
+		if (d->config.mode == DETECT_MODE_RISING ?
+				(prev < 0 && cur >= 0) : (prev >= 0 && cur < 0)) {
+			return i;
+		}
+		prev = cur;
+	}
+	return n;
+}
+
+static void runBlock(detector_t *d) {
+	const size_t n = DETECT_BLOCK_SWEEPS;
+
+	dsp_biquad(&d->highpass, d->block, d->block, n);
+	dsp_biquad(&d->lowpass, d->block, d->block, n);
+	uint32_t power = (uint32_t) (dsp_energy(d->block, n) / n);
+	int64_t step = ((int64_t) power - d->envelope) * d->weight;
+	d->envelope = (uint32_t) ((int64_t) d->envelope + step / 65536);
+	stats.blocks++;
+
+	bool above = d->envelope >= d->thresholdSq;
+	if (d->spent && d->envelope < d->thresholdSq / 4) {
+		d->spent = false;
+	}
+	if (d->hold == 0 && above) {
+		if (d->config.mode == DETECT_MODE_THRESHOLD) {
+			if (!d->spent) {
+				d->spent = true;
+				trigger(d, n - 1);
+			}
+		} else {
+			size_t at = crossing(d, n);
+			if (at < n) {
+				trigger(d, at);
+			}
+		}
+	} else if (d->hold) {
+		d->hold = d->hold > n ? d->hold - (uint32_t) n : 0;
+	}
+	d->last = d->block[n - 1];
+}
+
+void detect_init(detect_fire_t fire) {
+	// Latency is timed on the cycle counter, with or without prof.c.
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	memset(detectors, 0, sizeof(detectors));
+	memset(&stats, 0, sizeof(stats));
+	for (size_t i = 0; i < DETECT_MAX_DETECTORS; i++) {
+		triggered[i] = false;
+	}
+	blockFill = 0;
+	fireTrain = fire;
+}
+
+sl_status_t detect_decode(const uint8_t *record, size_t len,
+		detect_config_t *config) {
+	if (len != DETECT_RECORD_SIZE) {
+		return SL_STATUS_INVALID_PARAMETER;
+	}
+	config->index = record[0];
+	config->mode = record[1];
+	config->channel = record[2];
+	config->highpassHz = get_le16(record + 4);
+	config->lowpassHz = get_le16(record + 6);
+	config->threshold = get_le16(record + 8);
+	config->envelopeMs = get_le16(record + 10);
+	config->refractoryMs = get_le16(record + 12);
+	config->pulses = get_le16(record + 14);
+	return SL_STATUS_OK;
+}
+
+sl_status_t detect_set(const detect_config_t *config) {
+	detector_t d = { .config = *config };
+	sl_status_t sc;
+
+	if (config->index >= DETECT_MAX_DETECTORS
+			|| config->mode > DETECT_MODE_FALLING) {
+		return SL_STATUS_INVALID_PARAMETER;
+	}
+	if (config->mode == DETECT_MODE_OFF) {
+		memset(&detectors[config->index], 0, sizeof(detector_t));
+		triggered[config->index] = false;
+		return SL_STATUS_OK;
+	}
+	if (config->channel >= 16
+			|| !(ACQ_CHANNEL_MASK & (1u << config->channel))) {
+		return SL_STATUS_INVALID_PARAMETER;
+	}
+	if (config->highpassHz >= config->lowpassHz
+			|| config->refractoryMs < DETECT_MIN_REFRACTORY_MS
+			|| config->pulses == 0) {
+		return SL_STATUS_INVALID_RANGE;
+	}
+	sc = dsp_biquad_design(DSP_HIGHPASS, ACQ_SAMPLE_RATE_HZ,
+			config->highpassHz, &d.highpass);
+	if (sc == SL_STATUS_OK) {
+		sc = dsp_biquad_design(DSP_LOWPASS, ACQ_SAMPLE_RATE_HZ,
+				config->lowpassHz, &d.lowpass);
+	}
+	if (sc != SL_STATUS_OK) {
+		return SL_STATUS_INVALID_RANGE;
+	}
+
+	for (uint8_t c = 0; c < config->channel; c++) {
+		d.position += (ACQ_CHANNEL_MASK >> c) & 1u;
+	}
+	d.thresholdSq = (uint32_t) config->threshold * config->threshold;
+	uint32_t tau = sweepsOf(config->envelopeMs);
+	d.weight = (uint32_t) (65536ull * DETECT_BLOCK_SWEEPS
+			/ (tau + DETECT_BLOCK_SWEEPS));
+	d.refractory = sweepsOf(config->refractoryMs);
+	// Armed from the next block, with an empty history.
+	detectors[config->index] = d;
+	triggered[config->index] = false;
+	return SL_STATUS_OK;
+}
+
+bool detect_armed(void) {
+	for (size_t i = 0; i < DETECT_MAX_DETECTORS; i++) {
+		if (detectors[i].config.mode != DETECT_MODE_OFF) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void detect_on_sweep(const uint16_t *samples, uint32_t cycles) {
+	uint8_t at = blockFill++;
+
+	blockCycles[at] = cycles;
+	for (size_t i = 0; i < DETECT_MAX_DETECTORS; i++) {
+		detector_t *d = &detectors[i];
+		// Offset binary to signed.
+		d->block[at] = (int16_t) (samples[d->position] ^ 0x8000u);
+	}
+	if (blockFill < DETECT_BLOCK_SWEEPS) {
+		return;
+	}
+	blockFill = 0;
+	PROF_BEGIN(start);
+	for (size_t i = 0; i < DETECT_MAX_DETECTORS; i++) {
+		if (detectors[i].config.mode != DETECT_MODE_OFF) {
+			runBlock(&detectors[i]);
+		}
+	}
+	PROF_END(PROF_DETECT, start);
+}
+
+void detect_restart(void) {
+	blockFill = 0;
+	for (size_t i = 0; i < DETECT_MAX_DETECTORS; i++) {
+		detector_t *d = &detectors[i];
+		dsp_biquad_reset(&d->highpass);
+		dsp_biquad_reset(&d->lowpass);
+		d->envelope = 0;
+		d->last = 0;
+	}
+}
+
+void detect_process_action(void) {
+	for (size_t i = 0; i < DETECT_MAX_DETECTORS; i++) {
+		if (!triggered[i]) {
+			continue;
+		}
+		uint32_t since = triggerCycles[i];
+		triggered[i] = false;
+		sl_status_t sc = fireTrain ?
+				fireTrain(detectors[i].config.pulses) : SL_STATUS_NOT_READY;
+		if (sc == SL_STATUS_BUSY) {
+			stats.busy++;
+			continue;
+		}
+		if (sc != SL_STATUS_OK) {
+			stats.failed++;
+			DLOG(DLOG_DETECT_NOT_FIRED, i, sc);
+			continue;
+		}
+		uint32_t mhz = SystemCoreClockGet() / 1000000u;
+		uint32_t latency = DWT->CYCCNT - since;
+		latency = mhz ? latency / mhz : latency;
+		stats.fired++;
+		stats.latencyLastUs = latency;
+		stats.latencyTotalUs += latency;
+		if (latency > stats.latencyMaxUs) {
+			stats.latencyMaxUs = latency;
+		}
+		DLOG(DLOG_DETECT_FIRED, i, latency, detectors[i].config.pulses);
+	}
+}
+
+void detect_get_stats(detect_stats_t *out) {
+	*out = stats;
+}
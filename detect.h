@@ -0,0 +1,143 @@
+/***************************************************************************//**
+ * @file detect.h
+ * @brief Closed-loop stimulation: detectors on the acquired channels start
+ *        pulse trains on the device, without a round trip to the central.
+ *
+ * Up to DETECT_MAX_DETECTORS detectors each watch one channel of the
+ * sweeps converted by acq.c. While any detector is armed the sweep clock
+ * runs whether or not a central subscribes to the stream.
+ *
+ * Sweeps are taken in blocks of DETECT_BLOCK_SWEEPS. Each detector
+ * band-passes its channel's block through a high-pass and a low-pass
+ * Butterworth section (dsp.h) and smooths the block's mean square into an
+ * envelope. It triggers:
+ *
+ *   DETECT_MODE_THRESHOLD  when the envelope rises through the threshold;
+ *   DETECT_MODE_RISING     at each rising zero crossing of the filtered
+ *                          signal while the envelope is above it, i.e. at
+ *                          phase 0 of the band;
+ *   DETECT_MODE_FALLING    at each falling crossing, phase 180 degrees.
+ *
+ * After a trigger a detector waits out its refractory period; in threshold
+ * mode the envelope must also fall below half the threshold first.
+ *
+ * A trigger wakes the stimulation task, which starts a train of the
+ * detector's pulse count with the current settings unless a train or a
+ * protocol is already running. The latency from the sweep clock tick of
+ * the triggering sample to the start of the train is measured on the cycle
+ * counter, logged with DLOG_DETECT_FIRED and kept in detect_stats_t; up to
+ * DETECT_BLOCK_SWEEPS - 1 sweeps of it are spent filling the block.
+ *
+ * Detectors are set over nodeRx with CMD_OP_DETECT and are not kept
+ * across resets. Record, little-endian:
+ *
+ *   offset  size  field
+ *   0       1     detector index
+ *   1       1     detect_mode_t; DETECT_MODE_OFF disarms
+ *   2       1     channel, one of ACQ_CHANNEL_MASK
+ *   3       1     reserved, 0
+ *   4       2     high-pass cutoff, Hz
+ *   6       2     low-pass cutoff, Hz
+ *   8       2     threshold, RMS in ADC counts
+ *   10      2     envelope time constant, ms; 0 for none
+ *   12      2     refractory period, ms, at least DETECT_MIN_REFRACTORY_MS
+ *   14      2     pulses per trigger, 1 or more
+ ******************************************************************************/
+#ifndef DETECT_H
+#define DETECT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sl_status.h"
+
+#define DETECT_RECORD_SIZE      16
+
+typedef enum {
+	DETECT_MODE_OFF = 0,
+	DETECT_MODE_THRESHOLD,
+	DETECT_MODE_RISING,
+	DETECT_MODE_FALLING,
+} detect_mode_t;
+
+typedef struct {
+	uint8_t index;
+	uint8_t mode;               ///< detect_mode_t.
+	uint8_t channel;
+	uint16_t highpassHz;
+	uint16_t lowpassHz;
+	uint16_t threshold;         ///< RMS, ADC counts.
+	uint16_t envelopeMs;
+	uint16_t refractoryMs;
+	uint16_t pulses;
+} detect_config_t;
+
+typedef struct {
+	uint32_t blocks;            ///< Blocks filtered, per detector.
+	uint32_t triggers;
+	uint32_t fired;             ///< Trains started.
+	uint32_t busy;              ///< Triggers while a train or protocol ran.
+	uint32_t failed;            ///< Trains that could not be started.
+	uint32_t latencyLastUs;     ///< Triggering sample to train start.
+	uint32_t latencyMaxUs;
+	uint64_t latencyTotalUs;
+} detect_stats_t;
+
+/**
+ * @brief Starts a train of the given pulses; SL_STATUS_BUSY if a train or
+ *        protocol is running.
+ */
+typedef sl_status_t (*detect_fire_t)(uint32_t pulses);
+
+/**
+ * @brief Disarm every detector and clear the statistics. Call once.
+ */
+void detect_init(detect_fire_t fire);
+
+/**
+ * @brief Parse a detector record.
+ *
+ * @return SL_STATUS_OK, or SL_STATUS_INVALID_PARAMETER for a record of the
+ *         wrong size.
+ */
+sl_status_t detect_decode(const uint8_t *record, size_t len,
+		detect_config_t *config);
+
+/**
+ * @brief Arm, replace or disarm a detector. Call from the acquisition task.
+ *
+ * @return SL_STATUS_OK, SL_STATUS_INVALID_PARAMETER for an index, mode or
+ *         channel not available, or SL_STATUS_INVALID_RANGE for filter
+ *         cutoffs, a refractory period or a pulse count out of range.
+ */
+sl_status_t detect_set(const detect_config_t *config);
+
+/**
+ * @brief True while any detector is armed.
+ */
+bool detect_armed(void);
+
+/**
+ * @brief Feed one sweep of samples, one per channel of ACQ_CHANNEL_MASK in
+ *        ascending order, converted at cycle count cycles. Called by acq.c.
+ */
+void detect_on_sweep(const uint16_t *samples, uint32_t cycles);
+
+/**
+ * @brief Forget a partial block and the filter state, before a gap in the
+ *        sweeps. Called by acq.c.
+ */
+void detect_restart(void);
+
+/**
+ * @brief Start the trains of pending triggers. Call from the stimulation
+ *        task.
+ */
+void detect_process_action(void);
+
+/**
+ * @brief Copy the statistics since detect_init().
+ */
+void detect_get_stats(detect_stats_t *stats);
+
+#endif // DETECT_H
@@ -0,0 +1,239 @@
+/***************************************************************************//**
+ * @file dlog.c
+ * @brief Deferred binary log.
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "byteorder.h"
+#include "config.h"
+#include "conn_tuning.h"
+#include "dlog.h"
+#include "em_core.h"
+#include "gatt_db.h"
+#include "power.h"
+#include "sl_component_catalog.h"
+#include "sl_sleeptimer.h"
+
+// With TRACE_VCOM the USART carries the event trace instead; see trace.h.
+#if defined(SL_CATALOG_IOSTREAM_USART_PRESENT) && !(TRACE_ENABLE && TRACE_VCOM)
+#include "em_usart.h"
+#include "sl_iostream_usart_vcom_config.h"
+#define DLOG_UART SL_IOSTREAM_USART_VCOM_PERIPHERAL
+#endif
+
+#define DLOG_RING_MASK          (DLOG_RING_WORDS - 1u)
+#define DLOG_HEADER_WORDS       2       // event and argument count, tick
+#define DLOG_NO_CONNECTION      0xFF
+#define DLOG_ATT_HEADER_SIZE    3
+
+_Static_assert((DLOG_RING_WORDS & DLOG_RING_MASK) == 0,
+		"DLOG_RING_WORDS must be a power of two");
+_Static_assert(DLOG_EVENT_COUNT <= UINT16_MAX, "event index is 16 bits");
+#ifdef gattdb_dlog
+_Static_assert(DLOG_STREAM_MAX_SIZE >= DLOG_ENTRY_MAX_SIZE,
+		"a notification must hold the largest entry");
+#endif
+
+static uint32_t ring[DLOG_RING_WORDS];
+// Free running word indices; producers move head, dlog_read() moves tail.
+static uint32_t head;
+static volatile uint32_t tail;
+static dlog_stats_t stats;
+static uint32_t pendingDrops;   // not reported by a DLOG_DROPPED entry yet
+
+static uint8_t connection = DLOG_NO_CONNECTION;
+static uint8_t frame[DLOG_STREAM_MAX_SIZE];
+static size_t frameLen;         // non-zero while waiting for TX buffers
+
+#ifdef DLOG_UART
+static uint8_t uartEntry[DLOG_ENTRY_MAX_SIZE];
+static size_t uartLen;
+static size_t uartPos;
+#endif
+
+// Call with interrupts masked.
+static bool store(uint32_t event, uint32_t argc, uint32_t tick,
+		const uint32_t *args) {
+	uint32_t words = DLOG_HEADER_WORDS + argc;
+	uint32_t used = head - tail;
+
+	if (used + words > DLOG_RING_WORDS) {
+		return false;
+	}
+	ring[head++ & DLOG_RING_MASK] = event | (argc << 16);
+	ring[head++ & DLOG_RING_MASK] = tick;
+	for (uint32_t i = 0; i < argc; i++) {
+		ring[head++ & DLOG_RING_MASK] = args[i];
+	}
+	used += words;
+	if (used > stats.highWater) {
+		stats.highWater = (uint16_t) used;
+	}
+	stats.written++;
+	return true;
+}
+
+void dlog_write(dlog_event_t event, uint32_t argc, uint32_t a0, uint32_t a1,
+		uint32_t a2) {
+	uint32_t args[DLOG_MAX_ARGS] = { a0, a1, a2 };
+	uint32_t tick = sl_sleeptimer_get_tick_count();
+
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_ATOMIC();
+	if (pendingDrops && store(DLOG_DROPPED, 1, tick, &pendingDrops)) {
+		pendingDrops = 0;
+	}
+	if (pendingDrops || !store(event, argc, tick, args)) {
+		pendingDrops++;
+		stats.dropped++;
+	}
+	CORE_EXIT_ATOMIC();
+}
+
+size_t dlog_read(uint8_t *out, size_t size) {
+	size_t len = 0;
+	uint32_t t = tail;
+
+	// Only this function moves tail, and entries below head are complete.
+	while (t != head) {
+		uint32_t word = ring[t & DLOG_RING_MASK];
+		uint32_t argc = word >> 16;
+		size_t n = 8 + 4 * argc;
+		if (len + n > size) {
+			break;
+		}
+		out[len] = DLOG_SYNC;
+		out[len + 1] = (uint8_t) argc;
+		put_le16(out + len + 2, (uint16_t) word);
+		put_le32(out + len + 4, ring[(t + 1) & DLOG_RING_MASK]);
+		for (uint32_t i = 0; i < argc; i++) {
+			put_le32(out + len + 8 + 4 * i,
+					ring[(t + DLOG_HEADER_WORDS + i) & DLOG_RING_MASK]);
+		}
+		len += n;
+		t += DLOG_HEADER_WORDS + argc;
+		stats.drained++;
+	}
+	tail = t;
+	return len;
+}
+
+#ifdef gattdb_dlog
+static size_t frameBudget(void) {
+	size_t mtu = conn_tuning_get(connection)->mtu;
+	size_t value = mtu > DLOG_ATT_HEADER_SIZE ? mtu - DLOG_ATT_HEADER_SIZE : 0;
+	return value < DLOG_STREAM_MAX_SIZE ? value : DLOG_STREAM_MAX_SIZE;
+}
+
+static void drainGatt(void) {
+	for (;;) {
+		if (frameLen == 0) {
+			frameLen = dlog_read(frame, frameBudget());
+			if (frameLen == 0) {
+				return;
+			}
+		}
+		sl_status_t sc = sl_bt_gatt_server_send_notification(connection,
+				gattdb_dlog, frameLen, frame);
+		if (sc == SL_STATUS_NO_MORE_RESOURCE) {
+			return;
+		}
+		// Sent, or lost with the connection.
+		frameLen = 0;
+	}
+}
+#endif
+
+#ifdef DLOG_UART
+static void drainUart(void) {
+	for (;;) {
+		if (uartPos == uartLen) {
+			uartPos = 0;
+			uartLen = dlog_read(uartEntry, sizeof(uartEntry));
+			if (uartLen == 0) {
+				break;
+			}
+		}
+		if (!(USART_StatusGet(DLOG_UART) & USART_STATUS_TXBL)) {
+			break;
+		}
+		DLOG_UART->TXDATA = uartEntry[uartPos++];
+	}
+	// The USART stops in EM2; stay up until the last byte is out.
+	if (uartPos < uartLen || !(USART_StatusGet(DLOG_UART) & USART_STATUS_TXC)) {
+		power_hold(POWER_CLIENT_DLOG);
+	} else {
+		power_release(POWER_CLIENT_DLOG);
+	}
+}
+#endif
+
+void dlog_init(void) {
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_ATOMIC();
+	head = tail = 0;
+	pendingDrops = 0;
+	memset(&stats, 0, sizeof(stats));
+	CORE_EXIT_ATOMIC();
+	connection = DLOG_NO_CONNECTION;
+	frameLen = 0;
+#ifdef DLOG_UART
+	uartLen = uartPos = 0;
+#endif
+}
+
+void dlog_on_event(const sl_bt_msg_t *evt) {
+	switch (SL_BT_MSG_ID(evt->header)) {
+	case sl_bt_evt_gatt_server_characteristic_status_id: {
+		const sl_bt_evt_gatt_server_characteristic_status_t *status =
+				&evt->data.evt_gatt_server_characteristic_status;
+#ifdef gattdb_dlog
+		if (status->characteristic != gattdb_dlog
+				|| status->status_flags != sl_bt_gatt_server_client_config) {
+			break;
+		}
+		if (status->client_config_flags & sl_bt_gatt_server_notification) {
+			connection = status->connection;
+		} else if (status->connection == connection) {
+			connection = DLOG_NO_CONNECTION;
+		}
+#else
+		(void) status;
+#endif
+		break;
+	}
+
+	case sl_bt_evt_connection_closed_id:
+		if (evt->data.evt_connection_closed.connection == connection) {
+			connection = DLOG_NO_CONNECTION;
+			frameLen = 0;
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+void dlog_process_action(void) {
+#ifdef gattdb_dlog
+	// A subscribed central takes the log instead of the USART.
+	if (connection != DLOG_NO_CONNECTION) {
+		drainGatt();
+		return;
+	}
+#endif
+#ifdef DLOG_UART
+	drainUart();
+#endif
+}
+
+void dlog_get_stats(dlog_stats_t *out) {
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_ATOMIC();
+	*out = stats;
+	CORE_EXIT_ATOMIC();
+}
@@ -0,0 +1,114 @@
+/***************************************************************************//**
+ * @file dlog.h
+ * @brief Deferred binary log.
+ *
+ * DLOG(id, args...) stores a message index from dlog_events.h, a sleeptimer
+ * timestamp and up to three 32-bit arguments in a RAM ring: a few words
+ * copied with interrupts masked, no formatting and no I/O, so it is safe
+ * from the Bluetooth event handler and from interrupts. When the ring is
+ * full new entries are dropped and counted, and a DLOG_DROPPED entry
+ * reports the count once there is room again.
+ *
+ * dlog_process_action() drains the ring in the background: as
+ * notifications to a central subscribed to the dlog characteristic, or
+ * else into the VCOM USART a byte at a time whenever its transmit buffer
+ * has room, never waiting for it. dlog_decode.py renders the entries.
+ *
+ * Entry on the wire, little-endian; a notification carries whole entries:
+ *
+ *   offset  size  field
+ *   0       1     DLOG_SYNC
+ *   1       1     argument count n, 0 .. 3
+ *   2       2     message index
+ *   4       4     sleeptimer tick count
+ *   8       4n    arguments
+ ******************************************************************************/
+#ifndef DLOG_H
+#define DLOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "dlog_events.h"
+#include "sl_bluetooth.h"
+
+#define DLOG_SYNC               0xA5
+#define DLOG_MAX_ARGS           3
+#define DLOG_ENTRY_MAX_SIZE     (8 + 4 * DLOG_MAX_ARGS)
+
+typedef enum {
+	DLOG_INFO = 0,
+	DLOG_WARNING,
+} dlog_level_t;
+
+#define DLOG_EVENT_ID(name, level, format) name,
+typedef enum {
+	DLOG_EVENTS(DLOG_EVENT_ID)
+	DLOG_EVENT_COUNT
+} dlog_event_t;
+#undef DLOG_EVENT_ID
+
+typedef struct {
+	uint32_t written;       ///< Entries stored since boot.
+	uint32_t dropped;       ///< Entries lost to a full ring.
+	uint32_t drained;       ///< Entries sent or read out.
+	uint16_t highWater;     ///< Most ring words in use at once.
+} dlog_stats_t;
+
+void dlog_write(dlog_event_t event, uint32_t argc, uint32_t a0, uint32_t a1,
+		uint32_t a2);
+
+static inline void dlog_0(dlog_event_t event) {
+	dlog_write(event, 0, 0, 0, 0);
+}
+
+static inline void dlog_1(dlog_event_t event, uint32_t a0) {
+	dlog_write(event, 1, a0, 0, 0);
+}
+
+static inline void dlog_2(dlog_event_t event, uint32_t a0, uint32_t a1) {
+	dlog_write(event, 2, a0, a1, 0);
+}
+
+static inline void dlog_3(dlog_event_t event, uint32_t a0, uint32_t a1,
+		uint32_t a2) {
+	dlog_write(event, 3, a0, a1, a2);
+}
+
+#define DLOG_PICK(_1, _2, _3, _4, name, ...) name
+/**
+ * @brief Log an event with zero to three arguments. Interrupt safe.
+ */
+#define DLOG(...) \
+	DLOG_PICK(__VA_ARGS__, dlog_3, dlog_2, dlog_1, dlog_0, 0)(__VA_ARGS__)
+
+/**
+ * @brief Empty the ring. Call once, before the first DLOG().
+ */
+void dlog_init(void);
+
+/**
+ * @brief Pass every stack event; tracks the subscription to the dlog
+ *        characteristic.
+ */
+void dlog_on_event(const sl_bt_msg_t *evt);
+
+/**
+ * @brief Drain what the link or the USART takes without waiting. Call from
+ *        the superloop.
+ */
+void dlog_process_action(void);
+
+/**
+ * @brief Move whole entries out of the ring in wire format.
+ *
+ * @return Bytes written; 0 if the ring is empty or the next entry does not
+ *         fit.
+ */
+size_t dlog_read(uint8_t *out, size_t size);
+
+/**
+ * @brief Counters since boot.
+ */
+void dlog_get_stats(dlog_stats_t *stats);
+
+#endif // DLOG_H
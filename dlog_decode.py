@@ -0,0 +1,104 @@
+#!/usr/bin/env python3
+"""Render the deferred binary log (dlog.h) as text.
+
+Reads entries from a file (for example captured with host/build/dlog_dump or
+saved from dlog characteristic notifications), from stdin with '-', or from
+the VCOM port with --serial (needs pyserial). Message texts come from
+dlog_events.h, so decode with the table of the firmware that wrote the log.
+
+    python3 dlog_decode.py dlog.bin
+    python3 dlog_decode.py --serial /dev/ttyACM0
+"""
+import argparse
+import re
+import struct
+import sys
+from pathlib import Path
+
+SYNC = 0xA5
+MAX_ARGS = 3
+TICK_HZ = 32768
+LEVELS = {'DLOG_INFO': 'I', 'DLOG_WARNING': 'W'}
+EVENT_RE = re.compile(r'X\((\w+),\s*(\w+),\s*"((?:[^"\\]|\\.)*)"\)')
+
+
+def load_events(path):
+    text = Path(path).read_text()
+    events = [(name, LEVELS.get(level, '?'), fmt)
+              for name, level, fmt in EVENT_RE.findall(text)]
+    if not events:
+        sys.exit(f'no events found in {path}')
+    return events
+
+
+def entries(read):
+    """Yield (index, tick, args) from a byte source, resyncing on garbage."""
+    buf = bytearray()
+    while True:
+        chunk = read()
+        if not chunk:
+            break
+        buf += chunk
+        while len(buf) >= 8:
+            if buf[0] != SYNC or buf[1] > MAX_ARGS:
+                del buf[0]
+                continue
+            size = 8 + 4 * buf[1]
+            if len(buf) < size:
+                break
+            index, tick = struct.unpack_from('<HI', buf, 2)
+            args = struct.unpack_from(f'<{buf[1]}I', buf, 8)
+            del buf[:size]
+            yield index, tick, args
+    if buf:
+        print(f'# {len(buf)} trailing bytes ignored', file=sys.stderr)
+
+
+def render(fmt, args):
+    # Arguments are 32-bit; %d shows them signed.
+    values = []
+    for conv, value in zip(re.findall(r'%[-0-9]*([udx])', fmt), args):
+        values.append(value - (1 << 32) if conv == 'd' and value >> 31 else value)
+    try:
+        return fmt % tuple(values)
+    except (TypeError, ValueError):
+        return f'{fmt} {list(args)}'
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('input', nargs='?', default='-',
+                        help="log file, or '-' for stdin")
+    parser.add_argument('--serial', metavar='PORT', help='read from a serial port')
+    parser.add_argument('--baud', type=int, default=115200)
+    parser.add_argument('--events', default=Path(__file__).with_name('dlog_events.h'),
+                        help='message table (default: dlog_events.h next to this script)')
+    parser.add_argument('--hz', type=int, default=TICK_HZ, help='sleeptimer tick rate')
+    args = parser.parse_args()
+
+    events = load_events(args.events)
+    if args.serial:
+        import serial
+        port = serial.Serial(args.serial, args.baud, timeout=None)
+        read = lambda: port.read(max(1, port.in_waiting))
+    elif args.input == '-':
+        read = lambda: sys.stdin.buffer.read1(4096)
+    else:
+        stream = open(args.input, 'rb')
+        read = lambda: stream.read(4096)
+
+    first = None
+    for index, tick, values in entries(read):
+        # Ticks wrap at 32 bits; show time since the first entry.
+        first = tick if first is None else first
+        t = ((tick - first) & 0xFFFFFFFF) / args.hz
+        if index < len(events):
+            name, level, fmt = events[index]
+            line = render(fmt, values)
+        else:
+            level, line = '?', f'unknown event {index} {list(values)}'
+        print(f'{t:10.4f} [{level}] {line}', flush=bool(args.serial))
+
+
+if __name__ == '__main__':
+    main()
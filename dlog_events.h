@@ -0,0 +1,69 @@
+/***************************************************************************//**
+ * @file dlog_events.h
+ * @brief Message table of the deferred binary log.
+ *
+ * X(name, level, format): format takes up to three 32-bit arguments with
+ * %u, %d or %x conversions. Entries carry only the index, so the list is
+ * append only: dlog_decode.py reads this file to render a log, and a
+ * renumbered entry would be shown with the wrong text by older tools.
+ ******************************************************************************/
+#ifndef DLOG_EVENTS_H
+#define DLOG_EVENTS_H
+
+#define DLOG_EVENTS(X) \
+	X(DLOG_DROPPED,              DLOG_WARNING, "%u log entries dropped") \
+	X(DLOG_CONN_OPENED,          DLOG_INFO,    "Connection opened") \
+	X(DLOG_CONN_CLOSED,          DLOG_INFO,    "Connection closed, reason 0x%04x") \
+	X(DLOG_RHS2116_INIT_FAILED,  DLOG_WARNING, "RHS2116 init failed: 0x%04x") \
+	X(DLOG_RHS2116_FOUND,        DLOG_INFO,    "RHS2116 found") \
+	X(DLOG_RHS2116_NOT_FOUND,    DLOG_WARNING, "RHS2116 not found: 0x%04x, chip ID %u") \
+	X(DLOG_STIM_NOT_STARTED,     DLOG_WARNING, "Stimulation not started: 0x%04x") \
+	X(DLOG_PROTOCOL_STORED,      DLOG_INFO,    "Protocol stored in slot %u, %u epochs") \
+	X(DLOG_PROTOCOL_NOT_STARTED, DLOG_WARNING, "Protocol in slot %u not started: 0x%04x") \
+	X(DLOG_PROTOCOL_EPOCH,       DLOG_INFO,    "Protocol in slot %u epoch %u: %u pulses") \
+	X(DLOG_PROTOCOL_EPOCH_FAILED, DLOG_WARNING, "Protocol in slot %u epoch %u failed: 0x%04x") \
+	X(DLOG_PROTOCOL_DONE,        DLOG_INFO,    "Protocol in slot %u done") \
+	X(DLOG_NODE_RX_READ_FAILED,  DLOG_WARNING, "nodeRx read failed: 0x%04x") \
+	X(DLOG_NODE_TX_FAILED,       DLOG_WARNING, "nodeTx update failed: 0x%04x") \
+	X(DLOG_NOTIFY_NO_ROOM,       DLOG_WARNING, "No room to track connection %u") \
+	X(DLOG_NOTIFY_FAILED,        DLOG_WARNING, "Notification to %u failed: 0x%04x") \
+	X(DLOG_DIAG_FAILED,          DLOG_WARNING, "diagnostics update failed: 0x%04x") \
+	X(DLOG_PHY_REQUEST_FAILED,   DLOG_WARNING, "PHY request failed: 0x%04x") \
+	X(DLOG_DLE_REQUEST_FAILED,   DLOG_WARNING, "data length request failed: 0x%04x") \
+	X(DLOG_INTERVAL_REQUEST_FAILED, DLOG_WARNING, "interval request failed: 0x%04x") \
+	X(DLOG_MTU_NOT_SET,          DLOG_WARNING, "max MTU not set: 0x%04x") \
+	X(DLOG_CONN_INTERVAL,        DLOG_INFO,    "Connection interval %u x 1.25 ms, latency %u") \
+	X(DLOG_CONN_PHY,             DLOG_INFO,    "PHY %u") \
+	X(DLOG_CONN_DATA_LENGTH,     DLOG_INFO,    "Data length TX %u RX %u") \
+	X(DLOG_CONN_MTU,             DLOG_INFO,    "MTU %u") \
+	X(DLOG_POWER_REPORT_FAILED,  DLOG_WARNING, "power report update failed: 0x%04x") \
+	X(DLOG_ADV_TIMER_FAILED,     DLOG_WARNING, "advertising stage timer failed: 0x%04x") \
+	X(DLOG_ADV_STAGE,            DLOG_INFO,    "Advertising stage %u") \
+	X(DLOG_ACQ_STARTED,          DLOG_INFO,    "Acquisition started: %u channels at %u Hz") \
+	X(DLOG_ACQ_START_FAILED,     DLOG_WARNING, "Acquisition not started: 0x%04x") \
+	X(DLOG_ACQ_STOPPED,          DLOG_INFO,    "Acquisition stopped: %u sweeps, %u frames") \
+	X(DLOG_ACQ_STATS_FAILED,     DLOG_WARNING, "acq stats update failed: 0x%04x") \
+	X(DLOG_OTA_DELTA_BEGIN,      DLOG_INFO,    "Delta OTA from %u, slot of %u bytes") \
+	X(DLOG_OTA_DELTA_DONE,       DLOG_INFO,    "Delta OTA rebuilt %u bytes from %u patch bytes") \
+	X(DLOG_OTA_DELTA_FAILED,     DLOG_WARNING, "Delta OTA failed: status %u, detail 0x%04x, at %u") \
+	X(DLOG_OTA_DELTA_ABORTED,    DLOG_INFO,    "Delta OTA aborted at %u") \
+	X(DLOG_SESSION_OPENED,       DLOG_INFO,    "Connection %u opened, role %u") \
+	X(DLOG_SESSION_NO_ROOM,      DLOG_WARNING, "No session for connection %u") \
+	X(DLOG_SESSION_ROLE,         DLOG_INFO,    "Connection %u now has role %u") \
+	X(DLOG_SESSION_DENIED,       DLOG_WARNING, "Command 0x%02x from observer %u refused") \
+	X(DLOG_TASK_NOT_CREATED,     DLOG_WARNING, "Task %u not created, %u bytes of stack") \
+	X(DLOG_TASK_STATS,           DLOG_INFO,    "Task %u: %u bytes of stack free, worst wake-up %u us") \
+	X(DLOG_SETTINGS_RESTORED,    DLOG_INFO,    "Settings restored: A%u F%u P%u") \
+	X(DLOG_SETTINGS_NOT_RESTORED, DLOG_WARNING, "Stored settings not restored: 0x%04x") \
+	X(DLOG_SETTINGS_STORE_FAILED, DLOG_WARNING, "Settings not stored: 0x%08x") \
+	X(DLOG_DETECT_FIRED,         DLOG_INFO,    "Detector %u fired after %u us, %u pulses") \
+	X(DLOG_DETECT_NOT_FIRED,     DLOG_WARNING, "Detector %u trigger not fired: 0x%04x") \
+	X(DLOG_TRACE_FULL,           DLOG_WARNING, "Event trace full after %u events, %u bytes") \
+	X(DLOG_BOOT_PHASE_FAILED,    DLOG_WARNING, "Boot phase %u failed: 0x%04x") \
+	X(DLOG_BOOT_REPORT_FAILED,   DLOG_WARNING, "Boot report not updated: 0x%04x") \
+	X(DLOG_BOOT_DONE,            DLOG_INFO,    "Boot: connectable at %u us, complete at %u us, reset cause %u") \
+	X(DLOG_TELEMETRY_FAILED,     DLOG_WARNING, "telemetry update failed: 0x%04x") \
+	X(DLOG_TELEMETRY_MISSED,     DLOG_WARNING, "Train ended with %u pulses, %u missed") \
+	X(DLOG_SESSION_WRITE_DENIED, DLOG_WARNING, "Write to attribute %u from observer %u refused")
+
+#endif // DLOG_EVENTS_H
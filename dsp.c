@@ -0,0 +1,163 @@
+/***************************************************************************//**
+ * @file dsp.c
+ * @brief Fixed-point filter kernels for signal detection (detect.h).
+ ******************************************************************************/
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "config.h"
+#include "dsp.h"
+
+#if DSP_SIMD
+#include "em_device.h"
+#endif
+
+#define DSP_ROUND               (1 << (DSP_Q - 1))
+#define DSP_PI                  3.14159265358979f
+#define DSP_BUTTERWORTH_Q       0.70710678f
+
+_Static_assert(DSP_SIMD == 0 || DSP_SIMD == 1, "DSP_SIMD must be 0 or 1");
+
+static inline int16_t saturate16(int64_t v) {
+	if (v > INT16_MAX) {
+		return INT16_MAX;
+	}
+	if (v < INT16_MIN) {
+		return INT16_MIN;
+	}
+	return (int16_t) v;
+}
+
+static int32_t quantize(float v) {
+	return (int32_t) floorf(v * DSP_ONE + 0.5f);
+}
+
+sl_status_t dsp_biquad_design(dsp_response_t response, uint32_t rate,
+		uint32_t cutoff, dsp_biquad_t *section) {
+	if (rate == 0 || cutoff == 0 || 2 * (uint64_t) cutoff >= rate) {
+		return SL_STATUS_INVALID_RANGE;
+	}
+	// Bilinear-transform design (RBJ cookbook), normalized by a0.
+	float w0 = 2.0f * DSP_PI * (float) cutoff / (float) rate;
+	float cosw = cosf(w0);
+	float alpha = sinf(w0) / (2.0f * DSP_BUTTERWORTH_Q);
+	float a0 = 1.0f + alpha;
+	float k = (response == DSP_LOWPASS ? 1.0f - cosw : 1.0f + cosw) / 2.0f;
+
+	int32_t b0 = quantize(k / a0);
+	int32_t a1 = quantize(2.0f * cosw / a0);
+	int32_t a2 = quantize((alpha - 1.0f) / a0);
+	// Zeros exactly at DC or Nyquist whatever the rounding.
+	int32_t b1 = response == DSP_LOWPASS ? 2 * b0 : -2 * b0;
+
+	// A vanishing gain, a coefficient out of Q14, or poles that rounded
+	// onto the unit circle: the cutoff is too extreme for this rate.
+	if (b0 == 0 || b1 > INT16_MAX || b1 < INT16_MIN || a1 > INT16_MAX
+			|| a2 <= -DSP_ONE || (a1 < 0 ? -a1 : a1) >= DSP_ONE - a2) {
+		return SL_STATUS_INVALID_RANGE;
+	}
+	memset(section, 0, sizeof(*section));
+	section->b0 = (int16_t) b0;
+	section->b1 = (int16_t) b1;
+	section->b2 = (int16_t) b0;
+	section->a1 = (int16_t) a1;
+	section->a2 = (int16_t) a2;
+	return SL_STATUS_OK;
+}
+
+void dsp_biquad_reset(dsp_biquad_t *section) {
+	section->x1 = section->x2 = 0;
+	section->y1 = section->y2 = 0;
+}
+
+void dsp_biquad_ref(dsp_biquad_t *s, const int16_t *in, int16_t *out,
+		size_t n) {
+	int16_t x1 = s->x1, x2 = s->x2, y1 = s->y1, y2 = s->y2;
+
+	for (size_t i = 0; i < n; i++) {
+		int16_t x = in[i];
+		int64_t acc = DSP_ROUND + (int64_t) s->b0 * x + (int64_t) s->b1 * x1
+				+ (int64_t) s->b2 * x2 + (int64_t) s->a1 * y1
+				+ (int64_t) s->a2 * y2;
+		int16_t y = saturate16(acc >> DSP_Q);
+		x2 = x1;
+		x1 = x;
+		y2 = y1;
+		y1 = y;
+		out[i] = y;
+	}
+	s->x1 = x1;
+	s->x2 = x2;
+	s->y1 = y1;
+	s->y2 = y2;
+}
+
+uint64_t dsp_energy_ref(const int16_t *in, size_t n) {
+	uint64_t sum = 0;
+
+	for (size_t i = 0; i < n; i++) {
+		sum += (uint64_t) ((int32_t) in[i] * in[i]);
+	}
+	return sum;
+}
+
+#if DSP_SIMD
+
+// Halfword pairs are packed low first, the order SMLALD multiplies them in:
+// (b0, b1) x (x, x1) and (b2, a1) x (x2, y1), then a2 y2 on its own.
+void dsp_biquad(dsp_biquad_t *s, const int16_t *in, int16_t *out,
+		size_t n) {
+	const uint32_t b01 = __PKHBT((uint32_t) s->b0, (uint32_t) s->b1, 16);
+	const uint32_t b2a1 = __PKHBT((uint32_t) s->b2, (uint32_t) s->a1, 16);
+	const int32_t a2 = s->a2;
+	int32_t x1 = s->x1, x2 = s->x2, y1 = s->y1, y2 = s->y2;
+
+	for (size_t i = 0; i < n; i++) {
+		int32_t x = in[i];
+		uint64_t acc = (uint64_t) (DSP_ROUND + (int64_t) (a2 * y2));
+		acc = __SMLALD(b01, __PKHBT((uint32_t) x, (uint32_t) x1, 16), acc);
+		acc = __SMLALD(b2a1, __PKHBT((uint32_t) x2, (uint32_t) y1, 16), acc);
+		// |acc| < 2^33, so the shifted sum fits 32 bits for SSAT.
+		int32_t y = __SSAT((int32_t) ((int64_t) acc >> DSP_Q), 16);
+		x2 = x1;
+		x1 = x;
+		y2 = y1;
+		y1 = y;
+		out[i] = (int16_t) y;
+	}
+	s->x1 = (int16_t) x1;
+	s->x2 = (int16_t) x2;
+	s->y1 = (int16_t) y1;
+	s->y2 = (int16_t) y2;
+}
+
+// Two squares per SMLALD, from a word holding two samples.
+uint64_t dsp_energy(const int16_t *in, size_t n) {
+	uint64_t sum = 0;
+	size_t i = 0;
+
+	for (; i + 2 <= n; i += 2) {
+		uint32_t pair;
+		memcpy(&pair, in + i, sizeof(pair));
+		sum = __SMLALD(pair, pair, sum);
+	}
+	if (i < n) {
+		sum += (uint64_t) ((int32_t) in[i] * in[i]);
+	}
+	return sum;
+}
+
+#else // DSP_SIMD
+
+void dsp_biquad(dsp_biquad_t *section, const int16_t *in, int16_t *out,
+		size_t n) {
+	dsp_biquad_ref(section, in, out, n);
+}
+
+uint64_t dsp_energy(const int16_t *in, size_t n) {
+	return dsp_energy_ref(in, n);
+}
+
+#endif // DSP_SIMD
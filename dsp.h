@@ -0,0 +1,79 @@
+/***************************************************************************//**
+ * @file dsp.h
+ * @brief Fixed-point filter kernels for signal detection (detect.h).
+ *
+ * Samples are signed 16-bit. A biquad section has Q14 coefficients and
+ * runs in direct form I, accumulating in 64 bits, so no input makes the
+ * sum overflow; the output is rounded and saturated to 16 bits. A filter
+ * is a cascade of sections, each run over a whole block.
+ *
+ * With DSP_SIMD set in config.h (the default on cores with the DSP
+ * extension), the kernels use the Cortex-M33 dual 16-bit multiply-
+ * accumulate instructions, two products per cycle. The _ref kernels are
+ * the same arithmetic in plain C and give identical results; they are kept
+ * for tests and benchmarks.
+ ******************************************************************************/
+#ifndef DSP_H
+#define DSP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sl_status.h"
+
+#define DSP_Q                   14
+#define DSP_ONE                 (1 << DSP_Q)
+
+typedef enum {
+	DSP_LOWPASS = 0,
+	DSP_HIGHPASS,
+} dsp_response_t;
+
+/**
+ * @brief One biquad section and its state.
+ *
+ * y[n] = b0 x[n] + b1 x[n-1] + b2 x[n-2] + a1 y[n-1] + a2 y[n-2]
+ *
+ * The feedback coefficients are stored negated, as added.
+ */
+typedef struct {
+	int16_t b0, b1, b2;     ///< Q14.
+	int16_t a1, a2;         ///< Q14, negated feedback.
+	int16_t x1, x2;
+	int16_t y1, y2;
+} dsp_biquad_t;
+
+/**
+ * @brief Design a second-order Butterworth section and clear its state.
+ *
+ * @param[in] rate Sample rate, Hz.
+ * @param[in] cutoff -3 dB frequency, Hz, below rate / 2.
+ * @return SL_STATUS_OK, or SL_STATUS_INVALID_RANGE if the cutoff is out of
+ *         range or too close to 0 or rate / 2 for Q14 coefficients.
+ */
+sl_status_t dsp_biquad_design(dsp_response_t response, uint32_t rate,
+		uint32_t cutoff, dsp_biquad_t *section);
+
+/**
+ * @brief Clear the state of a section, keeping its coefficients.
+ */
+void dsp_biquad_reset(dsp_biquad_t *section);
+
+/**
+ * @brief Filter n samples through one section; in and out may be the same.
+ */
+void dsp_biquad(dsp_biquad_t *section, const int16_t *in, int16_t *out,
+		size_t n);
+
+/**
+ * @brief Sum of the squares of n samples.
+ */
+uint64_t dsp_energy(const int16_t *in, size_t n);
+
+/**
+ * @brief Reference kernels in plain C. Same results as the above.
+ */
+void dsp_biquad_ref(dsp_biquad_t *section, const int16_t *in, int16_t *out,
+		size_t n);
+uint64_t dsp_energy_ref(const int16_t *in, size_t n);
+
+#endif // DSP_H
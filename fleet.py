@@ -0,0 +1,496 @@
+#!/usr/bin/env python3
+"""Apply commands to many MouseCap units at once and time the replies.
+
+Every unit gets its own session: binary frames (cmd_proto.h) are written to
+nodeRx without waiting for each reply, up to --window in flight, and matched
+to the STATE notifications on nodeTx by sequence number. Replies to writes
+delivered in one connection event are coalesced into one notification for
+the last of them, so a reply also completes the commands sent before it.
+A command still unanswered after --timeout is resolved by reading nodeTx
+back. Each unit is then acknowledged by a GET whose state must hold the
+values asked for, or by the status of every step for a protocol.
+
+Units are simulated, each a host/build/fleet_device process running the
+firmware (build it with make -C host), or real devices over bleak, which
+needs the nodeRx and nodeTx characteristic UUIDs of the GATT configuration.
+
+    python3 fleet.py --sim 100 set A100,F20,P200,G1
+    python3 fleet.py --sim 8 set 'A100,F20;P200;G1'
+    python3 fleet.py --sim 20 protocol 100,20,200,1000,500 50,100,100,300,0
+    python3 fleet.py --sim 50 bench --commands 200 --window 8
+    python3 fleet.py --ble AA:BB:CC:DD:EE:FF --rx-uuid RX --tx-uuid TX get
+"""
+import argparse
+import asyncio
+import collections
+import struct
+import sys
+import time
+from pathlib import Path
+
+HERE = Path(__file__).resolve().parent
+SOF = 0xB5
+VERSION = 1
+OP_SET, OP_GET, OP_BATCH = 0x01, 0x02, 0x03
+OP_PROTOCOL_WRITE, OP_PROTOCOL_RUN = 0x04, 0x05
+OP_STATE = 0x81
+MASK_EXT = 0x80
+FIELDS = 'AFPGLSI-BR'           # bit n is field n; bit 7 extends the mask
+STATE_FIELDS = set('AFPGSIBR')  # L toggles, it is not state
+STATUS = ['OK', 'EMPTY', 'FORMAT', 'VERSION', 'LENGTH', 'CRC', 'OPCODE',
+          'RANGE', 'NOT_FOUND', 'STORAGE', 'PERMISSION']
+TRIGGERS = {'now': 0x01, 'boot': 0x02, 'disconnect': 0x04}
+PROTOCOL_NAME_SIZE = 12
+PROTOCOL_MAX_EPOCHS = 8
+SEQ_WINDOW_MAX = 128            # sequence numbers are 8 bits
+
+
+def crc16(data):
+    crc = 0xFFFF
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = (crc << 1) ^ 0x1021 if crc & 0x8000 else crc << 1
+            crc &= 0xFFFF
+    return crc
+
+
+def frame(op, seq, payload=b''):
+    body = bytes([SOF, VERSION, op, seq & 0xFF]) + payload
+    return body + struct.pack('<H', crc16(body))
+
+
+def parse_fields(text):
+    """'A100,F20' -> {'A': 100, 'F': 20}."""
+    fields = {}
+    for item in filter(None, text.split(',')):
+        letter, value = item[0].upper(), item[1:]
+        if letter not in FIELDS or letter == '-':
+            raise ValueError(f'unknown field {letter!r}')
+        fields[letter] = int(value, 0)
+    if not fields:
+        raise ValueError('no fields')
+    return fields
+
+
+def set_payload(fields):
+    mask = 0
+    for letter in fields:
+        mask |= 1 << FIELDS.index(letter)
+    head = bytes([mask & 0xFF | MASK_EXT, mask >> 8]) if mask >> 8 \
+        else bytes([mask])
+    values = [fields[FIELDS[i]] for i in range(len(FIELDS))
+              if mask >> i & 1]
+    return head + struct.pack(f'<{len(values)}I', *values)
+
+
+def parse_spec(spec):
+    """'A100,F20;P200' -> (opcode, payload, fields applied in order)."""
+    commands = [parse_fields(part) for part in spec.split(';')]
+    payload = b''.join(set_payload(c) for c in commands)
+    merged = {}
+    for c in commands:
+        merged.update(c)
+    return (OP_BATCH if len(commands) > 1 else OP_SET), payload, merged
+
+
+def protocol_record(name, epochs):
+    if not 1 <= len(epochs) <= PROTOCOL_MAX_EPOCHS:
+        raise ValueError(f'1 to {PROTOCOL_MAX_EPOCHS} epochs')
+    record = name.encode()[:PROTOCOL_NAME_SIZE].ljust(PROTOCOL_NAME_SIZE,
+                                                       b'\0')
+    record += bytes([len(epochs)])
+    for epoch in epochs:
+        record += struct.pack('<5I', *epoch)
+    return record
+
+
+def parse_epoch(text):
+    values = [int(v, 0) for v in text.split(',')]
+    if len(values) != 5:
+        raise argparse.ArgumentTypeError('epoch is A,F,P,duration_ms,gap_ms')
+    return values
+
+
+def decode_state(data):
+    """STATE frame -> (seq, status, {field: value}), or None."""
+    if len(data) < 8 or data[0] != SOF or data[1] != VERSION \
+            or data[2] != OP_STATE \
+            or crc16(data[:-2]) != struct.unpack('<H', data[-2:])[0]:
+        return None
+    seq, status, mask, at = data[3], data[4], data[5], 6
+    if mask & MASK_EXT:
+        mask = mask & ~MASK_EXT | data[6] << 8
+        at = 7
+    fields = {}
+    for i, letter in enumerate(FIELDS):
+        if mask >> i & 1:
+            if at + 4 > len(data) - 2:
+                return None
+            fields[letter] = struct.unpack_from('<I', data, at)[0]
+            at += 4
+    return seq, status, fields
+
+
+class Transport:
+    """One link to a unit: nodeRx writes, nodeTx notifications and reads."""
+
+    name = '?'
+
+    async def open(self, on_notify):
+        raise NotImplementedError
+
+    async def write(self, data):
+        raise NotImplementedError
+
+    async def read(self):
+        raise NotImplementedError
+
+    async def close(self):
+        pass
+
+
+class SimTransport(Transport):
+    """A fleet_device process. With interval_ms, writes are held and sent
+    together once per interval, as a connection event delivers them."""
+
+    def __init__(self, name, device, interval_ms=0):
+        self.name = name
+        self.device = device
+        self.interval = interval_ms / 1000
+        self.held = []
+        self.event = None
+        self.reads = collections.deque()
+        self.rejected = []
+
+    async def open(self, on_notify):
+        self.on_notify = on_notify
+        self.proc = await asyncio.create_subprocess_exec(
+            str(self.device), stdin=asyncio.subprocess.PIPE,
+            stdout=asyncio.subprocess.PIPE)
+        self.reader = asyncio.ensure_future(self._receive())
+
+    def _send(self, kind, data):
+        self.proc.stdin.write(bytes([kind]) + struct.pack('<H', len(data))
+                              + data)
+
+    def _flush(self):
+        if self.event:
+            self.event.cancel()
+            self.event = None
+        for data in self.held:
+            self._send(ord('W'), data)
+        self.held = []
+
+    async def write(self, data):
+        if not self.interval:
+            self._send(ord('W'), data)
+        else:
+            if not self.held:
+                self.event = asyncio.get_running_loop().call_later(
+                    self.interval, self._flush)
+            self.held.append(data)
+        await self.proc.stdin.drain()
+
+    async def read(self, which=b'n'):
+        # After the writes held, as a read waits for its connection event.
+        self._flush()
+        reply = asyncio.get_running_loop().create_future()
+        self.reads.append(reply)
+        self._send(ord('R'), which)
+        await self.proc.stdin.drain()
+        return await reply
+
+    async def _receive(self):
+        out = self.proc.stdout
+        try:
+            while True:
+                header = await out.readexactly(3)
+                data = await out.readexactly(header[1] | header[2] << 8)
+                if header[0] == ord('N'):
+                    self.on_notify(data)
+                elif header[0] == ord('V') and self.reads:
+                    self.reads.popleft().set_result(data)
+                elif header[0] == ord('E'):
+                    self.rejected.append(struct.unpack('<I', data)[0])
+        except asyncio.IncompleteReadError:
+            for reply in self.reads:
+                if not reply.done():
+                    reply.set_exception(ConnectionError('unit exited'))
+
+    async def close(self):
+        self._flush()
+        self.proc.stdin.close()
+        await self.proc.wait()
+        await self.reader
+
+
+class BleakTransport(Transport):
+    """A device over the host's Bluetooth adapter (pip install bleak)."""
+
+    def __init__(self, address, rx_uuid, tx_uuid):
+        self.name = address
+        self.rx = rx_uuid
+        self.tx = tx_uuid
+
+    async def open(self, on_notify):
+        from bleak import BleakClient
+        self.client = BleakClient(self.name)
+        await self.client.connect()
+        await self.client.start_notify(
+            self.tx, lambda _, data: on_notify(bytes(data)))
+
+    async def write(self, data):
+        await self.client.write_gatt_char(self.rx, data, response=False)
+
+    async def read(self):
+        return bytes(await self.client.read_gatt_char(self.tx))
+
+    async def close(self):
+        await self.client.disconnect()
+
+
+class Unit:
+    """Pipelined command session with one unit."""
+
+    def __init__(self, transport, window, timeout):
+        self.transport = transport
+        self.window = asyncio.Semaphore(min(window, SEQ_WINDOW_MAX))
+        self.timeout = timeout
+        self.seq = 0
+        self.pending = collections.OrderedDict()   # seq -> future, sent order
+        self.latencies = []
+        self.error = None
+        self.output = None
+
+    @property
+    def name(self):
+        return self.transport.name
+
+    async def open(self):
+        await self.transport.open(self._on_notify)
+
+    def _on_notify(self, data):
+        state = decode_state(data)
+        if state:
+            self._resolve(*state)
+
+    def _resolve(self, seq, status, fields):
+        """Complete seq and, coalesced into its reply, every command sent
+        before it. Only seq itself carries the status."""
+        if seq not in self.pending:
+            return
+        while self.pending:
+            s, reply = self.pending.popitem(last=False)
+            if not reply.done():
+                reply.set_result((status, fields) if s == seq
+                                 else (None, fields))
+            if s == seq:
+                break
+
+    async def command(self, op, payload=b''):
+        """Send one frame; return (status, state). status is None when the
+        reply was coalesced with a later command's."""
+        async with self.window:
+            seq = self.seq
+            self.seq = (self.seq + 1) & 0xFF
+            reply = asyncio.get_running_loop().create_future()
+            self.pending[seq] = reply
+            start = time.perf_counter()
+            await self.transport.write(frame(op, seq, payload))
+            try:
+                result = await asyncio.wait_for(asyncio.shield(reply),
+                                                self.timeout)
+            except asyncio.TimeoutError:
+                result = await self._read_back(seq, reply)
+            self.latencies.append(time.perf_counter() - start)
+            return result
+
+    async def _read_back(self, seq, reply):
+        # Notifications off or lost: nodeTx keeps the last reply.
+        state = decode_state(await self.transport.read())
+        if state:
+            self._resolve(*state)
+        if not reply.done():
+            self.pending.pop(seq, None)
+            raise TimeoutError(f'no reply to seq {seq}')
+        return reply.result()
+
+    async def close(self):
+        await self.transport.close()
+
+
+def check(status, what):
+    if status not in (None, 0):
+        name = STATUS[status] if status < len(STATUS) else str(status)
+        raise RuntimeError(f'{what} refused: {name}')
+
+
+async def acknowledge(unit, expected):
+    """GET and compare the state with the values asked for."""
+    status, state = await unit.command(OP_GET)
+    check(status, 'GET')
+    wrong = {k: (v, state.get(k)) for k, v in expected.items()
+             if k in STATE_FIELDS and state.get(k) != v}
+    if wrong:
+        raise RuntimeError('state differs: ' + ', '.join(
+            f'{k} {got} not {want}' for k, (want, got) in wrong.items()))
+    return state
+
+
+async def do_set(unit, args):
+    op, payload, expected = parse_spec(args.spec)
+    status, _ = await unit.command(op, payload)
+    check(status, 'SET')
+    await acknowledge(unit, expected)
+
+
+async def do_get(unit, args):
+    status, state = await unit.command(OP_GET)
+    check(status, 'GET')
+    unit.output = ','.join(f'{k}{v}' for k, v in state.items())
+
+
+async def do_protocol(unit, args):
+    # One step at a time so each status is reported, not coalesced.
+    record = protocol_record(args.name, args.epochs)
+    status, _ = await unit.command(OP_PROTOCOL_WRITE,
+                                   bytes([args.slot]) + record)
+    check(status, 'PROTOCOL_WRITE')
+    triggers = 0
+    for t in args.trigger.split(','):
+        triggers |= TRIGGERS[t]
+    status, _ = await unit.command(OP_PROTOCOL_RUN,
+                                   bytes([args.slot, triggers]))
+    check(status, 'PROTOCOL_RUN')
+
+
+async def do_bench(unit, args):
+    sends = []
+    for i in range(args.commands):
+        fields = {'A': 1 + i % 200, 'F': 20, 'P': 200}
+        sends.append(unit.command(OP_SET, set_payload(fields)))
+    for status, _ in await asyncio.gather(*sends):
+        check(status, 'SET')
+    await acknowledge(unit, fields)
+
+
+async def run_unit(unit, action, args, connect):
+    try:
+        async with connect:
+            await unit.open()
+        try:
+            await action(unit, args)
+        finally:
+            await unit.close()
+        rejected = getattr(unit.transport, 'rejected', None)
+        if rejected:
+            raise RuntimeError(f'{len(rejected)} writes rejected by the stack')
+    except Exception as e:      # report every unit, whatever went wrong
+        unit.error = f'{type(e).__name__}: {e}'
+
+
+def percentile(values, p):
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+def report(units, elapsed):
+    for u in units:
+        if u.output:
+            print(f'{u.name}: {u.output}')
+    failed = [u for u in units if u.error]
+    latencies = sorted(t for u in units for t in u.latencies)
+    print(f'units      {len(units) - len(failed)} acknowledged, '
+          f'{len(failed)} failed')
+    if latencies:
+        ms = lambda t: f'{t * 1000:.2f}'
+        print(f'commands   {len(latencies)} in {elapsed:.2f} s, '
+              f'{len(latencies) / elapsed:.0f}/s')
+        print(f'latency    p50 {ms(percentile(latencies, 50))} '
+              f'p90 {ms(percentile(latencies, 90))} '
+              f'p99 {ms(percentile(latencies, 99))} '
+              f'max {ms(latencies[-1])} ms')
+    for u in failed:
+        print(f'  {u.name}: {u.error}')
+    return not failed
+
+
+async def run(args):
+    if args.sim:
+        if not args.device.exists():
+            sys.exit(f'{args.device} not found; run make -C host')
+        transports = [SimTransport(f'sim{i}', args.device, args.interval_ms)
+                      for i in range(args.sim)]
+    else:
+        if not (args.rx_uuid and args.tx_uuid):
+            sys.exit('--ble needs --rx-uuid and --tx-uuid')
+        transports = [BleakTransport(a, args.rx_uuid, args.tx_uuid)
+                      for a in args.ble]
+    units = [Unit(t, args.window, args.timeout) for t in transports]
+    connect = asyncio.Semaphore(args.connect_limit)
+
+    start = time.perf_counter()
+    await asyncio.gather(*(run_unit(u, args.action, args, connect)
+                           for u in units))
+    return report(units, time.perf_counter() - start)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    units = parser.add_mutually_exclusive_group(required=True)
+    units.add_argument('--sim', type=int, metavar='N',
+                       help='N simulated units')
+    units.add_argument('--ble', nargs='+', metavar='ADDRESS',
+                       help='devices to connect with bleak')
+    parser.add_argument('--device', type=Path,
+                        default=HERE / 'host' / 'build' / 'fleet_device',
+                        help='simulated unit '
+                        '(default: host/build/fleet_device)')
+    parser.add_argument('--interval-ms', type=float, default=0,
+                        help='simulated connection interval (default: none)')
+    parser.add_argument('--rx-uuid', help='nodeRx characteristic UUID')
+    parser.add_argument('--tx-uuid', help='nodeTx characteristic UUID')
+    parser.add_argument('--window', type=int, default=8,
+                        help='commands in flight per unit (default: 8)')
+    parser.add_argument('--timeout', type=float, default=1.0,
+                        help='seconds before reading nodeTx back (default: 1)')
+    parser.add_argument('--connect-limit', type=int, default=4,
+                        help='connections opened at once (default: 4)')
+    sub = parser.add_subparsers(required=True, metavar='command')
+
+    p = sub.add_parser('set', help="apply settings, e.g. A100,F20 or 'A1;G1'")
+    p.add_argument('spec')
+    p.set_defaults(action=do_set)
+    p = sub.add_parser('get', help='print each unit\'s state')
+    p.set_defaults(action=do_get)
+    p = sub.add_parser('protocol', help='store a protocol and run it')
+    p.add_argument('epochs', nargs='+', type=parse_epoch,
+                   metavar='A,F,P,duration_ms,gap_ms')
+    p.add_argument('--slot', type=int, default=0)
+    p.add_argument('--name', default='fleet')
+    p.add_argument('--trigger', default='now',
+                   help='now, boot, disconnect, comma separated')
+    p.set_defaults(action=do_protocol)
+    p = sub.add_parser('bench', help='time pipelined SETs')
+    p.add_argument('--commands', type=int, default=100)
+    p.add_argument('--window', type=int, default=argparse.SUPPRESS,
+                   help='as above')
+    p.set_defaults(action=do_bench)
+
+    args = parser.parse_args()
+    # Reject bad arguments once, not from every unit.
+    try:
+        if args.action is do_set:
+            parse_spec(args.spec)
+        if args.action is do_protocol:
+            protocol_record(args.name, args.epochs)
+            for t in args.trigger.split(','):
+                if t not in TRIGGERS:
+                    raise ValueError(f'unknown trigger {t!r}')
+    except ValueError as e:
+        parser.error(str(e))
+    sys.exit(0 if asyncio.run(run(args)) else 1)
+
+
+if __name__ == '__main__':
+    main()
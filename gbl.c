@@ -0,0 +1,380 @@
+/***************************************************************************//**
+ * @file gbl.c
+ * @brief Streaming parser and verifier for Gecko Bootloader (GBL) files.
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "byteorder.h"
+#include "crc32.h"
+#include "gbl.h"
+
+#define TAG_HEADER_SIZE         8
+#define GBL_MAJOR_VERSION       3
+
+// Application properties, see application_properties.h in the Gecko SDK
+#define APP_PROPS_VECTOR        (13 * 4)
+#define APP_PROPS_SIZE          28      // magic, version, type, location
+#define APP_SIGNATURE_CRC32     (1u << 1)
+
+enum {
+	PHASE_HEAD = 0,     // collecting a tag ID and length
+	PHASE_FIXED,        // collecting a tag's fixed fields
+	PHASE_BODY,         // streaming the rest of a payload
+	PHASE_END_CRC,      // collecting the end tag CRC
+	PHASE_DONE,
+};
+
+enum {
+	WINDOW_PROPS_POINTER = 0,
+	WINDOW_PROPS,
+	WINDOW_CRC,
+	WINDOW_CAPTURED,
+	WINDOW_NONE,        // the image asks for no CRC
+};
+
+static const uint8_t appPropsMagic[16] = {
+	0x13, 0xb7, 0x79, 0xfa, 0xc9, 0x25, 0xdd, 0xb7,
+	0xad, 0xf3, 0xcf, 0xe0, 0xf1, 0xb6, 0x14, 0xb8,
+};
+
+static inline uint32_t min_u32(uint32_t a, uint32_t b) {
+	return a < b ? a : b;
+}
+
+// Bytes of payload parsed before the payload is streamed.
+static uint32_t fixedSize(uint32_t id) {
+	switch (id) {
+	case GBL_TAG_HEADER:
+	case GBL_TAG_BOOTLOADER:
+	case GBL_TAG_SE_UPGRADE:
+		return 8;
+	case GBL_TAG_APPLICATION:
+		return 28;
+	case GBL_TAG_PROG:
+	case GBL_TAG_ERASEPROG:
+	case GBL_TAG_PROG_LZ4:
+	case GBL_TAG_PROG_LZMA:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+static void setWindow(gbl_parser_t *g, uint8_t step, uint32_t addr,
+		uint32_t len) {
+	g->windowStep = step;
+	g->windowAddr = addr;
+	g->windowLen = len;
+	g->windowHave = 0;
+}
+
+// A window of the image has been captured; decide what to capture next.
+static void nextWindow(gbl_parser_t *g) {
+	switch (g->windowStep) {
+	case WINDOW_PROPS_POINTER: {
+		uint32_t props = get_le32(g->window);
+		if (props < g->imageBase + APP_PROPS_VECTOR + 4) {
+			setWindow(g, WINDOW_NONE, 0, 0);
+		} else {
+			setWindow(g, WINDOW_PROPS, props, APP_PROPS_SIZE);
+		}
+		break;
+	}
+	case WINDOW_PROPS: {
+		uint32_t type = get_le32(g->window + 20);
+		uint32_t location = get_le32(g->window + 24);
+		if (memcmp(g->window, appPropsMagic, sizeof(appPropsMagic)) != 0
+				|| !(type & APP_SIGNATURE_CRC32)
+				|| location < g->windowAddr + APP_PROPS_SIZE) {
+			setWindow(g, WINDOW_NONE, 0, 0);
+		} else {
+			g->signatureLocation = location;
+			setWindow(g, WINDOW_CRC, location, 4);
+		}
+		break;
+	}
+	case WINDOW_CRC:
+		g->info.imageCrc = get_le32(g->window);
+		setWindow(g, WINDOW_CAPTURED, 0, 0);
+		break;
+	default:
+		break;
+	}
+}
+
+// Copy the parts of raw program data at addr that fall into the windows.
+static void capture(gbl_parser_t *g, uint32_t addr, const uint8_t *p,
+		uint32_t n) {
+	while (g->windowStep < WINDOW_CAPTURED) {
+		uint32_t want = g->windowAddr + g->windowHave;
+		uint32_t end = g->windowAddr + g->windowLen;
+		if (want < addr) {
+			// The bytes went by before we knew we needed them.
+			g->imageBroken = true;
+			return;
+		}
+		if (want >= addr + n) {
+			return;
+		}
+		uint32_t take = min_u32(end, addr + n) - want;
+		memcpy(g->window + g->windowHave, p + (want - addr), take);
+		g->windowHave += take;
+		if (g->windowHave < g->windowLen) {
+			return;
+		}
+		nextWindow(g);
+	}
+}
+
+static void imageBytes(gbl_parser_t *g, const uint8_t *p, uint32_t n) {
+	uint32_t addr = g->imageNext;
+	uint32_t hash = n;
+
+	capture(g, addr, p, n);
+	if (g->signatureLocation) {
+		if (g->signatureLocation < addr) {
+			hash = 0;
+		} else {
+			hash = min_u32(n, g->signatureLocation - addr);
+		}
+	}
+	g->imageCrc = crc32(g->imageCrc, p, hash);
+	g->imageNext += n;
+}
+
+// The fixed fields of the current tag are in g->fixed.
+static gbl_status_t parseFixed(gbl_parser_t *g) {
+	gbl_info_t *info = &g->info;
+	const uint8_t *f = g->fixed + TAG_HEADER_SIZE;
+	uint32_t payload = g->left;
+
+	switch (g->tag.id) {
+	case GBL_TAG_HEADER:
+		info->version = get_le32(f);
+		info->type = get_le32(f + 4);
+		if (info->version >> 24 != GBL_MAJOR_VERSION) {
+			return GBL_ERR_HEADER;
+		}
+		break;
+
+	case GBL_TAG_APPLICATION:
+		info->hasApplication = true;
+		info->appType = get_le32(f);
+		info->appVersion = get_le32(f + 4);
+		info->appCapabilities = get_le32(f + 8);
+		memcpy(info->productId, f + 12, sizeof(info->productId));
+		break;
+
+	case GBL_TAG_BOOTLOADER:
+		info->hasBootloader = true;
+		info->bootloaderVersion = get_le32(f);
+		info->bootloaderAddress = get_le32(f + 4);
+		info->bootloaderBytes += payload;
+		break;
+
+	case GBL_TAG_SE_UPGRADE:
+		info->seUpgradeBytes += payload;
+		break;
+
+	case GBL_TAG_PROG:
+	case GBL_TAG_ERASEPROG:
+	case GBL_TAG_PROG_LZ4:
+	case GBL_TAG_PROG_LZMA: {
+		uint32_t addr = get_le32(f);
+		if (info->progTags == 0 || addr < info->progStart) {
+			info->progStart = addr;
+		}
+		info->progTags++;
+		info->progBytes += payload;
+		if (g->tag.id == GBL_TAG_PROG_LZ4 || g->tag.id == GBL_TAG_PROG_LZMA) {
+			info->progLz4Tags += g->tag.id == GBL_TAG_PROG_LZ4;
+			info->progLzmaTags += g->tag.id == GBL_TAG_PROG_LZMA;
+			g->imageBroken = true;
+			break;
+		}
+		if (addr + payload > info->progEnd) {
+			info->progEnd = addr + payload;
+		}
+		if (!g->imageStarted) {
+			g->imageStarted = true;
+			g->imageBase = addr;
+			g->imageNext = addr;
+			setWindow(g, WINDOW_PROPS_POINTER, addr + APP_PROPS_VECTOR, 4);
+		} else if (addr != g->imageNext) {
+			g->imageBroken = true;
+		}
+		g->imageRaw = true;
+		break;
+	}
+
+	default:
+		break;
+	}
+	return GBL_OK;
+}
+
+// A tag ID and length are in g->fixed.
+static gbl_status_t startTag(gbl_parser_t *g) {
+	gbl_info_t *info = &g->info;
+
+	g->tag.id = get_le32(g->fixed);
+	g->tag.length = get_le32(g->fixed + 4);
+	g->tag.offset = info->size - TAG_HEADER_SIZE;
+	if (info->tags == 0 && g->tag.id != GBL_TAG_HEADER) {
+		return GBL_ERR_HEADER;
+	}
+	info->tags++;
+	if (g->onTag != NULL) {
+		g->onTag(&g->tag, g->ctx);
+	}
+
+	switch (g->tag.id) {
+	case GBL_TAG_END:
+		if (g->tag.length != 4) {
+			return GBL_ERR_TAG;
+		}
+		info->hasEnd = true;
+		info->crcComputed = g->crc;
+		g->fixedLen = 0;
+		g->fixedNeed = 4;
+		g->phase = PHASE_END_CRC;
+		return GBL_OK;
+	case GBL_TAG_ENC_INIT:
+	case GBL_TAG_ENC_DATA:
+		info->encryptedBytes += g->tag.length;
+		g->imageBroken = true;
+		break;
+	case GBL_TAG_CERTIFICATE:
+		info->hasCertificate = true;
+		break;
+	case GBL_TAG_SIGNATURE:
+		info->hasSignature = true;
+		break;
+	default:
+		break;
+	}
+
+	uint32_t fixed = fixedSize(g->tag.id);
+	if (g->tag.length < fixed) {
+		return GBL_ERR_TAG;
+	}
+	g->imageRaw = false;
+	g->fixedNeed = TAG_HEADER_SIZE + fixed;
+	g->left = g->tag.length - fixed;
+	g->phase = fixed ? PHASE_FIXED : PHASE_BODY;
+	return GBL_OK;
+}
+
+void gbl_parser_init(gbl_parser_t *parser, gbl_tag_fn_t on_tag, void *ctx) {
+	memset(parser, 0, sizeof(*parser));
+	parser->onTag = on_tag;
+	parser->ctx = ctx;
+	parser->fixedNeed = TAG_HEADER_SIZE;
+	parser->windowStep = WINDOW_NONE;
+}
+
+gbl_status_t gbl_parser_feed(gbl_parser_t *parser, const void *data,
+		size_t len) {
+	gbl_parser_t *g = parser;
+	const uint8_t *p = data;
+
+	while (len && g->status == GBL_OK) {
+		uint32_t n;
+
+		switch (g->phase) {
+		case PHASE_HEAD:
+		case PHASE_FIXED:
+		case PHASE_END_CRC:
+			n = min_u32((uint32_t) len, g->fixedNeed - g->fixedLen);
+			memcpy(g->fixed + g->fixedLen, p, n);
+			if (g->phase != PHASE_END_CRC) {
+				g->crc = crc32(g->crc, p, n);
+			}
+			g->fixedLen += n;
+			g->info.size += n;
+			p += n;
+			len -= n;
+			if (g->fixedLen < g->fixedNeed) {
+				break;
+			}
+			if (g->phase == PHASE_HEAD) {
+				g->status = startTag(g);
+				break;
+			}
+			if (g->phase == PHASE_END_CRC) {
+				g->info.crc = get_le32(g->fixed);
+				g->phase = PHASE_DONE;
+				break;
+			}
+			g->status = parseFixed(g);
+			g->phase = PHASE_BODY;
+			break;
+
+		case PHASE_BODY:
+			n = min_u32((uint32_t) len, g->left);
+			g->crc = crc32(g->crc, p, n);
+			if (g->imageRaw && !g->imageBroken) {
+				imageBytes(g, p, n);
+			}
+			g->left -= n;
+			g->info.size += n;
+			p += n;
+			len -= n;
+			break;
+
+		default:
+			g->status = GBL_ERR_TRAILING;
+			break;
+		}
+
+		if (g->phase == PHASE_BODY && g->left == 0) {
+			g->phase = PHASE_HEAD;
+			g->fixedLen = 0;
+			g->fixedNeed = TAG_HEADER_SIZE;
+		}
+	}
+	return g->status;
+}
+
+gbl_status_t gbl_parser_finish(gbl_parser_t *parser, gbl_info_t *info) {
+	gbl_parser_t *g = parser;
+	gbl_info_t *i = &g->info;
+	gbl_status_t status = g->status;
+
+	if (g->imageBroken) {
+		i->image = GBL_IMAGE_UNCHECKED;
+	} else if (g->windowStep == WINDOW_CAPTURED) {
+		i->imageCrcComputed = g->imageCrc;
+		i->image = g->imageCrc == i->imageCrc ? GBL_IMAGE_OK : GBL_IMAGE_BAD;
+	} else if (g->windowStep == WINDOW_CRC) {
+		// A CRC was asked for but the image stops before it.
+		i->image = GBL_IMAGE_BAD;
+	} else {
+		i->image = GBL_IMAGE_NONE;
+	}
+
+	if (status == GBL_OK) {
+		if (g->phase != PHASE_DONE) {
+			status = GBL_ERR_TRUNCATED;
+		} else if (i->crc != i->crcComputed) {
+			status = GBL_ERR_CRC;
+		} else if (i->image == GBL_IMAGE_BAD) {
+			status = GBL_ERR_IMAGE_CRC;
+		}
+	}
+	if (info != NULL) {
+		*info = *i;
+	}
+	return status;
+}
+
+gbl_status_t gbl_verify(const void *data, size_t len, gbl_info_t *info) {
+	gbl_parser_t parser;
+
+	gbl_parser_init(&parser, NULL, NULL);
+	gbl_parser_feed(&parser, data, len);
+	return gbl_parser_finish(&parser, info);
+}
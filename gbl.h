@@ -0,0 +1,164 @@
+/***************************************************************************//**
+ * @file gbl.h
+ * @brief Streaming parser and verifier for Gecko Bootloader (GBL) files.
+ *
+ * A GBL file is a sequence of tags, each a uint32 ID and a uint32 payload
+ * length followed by the payload, all little-endian. The first tag is the
+ * header and the last one the end tag, whose payload is the CRC-32 of every
+ * byte before it. The parser is fed the file in pieces of any size and
+ * holds no more than a tag's fixed fields, so it runs over a download in
+ * flash or a file read in blocks in a single pass.
+ *
+ * Besides the file CRC it checks the application image CRC when the image
+ * is carried in plain, uncompressed program data tags and its application
+ * properties (pointed to by vector table entry 13) ask for one, as images
+ * converted with `commander convert --crc` do. Encrypted and compressed
+ * images are parsed but their image CRC is reported as not checked, and
+ * signatures are reported but not verified.
+ ******************************************************************************/
+#ifndef GBL_H
+#define GBL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define GBL_TAG_HEADER          0x03A617EBu
+#define GBL_TAG_APPLICATION     0xF40A0AF4u
+#define GBL_TAG_BOOTLOADER      0xF50909F5u
+#define GBL_TAG_SE_UPGRADE      0x5EA617EBu
+#define GBL_TAG_METADATA        0xF60808F6u
+#define GBL_TAG_PROG            0xFE0101FEu
+#define GBL_TAG_ERASEPROG       0xFD0303FDu
+#define GBL_TAG_PROG_LZ4        0xFD0505FDu
+#define GBL_TAG_PROG_LZMA       0xFD0707FDu
+#define GBL_TAG_ENC_INIT        0xFA0606FAu
+#define GBL_TAG_ENC_DATA        0xF90707F9u
+#define GBL_TAG_CERTIFICATE     0xF30B0BF3u
+#define GBL_TAG_SIGNATURE       0xF70A0AF7u
+#define GBL_TAG_END             0xFC0404FCu
+
+// Header type bits
+#define GBL_TYPE_ENCRYPTED      0x00000001u
+#define GBL_TYPE_SIGNED         0x00000100u
+
+typedef enum {
+	GBL_OK = 0,
+	GBL_ERR_HEADER,         ///< Does not start with a version 3 header tag.
+	GBL_ERR_TAG,            ///< A tag is shorter than its fixed fields.
+	GBL_ERR_TRUNCATED,      ///< Ends before the end tag.
+	GBL_ERR_TRAILING,       ///< Data after the end tag.
+	GBL_ERR_CRC,            ///< File CRC mismatch.
+	GBL_ERR_IMAGE_CRC,      ///< Application image CRC mismatch.
+} gbl_status_t;
+
+typedef enum {
+	GBL_IMAGE_NONE = 0,     ///< No program data, or no CRC asked for.
+	GBL_IMAGE_OK,
+	GBL_IMAGE_BAD,
+	GBL_IMAGE_UNCHECKED,    ///< Encrypted, compressed or not contiguous.
+} gbl_image_check_t;
+
+typedef struct {
+	uint32_t id;
+	uint32_t length;        ///< Payload bytes.
+	uint32_t offset;        ///< File offset of the tag ID.
+} gbl_tag_t;
+
+/**
+ * @brief What a file contains, filled in as its tags go by.
+ */
+typedef struct {
+	uint32_t size;              ///< Bytes parsed.
+	uint32_t tags;
+	uint32_t version;           ///< Header.
+	uint32_t type;              ///< Header, GBL_TYPE_* bits.
+	bool hasApplication;
+	uint32_t appType;
+	uint32_t appVersion;
+	uint32_t appCapabilities;
+	uint8_t productId[16];
+	bool hasBootloader;
+	uint32_t bootloaderVersion;
+	uint32_t bootloaderAddress;
+	uint32_t bootloaderBytes;
+	uint32_t seUpgradeBytes;
+	uint32_t progTags;
+	uint32_t progBytes;         ///< Program data payload, as stored.
+	uint32_t progStart;         ///< Lowest program data address.
+	uint32_t progEnd;           ///< End of the highest raw program data.
+	uint32_t progLz4Tags;
+	uint32_t progLzmaTags;
+	uint32_t encryptedBytes;
+	bool hasCertificate;
+	bool hasSignature;
+	bool hasEnd;
+	uint32_t crc;               ///< Stored in the end tag.
+	uint32_t crcComputed;
+	gbl_image_check_t image;
+	uint32_t imageCrc;          ///< Stored in the image, when checked.
+	uint32_t imageCrcComputed;
+} gbl_info_t;
+
+typedef void (*gbl_tag_fn_t)(const gbl_tag_t *tag, void *ctx);
+
+/**
+ * @brief Parser state. Treat as opaque.
+ */
+typedef struct {
+	gbl_info_t info;
+	gbl_tag_fn_t onTag;
+	void *ctx;
+	gbl_status_t status;
+	uint8_t phase;
+	uint8_t fixed[36];          // tag header and fixed fields
+	uint32_t fixedLen;
+	uint32_t fixedNeed;
+	gbl_tag_t tag;
+	uint32_t left;              // payload bytes left in the tag
+	uint32_t crc;
+	// Application image CRC, over raw program data
+	bool imageRaw;              // current tag carries raw program data
+	bool imageBroken;           // cannot be checked
+	bool imageStarted;
+	uint32_t imageBase;
+	uint32_t imageNext;         // address the next raw byte lands at
+	uint32_t imageCrc;
+	uint32_t windowAddr;        // bytes of the image being captured
+	uint32_t windowLen;
+	uint32_t windowHave;
+	uint8_t window[28];
+	uint8_t windowStep;         // props pointer, properties, CRC word
+	uint32_t signatureLocation; // end of the image CRC, 0 until known
+} gbl_parser_t;
+
+/**
+ * @brief Start parsing a file.
+ *
+ * @param[in] on_tag Called with each tag header as it is reached, or NULL.
+ */
+void gbl_parser_init(gbl_parser_t *parser, gbl_tag_fn_t on_tag, void *ctx);
+
+/**
+ * @brief Parse the next piece of the file.
+ *
+ * @return GBL_OK, or the first error met; once an error is returned the
+ *         rest of the file is ignored.
+ */
+gbl_status_t gbl_parser_feed(gbl_parser_t *parser, const void *data,
+		size_t len);
+
+/**
+ * @brief Finish the file and check its CRCs.
+ *
+ * @param[out] info What the file contains, also on error, or NULL.
+ * @return GBL_OK, or why the file is not valid.
+ */
+gbl_status_t gbl_parser_finish(gbl_parser_t *parser, gbl_info_t *info);
+
+/**
+ * @brief Parse and verify a whole file in memory.
+ */
+gbl_status_t gbl_verify(const void *data, size_t len, gbl_info_t *info);
+
+#endif // GBL_H
@@ -0,0 +1,171 @@
+/***************************************************************************//**
+ * @file acq_stream.c
+ * @brief Stream RHS2116 acquisition through the host simulation build.
+ *
+ *   acq_stream [-o] [seconds] [queue slots] [packets per connection event]
+ *
+ * Boots the application, connects, negotiates and subscribes to acq_stream,
+ * then runs the superloop in 250 us steps of simulated time. Every frame is
+ * decoded as a central would: sequence numbers and sweep indices are
+ * checked for continuity and the samples against the RHS2116 model. With a
+ * queue limit the link is throttled (see sim_set_link_budget()), so
+ * backpressure and drops can be observed. With -o a second central joins
+ * halfway through without negotiating anything; the stream must carry on
+ * at the streaming central's MTU. Ends with the acquisition stats.
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "acq.h"
+#include "app.h"
+#include "byteorder.h"
+#include "config.h"
+#include "delta_pack.h"
+#include "gatt_db.h"
+#include "rhs2116.h"
+#include "sim.h"
+
+#define STEP_NS 250000ull
+
+static struct {
+	size_t frames;
+	size_t bytes;
+	size_t sweeps;
+	size_t seqErrors;
+	size_t gaps;            // sweeps missing between frames
+	size_t decodeErrors;
+	size_t mismatches;      // samples unlike the model's
+	uint16_t nextSeq;
+	uint32_t nextSweep;
+} rx;
+
+static void onNotification(uint8_t connection, uint16_t characteristic,
+		const uint8_t *value, size_t len) {
+	static uint16_t samples[ACQ_FRAME_MAX_SWEEPS * RHS2116_CHANNELS];
+	(void) connection;
+
+	if (characteristic != gattdb_acq_stream) {
+		return;
+	}
+	if (len < ACQ_FRAME_HEADER_SIZE) {
+		rx.decodeErrors++;
+		return;
+	}
+	uint16_t seq = get_le16(value);
+	uint32_t first = get_le32(value + 2);
+	uint8_t count = value[6];
+	uint16_t mask = get_le16(value + 7);
+	size_t channels = (size_t) __builtin_popcount(mask);
+
+	rx.frames++;
+	rx.bytes += len;
+	if (seq != rx.nextSeq) {
+		rx.seqErrors++;
+	}
+	rx.nextSeq = (uint16_t) (seq + 1);
+	if (first < rx.nextSweep) {
+		rx.decodeErrors++;
+	} else {
+		rx.gaps += first - rx.nextSweep;
+	}
+	rx.nextSweep = first + count;
+
+	if (count == 0 || count > ACQ_FRAME_MAX_SWEEPS
+			|| delta_pack_decode(value + ACQ_FRAME_HEADER_SIZE,
+					len - ACQ_FRAME_HEADER_SIZE, channels, count, samples)
+					!= SL_STATUS_OK) {
+		rx.decodeErrors++;
+		return;
+	}
+	rx.sweeps += count;
+	// Without overruns, the n-th sweep holds each channel's n-th conversion.
+	for (size_t s = 0; s < count; s++) {
+		size_t i = 0;
+		for (uint8_t c = 0; c < RHS2116_CHANNELS; c++) {
+			if (!(mask & (1u << c))) {
+				continue;
+			}
+			if (samples[s * channels + i++]
+					!= sim_rhs2116_sample(c, first + (uint32_t) s)) {
+				rx.mismatches++;
+			}
+		}
+	}
+}
+
+int main(int argc, char **argv) {
+	unsigned int seconds = 10;
+	size_t slots = 0, perEvent = 0;
+	bool observer = argc > 1 && strcmp(argv[1], "-o") == 0;
+
+	if (observer) {
+		argc--;
+		argv++;
+	}
+	if (argc > 1) {
+		seconds = (unsigned int) strtoul(argv[1], NULL, 0);
+	}
+	if (argc > 3) {
+		slots = strtoul(argv[2], NULL, 0);
+		perEvent = strtoul(argv[3], NULL, 0);
+	}
+	if (seconds == 0 || (argc > 1 && argc != 2 && argc != 4)) {
+		fprintf(stderr, "usage: acq_stream [-o] [seconds] [queue slots] "
+				"[per event]\n");
+		return 2;
+	}
+
+	sim_reset();
+	app_init();
+	sim_boot();
+	uint8_t conn = sim_connect();
+	sim_negotiate(conn);
+	sim_set_notification_sink(onNotification);
+	sim_set_link_budget(slots, perEvent);
+	sim_subscribe(conn, gattdb_acq_stream, sl_bt_gatt_server_notification);
+
+	uint64_t steps = (uint64_t) seconds * 1000000000ull / STEP_NS;
+	size_t framesBefore = 0;
+	for (uint64_t i = 0; i < steps; i++) {
+		if (observer && i == steps / 2) {
+			framesBefore = rx.frames;
+			sim_connect();
+		}
+		sim_advance(STEP_NS);
+		app_process_action();
+	}
+	sim_subscribe(conn, gattdb_acq_stream, sl_bt_gatt_server_disable);
+	app_process_action();
+
+	acq_stats_t stats;
+	acq_get_stats(&stats);
+	bool checkSamples = stats.overruns == 0;
+	printf("stream %us link=%s: frames=%zu sweeps=%zu bytes=%zu "
+			"(%.1f kbit/s) seq_errors=%zu gaps=%zu decode_errors=%zu "
+			"mismatches=%s%zu\n", seconds, slots ? "throttled" : "unlimited",
+			rx.frames, rx.sweeps, rx.bytes, rx.bytes * 8.0 / seconds / 1000.0,
+			rx.seqErrors, rx.gaps, rx.decodeErrors,
+			checkSamples ? "" : "unchecked ", rx.mismatches);
+	printf("stats samples/s=%u of %u acquired=%u sent=%u dropped_frames=%u "
+			"dropped_sweeps=%u overruns=%u backpressure=%u high_water=%u "
+			"ratio=%.2f\n", (unsigned int) stats.samplesPerSecond,
+			(unsigned int) stats.configuredSamplesPerSecond,
+			(unsigned int) stats.sweepsAcquired, (unsigned int) stats.framesSent,
+			(unsigned int) stats.framesDropped,
+			(unsigned int) stats.sweepsDropped, (unsigned int) stats.overruns,
+			(unsigned int) stats.backpressure, stats.ringHighWater,
+			stats.packedBytes ? (double) stats.rawBytes / stats.packedBytes
+					: 0.0);
+
+	if (observer) {
+		printf("observer joined: frames %zu before, %zu after\n", framesBefore,
+				rx.frames - framesBefore);
+	}
+
+	bool ok = rx.frames > 0 && (!observer || rx.frames - framesBefore
+			>= framesBefore * 9 / 10) && rx.seqErrors == 0 && rx.decodeErrors == 0
+			&& (!checkSamples || rx.mismatches == 0);
+	return ok ? 0 : 1;
+}
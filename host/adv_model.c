@@ -0,0 +1,114 @@
+/***************************************************************************//**
+ * @file adv_model.c
+ * @brief Trade reconnect latency against idle current for an advertising
+ *        policy, through the host simulation build.
+ *
+ *   adv_model [idle_s] [interval,duration_ms]...
+ *
+ * Without stages the defaults from config.h are used; otherwise the stages
+ * are sent over nodeRx with CMD_OP_ADV_POLICY first. The central then
+ * drops the link and the device stays unconnected for idle_s seconds
+ * (default 600) on the simulation clock. Prints each stage as it starts
+ * with the worst-case discovery delay (one interval) and its estimated
+ * advertising current, then the charge estimate from power.c for the whole
+ * idle time.
+ ******************************************************************************/
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "adv_policy.h"
+#include "app.h"
+#include "cmd_proto.h"
+#include "config.h"
+#include "gatt_db.h"
+#include "power.h"
+#include "sim.h"
+
+#define MODEL_STEP_NS   10000000ull // 10 ms
+
+static int sendPolicy(uint8_t connection, const adv_policy_t *policy) {
+	uint8_t data[NODE_RX_MAX_SIZE];
+	uint8_t reply[NODE_TX_MAX_SIZE];
+	size_t len, replyLen;
+
+	data[0] = CMD_PROTO_SOF;
+	data[1] = CMD_PROTO_VERSION;
+	data[2] = CMD_OP_ADV_POLICY;
+	data[3] = 0;
+	len = CMD_HEADER_SIZE + adv_policy_encode(policy, data + CMD_HEADER_SIZE,
+			sizeof(data) - CMD_HEADER_SIZE - CMD_CRC_SIZE);
+	uint16_t crc = cmd_crc16(data, len);
+	data[len++] = (uint8_t) crc;
+	data[len++] = (uint8_t) (crc >> 8);
+	if (sim_gatt_write(connection, gattdb_node_rx, data, len) != SL_STATUS_OK
+			|| sim_gatt_read(gattdb_node_tx, reply, sizeof(reply), &replyLen)
+					!= SL_STATUS_OK || replyLen <= CMD_HEADER_SIZE) {
+		return -1;
+	}
+	return reply[CMD_HEADER_SIZE];
+}
+
+int main(int argc, char **argv) {
+	uint64_t idleMs = 600000;
+	adv_policy_t policy = { 0 };
+
+	if (argc > 1) {
+		idleMs = strtoull(argv[1], NULL, 0) * 1000;
+	}
+	for (int i = 2; i < argc; i++) {
+		adv_policy_stage_t *st = &policy.stages[policy.stageCount];
+		unsigned int interval;
+		if (policy.stageCount == ADV_POLICY_MAX_STAGES
+				|| sscanf(argv[i], "%u,%" SCNu32, &interval, &st->durationMs)
+						!= 2) {
+			fprintf(stderr, "usage: %s [idle_s] [interval,duration_ms]... "
+					"(up to %d stages)\n", argv[0], ADV_POLICY_MAX_STAGES);
+			return 1;
+		}
+		st->interval = (uint16_t) interval;
+		policy.stageCount++;
+	}
+
+	sim_nvm3_erase();
+	sim_reset();
+	app_init();
+	sim_boot();
+	uint8_t connection = sim_connect();
+	if (policy.stageCount) {
+		int status = sendPolicy(connection, &policy);
+		if (status != CMD_OK) {
+			printf("policy rejected: status %d\n", status);
+			return 1;
+		}
+	}
+	policy = *adv_policy_get();
+
+	// Count only the idle time from the dropout on.
+	sim_disconnect(connection, 0);
+	power_stats_t before, after;
+	power_get(&before);
+
+	int stage = -1;
+	for (uint64_t ms = 0; ms <= idleMs; ms += MODEL_STEP_NS / 1000000) {
+		if (adv_policy_stage() != stage) {
+			stage = adv_policy_stage();
+			uint16_t interval = policy.stages[stage].interval;
+			printf("%9.1f s  stage %d  interval %7.2f ms  adv %6.1f uA\n",
+					(double) ms / 1000, stage, interval * 0.625,
+					(double) POWER_ADV_EVENT_NC * 1.6 / interval);
+		}
+		sim_advance(MODEL_STEP_NS);
+		app_process_action();
+	}
+	power_get(&after);
+
+	uint64_t charge = after.chargeNah - before.chargeNah;
+	uint64_t ms = after.uptimeMs - before.uptimeMs;
+	printf("idle %" PRIu64 " s: charge=%" PRIu64 " nAh average=%.1f uA "
+			"advertising data generated %zu time(s)\n", ms / 1000, charge,
+			ms ? (double) charge * 3600.0 / (double) ms : 0.0,
+			sim_advertising_data_generated());
+	return 0;
+}
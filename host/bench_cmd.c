@@ -0,0 +1,324 @@
+/***************************************************************************//**
+ * @file bench_cmd.c
+ * @brief Command-path benchmark for the host simulation build.
+ *
+ * Feeds synthetic sl_bt_evt_gatt_server_attribute_value_id events for
+ * gattdb_node_rx through sl_bt_on_event() and reports per-command latency
+ * percentiles and throughput, for both the legacy ASCII and the binary
+ * encoding of each scenario, sent as separate writes, as one batch write,
+ * and as a burst with a notification subscriber. Each result line starts
+ * with "bench" and is stable across runs so numbers can be tracked per
+ * firmware revision.
+ ******************************************************************************/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app.h"
+#include "cmd_proto.h"
+#include "config.h"
+#include "conn_tuning.h"
+#include "gatt_db.h"
+#include "sim.h"
+
+#define BENCH_DEFAULT_ITERATIONS 200000
+#define BENCH_WARMUP_ITERATIONS  1000
+
+#define BENCH_MAX_COMMANDS       4
+
+typedef struct {
+	const char *name;
+	const char *commands[BENCH_MAX_COMMANDS];
+} bench_case_t;
+
+// One encoded nodeRx write.
+typedef struct {
+	uint8_t data[NODE_RX_MAX_SIZE];
+	size_t len;
+} bench_write_t;
+
+static const bench_case_t cases[] = {
+	{ "single",   { "_A5" } },
+	{ "full",     { "_A100,F20,P200,G1" } },
+	{ "led",      { "_L1" } },
+	{ "mixed",    { "_A100,F20,P200,G1", "_A5", "_F130,P90", "_G0" } },
+};
+
+static int compare_u64(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t*) a;
+	uint64_t y = *(const uint64_t*) b;
+	return (x > y) - (x < y);
+}
+
+static void report(const char *path, const char *name, uint64_t *samples,
+		size_t n, uint64_t total_ns) {
+	uint64_t sum = 0;
+	for (size_t i = 0; i < n; i++) {
+		sum += samples[i];
+	}
+	qsort(samples, n, sizeof(samples[0]), compare_u64);
+	printf("bench %-9s %-6s n=%zu min=%llu p50=%llu p99=%llu max=%llu "
+			"mean=%.1f ns throughput=%.0f cmd/s\n", path, name, n,
+			(unsigned long long) samples[0],
+			(unsigned long long) samples[n / 2],
+			(unsigned long long) samples[(n * 99) / 100],
+			(unsigned long long) samples[n - 1], (double) sum / (double) n,
+			(double) n * 1e9 / (double) total_ns);
+}
+
+static size_t case_command_count(const bench_case_t *c) {
+	size_t count = 0;
+	while (count < BENCH_MAX_COMMANDS && c->commands[count] != NULL) {
+		count++;
+	}
+	return count;
+}
+
+/* Encode a case's commands in the requested wire format. */
+static size_t encode_case(const bench_case_t *c, cmd_format_t format,
+		bench_write_t *writes) {
+	size_t count = case_command_count(c);
+
+	for (size_t i = 0; i < count; i++) {
+		size_t len = strlen(c->commands[i]);
+		if (format == CMD_FORMAT_ASCII) {
+			memcpy(writes[i].data, c->commands[i], len);
+			writes[i].len = len;
+		} else {
+			cmd_t cmd;
+			cmd_decode((const uint8_t*) c->commands[i], len, &cmd);
+			writes[i].len = cmd_encode_set((uint8_t) i, &cmd, writes[i].data,
+					sizeof(writes[i].data));
+		}
+	}
+	return count;
+}
+
+/* Encode all of a case's commands as a single batch write. */
+static void encode_batch(const bench_case_t *c, cmd_format_t format,
+		bench_write_t *write) {
+	size_t count = case_command_count(c);
+
+	if (format == CMD_FORMAT_ASCII) {
+		size_t len = 0;
+		for (size_t i = 0; i < count; i++) {
+			const char *s = c->commands[i];
+			size_t n;
+			if (i) {
+				write->data[len++] = CMD_ASCII_SEPARATOR;
+				s++; // drop the '_' of the following commands
+			}
+			n = strlen(s);
+			memcpy(write->data + len, s, n);
+			len += n;
+		}
+		write->len = len;
+	} else {
+		cmd_t cmds[BENCH_MAX_COMMANDS];
+		for (size_t i = 0; i < count; i++) {
+			cmd_decode((const uint8_t*) c->commands[i], strlen(c->commands[i]),
+					&cmds[i]);
+		}
+		write->len = cmd_encode_batch(0, cmds, count, write->data,
+				sizeof(write->data));
+	}
+}
+
+static void warmup(const bench_write_t *writes, size_t count,
+		uint8_t connection) {
+	for (size_t i = 0; i < BENCH_WARMUP_ITERATIONS; i++) {
+		const bench_write_t *w = &writes[i % count];
+		sim_gatt_write(connection, gattdb_node_rx, w->data, w->len);
+	}
+}
+
+/* Full event path: GATT write -> sl_bt_on_event -> decode -> nodeTx update. */
+static void bench_event_path(const char *path, const char *name,
+		const bench_write_t *writes, size_t count, uint8_t connection,
+		uint64_t *samples, size_t n) {
+	uint64_t start = sim_now_ns();
+
+	for (size_t i = 0; i < n; i++) {
+		const bench_write_t *w = &writes[i % count];
+		uint64_t t0 = sim_now_ns();
+		sim_gatt_write(connection, gattdb_node_rx, w->data, w->len);
+		samples[i] = sim_now_ns() - t0;
+	}
+	report(path, name, samples, n, sim_now_ns() - start);
+}
+
+/*
+ * Writes of a case arriving in one connection event, with a client
+ * subscribed to nodeTx notifications: one sample per burst, including the
+ * superloop passes that coalesce and send the notification.
+ */
+static void bench_burst(const char *path, const char *name,
+		const bench_write_t *writes, size_t count, uint8_t connection,
+		uint8_t subscriber, uint64_t *samples, size_t n) {
+	const uint8_t *data[BENCH_MAX_COMMANDS];
+	size_t len[BENCH_MAX_COMMANDS];
+	size_t sent = sim_notification_count(subscriber);
+	uint64_t start = sim_now_ns();
+
+	for (size_t i = 0; i < count; i++) {
+		data[i] = writes[i].data;
+		len[i] = writes[i].len;
+	}
+	for (size_t i = 0; i < n; i++) {
+		uint64_t t0 = sim_now_ns();
+		sim_gatt_write_burst(connection, gattdb_node_rx, data, len, count);
+		samples[i] = sim_now_ns() - t0;
+	}
+	report(path, name, samples, n, sim_now_ns() - start);
+	printf("notify %-9s %-6s writes/burst=%zu notifications/burst=%.2f\n", path,
+			name, count,
+			(double) (sim_notification_count(subscriber) - sent) / (double) n);
+}
+
+/* Decoder alone, without the stack round trip through the GATT database. */
+static void bench_parser(const char *path, const char *name,
+		const bench_write_t *writes, size_t count, uint64_t *samples,
+		size_t n) {
+	uint64_t start = sim_now_ns();
+	cmd_t cmd;
+
+	for (size_t i = 0; i < n; i++) {
+		const bench_write_t *w = &writes[i % count];
+		uint64_t t0 = sim_now_ns();
+		handleNodeRxChange(w->data, w->len, &cmd);
+		samples[i] = sim_now_ns() - t0;
+	}
+	report(path, name, samples, n, sim_now_ns() - start);
+}
+
+int main(int argc, char **argv) {
+	size_t n = BENCH_DEFAULT_ITERATIONS;
+	uint64_t *samples;
+	uint8_t connection;
+
+	if (argc > 1) {
+		n = strtoul(argv[1], NULL, 0);
+		if (n == 0) {
+			fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+			return 1;
+		}
+	}
+	samples = malloc(n * sizeof(samples[0]));
+	if (samples == NULL) {
+		return 1;
+	}
+
+	sim_reset();
+	app_init();
+	sim_boot();
+	connection = sim_connect();
+	sim_negotiate(connection);
+
+	// Sanity check that the command path is wired up before timing it.
+	{
+		const char *cmd = "_A100,F20,P200,G1";
+		char tx[64] = { 0 };
+		size_t len = 0;
+		sim_gatt_write(connection, gattdb_node_rx, (const uint8_t*) cmd,
+				strlen(cmd));
+		sim_gatt_read(gattdb_node_tx, (uint8_t*) tx, sizeof(tx) - 1, &len);
+		if (strcmp(tx, cmd) != 0) {
+			fprintf(stderr, "unexpected nodeTx \"%s\"\n", tx);
+			return 1;
+		}
+	}
+	{
+		cmd_t cmd = { .mask = CMD_FIELD_AMPLITUDE, .value = { 7 } };
+		uint8_t frame[CMD_FRAME_MAX_SIZE];
+		uint8_t tx[NODE_TX_MAX_SIZE];
+		size_t len = cmd_encode_set(0x42, &cmd, frame, sizeof(frame));
+		sim_gatt_write(connection, gattdb_node_rx, frame, len);
+		sim_gatt_read(gattdb_node_tx, tx, sizeof(tx), &len);
+		if (len != CMD_STATE_FRAME_SIZE || tx[2] != CMD_OP_STATE
+				|| tx[3] != 0x42 || tx[4] != CMD_OK || tx[7] != 7) {
+			fprintf(stderr, "unexpected binary nodeTx reply\n");
+			return 1;
+		}
+	}
+
+	{
+		// A batch is all or nothing: the second entry is out of range, so
+		// the first must not be applied either.
+		cmd_t cmds[2] = {
+			{ .mask = CMD_FIELD_AMPLITUDE, .value = { 9 } },
+			{ .mask = CMD_FIELD_FREQUENCY | CMD_FIELD_PULSE_WIDTH
+					| CMD_FIELD_PHASES, .value = { [1] = 10000, [2] = 60,
+					[5] = 2 } },
+		};
+		uint8_t frame[NODE_RX_MAX_SIZE];
+		uint8_t tx[NODE_TX_MAX_SIZE];
+		size_t len = cmd_encode_batch(0x43, cmds, 2, frame, sizeof(frame));
+		sim_gatt_write(connection, gattdb_node_rx, frame, len);
+		sim_gatt_read(gattdb_node_tx, tx, sizeof(tx), &len);
+		if (tx[3] != 0x43 || tx[4] != CMD_ERR_RANGE || tx[7] != 7) {
+			fprintf(stderr, "batch was not rejected as a whole\n");
+			return 1;
+		}
+		// The same entries plus a fix-up, sent as a long write.
+		cmds[1].mask |= CMD_FIELD_LED;
+		cmd_t fix[16];
+		for (size_t i = 0; i < 16; i++) {
+			fix[i] = cmds[i % 2];
+			fix[i].value[2] = 40;
+		}
+		len = cmd_encode_batch(0x44, fix, 16, frame, sizeof(frame));
+		sim_gatt_long_write(connection, gattdb_node_rx, frame, len, 64);
+		sim_gatt_read(gattdb_node_tx, tx, sizeof(tx), &len);
+		if (tx[3] != 0x44 || tx[4] != CMD_OK || tx[7] != 9) {
+			fprintf(stderr, "long batch write not applied\n");
+			return 1;
+		}
+	}
+
+	// An observer subscribed to nodeTx sees the controller's bursts.
+	uint8_t subscriber = sim_connect();
+	sim_negotiate(subscriber);
+	sim_subscribe(subscriber, gattdb_node_tx, sl_bt_gatt_server_notification);
+
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		bench_write_t writes[BENCH_MAX_COMMANDS];
+		size_t count;
+
+		count = encode_case(&cases[i], CMD_FORMAT_ASCII, writes);
+		warmup(writes, count, connection);
+		bench_event_path("event", cases[i].name, writes, count, connection,
+				samples, n);
+		bench_parser("parse", cases[i].name, writes, count, samples, n);
+		bench_burst("burst", cases[i].name, writes, count, connection,
+				subscriber, samples, n);
+
+		if (count > 1) {
+			encode_batch(&cases[i], CMD_FORMAT_ASCII, &writes[0]);
+			bench_event_path("batch", cases[i].name, writes, 1, connection,
+					samples, n);
+			encode_batch(&cases[i], CMD_FORMAT_BINARY, &writes[0]);
+			bench_event_path("batch-bin", cases[i].name, writes, 1,
+					connection, samples, n);
+		}
+
+		count = encode_case(&cases[i], CMD_FORMAT_BINARY, writes);
+		warmup(writes, count, connection);
+		bench_event_path("event-bin", cases[i].name, writes, count,
+				connection, samples, n);
+		bench_parser("parse-bin", cases[i].name, writes, count, samples, n);
+		bench_burst("burst-bin", cases[i].name, writes, count, connection,
+				subscriber, samples, n);
+	}
+
+	// What the link negotiated and what the device measured itself.
+	const conn_tuning_stats_t *link = conn_tuning_get(connection);
+	printf("link interval=%u phy=%u mtu=%u tx_octets=%u apply_us last=%u "
+			"min=%u max=%u samples=%u\n", link->interval, link->phy, link->mtu,
+			link->txOctets, (unsigned) link->lastLatencyUs,
+			(unsigned) link->minLatencyUs, (unsigned) link->maxLatencyUs,
+			(unsigned) link->samples);
+
+	free(samples);
+	return 0;
+}
@@ -0,0 +1,416 @@
+/***************************************************************************//**
+ * @file bench_detect.c
+ * @brief Benchmark of the closed-loop detectors and their filter kernels.
+ *
+ *   bench_detect [iterations [recording.raw]]
+ *
+ * Runs on three test recordings of one channel at ACQ_SAMPLE_RATE_HZ, built
+ * the same way on every run: sharp-wave ripples (60 ms bursts at 200 Hz,
+ * at known onsets, over theta and noise), theta in episodes (8 Hz, 2 s on,
+ * 1 s off, over noise), and noise alone. A recording of raw little-endian
+ * uint16 RHS2116 samples, one channel at ACQ_SAMPLE_RATE_HZ, can be given
+ * as well; it is run with the ripple detector, without scoring.
+ *
+ * For each recording it reports:
+ *  - ns per sample of the biquad and energy kernels, with DSP_SIMD and in
+ *    reference C, and checks that both give identical results;
+ *  - the detector's triggers run offline through detect.c: ripples found,
+ *    missed and false, and the delay from onset to the end of the block
+ *    that triggered; the phase of theta at phase-locked triggers; false
+ *    triggers per minute on noise;
+ *  - the same recording played through the simulation on channel 0 with
+ *    the detector set over nodeRx: trains started and the latency from the
+ *    triggering sweep to the train, as detect_stats_t reports it. The
+ *    simulated bus takes no clock time, so this is the wait for the rest
+ *    of the block plus the processing.
+ *
+ * Each result line starts with "bench". Kernel times vary with the host;
+ * on the target, PROF_DETECT gives the cycles per block.
+ ******************************************************************************/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app.h"
+#include "byteorder.h"
+#include "cmd_proto.h"
+#include "config.h"
+#include "detect.h"
+#include "dsp.h"
+#include "gatt_db.h"
+#include "rhs2116.h"
+#include "sim.h"
+
+#define BENCH_DEFAULT_ITERATIONS 20
+#define BENCH_SECONDS            60
+#define BENCH_SAMPLES            (BENCH_SECONDS * ACQ_SAMPLE_RATE_HZ)
+#define BENCH_MAX_EVENTS         256
+#define BENCH_MAX_TRIGGERS       8192
+#define BENCH_STEP_NS            250000ull
+#define BENCH_RIPPLE_MS          60
+#define BENCH_THETA_HZ           8.0
+
+typedef enum {
+	SCORE_EVENTS = 0,
+	SCORE_PHASE,
+	SCORE_FALSE,
+	SCORE_NONE,
+} score_t;
+
+typedef struct {
+	const char *name;
+	score_t score;
+	detect_config_t config;
+	uint16_t samples[BENCH_SAMPLES];
+	size_t count;
+	size_t onsets[BENCH_MAX_EVENTS];
+	size_t onsetCount;
+} recording_t;
+
+static recording_t recordings[4];
+static size_t triggers[BENCH_MAX_TRIGGERS];
+static size_t triggerCount;
+static size_t nowSweep;
+static int16_t scratch[BENCH_SAMPLES];
+static int16_t filtered[2][BENCH_SAMPLES];
+static uint32_t rng = 1;
+
+static const detect_config_t rippleDetector = {
+	.mode = DETECT_MODE_THRESHOLD, .highpassHz = 150, .lowpassHz = 250,
+	.threshold = 60, .envelopeMs = 8, .refractoryMs = 200, .pulses = 5,
+};
+static const detect_config_t thetaDetector = {
+	.mode = DETECT_MODE_RISING, .highpassHz = 5, .lowpassHz = 12,
+	.threshold = 50, .envelopeMs = 100, .refractoryMs = 100, .pulses = 1,
+};
+
+// Roughly Gaussian, unit variance.
+static double noise(void) {
+	double sum = 0;
+	for (int i = 0; i < 12; i++) {
+		rng = rng * 1664525u + 1013904223u;
+		sum += (rng >> 8) / 16777216.0;
+	}
+	return sum - 6.0;
+}
+
+static uint16_t code(double v) {
+	long c = lround(32768.0 + v);
+	return (uint16_t) (c < 0 ? 0 : c > 65535 ? 65535 : c);
+}
+
+static void makeRipples(recording_t *r) {
+	const double rate = ACQ_SAMPLE_RATE_HZ;
+	size_t next = ACQ_SAMPLE_RATE_HZ;
+
+	r->name = "ripples";
+	r->score = SCORE_EVENTS;
+	r->config = rippleDetector;
+	r->count = BENCH_SAMPLES;
+	for (size_t n = 0; n < r->count; n++) {
+		if (n == next && r->onsetCount < BENCH_MAX_EVENTS) {
+			r->onsets[r->onsetCount++] = n;
+			// The next one 0.5 to 2 s later.
+			next += ACQ_SAMPLE_RATE_HZ / 2
+					+ (size_t) (rng % (3 * ACQ_SAMPLE_RATE_HZ / 2));
+		}
+		double v = 150.0 * sin(2.0 * M_PI * BENCH_THETA_HZ * n / rate)
+				+ 25.0 * noise();
+		if (r->onsetCount) {
+			size_t k = n - r->onsets[r->onsetCount - 1];
+			size_t len = BENCH_RIPPLE_MS * ACQ_SAMPLE_RATE_HZ / 1000;
+			if (k < len) {
+				double window = 0.5 - 0.5 * cos(2.0 * M_PI * k / len);
+				v += 250.0 * window * sin(2.0 * M_PI * 200.0 * k / rate);
+			}
+		}
+		r->samples[n] = code(v);
+	}
+}
+
+static void makeTheta(recording_t *r) {
+	const double rate = ACQ_SAMPLE_RATE_HZ;
+
+	r->name = "theta";
+	r->score = SCORE_PHASE;
+	r->config = thetaDetector;
+	r->count = BENCH_SAMPLES;
+	for (size_t n = 0; n < r->count; n++) {
+		bool on = (n / ACQ_SAMPLE_RATE_HZ) % 3 != 2;
+		double v = 25.0 * noise();
+		if (on) {
+			v += 200.0 * sin(2.0 * M_PI * BENCH_THETA_HZ * n / rate);
+		}
+		r->samples[n] = code(v);
+	}
+}
+
+static void makeNoise(recording_t *r) {
+	r->name = "noise";
+	r->score = SCORE_FALSE;
+	r->config = rippleDetector;
+	r->count = BENCH_SAMPLES;
+	for (size_t n = 0; n < r->count; n++) {
+		r->samples[n] = code(25.0 * noise());
+	}
+}
+
+static bool load(recording_t *r, const char *path) {
+	FILE *f = fopen(path, "rb");
+	uint8_t b[2];
+
+	if (f == NULL) {
+		return false;
+	}
+	r->name = "file";
+	r->score = SCORE_NONE;
+	r->config = rippleDetector;
+	while (r->count < BENCH_SAMPLES && fread(b, 1, 2, f) == 2) {
+		r->samples[r->count++] = (uint16_t) (b[0] | (b[1] << 8));
+	}
+	fclose(f);
+	return r->count >= DETECT_BLOCK_SWEEPS;
+}
+
+static sl_status_t onFire(uint32_t pulses) {
+	(void) pulses;
+	if (triggerCount < BENCH_MAX_TRIGGERS) {
+		triggers[triggerCount++] = nowSweep;
+	}
+	return SL_STATUS_OK;
+}
+
+static int benchKernels(const recording_t *r, unsigned int iterations) {
+	const size_t n = r->count - r->count % DETECT_BLOCK_SWEEPS;
+	dsp_biquad_t sections[2][2];
+	uint64_t ns[2] = { 0, 0 }, energyNs[2] = { 0, 0 };
+	uint64_t energy[2] = { 0, 0 };
+	int errors = 0;
+
+	for (size_t i = 0; i < n; i++) {
+		scratch[i] = (int16_t) (r->samples[i] ^ 0x8000u);
+	}
+	for (int k = 0; k < 2; k++) {
+		dsp_biquad_design(DSP_HIGHPASS, ACQ_SAMPLE_RATE_HZ,
+				r->config.highpassHz, &sections[k][0]);
+		dsp_biquad_design(DSP_LOWPASS, ACQ_SAMPLE_RATE_HZ,
+				r->config.lowpassHz, &sections[k][1]);
+	}
+	for (unsigned int it = 0; it < iterations; it++) {
+		for (int k = 0; k < 2; k++) {
+			void (*biquad)(dsp_biquad_t*, const int16_t*, int16_t*, size_t) =
+					k ? dsp_biquad_ref : dsp_biquad;
+			uint64_t (*sum)(const int16_t*, size_t) =
+					k ? dsp_energy_ref : dsp_energy;
+			dsp_biquad_reset(&sections[k][0]);
+			dsp_biquad_reset(&sections[k][1]);
+
+			uint64_t start = sim_now_ns();
+			for (size_t i = 0; i < n; i += DETECT_BLOCK_SWEEPS) {
+				biquad(&sections[k][0], scratch + i, filtered[k] + i,
+						DETECT_BLOCK_SWEEPS);
+				biquad(&sections[k][1], filtered[k] + i, filtered[k] + i,
+						DETECT_BLOCK_SWEEPS);
+			}
+			uint64_t mid = sim_now_ns();
+			energy[k] = 0;
+			for (size_t i = 0; i < n; i += DETECT_BLOCK_SWEEPS) {
+				energy[k] += sum(filtered[k] + i, DETECT_BLOCK_SWEEPS);
+			}
+			ns[k] += mid - start;
+			energyNs[k] += sim_now_ns() - mid;
+		}
+	}
+	if (memcmp(filtered[0], filtered[1], n * sizeof(int16_t)) != 0
+			|| energy[0] != energy[1]) {
+		errors++;
+	}
+	double samples = (double) n * iterations;
+	printf("bench %-8s kernels  biquad x2 ns/sample=%.2f (ref %.2f) "
+			"energy ns/sample=%.2f (ref %.2f) simd=%d errors=%d\n", r->name,
+			ns[0] / samples, ns[1] / samples, energyNs[0] / samples,
+			energyNs[1] / samples, DSP_SIMD, errors);
+	return errors;
+}
+
+static void score(const recording_t *r, const char *where) {
+	const size_t rate = ACQ_SAMPLE_RATE_HZ;
+
+	switch (r->score) {
+	case SCORE_EVENTS: {
+		size_t hits = 0, matched = 0;
+		double delay = 0, worst = 0;
+		size_t t = 0;
+		for (size_t e = 0; e < r->onsetCount; e++) {
+			size_t from = r->onsets[e];
+			size_t to = from + (BENCH_RIPPLE_MS + 20) * rate / 1000;
+			while (t < triggerCount && triggers[t] < from) {
+				t++;
+			}
+			if (t < triggerCount && triggers[t] < to) {
+				double ms = (triggers[t] - from) * 1000.0 / rate;
+				hits++;
+				delay += ms;
+				worst = ms > worst ? ms : worst;
+				while (t < triggerCount && triggers[t] < to) {
+					matched++;
+					t++;
+				}
+			}
+		}
+		printf("bench %-8s %-8s events=%zu found=%zu missed=%zu false=%zu "
+				"delay_ms=%.1f worst_ms=%.1f\n", r->name, where,
+				r->onsetCount, hits, r->onsetCount - hits,
+				triggerCount - matched, hits ? delay / hits : 0.0, worst);
+		break;
+	}
+	case SCORE_PHASE: {
+		double c = 0, s = 0;
+		for (size_t t = 0; t < triggerCount; t++) {
+			double phase = 2.0 * M_PI * BENCH_THETA_HZ * triggers[t] / rate;
+			c += cos(phase);
+			s += sin(phase);
+		}
+		double mean = triggerCount ? atan2(s, c) * 180.0 / M_PI : 0.0;
+		double length = triggerCount ? sqrt(c * c + s * s) / triggerCount : 0;
+		printf("bench %-8s %-8s triggers=%zu phase_deg=%.0f locking=%.2f\n",
+				r->name, where, triggerCount, mean, length);
+		break;
+	}
+	case SCORE_FALSE:
+		printf("bench %-8s %-8s false/min=%.1f\n", r->name, where,
+				triggerCount * 60.0 * rate / r->count);
+		break;
+	default:
+		printf("bench %-8s %-8s triggers=%zu per_min=%.1f\n", r->name, where,
+				triggerCount, triggerCount * 60.0 * rate / r->count);
+		break;
+	}
+}
+
+// The detector on its own, one sweep at a time as acq.c feeds it.
+static int runOffline(const recording_t *r) {
+	uint16_t sweep[RHS2116_CHANNELS] = { 0 };
+	detect_config_t config = r->config;
+
+	detect_init(onFire);
+	if (detect_set(&config) != SL_STATUS_OK) {
+		printf("bench %-8s offline  detector rejected\n", r->name);
+		return 1;
+	}
+	triggerCount = 0;
+	for (nowSweep = 0; nowSweep < r->count; nowSweep++) {
+		sweep[0] = r->samples[nowSweep];
+		detect_on_sweep(sweep, (uint32_t) nowSweep);
+		detect_process_action();
+	}
+	score(r, "offline");
+	return 0;
+}
+
+static size_t frame(uint8_t op, const uint8_t *payload, size_t len,
+		uint8_t *out) {
+	out[0] = CMD_PROTO_SOF;
+	out[1] = CMD_PROTO_VERSION;
+	out[2] = op;
+	out[3] = 0;
+	memcpy(out + CMD_HEADER_SIZE, payload, len);
+	len += CMD_HEADER_SIZE;
+	uint16_t crc = cmd_crc16(out, len);
+	out[len++] = (uint8_t) crc;
+	out[len++] = (uint8_t) (crc >> 8);
+	return len;
+}
+
+// Send a frame and return the status byte of the STATE reply.
+static int send(uint8_t connection, const uint8_t *data, size_t len) {
+	uint8_t reply[NODE_TX_MAX_SIZE];
+	size_t replyLen;
+
+	if (sim_gatt_write(connection, gattdb_node_rx, data, len) != SL_STATUS_OK
+			|| sim_gatt_read(gattdb_node_tx, reply, sizeof(reply), &replyLen)
+					!= SL_STATUS_OK || replyLen <= CMD_HEADER_SIZE) {
+		return -1;
+	}
+	return reply[CMD_HEADER_SIZE];
+}
+
+// The whole firmware: sweep clock, SPI, detector, stimulation task.
+static int runSimulated(const recording_t *r) {
+	const detect_config_t *c = &r->config;
+	uint8_t record[DETECT_RECORD_SIZE] = { 0, c->mode, 0, 0 };
+	uint8_t data[NODE_RX_MAX_SIZE];
+	cmd_t set = { .opcode = CMD_OP_SET,
+		.mask = CMD_FIELD_AMPLITUDE | CMD_FIELD_FREQUENCY
+				| CMD_FIELD_PULSE_WIDTH,
+		.value = { 50, 100, 100 } };
+	detect_stats_t stats;
+
+	put_le16(record + 4, c->highpassHz);
+	put_le16(record + 6, c->lowpassHz);
+	put_le16(record + 8, c->threshold);
+	put_le16(record + 10, c->envelopeMs);
+	put_le16(record + 12, c->refractoryMs);
+	put_le16(record + 14, c->pulses);
+
+	sim_nvm3_erase();
+	sim_reset();
+	app_init();
+	sim_boot();
+	uint8_t connection = sim_connect();
+	if (send(connection, data, cmd_encode_set(0, &set, data, sizeof(data)))
+			!= CMD_OK
+			|| send(connection, data, frame(CMD_OP_DETECT, record,
+					sizeof(record), data)) != CMD_OK) {
+		printf("bench %-8s sim      detector not set\n", r->name);
+		return 1;
+	}
+	app_process_action();
+	sim_rhs2116_play(0, r->samples, r->count);
+	uint64_t steps = (uint64_t) r->count * 1000000000ull / ACQ_SAMPLE_RATE_HZ
+			/ BENCH_STEP_NS;
+	for (uint64_t i = 0; i < steps; i++) {
+		sim_advance(BENCH_STEP_NS);
+		app_process_action();
+	}
+	detect_get_stats(&stats);
+	printf("bench %-8s sim      triggers=%u trains=%u busy=%u failed=%u "
+			"latency_us=%.0f worst_us=%u\n", r->name, stats.triggers,
+			stats.fired, stats.busy, stats.failed,
+			stats.fired ? (double) stats.latencyTotalUs / stats.fired : 0.0,
+			stats.latencyMaxUs);
+	sim_disconnect(connection, 0x13);
+	return stats.failed ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+	unsigned int iterations = BENCH_DEFAULT_ITERATIONS;
+	size_t count = 3;
+
+	if (argc > 1) {
+		iterations = (unsigned int) strtoul(argv[1], NULL, 0);
+	}
+	if (iterations == 0 || argc > 3) {
+		fprintf(stderr, "usage: %s [iterations [recording.raw]]\n", argv[0]);
+		return 2;
+	}
+	makeRipples(&recordings[0]);
+	makeTheta(&recordings[1]);
+	makeNoise(&recordings[2]);
+	if (argc > 2) {
+		if (!load(&recordings[3], argv[2])) {
+			fprintf(stderr, "cannot load %s\n", argv[2]);
+			return 2;
+		}
+		count = 4;
+	}
+
+	int failed = 0;
+	for (size_t i = 0; i < count; i++) {
+		failed |= benchKernels(&recordings[i], iterations);
+		failed |= runOffline(&recordings[i]);
+		failed |= runSimulated(&recordings[i]);
+	}
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,100 @@
+/***************************************************************************//**
+ * @file bench_gbl.c
+ * @brief Benchmark of the CRC-32 kernels and the GBL verifier.
+ *
+ *   bench_gbl [file.gbl [iterations]]
+ *
+ * Runs each CRC-32 kernel over a 1 MiB buffer and checks they agree, then
+ * verifies a GBL file held in memory (default ../output_gbl/full-crc.gbl),
+ * fed to the streaming parser in 4 KiB pieces as a download would be.
+ * Each result line starts with "bench" and is stable across runs.
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "crc32.h"
+#include "gbl.h"
+#include "sim.h"
+
+#define BENCH_BUFFER_SIZE       (1u << 20)
+#define BENCH_DEFAULT_ITERATIONS 200
+#define BENCH_PIECE             4096
+
+typedef uint32_t (*kernel_t)(uint32_t crc, const void *data, size_t len);
+
+static uint8_t buffer[BENCH_BUFFER_SIZE];
+
+static uint32_t kernel(const char *name, kernel_t fn, unsigned int passes) {
+	uint32_t crc = 0;
+	uint64_t start = sim_now_ns();
+	for (unsigned int i = 0; i < passes; i++) {
+		crc = fn(0, buffer, sizeof(buffer));
+	}
+	uint64_t ns = sim_now_ns() - start;
+	printf("bench crc32 %-9s MB/s=%.0f crc=0x%08x\n", name,
+			ns ? (double) passes * sizeof(buffer) * 1e3 / ns : 0.0, crc);
+	return crc;
+}
+
+static int verify(const char *path, unsigned int iterations) {
+	gbl_parser_t parser;
+	gbl_info_t info;
+	gbl_status_t status = GBL_OK;
+
+	FILE *f = fopen(path, "rb");
+	if (f == NULL) {
+		perror(path);
+		return 1;
+	}
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	rewind(f);
+	uint8_t *data = malloc((size_t) size);
+	if (data == NULL || fread(data, 1, (size_t) size, f) != (size_t) size) {
+		fclose(f);
+		free(data);
+		return 1;
+	}
+	fclose(f);
+
+	uint64_t start = sim_now_ns();
+	for (unsigned int i = 0; i < iterations; i++) {
+		gbl_parser_init(&parser, NULL, NULL);
+		for (long pos = 0; pos < size; pos += BENCH_PIECE) {
+			long n = size - pos < BENCH_PIECE ? size - pos : BENCH_PIECE;
+			gbl_parser_feed(&parser, data + pos, (size_t) n);
+		}
+		status = gbl_parser_finish(&parser, &info);
+	}
+	uint64_t ns = sim_now_ns() - start;
+	free(data);
+	printf("bench gbl   verify    MB/s=%.0f us/file=%.1f size=%ld "
+			"status=%d image=%d\n",
+			ns ? (double) iterations * size * 1e3 / ns : 0.0,
+			(double) ns / iterations / 1e3, size, status, info.image);
+	return status != GBL_OK;
+}
+
+int main(int argc, char **argv) {
+	const char *path = argc > 1 ? argv[1] : "../output_gbl/full-crc.gbl";
+	unsigned int iterations =
+			argc > 2 ? (unsigned int) atoi(argv[2]) : BENCH_DEFAULT_ITERATIONS;
+	uint32_t x = 2463534242u;
+
+	for (size_t i = 0; i < sizeof(buffer); i++) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		buffer[i] = (uint8_t) x;
+	}
+	uint32_t a = kernel("bitwise", crc32_bitwise, 4);
+	uint32_t b = kernel("bytewise", crc32_bytewise, 40);
+	uint32_t c = kernel("default", crc32, 40);
+	// The check value of the IEEE CRC-32.
+	int errors = crc32(0, "123456789", 9) != 0xCBF43926u || a != b || b != c;
+	if (errors) {
+		printf("bench crc32 kernels disagree\n");
+	}
+	return verify(path, iterations) || errors;
+}
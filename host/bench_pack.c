@@ -0,0 +1,117 @@
+/***************************************************************************//**
+ * @file bench_pack.c
+ * @brief Benchmark of the acquisition frame compression.
+ *
+ *   bench_pack [iterations]
+ *
+ * Packs blocks of the RHS2116 model's synthetic recording, and of noise
+ * with every bit random, at the frame sizes the stream uses. Reports the
+ * time per sweep to fit and encode a frame, the sample throughput, and the
+ * compression ratio, and checks that every block decodes to its input.
+ * Each result line starts with "bench" and is stable across runs.
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "acq.h"
+#include "config.h"
+#include "delta_pack.h"
+#include "rhs2116.h"
+#include "sim.h"
+
+#define BENCH_DEFAULT_ITERATIONS 20000
+#define BENCH_CHANNELS           RHS2116_CHANNELS
+#define BENCH_BLOCK_SWEEPS       4096
+
+static uint16_t recording[BENCH_BLOCK_SWEEPS * BENCH_CHANNELS];
+static uint16_t noise[BENCH_BLOCK_SWEEPS * BENCH_CHANNELS];
+static uint16_t decoded[ACQ_FRAME_MAX_SWEEPS * BENCH_CHANNELS];
+
+static int run(const char *name, const uint16_t *samples, size_t budget,
+		unsigned int iterations) {
+	uint8_t out[ACQ_STREAM_MAX_SIZE];
+	size_t sweeps = 0, packed = 0, frames = 0, pos = 0;
+	int errors = 0;
+
+	uint64_t start = sim_now_ns();
+	for (unsigned int i = 0; i < iterations; i++) {
+		if (pos + ACQ_FRAME_MAX_SWEEPS > BENCH_BLOCK_SWEEPS) {
+			pos = 0;
+		}
+		const uint16_t *block = samples + pos * BENCH_CHANNELS;
+		size_t fit = delta_pack_fit(block, BENCH_CHANNELS, ACQ_FRAME_MAX_SWEEPS,
+				budget);
+		size_t len = delta_pack_encode(block, BENCH_CHANNELS, fit, out,
+				budget);
+		if (fit == 0 || len == 0) {
+			errors++;
+			break;
+		}
+		sweeps += fit;
+		packed += len;
+		frames++;
+		pos += fit;
+	}
+	uint64_t ns = sim_now_ns() - start;
+
+	// Round trip over the whole block, outside the timed loop.
+	for (pos = 0; pos + ACQ_FRAME_MAX_SWEEPS <= BENCH_BLOCK_SWEEPS;) {
+		const uint16_t *block = samples + pos * BENCH_CHANNELS;
+		size_t fit = delta_pack_fit(block, BENCH_CHANNELS, ACQ_FRAME_MAX_SWEEPS,
+				budget);
+		size_t len = delta_pack_encode(block, BENCH_CHANNELS, fit, out,
+				budget);
+		if (fit == 0
+				|| delta_pack_decode(out, len, BENCH_CHANNELS, fit, decoded)
+						!= SL_STATUS_OK
+				|| memcmp(decoded, block, fit * BENCH_CHANNELS * 2) != 0) {
+			errors++;
+			break;
+		}
+		pos += fit;
+	}
+
+	double raw = (double) sweeps * BENCH_CHANNELS * 2;
+	printf("bench %-9s budget=%3zu frames=%zu sweeps/frame=%.1f "
+			"ns/sweep=%.0f Msamples/s=%.1f ratio=%.2f errors=%d\n", name,
+			budget, frames, frames ? (double) sweeps / frames : 0.0,
+			sweeps ? (double) ns / sweeps : 0.0,
+			ns ? raw / 2 * 1000.0 / ns : 0.0, packed ? raw / packed : 0.0,
+			errors);
+	return errors;
+}
+
+int main(int argc, char **argv) {
+	unsigned int iterations = BENCH_DEFAULT_ITERATIONS;
+	// Bitstream room after the frame header at a few negotiated MTUs.
+	static const size_t budgets[] = {
+		247 - 3 - ACQ_FRAME_HEADER_SIZE, 185 - 3 - ACQ_FRAME_HEADER_SIZE,
+		103 - 3 - ACQ_FRAME_HEADER_SIZE,
+	};
+
+	if (argc > 1) {
+		iterations = (unsigned int) strtoul(argv[1], NULL, 0);
+	}
+	if (iterations == 0) {
+		fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+		return 2;
+	}
+
+	uint32_t state = 1;
+	for (size_t s = 0; s < BENCH_BLOCK_SWEEPS; s++) {
+		for (size_t c = 0; c < BENCH_CHANNELS; c++) {
+			recording[s * BENCH_CHANNELS + c] = sim_rhs2116_sample(
+					(uint8_t) c, (uint32_t) s);
+			state = state * 1664525u + 1013904223u;
+			noise[s * BENCH_CHANNELS + c] = (uint16_t) (state >> 16);
+		}
+	}
+
+	int failed = 0;
+	for (size_t i = 0; i < sizeof(budgets) / sizeof(budgets[0]); i++) {
+		failed |= run("recording", recording, budgets[i], iterations);
+		failed |= run("noise", noise, budgets[i], iterations);
+	}
+	return failed ? 1 : 0;
+}
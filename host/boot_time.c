@@ -0,0 +1,135 @@
+/***************************************************************************//**
+ * @file boot_time.c
+ * @brief Time the boot sequence through the host simulation build.
+ *
+ *   boot_time [stack_ms]
+ *
+ * Boots the application under a few reset scenarios and prints the boot
+ * report as a central reads it from the boot_report characteristic: the
+ * time each phase was reached, in microseconds from the start of
+ * app_init(), or why it was not. The stack's boot event is delivered
+ * stack_ms (default 20) after app_init() returns, except where a scenario
+ * delays it; the superloop runs every millisecond meanwhile.
+ *
+ *   power-on         clean start
+ *   brown-out        the RHS2116 answers only after 120 ms
+ *   stack-late       the boot event arrives after BOOT_STACK_TIMEOUT_MS
+ *   no-rhs2116       the RHS2116 never answers
+ *
+ * Times include the host's own execution, so they bound the ordering and
+ * the timeouts rather than the target's absolute figures. Exits non-zero
+ * if the power-on boot does not reach every phase.
+ ******************************************************************************/
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "app.h"
+#include "boot.h"
+#include "byteorder.h"
+#include "config.h"
+#include "em_rmu.h"
+#include "gatt_db.h"
+#include "sim.h"
+#include "sl_sleeptimer.h"
+#include "spidrv.h"
+
+#define MS              1000000ull
+
+typedef struct {
+	const char *name;
+	uint32_t cause;             // EMU_RSTCAUSE_* bits
+	uint32_t stackMs;           // 0: the command line value
+	uint32_t rhsReadyMs;        // RHS2116 transfers fail before this
+} scenario_t;
+
+static const char *const phaseNames[BOOT_PHASE_COUNT] = {
+	"app_init", "settings", "stack", "advertising", "device_info", "rhs2116",
+	"connected",
+};
+
+static const char *const resetNames[] = {
+	"unknown", "power-on", "brown-out", "watchdog", "lockup", "software",
+	"pin", "em4",
+};
+
+// One superloop pass a millisecond; until the RHS2116 is ready every
+// transfer started meanwhile fails, as with its supply still ramping.
+static void step(const scenario_t *s, uint32_t *ms) {
+	sim_rhs2116_fail_next(*ms < s->rhsReadyMs ?
+			ECODE_EMDRV_SPIDRV_ABORTED : ECODE_EMDRV_SPIDRV_OK);
+	sim_advance(MS);
+	(*ms)++;
+	app_process_action();
+}
+
+static bool run(const scenario_t *s, uint32_t stackMs) {
+	uint32_t ms = 0;
+
+	sim_reset();
+	sim_nvm3_erase();
+	sim_set_reset_cause(s->cause);
+	if (s->rhsReadyMs) {
+		sim_rhs2116_fail_next(ECODE_EMDRV_SPIDRV_ABORTED);
+	}
+	// On the sleeptimer, as boot.c stamps the phases.
+	uint32_t startUs = (uint32_t) (sl_sleeptimer_get_tick_count64() * 1000000u
+			/ sl_sleeptimer_get_timer_frequency());
+	app_init();
+
+	uint32_t due = s->stackMs ? s->stackMs : stackMs;
+	while (ms < due) {
+		step(s, &ms);
+	}
+	sim_boot();
+	for (uint32_t i = 0; i < 1000 && !boot_complete(); i++) {
+		step(s, &ms);
+	}
+	sim_connect();
+	app_process_action();
+
+	uint8_t record[BOOT_REPORT_MAX_SIZE];
+	size_t len;
+	if (sim_gatt_read(gattdb_boot_report, record, sizeof(record), &len)
+			!= SL_STATUS_OK || len != BOOT_REPORT_SIZE
+			|| record[0] != BOOT_REPORT_VERSION) {
+		printf("%s: boot report not readable\n", s->name);
+		return false;
+	}
+	uint8_t reached = record[2], failed = record[3];
+	printf("%s: reset cause %s\n", s->name,
+			record[1] < sizeof(resetNames) / sizeof(resetNames[0]) ?
+					resetNames[record[1]] : "?");
+	for (size_t i = 0; i < BOOT_PHASE_COUNT; i++) {
+		printf("  %-12s ", phaseNames[i]);
+		if (reached & (1u << i)) {
+			printf("%8" PRIu32 " us\n",
+					get_le32(record + 4 + 4 * i) - startUs);
+		} else if (failed & (1u << i)) {
+			printf("%8s\n", "failed");
+		} else {
+			printf("%8s\n", "-");
+		}
+	}
+	return reached == (1u << BOOT_PHASE_COUNT) - 1;
+}
+
+int main(int argc, char **argv) {
+	uint32_t stackMs = argc > 1 ? (uint32_t) strtoul(argv[1], NULL, 0) : 20;
+	const scenario_t scenarios[] = {
+		{ "power-on", EMU_RSTCAUSE_POR, 0, 0 },
+		{ "brown-out", EMU_RSTCAUSE_DVDDBOD, 0, 120 },
+		{ "stack-late", EMU_RSTCAUSE_PIN, BOOT_STACK_TIMEOUT_MS + 500, 0 },
+		{ "no-rhs2116", EMU_RSTCAUSE_WDOG0, 0, UINT32_MAX },
+	};
+	bool ok = true;
+
+	for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+		bool all = run(&scenarios[i], stackMs);
+		if (i == 0) {
+			ok = all;
+		}
+	}
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,107 @@
+/***************************************************************************//**
+ * @file dlog_dump.c
+ * @brief Capture the deferred log of a session through the host simulation
+ *        build.
+ *
+ *   dlog_dump [file]
+ *
+ * Boots, connects and negotiates, sends a legacy nodeRx command, streams
+ * acquisition for a moment and disconnects. A second central then
+ * subscribes to the dlog characteristic and receives the log as
+ * notifications, which are written to file (default dlog.bin) for
+ * dlog_decode.py. Prints the counters of the ring and what it costs to
+ * record an entry compared with formatting the same message as text.
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app.h"
+#include "dlog.h"
+#include "gatt_db.h"
+#include "sim.h"
+
+#define BENCH_ITERATIONS 1000000
+
+static FILE *out;
+static size_t notifications;
+static size_t bytes;
+
+static void onNotification(uint8_t connection, uint16_t characteristic,
+		const uint8_t *value, size_t len) {
+	(void) connection;
+	if (characteristic == gattdb_dlog) {
+		fwrite(value, 1, len, out);
+		notifications++;
+		bytes += len;
+	}
+}
+
+static void run(uint64_t ms) {
+	for (uint64_t i = 0; i < ms; i++) {
+		sim_advance(1000000ull);
+		app_process_action();
+	}
+}
+
+int main(int argc, char **argv) {
+	const char *path = argc > 1 ? argv[1] : "dlog.bin";
+	static const char command[] = "_A100,F20,P200";
+
+	out = fopen(path, "wb");
+	if (out == NULL) {
+		perror(path);
+		return 1;
+	}
+
+	sim_reset();
+	app_init();
+	sim_boot();
+	uint8_t conn = sim_connect();
+	sim_negotiate(conn);
+	sim_gatt_write(conn, gattdb_node_rx, (const uint8_t*) command,
+			sizeof(command) - 1);
+	sim_subscribe(conn, gattdb_acq_stream, sl_bt_gatt_server_notification);
+	run(100);
+	sim_disconnect(conn, 0x13);
+	run(10);
+
+	conn = sim_connect();
+	sim_negotiate(conn);
+	sim_set_notification_sink(onNotification);
+	sim_subscribe(conn, gattdb_dlog, sl_bt_gatt_server_notification);
+	run(10);
+	fclose(out);
+
+	dlog_stats_t stats;
+	dlog_get_stats(&stats);
+	printf("dlog: %u written, %u dropped, %u drained, high water %u words; "
+			"%zu bytes in %zu notifications to %s\n",
+			(unsigned int) stats.written, (unsigned int) stats.dropped,
+			(unsigned int) stats.drained, stats.highWater, bytes, notifications,
+			path);
+
+	// Cost of recording against formatting. Drained as it goes so the
+	// ring never fills.
+	uint8_t drain[DLOG_ENTRY_MAX_SIZE * 8];
+	char text[128];
+	uint64_t t0 = sim_now_ns();
+	for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+		DLOG(DLOG_PROTOCOL_EPOCH, i & 3, i & 7, i);
+		if ((i & 7) == 7) {
+			dlog_read(drain, sizeof(drain));
+		}
+	}
+	uint64_t t1 = sim_now_ns();
+	for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+		snprintf(text, sizeof(text), "[I] Protocol in slot %u epoch %u: %u "
+				"pulses\n", i & 3, i & 7, i);
+		__asm__ volatile("" : : "r"(text) : "memory");
+	}
+	uint64_t t2 = sim_now_ns();
+	printf("bench dlog      ns/entry=%.1f\n",
+			(double) (t1 - t0) / BENCH_ITERATIONS);
+	printf("bench snprintf  ns/entry=%.1f\n",
+			(double) (t2 - t1) / BENCH_ITERATIONS);
+	return stats.dropped || notifications == 0;
+}
@@ -0,0 +1,171 @@
+/***************************************************************************//**
+ * @file fleet_device.c
+ * @brief One simulated MouseCap unit on stdin/stdout, for fleet.py.
+ *
+ *   fleet_device
+ *
+ * Boots the application on erased NVM3 with one central connected, MTU
+ * negotiated and nodeTx notifications enabled, then serves messages from
+ * the central on stdin and sends its notifications on stdout. Each message
+ * is a type byte, a little-endian uint16 length and the payload:
+ *
+ *   central to unit
+ *   'W'  write nodeRx with the payload; a value longer than the MTU allows
+ *        is sent as a long write
+ *   'R'  read an attribute: 'n' nodeTx, 't' telemetry, 'p' power report
+ *
+ *   unit to central
+ *   'N'  nodeTx notification
+ *   'V'  value read, empty if the read failed
+ *   'E'  write rejected, with the sl_status_t as a uint32
+ *
+ * Writes that arrive together are delivered in one connection event, so
+ * the application may answer them with one notification, as on air. The
+ * superloop runs on the host clock between messages. The unit exits when
+ * stdin closes.
+ ******************************************************************************/
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "app.h"
+#include "config.h"
+#include "conn_tuning.h"
+#include "gatt_db.h"
+#include "sim.h"
+
+#define FLEET_HEADER_SIZE       3
+#define FLEET_IDLE_MS           5       // superloop period without input
+#define FLEET_BURST_MAX         16      // writes delivered in one event
+#define FLEET_ATT_WRITE_HEADER  3
+#define FLEET_ATT_PREPARE_HEADER 5
+#define FLEET_VALUE_MAX_SIZE    255     // longest attribute value
+
+static uint8_t connection;
+static uint8_t input[4096];
+static size_t inputLen;
+
+static void emit(uint8_t type, const uint8_t *data, size_t len) {
+	uint8_t header[FLEET_HEADER_SIZE] = {
+		type, (uint8_t) len, (uint8_t) (len >> 8)
+	};
+	// Small and rare enough for plain blocking writes.
+	if (write(STDOUT_FILENO, header, sizeof(header)) != sizeof(header)
+			|| (len && write(STDOUT_FILENO, data, len) != (ssize_t) len)) {
+		_exit(1);
+	}
+}
+
+static void onNotification(uint8_t conn, uint16_t characteristic,
+		const uint8_t *value, size_t len) {
+	(void) conn;
+	if (characteristic == gattdb_node_tx) {
+		emit('N', value, len);
+	}
+}
+
+static void readAttribute(uint8_t which) {
+	uint8_t value[FLEET_VALUE_MAX_SIZE];
+	size_t len = 0;
+	uint16_t attribute = which == 't' ? gattdb_telemetry
+			: which == 'p' ? gattdb_power_report : gattdb_node_tx;
+
+	if (sim_gatt_read(attribute, value, sizeof(value), &len)
+			!= SL_STATUS_OK) {
+		len = 0;
+	}
+	emit('V', value, len);
+}
+
+static void rejected(sl_status_t sc) {
+	uint8_t status[4] = {
+		(uint8_t) sc, (uint8_t) (sc >> 8), (uint8_t) (sc >> 16),
+		(uint8_t) (sc >> 24)
+	};
+	emit('E', status, sizeof(status));
+}
+
+// Deliver the complete messages in input; writes queue up into a burst.
+static void serve(void) {
+	const uint8_t *burst[FLEET_BURST_MAX];
+	size_t burstLen[FLEET_BURST_MAX];
+	size_t count = 0, at = 0;
+	size_t payload = conn_tuning_get(connection)->mtu
+			- FLEET_ATT_WRITE_HEADER;
+
+	while (inputLen - at >= FLEET_HEADER_SIZE) {
+		const uint8_t *m = input + at;
+		size_t len = m[1] | (size_t) m[2] << 8;
+		if (inputLen - at < FLEET_HEADER_SIZE + len) {
+			break;
+		}
+		const uint8_t *data = m + FLEET_HEADER_SIZE;
+		at += FLEET_HEADER_SIZE + len;
+
+		if (m[0] == 'W' && len <= payload && count < FLEET_BURST_MAX) {
+			burst[count] = data;
+			burstLen[count++] = len;
+			continue;
+		}
+		// Anything else goes after the writes that came before it.
+		if (count) {
+			sim_gatt_write_burst(connection, gattdb_node_rx, burst, burstLen,
+					count);
+			count = 0;
+		}
+		if (m[0] == 'W') {
+			sl_status_t sc = len <= payload ?
+					sim_gatt_write(connection, gattdb_node_rx, data, len) :
+					sim_gatt_long_write(connection, gattdb_node_rx, data, len,
+							payload + FLEET_ATT_WRITE_HEADER
+									- FLEET_ATT_PREPARE_HEADER);
+			if (sc != SL_STATUS_OK) {
+				rejected(sc);
+			}
+			app_process_action();
+		} else if (m[0] == 'R' && len == 1) {
+			readAttribute(data[0]);
+		}
+	}
+	if (count) {
+		sim_gatt_write_burst(connection, gattdb_node_rx, burst, burstLen,
+				count);
+	}
+	memmove(input, input + at, inputLen - at);
+	inputLen -= at;
+}
+
+int main(void) {
+	sim_nvm3_erase();
+	sim_reset();
+	app_init();
+	sim_boot();
+	connection = sim_connect();
+	sim_negotiate(connection);
+	sim_subscribe(connection, gattdb_node_tx, sl_bt_gatt_server_notification);
+	sim_set_notification_sink(onNotification);
+	app_process_action();
+
+	for (;;) {
+		struct pollfd fd = { .fd = STDIN_FILENO, .events = POLLIN };
+		int ready = poll(&fd, 1, FLEET_IDLE_MS);
+		if (ready < 0 && errno != EINTR) {
+			return 1;
+		}
+		if (ready > 0) {
+			ssize_t n = read(STDIN_FILENO, input + inputLen,
+					sizeof(input) - inputLen);
+			if (n <= 0) {
+				return 0;
+			}
+			inputLen += (size_t) n;
+			serve();
+		}
+		// Timers due on the host clock, then one superloop pass.
+		sim_advance(0);
+		app_process_action();
+	}
+}
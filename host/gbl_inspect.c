@@ -0,0 +1,201 @@
+/***************************************************************************//**
+ * @file gbl_inspect.c
+ * @brief Inspect and verify GBL files without Simplicity Commander.
+ *
+ *   gbl_inspect [-v] path...
+ *
+ * Each path is a GBL file or a directory whose *.gbl files are checked in
+ * name order. Every file is read once, in blocks, through the streaming
+ * parser of gbl.h, which checks the file CRC and, where the image carries
+ * one, the application image CRC. Prints one line per file, with -v also
+ * its tags, then the total throughput. Exits 1 if any file fails.
+ ******************************************************************************/
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "gbl.h"
+#include "sim.h"
+
+#define READ_BLOCK      65536
+
+static const char *const statusNames[] = {
+	[GBL_OK] = "OK",
+	[GBL_ERR_HEADER] = "bad header",
+	[GBL_ERR_TAG] = "bad tag length",
+	[GBL_ERR_TRUNCATED] = "truncated",
+	[GBL_ERR_TRAILING] = "data after end tag",
+	[GBL_ERR_CRC] = "file CRC mismatch",
+	[GBL_ERR_IMAGE_CRC] = "image CRC mismatch",
+};
+
+static const char *const imageNames[] = {
+	[GBL_IMAGE_NONE] = "none",
+	[GBL_IMAGE_OK] = "ok",
+	[GBL_IMAGE_BAD] = "BAD",
+	[GBL_IMAGE_UNCHECKED] = "not checked",
+};
+
+static bool verbose;
+static size_t files, failed;
+static uint64_t bytes;
+
+static const char* tagName(uint32_t id) {
+	switch (id) {
+	case GBL_TAG_HEADER:      return "header";
+	case GBL_TAG_APPLICATION: return "application";
+	case GBL_TAG_BOOTLOADER:  return "bootloader";
+	case GBL_TAG_SE_UPGRADE:  return "se upgrade";
+	case GBL_TAG_METADATA:    return "metadata";
+	case GBL_TAG_PROG:        return "program data";
+	case GBL_TAG_ERASEPROG:   return "program data (erase)";
+	case GBL_TAG_PROG_LZ4:    return "program data (lz4)";
+	case GBL_TAG_PROG_LZMA:   return "program data (lzma)";
+	case GBL_TAG_ENC_INIT:    return "encryption init";
+	case GBL_TAG_ENC_DATA:    return "encrypted data";
+	case GBL_TAG_CERTIFICATE: return "certificate";
+	case GBL_TAG_SIGNATURE:   return "signature";
+	case GBL_TAG_END:         return "end";
+	default:                  return "unknown";
+	}
+}
+
+static void onTag(const gbl_tag_t *tag, void *ctx) {
+	(void) ctx;
+	if (verbose) {
+		printf("    %08x  0x%08x  %-22s %u\n", tag->offset, tag->id,
+				tagName(tag->id), tag->length);
+	}
+}
+
+static void report(const char *path, gbl_status_t status,
+		const gbl_info_t *i) {
+	printf("%-40s %7u B  %s", path, i->size, statusNames[status]);
+	if (i->hasApplication) {
+		printf("  app 0x%08x v%u", i->appType, i->appVersion);
+	}
+	if (i->hasBootloader) {
+		printf("  bootloader v%08x %u B", i->bootloaderVersion,
+				i->bootloaderBytes);
+	}
+	if (i->progTags) {
+		printf("  prog %u tag%s %u B", i->progTags, i->progTags > 1 ? "s" : "",
+				i->progBytes);
+		if (i->progEnd > i->progStart) {
+			printf(" 0x%08x-0x%08x", i->progStart, i->progEnd);
+		}
+		if (i->progLz4Tags || i->progLzmaTags) {
+			printf(" %s", i->progLz4Tags ? "lz4" : "lzma");
+		}
+	}
+	if (i->encryptedBytes) {
+		printf("  encrypted %u B", i->encryptedBytes);
+	}
+	if (i->hasSignature) {
+		printf("  signed");
+	}
+	printf("  crc 0x%08x", i->crc);
+	if (i->image != GBL_IMAGE_NONE) {
+		printf("  image crc %s", imageNames[i->image]);
+	}
+	printf("\n");
+	if (status == GBL_ERR_CRC) {
+		printf("    computed 0x%08x\n", i->crcComputed);
+	} else if (i->image == GBL_IMAGE_BAD) {
+		printf("    image crc 0x%08x computed 0x%08x\n", i->imageCrc,
+				i->imageCrcComputed);
+	}
+}
+
+static void inspect(const char *path) {
+	static uint8_t block[READ_BLOCK];
+	gbl_parser_t parser;
+	gbl_info_t info;
+	size_t n;
+
+	FILE *f = fopen(path, "rb");
+	if (f == NULL) {
+		perror(path);
+		files++;
+		failed++;
+		return;
+	}
+	gbl_parser_init(&parser, onTag, NULL);
+	if (verbose) {
+		printf("%s\n", path);
+	}
+	while ((n = fread(block, 1, sizeof(block), f)) > 0) {
+		if (gbl_parser_feed(&parser, block, n) != GBL_OK) {
+			break;
+		}
+	}
+	fclose(f);
+	gbl_status_t status = gbl_parser_finish(&parser, &info);
+	report(path, status, &info);
+	files++;
+	bytes += info.size;
+	failed += status != GBL_OK;
+}
+
+static int byName(const void *a, const void *b) {
+	return strcmp(*(char* const*) a, *(char* const*) b);
+}
+
+static void inspectDirectory(const char *dir) {
+	char **names = NULL;
+	size_t count = 0;
+	struct dirent *e;
+
+	DIR *d = opendir(dir);
+	if (d == NULL) {
+		perror(dir);
+		failed++;
+		return;
+	}
+	while ((e = readdir(d)) != NULL) {
+		size_t len = strlen(e->d_name);
+		if (len > 4 && strcmp(e->d_name + len - 4, ".gbl") == 0) {
+			names = realloc(names, (count + 1) * sizeof(*names));
+			names[count++] = strdup(e->d_name);
+		}
+	}
+	closedir(d);
+	qsort(names, count, sizeof(*names), byName);
+	for (size_t i = 0; i < count; i++) {
+		char path[4096];
+		snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+		inspect(path);
+		free(names[i]);
+	}
+	free(names);
+}
+
+int main(int argc, char **argv) {
+	struct stat st;
+	int first = 1;
+
+	if (argc > 1 && strcmp(argv[1], "-v") == 0) {
+		verbose = true;
+		first++;
+	}
+	if (first >= argc) {
+		fprintf(stderr, "usage: %s [-v] file.gbl|directory...\n", argv[0]);
+		return 2;
+	}
+
+	uint64_t start = sim_now_ns();
+	for (int a = first; a < argc; a++) {
+		if (stat(argv[a], &st) == 0 && S_ISDIR(st.st_mode)) {
+			inspectDirectory(argv[a]);
+		} else {
+			inspect(argv[a]);
+		}
+	}
+	uint64_t ns = sim_now_ns() - start;
+	printf("%zu files, %llu bytes, %zu failed, %.2f ms, %.0f MB/s\n", files,
+			(unsigned long long) bytes, failed, ns / 1e6,
+			ns ? bytes * 1e3 / ns : 0.0);
+	return failed != 0;
+}
@@ -0,0 +1,448 @@
+/***************************************************************************//**
+ * @file ota_encode.c
+ * @brief Delta patch encoder and image loaders for the host tools.
+ ******************************************************************************/
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "byteorder.h"
+#include "crc32.h"
+#include "gbl.h"
+#include "ota_encode.h"
+#include "ota_patch.h"
+
+#define SEED_SIZE       8       // bytes hashed to find candidates
+#define HASH_BITS       18
+#define CHAIN_MAX       64      // candidates tried per position
+#define MISMATCH_COST   2       // score of a changed byte; a match scores 1
+#define SCORE_DROP      48      // give up this far below the best score
+#define MIN_SCORE       20      // a match must save at least this much
+#define MERGE_GAP       3       // equal bytes that still join two runs
+
+typedef struct {
+	uint8_t *data;
+	size_t len;
+	size_t cap;
+	bool failed;
+} buf_t;
+
+static void put(buf_t *b, const void *data, size_t n) {
+	if (b->failed) {
+		return;
+	}
+	if (b->len + n > b->cap) {
+		size_t cap = b->cap ? b->cap : 4096;
+		while (cap < b->len + n) {
+			cap *= 2;
+		}
+		uint8_t *p = realloc(b->data, cap);
+		if (p == NULL) {
+			b->failed = true;
+			return;
+		}
+		b->data = p;
+		b->cap = cap;
+	}
+	memcpy(b->data + b->len, data, n);
+	b->len += n;
+}
+
+static void putByte(buf_t *b, uint8_t v) {
+	put(b, &v, 1);
+}
+
+static void putVarint(buf_t *b, uint32_t v) {
+	while (v >= 0x80) {
+		putByte(b, (uint8_t) (v | 0x80));
+		v >>= 7;
+	}
+	putByte(b, (uint8_t) v);
+}
+
+static inline uint32_t hashSeed(const uint8_t *p) {
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return (uint32_t) ((v * 0x9E3779B97F4A7C15ull) >> (64 - HASH_BITS));
+}
+
+typedef struct {
+	const uint8_t *base;
+	size_t baseLen;
+	const uint8_t *target;
+	size_t targetLen;
+	int32_t *head;
+	int32_t *prev;
+	size_t next;            // base offset the next operation is relative to
+	buf_t out;
+	ota_encode_stats_t stats;
+} encoder_t;
+
+// Grow a match from base[s] and target[t] across changed bytes, keeping
+// the length with the best score.
+static size_t extend(const encoder_t *e, size_t s, size_t t, long *score) {
+	long run = 0;
+	long best = 0;
+	size_t bestLen = 0;
+
+	for (size_t k = 0; s + k < e->baseLen && t + k < e->targetLen; k++) {
+		run += e->base[s + k] == e->target[t + k] ? 1 : -MISMATCH_COST;
+		if (run > best) {
+			best = run;
+			bestLen = k + 1;
+		} else if (run < best - SCORE_DROP) {
+			break;
+		}
+	}
+	*score = best;
+	return bestLen;
+}
+
+static void emitLiteral(encoder_t *e, size_t from, size_t to) {
+	if (to == from) {
+		return;
+	}
+	putByte(&e->out, OTA_PATCH_OP_LITERAL);
+	putVarint(&e->out, (uint32_t) (to - from));
+	put(&e->out, e->target + from, to - from);
+	e->stats.literals++;
+	e->stats.literalBytes += to - from;
+}
+
+// Find the next run of changed bytes at or after *k; false if none.
+static bool nextRun(const encoder_t *e, size_t s, size_t t, size_t len,
+		size_t *k, size_t *start, size_t *end) {
+	size_t i = *k;
+	while (i < len && e->base[s + i] == e->target[t + i]) {
+		i++;
+	}
+	if (i == len) {
+		return false;
+	}
+	size_t last = i;
+	for (size_t j = i + 1; j < len && j - last <= MERGE_GAP; j++) {
+		if (e->base[s + j] != e->target[t + j]) {
+			last = j;
+		}
+	}
+	*start = i;
+	*end = last + 1;
+	*k = last + 1;
+	return true;
+}
+
+static void emitMatch(encoder_t *e, size_t s, size_t t, size_t len) {
+	size_t k = 0, start, end;
+	uint32_t runs = 0;
+
+	while (nextRun(e, s, t, len, &k, &start, &end)) {
+		runs++;
+	}
+
+	int64_t delta = (int64_t) s - (int64_t) e->next;
+	uint32_t zigzag = (uint32_t) ((delta * 2) ^ (delta >> 63));
+	putByte(&e->out, runs ? OTA_PATCH_OP_PATCH : OTA_PATCH_OP_COPY);
+	putVarint(&e->out, (uint32_t) len);
+	putVarint(&e->out, zigzag);
+	e->next = s + len;
+	if (runs == 0) {
+		e->stats.copies++;
+		e->stats.copyBytes += len;
+		return;
+	}
+
+	putVarint(&e->out, runs);
+	size_t prevEnd = 0;
+	k = 0;
+	while (nextRun(e, s, t, len, &k, &start, &end)) {
+		putVarint(&e->out, (uint32_t) (start - prevEnd));
+		putVarint(&e->out, (uint32_t) (end - start));
+		put(&e->out, e->target + t + start, end - start);
+		e->stats.runBytes += end - start;
+		e->stats.copyBytes += start - prevEnd;
+		prevEnd = end;
+	}
+	e->stats.copyBytes += len - prevEnd;
+	e->stats.patches++;
+}
+
+size_t ota_encode(const uint8_t *base, size_t base_len, const uint8_t *target,
+		size_t target_len, uint8_t **patch, ota_encode_stats_t *stats) {
+	encoder_t e = {
+		.base = base,
+		.baseLen = base_len,
+		.target = target,
+		.targetLen = target_len,
+	};
+	uint8_t header[OTA_PATCH_HEADER_SIZE] = { 0 };
+
+	*patch = NULL;
+	e.head = malloc(sizeof(int32_t) << HASH_BITS);
+	e.prev = malloc(sizeof(int32_t) * (base_len ? base_len : 1));
+	if (e.head == NULL || e.prev == NULL) {
+		free(e.head);
+		free(e.prev);
+		return 0;
+	}
+	memset(e.head, 0xFF, sizeof(int32_t) << HASH_BITS);
+	for (size_t s = 0; s + SEED_SIZE <= base_len; s++) {
+		uint32_t h = hashSeed(base + s);
+		e.prev[s] = e.head[h];
+		e.head[h] = (int32_t) s;
+	}
+
+	put_le32(header, OTA_PATCH_MAGIC);
+	header[4] = OTA_PATCH_VERSION;
+	put_le32(header + 8, (uint32_t) base_len);
+	put_le32(header + 12, crc32(0, base, base_len));
+	put_le32(header + 16, (uint32_t) target_len);
+	put_le32(header + 20, crc32(0, target, target_len));
+	put(&e.out, header, sizeof(header));
+
+	size_t t = 0;
+	size_t literal = 0;     // start of the target not yet covered
+	size_t cont = 0;        // base offset lined up with t by the last match
+	bool haveCont = false;
+
+	while (t < target_len) {
+		long bestScore = 0, score;
+		size_t bestLen = 0, bestSrc = 0, len;
+
+		// Code after a changed instruction usually carries on where the
+		// last match left off.
+		if (haveCont && cont < base_len) {
+			bestLen = extend(&e, cont, t, &bestScore);
+			bestSrc = cont;
+		}
+		if (t + SEED_SIZE <= target_len) {
+			int32_t s = e.head[hashSeed(target + t)];
+			for (int n = 0; s >= 0 && n < CHAIN_MAX; s = e.prev[s], n++) {
+				if (haveCont && (size_t) s == cont) {
+					continue;
+				}
+				len = extend(&e, (size_t) s, t, &score);
+				if (score > bestScore) {
+					bestScore = score;
+					bestLen = len;
+					bestSrc = (size_t) s;
+				}
+			}
+		}
+
+		if (bestScore < MIN_SCORE) {
+			t++;
+			cont++;
+			continue;
+		}
+		// Take back equal bytes the literal would otherwise carry.
+		while (t > literal && bestSrc > 0
+				&& base[bestSrc - 1] == target[t - 1]) {
+			t--;
+			bestSrc--;
+			bestLen++;
+		}
+		emitLiteral(&e, literal, t);
+		emitMatch(&e, bestSrc, t, bestLen);
+		t += bestLen;
+		literal = t;
+		cont = bestSrc + bestLen;
+		haveCont = true;
+	}
+	emitLiteral(&e, literal, target_len);
+
+	free(e.head);
+	free(e.prev);
+	if (e.out.failed) {
+		free(e.out.data);
+		return 0;
+	}
+	if (stats != NULL) {
+		*stats = e.stats;
+	}
+	*patch = e.out.data;
+	return e.out.len;
+}
+
+uint8_t* ota_read_file(const char *path, size_t *len) {
+	FILE *f = fopen(path, "rb");
+	uint8_t *data = NULL;
+	long size;
+
+	if (f == NULL) {
+		return NULL;
+	}
+	if (fseek(f, 0, SEEK_END) == 0 && (size = ftell(f)) >= 0
+			&& fseek(f, 0, SEEK_SET) == 0) {
+		data = malloc(size ? (size_t) size : 1);
+		if (data != NULL && fread(data, 1, (size_t) size, f) != (size_t) size) {
+			free(data);
+			data = NULL;
+		}
+		*len = (size_t) size;
+	}
+	fclose(f);
+	return data;
+}
+
+bool ota_gbl_image(const uint8_t *gbl, size_t len, ota_image_t *image) {
+	gbl_info_t info;
+	size_t off = 0;
+
+	memset(image, 0, sizeof(*image));
+	if (gbl_verify(gbl, len, &info) != GBL_OK) {
+		fprintf(stderr, "not a valid GBL\n");
+		return false;
+	}
+	if (info.encryptedBytes || info.progLz4Tags || info.progLzmaTags
+			|| info.progTags == 0) {
+		fprintf(stderr, "GBL has no raw program data\n");
+		return false;
+	}
+	image->address = info.progStart;
+	image->len = info.progEnd - info.progStart;
+	image->data = malloc(image->len ? image->len : 1);
+	if (image->data == NULL) {
+		return false;
+	}
+	memset(image->data, 0xFF, image->len);
+
+	uint32_t next = info.progStart;
+	while (off + 8 <= len) {
+		uint32_t id = get_le32(gbl + off);
+		uint32_t tagLen = get_le32(gbl + off + 4);
+		const uint8_t *payload = gbl + off + 8;
+		if ((id == GBL_TAG_PROG || id == GBL_TAG_ERASEPROG) && tagLen >= 4) {
+			uint32_t addr = get_le32(payload);
+			if (addr != next) {
+				fprintf(stderr, "GBL program data is not contiguous\n");
+				free(image->data);
+				image->data = NULL;
+				return false;
+			}
+			memcpy(image->data + (addr - info.progStart), payload + 4,
+					tagLen - 4);
+			next += tagLen - 4;
+		}
+		off += 8 + (size_t) tagLen;
+	}
+	return true;
+}
+
+static int hexByte(const char *p) {
+	int v = 0;
+	for (int i = 0; i < 2; i++) {
+		int c = tolower((unsigned char) p[i]);
+		if (!isxdigit(c)) {
+			return -1;
+		}
+		v = v * 16 + (isdigit(c) ? c - '0' : c - 'a' + 10);
+	}
+	return v;
+}
+
+// Parse one data record: S1/S2/S3 with 2/3/4 address bytes.
+static bool srecRecord(const char *line, uint32_t *addr, uint8_t *data,
+		size_t *n) {
+	if (line[0] != 'S' || line[1] < '1' || line[1] > '3') {
+		return false;
+	}
+	size_t addrBytes = (size_t) (line[1] - '0') + 1;
+	int count = hexByte(line + 2);
+	uint8_t sum;
+	if (count < 0 || (size_t) count < addrBytes + 1
+			|| strlen(line) < 4 + 2 * (size_t) count) {
+		return false;
+	}
+	sum = (uint8_t) count;
+	*addr = 0;
+	for (int i = 0; i < count; i++) {
+		int b = hexByte(line + 4 + 2 * i);
+		if (b < 0) {
+			return false;
+		}
+		sum += (uint8_t) b;
+		if ((size_t) i < addrBytes) {
+			*addr = (*addr << 8) | (uint32_t) b;
+		} else if (i < count - 1) {
+			data[i - addrBytes] = (uint8_t) b;
+		}
+	}
+	*n = (size_t) count - addrBytes - 1;
+	return sum == 0xFF;
+}
+
+static bool srecImage(const char *path, ota_image_t *image) {
+	char line[600];
+	uint8_t data[256];
+	uint32_t addr, lo = UINT32_MAX, hi = 0;
+	size_t n;
+	FILE *f = fopen(path, "r");
+
+	if (f == NULL) {
+		perror(path);
+		return false;
+	}
+	// First pass finds the range, the second fills it.
+	for (int pass = 0; pass < 2; pass++) {
+		rewind(f);
+		while (fgets(line, sizeof(line), f) != NULL) {
+			if (line[0] != 'S' || line[1] < '1' || line[1] > '3') {
+				continue;
+			}
+			if (!srecRecord(line, &addr, data, &n)) {
+				fprintf(stderr, "%s: bad record: %s", path, line);
+				fclose(f);
+				return false;
+			}
+			if (pass == 0) {
+				lo = addr < lo ? addr : lo;
+				hi = addr + n > hi ? addr + (uint32_t) n : hi;
+			} else {
+				memcpy(image->data + (addr - lo), data, n);
+			}
+		}
+		if (pass == 0) {
+			if (hi <= lo) {
+				fprintf(stderr, "%s: no data records\n", path);
+				fclose(f);
+				return false;
+			}
+			image->address = lo;
+			image->len = hi - lo;
+			image->data = malloc(image->len);
+			if (image->data == NULL) {
+				fclose(f);
+				return false;
+			}
+			memset(image->data, 0xFF, image->len);
+		}
+	}
+	fclose(f);
+	return true;
+}
+
+bool ota_load_image(const char *path, ota_image_t *image) {
+	const char *ext = strrchr(path, '.');
+	size_t len;
+	uint8_t *data;
+
+	memset(image, 0, sizeof(*image));
+	if (ext != NULL && (!strcmp(ext, ".srec") || !strcmp(ext, ".s37")
+			|| !strcmp(ext, ".s19") || !strcmp(ext, ".s28"))) {
+		return srecImage(path, image);
+	}
+	data = ota_read_file(path, &len);
+	if (data == NULL) {
+		perror(path);
+		return false;
+	}
+	if (ext != NULL && !strcmp(ext, ".gbl")) {
+		bool ok = ota_gbl_image(data, len, image);
+		free(data);
+		return ok;
+	}
+	image->data = data;
+	image->len = len;
+	return true;
+}
@@ -0,0 +1,66 @@
+/***************************************************************************//**
+ * @file ota_encode.h
+ * @brief Delta patch encoder and image loaders for the host tools.
+ *
+ * The encoder is the counterpart of the ota_patch.h engine. It indexes
+ * the base with hash chains of 8-byte seeds and grows each candidate
+ * match across mismatching bytes while it still pays for itself, so code
+ * that moved in the relink becomes one PATCH carrying only the changed
+ * branch and address bytes. Whatever no match covers is sent as LITERAL.
+ ******************************************************************************/
+#ifndef OTA_ENCODE_H
+#define OTA_ENCODE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+	size_t copies;
+	size_t patches;
+	size_t literals;
+	size_t copyBytes;       ///< Target bytes taken from the base unchanged.
+	size_t runBytes;        ///< New bytes carried in PATCH runs.
+	size_t literalBytes;
+} ota_encode_stats_t;
+
+typedef struct {
+	uint8_t *data;
+	size_t len;
+	uint32_t address;       ///< Flash address of data[0], 0 if unknown.
+} ota_image_t;
+
+/**
+ * @brief Encode target against base.
+ *
+ * @param[out] patch malloc'd patch; free() it.
+ * @param[out] stats Optional.
+ * @return Patch size, 0 if out of memory.
+ */
+size_t ota_encode(const uint8_t *base, size_t base_len, const uint8_t *target,
+		size_t target_len, uint8_t **patch, ota_encode_stats_t *stats);
+
+/**
+ * @brief Read a whole file.
+ *
+ * @return malloc'd contents, NULL on error.
+ */
+uint8_t* ota_read_file(const char *path, size_t *len);
+
+/**
+ * @brief Load the application image a device runs after installing a
+ *        file: the raw program data of a GBL, the data records of an
+ *        S-record file, or a .bin as is.
+ *
+ * @return false, with a message on stderr, if the file cannot be used.
+ */
+bool ota_load_image(const char *path, ota_image_t *image);
+
+/**
+ * @brief Extract the raw program data of a verified GBL held in memory.
+ *
+ * The data must be one contiguous range, as the toolchain writes it.
+ */
+bool ota_gbl_image(const uint8_t *gbl, size_t len, ota_image_t *image);
+
+#endif // OTA_ENCODE_H
@@ -0,0 +1,388 @@
+/***************************************************************************//**
+ * @file ota_roundtrip.c
+ * @brief Round-trip delta OTA patches through the engine and the GATT path.
+ *
+ *   ota_roundtrip [old.gbl [new.gbl]]
+ *
+ * old.gbl (default ../output_gbl/application.gbl) is the installed release.
+ * Patches are made for new.gbl (default ../output_gbl/application-crc.gbl),
+ * for a synthetic next build that inserts code at 40% of the image and
+ * relocates every pointer past it, as a relink does, and for an unrelated
+ * file as the worst case. Each patch is applied by ota_patch.h in random
+ * pieces and budgets and must rebuild its target exactly, and corrupted
+ * patches and a wrong base must be rejected.
+ *
+ * The synthetic update is then sent to the simulated device over the
+ * ota_delta characteristic, a few writes per connection event within the
+ * FIFO credit, until the bootloader is asked to install the slot, whose
+ * contents must equal the target. The transfer time is compared with the
+ * full GBL at the same write rate. Finally a device running a different
+ * image must refuse the patch, so the central falls back to the full GBL.
+ * Exits 1 on any failure.
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app.h"
+#include "byteorder.h"
+#include "config.h"
+#include "crc32.h"
+#include "em_device.h"
+#include "gatt_db.h"
+#include "gbl.h"
+#include "ota_delta.h"
+#include "ota_encode.h"
+#include "ota_patch.h"
+#include "sim.h"
+
+#define STEP_NS             250000ull
+#define INTERVAL_NS         (CONN_TUNING_INTERVAL_MIN * 1250000ull)
+#define WRITES_PER_EVENT    4       // write without response per interval
+#define INSERT_BYTES        256
+#define FLIP_EVERY          500     // one changed constant per this many bytes
+#define CORRUPT_TRIALS      200
+
+static int failures;
+
+static void check(bool ok, const char *what) {
+	if (!ok) {
+		printf("FAIL: %s\n", what);
+		failures++;
+	}
+}
+
+// Deterministic, so every run builds the same synthetic release.
+static uint32_t rng = 12345;
+
+static uint32_t nextRandom(void) {
+	rng ^= rng << 13;
+	rng ^= rng >> 17;
+	rng ^= rng << 5;
+	return rng;
+}
+
+// ---------------------------------------------------------------------------
+// Synthetic releases
+
+// Keep the header and application tags of gbl, replace the program data
+// and close with a new end tag.
+static uint8_t* buildGbl(const uint8_t *gbl, const uint8_t *image, size_t len,
+		uint32_t address, size_t *outLen) {
+	size_t keep = 0;
+	for (int i = 0; i < 2; i++) {
+		keep += 8 + get_le32(gbl + keep + 4);
+	}
+	size_t total = keep + 12 + len + 12;
+	uint8_t *out = malloc(total);
+
+	memcpy(out, gbl, keep);
+	put_le32(out + keep, GBL_TAG_ERASEPROG);
+	put_le32(out + keep + 4, (uint32_t) (4 + len));
+	put_le32(out + keep + 8, address);
+	memcpy(out + keep + 12, image, len);
+	uint8_t *end = out + keep + 12 + len;
+	put_le32(end, GBL_TAG_END);
+	put_le32(end + 4, 4);
+	put_le32(end + 8, crc32(0, out, total - 4));
+	*outLen = total;
+	return out;
+}
+
+// The next build: code inserted at 40%, everything after it moved, the
+// pointers to it relocated, and a sprinkle of changed constants.
+static uint8_t* relink(const ota_image_t *base, size_t *outLen) {
+	size_t at = (base->len * 2 / 5) & ~(size_t) 3;
+	size_t len = base->len + INSERT_BYTES;
+	uint8_t *img = malloc(len);
+	uint32_t moved = base->address + (uint32_t) at;
+	uint32_t end = base->address + (uint32_t) base->len;
+
+	memcpy(img, base->data, at);
+	for (size_t i = 0; i < INSERT_BYTES; i++) {
+		img[at + i] = (uint8_t) nextRandom();
+	}
+	memcpy(img + at + INSERT_BYTES, base->data + at, base->len - at);
+	for (size_t i = 0; i + 4 <= len; i += 4) {
+		uint32_t v = get_le32(img + i);
+		if (v >= moved && v < end) {
+			put_le32(img + i, v + INSERT_BYTES);
+		}
+	}
+	for (size_t i = 0; i < len / FLIP_EVERY; i++) {
+		// Stay clear of the vector table and application properties.
+		size_t pos = 256 + nextRandom() % (len / 2);
+		img[pos] ^= (uint8_t) (1 + nextRandom() % 255);
+	}
+	*outLen = len;
+	return img;
+}
+
+// ---------------------------------------------------------------------------
+// Engine round trip
+
+typedef struct {
+	uint8_t *data;
+	size_t size;
+	size_t len;
+} sink_t;
+
+static bool writeMemory(uint32_t offset, const uint8_t *data, size_t len,
+		void *ctx) {
+	sink_t *s = ctx;
+	if (offset != s->len || offset + len > s->size) {
+		return false;
+	}
+	memcpy(s->data + offset, data, len);
+	s->len += len;
+	return true;
+}
+
+// Apply patch in random pieces, with random budgets.
+static ota_patch_status_t apply(const uint8_t *base, size_t baseLen,
+		const uint8_t *patch, size_t patchLen, sink_t *out) {
+	ota_patch_t p;
+	size_t at = 0;
+	ota_patch_status_t sc = OTA_PATCH_OK;
+
+	out->len = 0;
+	ota_patch_init(&p, base, (uint32_t) baseLen, writeMemory, out);
+	while (sc == OTA_PATCH_OK && (at < patchLen || ota_patch_pending(&p))) {
+		size_t piece = 1 + nextRandom() % 300;
+		size_t used;
+		if (piece > patchLen - at) {
+			piece = patchLen - at;
+		}
+		sc = ota_patch_feed(&p, patch + at, piece, &used,
+				1 + nextRandom() % 2048);
+		at += used;
+	}
+	return sc == OTA_PATCH_OK ? ota_patch_finish(&p) : sc;
+}
+
+static void roundTrip(const char *name, const ota_image_t *base,
+		const uint8_t *target, size_t targetLen, uint8_t **patchOut,
+		size_t *patchLenOut) {
+	uint8_t *patch;
+	ota_encode_stats_t st;
+	size_t patchLen = ota_encode(base->data, base->len, target, targetLen,
+			&patch, &st);
+	sink_t out = { malloc(targetLen), targetLen, 0 };
+	char what[128];
+
+	ota_patch_status_t sc = apply(base->data, base->len, patch, patchLen, &out);
+	printf("%-10s target %7zu  patch %7zu (%5.1f%%)  %zu copy %zu patch "
+			"%zu literal\n", name, targetLen, patchLen,
+			100.0 * patchLen / targetLen, st.copies, st.patches, st.literals);
+	snprintf(what, sizeof(what), "%s: rebuilt target differs", name);
+	check(sc == OTA_PATCH_OK && out.len == targetLen
+			&& !memcmp(out.data, target, targetLen), what);
+
+	if (patchOut != NULL) {
+		*patchOut = patch;
+		*patchLenOut = patchLen;
+	} else {
+		free(patch);
+	}
+	free(out.data);
+}
+
+// Corrupt patches and a wrong base must never yield OTA_PATCH_OK.
+static void rejections(const ota_image_t *base, size_t targetLen,
+		const uint8_t *patch, size_t patchLen) {
+	uint8_t *bad = malloc(patchLen);
+	sink_t out = { malloc(targetLen), targetLen, 0 };
+	size_t accepted = 0;
+
+	for (int i = 0; i < CORRUPT_TRIALS; i++) {
+		memcpy(bad, patch, patchLen);
+		size_t pos = OTA_PATCH_HEADER_SIZE
+				+ nextRandom() % (patchLen - OTA_PATCH_HEADER_SIZE);
+		bad[pos] ^= (uint8_t) (1 + nextRandom() % 255);
+		if (apply(base->data, base->len, bad, patchLen, &out) == OTA_PATCH_OK) {
+			accepted++;
+		}
+	}
+	check(accepted == 0, "corrupted patch accepted");
+	check(apply(base->data, base->len, patch, patchLen / 2, &out)
+			== OTA_PATCH_ERR_TARGET, "truncated patch accepted");
+
+	uint8_t *other = malloc(base->len);
+	memcpy(other, base->data, base->len);
+	other[base->len / 3] ^= 0x01;
+	check(apply(other, base->len, patch, patchLen, &out)
+			== OTA_PATCH_ERR_BASE, "wrong base accepted");
+	printf("rejected   %d corrupted, truncated and wrong-base patches\n",
+			CORRUPT_TRIALS);
+	free(other);
+	free(bad);
+	free(out.data);
+}
+
+// ---------------------------------------------------------------------------
+// Over the air
+
+static struct {
+	uint8_t state;
+	uint8_t status;
+	uint16_t detail;
+	uint32_t consumed;
+	size_t reports;
+} device;
+
+static void onNotification(uint8_t connection, uint16_t characteristic,
+		const uint8_t *value, size_t len) {
+	(void) connection;
+	if (characteristic == gattdb_ota_delta && len == OTA_DELTA_STATUS_SIZE) {
+		device.state = value[0];
+		device.status = value[1];
+		device.detail = get_le16(value + 2);
+		device.consumed = get_le32(value + 4);
+		device.reports++;
+	}
+}
+
+// One connection interval of superloop passes.
+static void interval(void) {
+	for (uint64_t t = 0; t < INTERVAL_NS; t += STEP_NS) {
+		sim_advance(STEP_NS);
+		app_process_action();
+	}
+}
+
+// Send a patch as the central would; returns simulated seconds.
+static double sendPatch(const ota_image_t *running, const uint8_t *patch,
+		size_t patchLen) {
+	uint8_t writes[WRITES_PER_EVENT][OTA_DELTA_MAX_SIZE];
+	const uint8_t *data[WRITES_PER_EVENT];
+	size_t lens[WRITES_PER_EVENT];
+	const size_t chunk = OTA_DELTA_MAX_SIZE - 1;
+	size_t sent = 0;
+	uint64_t t0;
+
+	sim_reset();
+	sim_flash_load(running->data, running->len);
+	memset(&device, 0, sizeof(device));
+	sim_set_notification_sink(onNotification);
+	app_init();
+	sim_boot();
+	uint8_t conn = sim_connect();
+	sim_negotiate(conn);
+	sim_subscribe(conn, gattdb_ota_delta, sl_bt_gatt_server_notification);
+	interval();
+
+	t0 = sim_now_ns();
+	while (sent < patchLen && device.state != OTA_DELTA_STATE_FAILED) {
+		size_t n = 0;
+		// Stay within the FIFO credit last reported.
+		while (n < WRITES_PER_EVENT && sent < patchLen) {
+			size_t len = patchLen - sent < chunk ? patchLen - sent : chunk;
+			if (sent + len - device.consumed > OTA_DELTA_FIFO_SIZE) {
+				break;
+			}
+			writes[n][0] = sent ? OTA_DELTA_OP_DATA : OTA_DELTA_OP_BEGIN;
+			memcpy(&writes[n][1], patch + sent, len);
+			data[n] = writes[n];
+			lens[n] = len + 1;
+			sent += len;
+			n++;
+		}
+		if (n) {
+			sim_gatt_write_burst(conn, gattdb_ota_delta, data, lens, n);
+		}
+		interval();
+	}
+	uint8_t commit = OTA_DELTA_OP_COMMIT;
+	sim_gatt_write(conn, gattdb_ota_delta, &commit, 1);
+	for (int i = 0; i < 1000 && device.state == OTA_DELTA_STATE_RECEIVING;
+			i++) {
+		interval();
+	}
+	double seconds = (sim_now_ns() - t0) / 1e9;
+	// Reboot into the bootloader once the status is out.
+	for (uint64_t ms = 0; ms < OTA_DELTA_REBOOT_DELAY_MS + 20; ms++) {
+		sim_advance(1000000);
+		app_process_action();
+	}
+	return seconds;
+}
+
+static void overTheAir(const ota_image_t *base, const uint8_t *target,
+		size_t targetLen, const uint8_t *patch, size_t patchLen) {
+	const size_t chunk = OTA_DELTA_MAX_SIZE - 1;
+	double seconds = sendPatch(base, patch, patchLen);
+	size_t slotLen;
+	const uint8_t *slot = sim_btl_slot(&slotLen);
+
+	check(device.state == OTA_DELTA_STATE_DONE, "device did not verify");
+	check(sim_btl_install_requested(), "install not requested");
+	check(slotLen >= targetLen && !memcmp(slot, target, targetLen),
+			"slot differs from the target");
+	double full = (double) ((targetLen + chunk * WRITES_PER_EVENT - 1)
+			/ (chunk * WRITES_PER_EVENT)) * INTERVAL_NS / 1e9;
+	printf("over BLE   %zu bytes in %.2f s, %zu status reports; full GBL "
+			"%.2f s at the same rate\n", patchLen, seconds, device.reports,
+			full);
+
+	// A device on another release: the patch is refused on its header.
+	ota_image_t other = *base;
+	other.data = malloc(base->len);
+	memcpy(other.data, base->data, base->len);
+	other.data[base->len / 2] ^= 0xFF;
+	sendPatch(&other, patch, patchLen);
+	check(device.state == OTA_DELTA_STATE_FAILED
+			&& device.status == OTA_DELTA_ERR_PATCH
+			&& device.detail == OTA_PATCH_ERR_BASE,
+			"wrong release not refused");
+	check(!sim_btl_install_requested(), "wrong release installed");
+	printf("refused    by a device on another release (status %u, detail "
+			"%u); fall back to the full GBL\n", device.status, device.detail);
+	free(other.data);
+}
+
+int main(int argc, char **argv) {
+	const char *oldPath = argc > 1 ? argv[1] : "../output_gbl/application.gbl";
+	const char *newPath = argc > 2 ? argv[2] :
+			"../output_gbl/application-crc.gbl";
+	ota_image_t base;
+	size_t oldLen, newLen, synthLen, imgLen;
+
+	uint8_t *oldGbl = ota_read_file(oldPath, &oldLen);
+	if (oldGbl == NULL || !ota_gbl_image(oldGbl, oldLen, &base)) {
+		fprintf(stderr, "%s: cannot load\n", oldPath);
+		return 1;
+	}
+	printf("base       %s, %zu bytes at 0x%08X\n", oldPath, base.len,
+			base.address);
+
+	uint8_t *newGbl = ota_read_file(newPath, &newLen);
+	if (newGbl != NULL) {
+		roundTrip("release", &base, newGbl, newLen, NULL, NULL);
+	}
+
+	uint8_t *img = relink(&base, &imgLen);
+	uint8_t *synth = buildGbl(oldGbl, img, imgLen, base.address, &synthLen);
+	check(gbl_verify(synth, synthLen, NULL) == GBL_OK, "synthetic GBL invalid");
+	uint8_t *patch;
+	size_t patchLen;
+	roundTrip("relinked", &base, synth, synthLen, &patch, &patchLen);
+
+	uint8_t *noise = malloc(synthLen);
+	for (size_t i = 0; i < synthLen; i++) {
+		noise[i] = (uint8_t) nextRandom();
+	}
+	roundTrip("unrelated", &base, noise, synthLen, NULL, NULL);
+
+	rejections(&base, synthLen, patch, patchLen);
+	overTheAir(&base, synth, synthLen, patch, patchLen);
+
+	printf("%s\n", failures ? "FAILED" : "OK");
+	free(noise);
+	free(patch);
+	free(synth);
+	free(img);
+	free(newGbl);
+	free(oldGbl);
+	free(base.data);
+	return failures != 0;
+}
@@ -0,0 +1,106 @@
+/***************************************************************************//**
+ * @file prof_dump.c
+ * @brief Profile a simulated session and capture the profile records.
+ *
+ *   prof_dump [file]
+ *
+ * Boots, connects, negotiates and streams acquisition while a mix of
+ * legacy and binary nodeRx commands arrives, running the superloop in 250 us
+ * steps the way main.c does, with the same PROF_SUPERLOOP region. Then
+ * subscribes to the profile characteristic and writes the records of one
+ * report to file (default prof.bin) for prof_report.py. Cycle counts are
+ * host time at the target core clock (see stubs/em_device.h), useful for
+ * comparing revisions of the same code on the same host.
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app.h"
+#include "cmd_proto.h"
+#include "config.h"
+#include "gatt_db.h"
+#include "prof.h"
+#include "sim.h"
+
+#define STEP_NS         250000ull
+#define SESSION_MS      3000
+
+static FILE *out;
+static size_t records;
+
+static void onNotification(uint8_t connection, uint16_t characteristic,
+		const uint8_t *value, size_t len) {
+	(void) connection;
+	if (characteristic == gattdb_profile) {
+		fwrite(value, 1, len, out);
+		records++;
+	}
+}
+
+// One main.c superloop iteration after a step of simulated time.
+static void step(void) {
+	sim_advance(STEP_NS);
+	PROF_BEGIN(loopStart);
+	app_process_action();
+	PROF_END(PROF_SUPERLOOP, loopStart);
+}
+
+static size_t binarySet(uint8_t *data, uint8_t seq, uint32_t amplitude) {
+	cmd_t cmd;
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.mask = CMD_FIELD_AMPLITUDE;
+	cmd.value[0] = amplitude;
+	return cmd_encode_set(seq, &cmd, data, NODE_RX_MAX_SIZE);
+}
+
+int main(int argc, char **argv) {
+	const char *path = argc > 1 ? argv[1] : "prof.bin";
+	static const char *const ascii[] = {
+		"_A100,F20,P200", "_A5", "_F130,P90", "_A100,F20;P200;L1", "_L0",
+	};
+	uint8_t data[NODE_RX_MAX_SIZE];
+
+	out = fopen(path, "wb");
+	if (out == NULL) {
+		perror(path);
+		return 1;
+	}
+
+	sim_reset();
+	app_init();
+	sim_boot();
+	uint8_t conn = sim_connect();
+	sim_negotiate(conn);
+	sim_subscribe(conn, gattdb_node_tx, sl_bt_gatt_server_notification);
+	sim_subscribe(conn, gattdb_acq_stream, sl_bt_gatt_server_notification);
+	for (unsigned int ms = 0; ms < SESSION_MS; ms++) {
+		if (ms % 10 == 0) {
+			const char *c = ascii[(ms / 10) % 5];
+			sim_gatt_write(conn, gattdb_node_rx, (const uint8_t*) c, strlen(c));
+		} else if (ms % 10 == 5) {
+			size_t len = binarySet(data, (uint8_t) ms, ms % 200);
+			sim_gatt_write(conn, gattdb_node_rx, data, len);
+		}
+		for (int i = 0; i < 4; i++) {
+			step();
+		}
+	}
+
+	sim_set_notification_sink(onNotification);
+	sim_subscribe(conn, gattdb_profile, sl_bt_gatt_server_notification);
+	for (unsigned int ms = 0; ms < PROF_REPORT_INTERVAL_MS + 10 && !records;
+			ms++) {
+		for (int i = 0; i < 4; i++) {
+			step();
+		}
+	}
+	// Let the rest of the report go out.
+	for (int i = 0; i < 40; i++) {
+		step();
+	}
+	fclose(out);
+	printf("%zu profile records written to %s\n", records, path);
+	return records == 0;
+}
@@ -0,0 +1,183 @@
+/***************************************************************************//**
+ * @file protocol_run.c
+ * @brief Play a stimulation protocol through the host simulation build.
+ *
+ *   protocol_run <amplitude,frequency_hz,pulse_width_us,duration_ms,gap_ms>...
+ *
+ * Each argument is one epoch. The protocol is written to slot 0 over nodeRx
+ * with CMD_OP_PROTOCOL_WRITE and armed with CMD_OP_PROTOCOL_RUN to start on
+ * disconnect, then the central leaves and the sequencer runs on the
+ * simulation clock in 1 ms steps. Prints when each epoch starts and when
+ * its train ends with the pulses it delivered, then the energy mode
+ * residency and charge estimate from power.c. A central then reconnects
+ * and reads the telemetry snapshot, whose pulse count must match the
+ * trains'. Finally checks that a reboot keeps the stored protocol.
+ ******************************************************************************/
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app.h"
+#include "byteorder.h"
+#include "cmd_proto.h"
+#include "config.h"
+#include "gatt_db.h"
+#include "power.h"
+#include "protocol.h"
+#include "sequencer.h"
+#include "sim.h"
+#include "stim.h"
+#include "telemetry.h"
+
+#define RUN_STEP_NS     1000000ull  // 1 ms
+#define RUN_LIMIT_MS    (24ull * 3600 * 1000)
+
+static size_t frame(uint8_t op, const uint8_t *payload, size_t len,
+		uint8_t *out) {
+	out[0] = CMD_PROTO_SOF;
+	out[1] = CMD_PROTO_VERSION;
+	out[2] = op;
+	out[3] = 0;
+	memcpy(out + CMD_HEADER_SIZE, payload, len);
+	len += CMD_HEADER_SIZE;
+	uint16_t crc = cmd_crc16(out, len);
+	out[len++] = (uint8_t) crc;
+	out[len++] = (uint8_t) (crc >> 8);
+	return len;
+}
+
+// Send a frame and return the status byte of the STATE reply.
+static int send(uint8_t connection, uint8_t op, const uint8_t *payload,
+		size_t len) {
+	uint8_t data[NODE_RX_MAX_SIZE];
+	uint8_t reply[NODE_TX_MAX_SIZE];
+	size_t replyLen;
+
+	len = frame(op, payload, len, data);
+	if (sim_gatt_long_write(connection, gattdb_node_rx, data, len, 64)
+			!= SL_STATUS_OK
+			|| sim_gatt_read(gattdb_node_tx, reply, sizeof(reply), &replyLen)
+					!= SL_STATUS_OK || replyLen <= CMD_HEADER_SIZE) {
+		return -1;
+	}
+	return reply[CMD_HEADER_SIZE];
+}
+
+int main(int argc, char **argv) {
+	protocol_t p = { .name = "protocol_run" };
+	uint8_t payload[1 + PROTOCOL_RECORD_MAX_SIZE];
+	int status;
+
+	if (argc < 2 || argc - 1 > PROTOCOL_MAX_EPOCHS) {
+		fprintf(stderr, "usage: %s <amplitude,frequency_hz,pulse_width_us,"
+				"duration_ms,gap_ms>... (up to %d epochs)\n", argv[0],
+				PROTOCOL_MAX_EPOCHS);
+		return 1;
+	}
+	for (int i = 1; i < argc; i++) {
+		protocol_epoch_t *e = &p.epochs[p.epochCount++];
+		if (sscanf(argv[i], "%" SCNu32 ",%" SCNu32 ",%" SCNu32 ",%" SCNu32
+				",%" SCNu32, &e->amplitude, &e->frequency, &e->pulseWidth,
+				&e->durationMs, &e->gapMs) != 5) {
+			fprintf(stderr, "bad epoch '%s'\n", argv[i]);
+			return 1;
+		}
+	}
+
+	sim_nvm3_erase();
+	sim_reset();
+	app_init();
+	sim_boot();
+	uint8_t connection = sim_connect();
+
+	payload[0] = 0; // slot
+	size_t len = protocol_encode(&p, payload + 1, sizeof(payload) - 1);
+	status = send(connection, CMD_OP_PROTOCOL_WRITE, payload, len + 1);
+	printf("write slot 0: %d epochs, %zu bytes, status %d\n", p.epochCount,
+			len, status);
+	if (status != CMD_OK) {
+		return 1;
+	}
+	payload[1] = PROTOCOL_TRIGGER_DISCONNECT;
+	status = send(connection, CMD_OP_PROTOCOL_RUN, payload, 2);
+	printf("arm slot 0 on disconnect: status %d\n", status);
+	if (status != CMD_OK) {
+		return 1;
+	}
+	sim_disconnect(connection, 0);
+
+	uint8_t slot, epoch, lastEpoch = 0;
+	uint64_t ms = 0, pulses = 0;
+	if (!sequencer_position(&slot, &epoch)) {
+		printf("sequencer did not start\n");
+		return 1;
+	}
+	printf("%10" PRIu64 " ms  epoch 0 start\n", ms);
+	while (sequencer_is_running() && ms < RUN_LIMIT_MS) {
+		bool wasRunning = stim_is_running();
+		sim_advance(RUN_STEP_NS);
+		ms++;
+		// Let a finished train stop first so its count can be read before
+		// the sequencer starts the next one.
+		stim_process_action();
+		if (wasRunning && !stim_is_running()) {
+			printf("%10" PRIu64 " ms  epoch %u end, %" PRIu32 " pulses\n", ms,
+					lastEpoch, stim_pulses_delivered());
+			pulses += stim_pulses_delivered();
+		}
+		app_process_action();
+		if (sequencer_position(&slot, &epoch) && epoch != lastEpoch) {
+			printf("%10" PRIu64 " ms  epoch %u start\n", ms, epoch);
+			lastEpoch = epoch;
+		}
+	}
+	printf("%10" PRIu64 " ms  protocol %s\n", ms,
+			sequencer_is_running() ? "still running" : "done");
+
+	power_stats_t power;
+	static const char *const states[POWER_STATE_COUNT] = {
+		"em0", "em1", "em2", "stim", "advertising", "connected"
+	};
+	power_get(&power);
+	printf("power uptime=%" PRIu64 " ms", power.uptimeMs);
+	for (int i = 0; i < POWER_STATE_COUNT; i++) {
+		printf(" %s=%" PRIu64, states[i], power.residencyMs[i]);
+	}
+	printf(" charge=%" PRIu64 " nAh average=%" PRIu32 " nA\n",
+			power.chargeNah, power.averageNa);
+
+	// Refreshed on connection, read in one go as a central would.
+	uint8_t record[TELEMETRY_MAX_SIZE];
+	connection = sim_connect();
+	if (sim_gatt_read(gattdb_telemetry, record, sizeof(record), &len)
+			!= SL_STATUS_OK || len != TELEMETRY_SIZE
+			|| record[0] != TELEMETRY_VERSION) {
+		printf("telemetry not readable\n");
+		return 1;
+	}
+	uint64_t counted = get_le64(record + 16);
+	printf("telemetry trains=%" PRIu32 " completed=%" PRIu32 " pulses=%"
+			PRIu64 " charge=%" PRIu64 " pC missed=%" PRIu32 " stim=%" PRIu32
+			" ms\n", get_le32(record + 4), get_le32(record + 8), counted,
+			get_le64(record + 24), get_le32(record + 32),
+			get_le32(record + 36));
+	if (counted != pulses) {
+		printf("telemetry counted %" PRIu64 " pulses, trains delivered %"
+				PRIu64 "\n", counted, pulses);
+		return 1;
+	}
+
+	// The slot and its autorun setting survive a reboot.
+	protocol_t stored;
+	protocol_autorun_t armed;
+	sim_reset();
+	app_init();
+	protocol_store_get_autorun(&armed);
+	bool kept = protocol_store_load(0, &stored) == SL_STATUS_OK
+			&& stored.epochCount == p.epochCount && armed.slot == 0
+			&& armed.triggers == PROTOCOL_TRIGGER_DISCONNECT;
+	printf("after reboot: %s, %zu NVM3 writes\n", kept ? "kept" : "lost",
+			sim_nvm3_writes());
+	return kept ? 0 : 1;
+}
@@ -0,0 +1,102 @@
+/***************************************************************************//**
+ * @file rhs_trace.c
+ * @brief Trace the RHS2116 bus through the host simulation build.
+ *
+ *   rhs_trace [registers]
+ *
+ * Boots the application, which identifies the chip, then writes and reads
+ * back the given number of registers (default 16) as one batch. Prints every
+ * word on the bus with its time, command and answer, checks each read-back
+ * against the model's register file, and compares the bus time with the
+ * same accesses done one read per batch.
+ ******************************************************************************/
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "app.h"
+#include "rhs2116.h"
+#include "sim.h"
+
+static int completions;
+static sl_status_t lastStatus;
+
+static void onBatch(rhs2116_batch_t *batch, sl_status_t status, void *context) {
+	(void) batch;
+	(void) context;
+	completions++;
+	lastStatus = status;
+}
+
+static const char* describe(uint32_t command) {
+	switch (command & 0xC0000000u) {
+	case RHS2116_CMD_WRITE:
+		return "WRITE";
+	case RHS2116_CMD_READ:
+		return "READ ";
+	default:
+		return "OTHER";
+	}
+}
+
+int main(int argc, char **argv) {
+	static rhs2116_batch_t batch;
+	static uint16_t readBack[RHS2116_BATCH_MAX];
+	unsigned int n = 16;
+
+	if (argc > 1) {
+		n = (unsigned int) strtoul(argv[1], NULL, 0);
+	}
+	if (n == 0 || 2 * n > RHS2116_BATCH_MAX) {
+		fprintf(stderr, "usage: %s [registers, 1..%d]\n", argv[0],
+				RHS2116_BATCH_MAX / 2);
+		return 1;
+	}
+
+	sim_reset();
+	app_init();
+	sim_rhs2116_run();
+	app_process_action();
+	size_t idWords = sim_rhs2116_words();
+
+	rhs2116_batch_init(&batch);
+	for (unsigned int i = 0; i < n; i++) {
+		rhs2116_batch_write(&batch, (uint8_t) (32 + i), (uint16_t) (0x1000 + i),
+				0);
+	}
+	for (unsigned int i = 0; i < n; i++) {
+		rhs2116_batch_read(&batch, (uint8_t) (32 + i), &readBack[i]);
+	}
+	rhs2116_submit(&batch, onBatch, NULL);
+	sim_rhs2116_run();
+	app_process_action();
+
+	const sim_rhs2116_word_t *words;
+	size_t count = sim_rhs2116_log(&words);
+	for (size_t i = 0; i < count; i++) {
+		printf("%8.2f us  %s R%-3u 0x%04x  -> 0x%08" PRIx32 "\n",
+				(double) words[i].ns / 1000, describe(words[i].command),
+				(unsigned int) ((words[i].command >> 16) & 0xFF),
+				(unsigned int) (words[i].command & 0xFFFF), words[i].answer);
+	}
+
+	int errors = 0;
+	for (unsigned int i = 0; i < n; i++) {
+		if (readBack[i] != sim_rhs2116_reg((uint8_t) (32 + i))
+				|| readBack[i] != 0x1000 + i) {
+			errors++;
+		}
+	}
+	// One read per batch pays the pipeline on every access.
+	uint64_t wordNs = sim_rhs2116_bus_ns() / sim_rhs2116_words();
+	size_t batchWords = sim_rhs2116_words() - idWords;
+	size_t singleWords = 2 * n * (1 + RHS2116_PIPELINE_DEPTH);
+	printf("batch: %u writes + %u reads in %zu words, %.1f us; "
+			"one per batch: %zu words, %.1f us\n", n, n, batchWords,
+			(double) (batchWords * wordNs) / 1000, singleWords,
+			(double) (singleWords * wordNs) / 1000);
+	printf("status 0x%04x, %d callbacks, %d read-back errors\n",
+			(unsigned int) lastStatus, completions, errors);
+	return lastStatus == SL_STATUS_OK && completions == 1 && errors == 0 ?
+			0 : 1;
+}
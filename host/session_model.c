@@ -0,0 +1,242 @@
+/***************************************************************************//**
+ * @file session_model.c
+ * @brief Walk two centrals through the controller and observer roles, through
+ *        the host simulation build.
+ *
+ *   session_model
+ *
+ * Central A connects first, toggles its subscriptions to the streams
+ * notify.c does not publish, and becomes the controller; central B joins as
+ * an observer without touching A's MTU; both subscribe to nodeTx. Each
+ * step sends one command and prints the status of the reply, the role of
+ * each central afterwards and the nodeTx notifications each received.
+ * Then every remaining connection slot is filled to show advertising stop
+ * at SESSION_MAX_CONNECTIONS and resume at the last advertising stage when
+ * one closes, and an observer subscribes to acq_stream next to the
+ * controller. Exits non-zero if any step differs from what session.h
+ * describes, if an observer can start a firmware update, or if it takes
+ * over the controller's stream.
+ ******************************************************************************/
+#include <stdio.h>
+#include <string.h>
+
+#include "acq.h"
+#include "adv_policy.h"
+#include "app.h"
+#include "byteorder.h"
+#include "cmd_proto.h"
+#include "config.h"
+#include "conn_tuning.h"
+#include "gatt_db.h"
+#include "ota_delta.h"
+#include "session.h"
+#include "sim.h"
+
+static int failures;
+
+// acq_stream frames received by the controller and one observer.
+static struct {
+	uint8_t connection;
+	size_t frames;
+	uint32_t lastSweep;
+	bool restarted;         // a frame went back to an earlier sweep
+} streamRx[2];
+
+static size_t frame(uint8_t op, const uint8_t *payload, size_t len,
+		uint8_t *out) {
+	out[0] = CMD_PROTO_SOF;
+	out[1] = CMD_PROTO_VERSION;
+	out[2] = op;
+	out[3] = 0;
+	memcpy(out + CMD_HEADER_SIZE, payload, len);
+	len += CMD_HEADER_SIZE;
+	uint16_t crc = cmd_crc16(out, len);
+	out[len++] = (uint8_t) crc;
+	out[len++] = (uint8_t) (crc >> 8);
+	return len;
+}
+
+// Send a frame from a central, run the superloop once to flush nodeTx, and
+// return the status byte of the reply the central was notified.
+static int send(uint8_t connection, uint8_t op, const uint8_t *payload,
+		size_t len) {
+	uint8_t data[NODE_RX_MAX_SIZE];
+	uint8_t reply[NODE_TX_MAX_SIZE];
+	size_t before = sim_notification_count(connection);
+
+	len = frame(op, payload, len, data);
+	if (sim_gatt_write(connection, gattdb_node_rx, data, len) != SL_STATUS_OK) {
+		return -1;
+	}
+	app_process_action();
+	if (sim_notification_count(connection) == before
+			|| sim_last_notification(connection, reply, sizeof(reply))
+					<= CMD_HEADER_SIZE) {
+		return -1;
+	}
+	return reply[CMD_HEADER_SIZE];
+}
+
+static int setAmplitude(uint8_t connection, uint32_t amplitude) {
+	uint8_t payload[1 + CMD_VALUE_SIZE] = { CMD_FIELD_AMPLITUDE };
+	for (int i = 0; i < CMD_VALUE_SIZE; i++) {
+		payload[1 + i] = (uint8_t) (amplitude >> (8 * i));
+	}
+	return send(connection, CMD_OP_SET, payload, sizeof(payload));
+}
+
+static int session(uint8_t connection, uint8_t action) {
+	return send(connection, CMD_OP_SESSION, &action, 1);
+}
+
+static const char* roleName(uint8_t connection) {
+	switch (session_role(connection)) {
+	case SESSION_ROLE_CONTROLLER:
+		return "controller";
+	case SESSION_ROLE_OBSERVER:
+		return "observer";
+	default:
+		return "-";
+	}
+}
+
+static void step(const char *what, int status, int expected, uint8_t a,
+		uint8_t b) {
+	static size_t seenA, seenB;
+	size_t nA = sim_notification_count(a), nB = sim_notification_count(b);
+	bool ok = status == expected;
+
+	printf("%-26s status=%-3d A=%-10s B=%-10s notified A+%zu B+%zu%s\n",
+			what, status, roleName(a), roleName(b), nA - seenA, nB - seenB,
+			ok ? "" : "  <-- unexpected");
+	seenA = nA;
+	seenB = nB;
+	failures += !ok;
+}
+
+static void check(const char *what, bool ok) {
+	printf("%-26s %s\n", what, ok ? "ok" : "FAILED");
+	failures += !ok;
+}
+
+static void onNotification(uint8_t connection, uint16_t characteristic,
+		const uint8_t *value, size_t len) {
+	if (characteristic != gattdb_acq_stream || len < ACQ_FRAME_HEADER_SIZE) {
+		return;
+	}
+	for (size_t i = 0; i < 2; i++) {
+		if (streamRx[i].connection != connection) {
+			continue;
+		}
+		uint32_t sweep = get_le32(value + 2);
+		if (streamRx[i].frames && sweep <= streamRx[i].lastSweep) {
+			streamRx[i].restarted = true;
+		}
+		streamRx[i].lastSweep = sweep;
+		streamRx[i].frames++;
+	}
+}
+
+// Run the superloop on the simulation clock, 1 ms per pass.
+static void runFor(uint32_t ms) {
+	while (ms--) {
+		sim_advance(1000000);
+		app_process_action();
+	}
+}
+
+int main(void) {
+	uint8_t extra[SESSION_MAX_CONNECTIONS];
+	size_t extras = 0;
+
+	sim_nvm3_erase();
+	sim_reset();
+	app_init();
+	sim_boot();
+
+	// Subscriptions to streams notify does not publish must not use up
+	// the slot nodeTx needs.
+	static const uint16_t streams[] = {
+		gattdb_acq_stream, gattdb_dlog, gattdb_profile, gattdb_trace,
+	};
+	uint8_t a = sim_connect();
+	sim_negotiate(a);
+	for (size_t i = 0; i < sizeof(streams) / sizeof(streams[0]); i++) {
+		sim_subscribe(a, streams[i], sl_bt_gatt_server_notification);
+		sim_subscribe(a, streams[i], sl_bt_gatt_server_disable);
+	}
+	sim_subscribe(a, gattdb_node_tx, sl_bt_gatt_server_notification);
+	uint8_t b = sim_connect();
+	bool ownMtu = conn_tuning_get(a)->mtu == CONN_TUNING_MAX_MTU
+			&& conn_tuning_get(b)->mtu == 23;
+	sim_negotiate(b);
+	sim_subscribe(b, gattdb_node_tx, sl_bt_gatt_server_notification);
+	step("connect A, B", CMD_OK, CMD_OK, a, b);
+	check("B joining keeps A's MTU", ownMtu);
+
+	step("A sets amplitude 100", setAmplitude(a, 100), CMD_OK, a, b);
+	step("B sets amplitude 50", setAmplitude(b, 50), CMD_ERR_PERMISSION, a,
+			b);
+	step("B reads state", send(b, CMD_OP_GET, NULL, 0), CMD_OK, a, b);
+	step("B claims", session(b, SESSION_CLAIM), CMD_ERR_PERMISSION, a, b);
+	step("A releases", session(a, SESSION_RELEASE), CMD_OK, a, b);
+	step("B claims", session(b, SESSION_CLAIM), CMD_OK, a, b);
+	step("B sets amplitude 50", setAmplitude(b, 50), CMD_OK, a, b);
+	step("A sets amplitude 100", setAmplitude(a, 100), CMD_ERR_PERMISSION, a,
+			b);
+
+	sim_disconnect(b, 0x13);
+	step("B disconnects", CMD_OK, CMD_OK, a, b);
+	step("A claims", session(a, SESSION_CLAIM), CMD_OK, a, b);
+
+	// An observer's BEGIN is ignored: no update starts, nothing is reported.
+	uint8_t c = extra[extras++] = sim_connect();
+	uint8_t begin = OTA_DELTA_OP_BEGIN;
+	sim_subscribe(c, gattdb_ota_delta, sl_bt_gatt_server_notification);
+	app_process_action();
+	size_t reports = sim_notification_count(c);
+	sim_gatt_write(c, gattdb_ota_delta, &begin, 1);
+	app_process_action();
+	check("observer OTA refused", sim_notification_count(c) == reports);
+
+	// Fill the table: advertising stops with the last slot taken.
+	check("advertising while A and C", sim_is_advertising());
+	while (session_count() < SESSION_MAX_CONNECTIONS) {
+		extra[extras++] = sim_connect();
+	}
+	printf("%-26s %zu connections, advertising %s\n", "fill the table",
+			session_count(), sim_is_advertising() ? "on" : "off");
+	failures += sim_is_advertising();
+	sim_disconnect(extra[--extras], 0x13);
+	check("advertising after a close", sim_is_advertising());
+	check("slow while A and C stay", adv_policy_stage()
+			== adv_policy_get()->stageCount - 1);
+	check("A still controls", session_controller() == a);
+
+	// An observer subscribing to acq_stream joins the controller's stream;
+	// the controller subscribing again starts a new one for both.
+	streamRx[0].connection = a;
+	streamRx[1].connection = c;
+	sim_set_notification_sink(onNotification);
+	sim_negotiate(c);
+	sim_subscribe(a, gattdb_acq_stream, sl_bt_gatt_server_notification);
+	runFor(300);
+	size_t framesA = streamRx[0].frames;
+	sim_subscribe(c, gattdb_acq_stream, sl_bt_gatt_server_notification);
+	runFor(300);
+	check("observer joins the stream", framesA && !streamRx[0].restarted
+			&& streamRx[0].frames > framesA && streamRx[1].frames);
+	sim_subscribe(a, gattdb_acq_stream, sl_bt_gatt_server_notification);
+	runFor(300);
+	check("controller restarts it", streamRx[0].restarted
+			&& streamRx[1].restarted);
+	sim_subscribe(c, gattdb_acq_stream, sl_bt_gatt_server_disable);
+	sim_subscribe(a, gattdb_acq_stream, sl_bt_gatt_server_disable);
+	sim_set_notification_sink(NULL);
+
+	if (failures) {
+		printf("%d unexpected result%s\n", failures, failures == 1 ? "" : "s");
+		return 1;
+	}
+	return 0;
+}
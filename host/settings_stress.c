@@ -0,0 +1,294 @@
+/***************************************************************************//**
+ * @file settings_stress.c
+ * @brief Measure the write amplification of the settings store, and check
+ *        what a reset restores, through the host simulation build.
+ *
+ *   settings_stress [sessions [seed]]
+ *
+ * Each session (default 500) connects a central that sends a burst of SET
+ * commands a few ms to a few hundred ms apart, then a few more seconds
+ * apart, as a person adjusting a rig would. Most sessions end with the
+ * central leaving, followed now and then by a reboot; the rest end in a
+ * brown-out at a random moment. After every reboot the restored settings
+ * are read back over nodeRx and from NVM3 and compared with what was
+ * applied: after a disconnect they must match exactly, after a brown-out
+ * they must be a state applied no more than SETTINGS_STORE_MAX_DELAY_MS
+ * before it.
+ *
+ * Prints the NVM3 writes and flash bytes per settings change against
+ * writing every change through, and exits non-zero on any mismatch.
+ ******************************************************************************/
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app.h"
+#include "cmd_proto.h"
+#include "config.h"
+#include "gatt_db.h"
+#include "settings_store.h"
+#include "sim.h"
+
+#define STRESS_HISTORY  256     // states remembered within one session
+#define MS              1000000ull
+
+typedef struct {
+	cmd_settings_t settings;
+	uint64_t at;                // sim_now_ns() when applied
+} applied_t;
+
+static applied_t history[STRESS_HISTORY];
+static size_t historyLen;
+static uint64_t rng = 0x9E3779B97F4A7C15ull;
+
+static uint32_t rnd(uint32_t n) {
+	rng ^= rng << 13;
+	rng ^= rng >> 7;
+	rng ^= rng << 17;
+	return (uint32_t) (rng % n);
+}
+
+static bool same(const cmd_settings_t *a, const cmd_settings_t *b) {
+	uint8_t ra[SETTINGS_STORE_RECORD_MAX_SIZE], rb[SETTINGS_STORE_RECORD_MAX_SIZE];
+	size_t la = settings_store_encode(a, ra, sizeof(ra));
+	size_t lb = settings_store_encode(b, rb, sizeof(rb));
+	return la == lb && memcmp(ra, rb, la) == 0;
+}
+
+static void remember(const cmd_settings_t *s) {
+	if (historyLen && same(&history[historyLen - 1].settings, s)) {
+		return;
+	}
+	if (historyLen == STRESS_HISTORY) {
+		memmove(history, history + 1, sizeof(history) - sizeof(history[0]));
+		historyLen--;
+	}
+	history[historyLen].settings = *s;
+	history[historyLen].at = sim_now_ns();
+	historyLen++;
+}
+
+static void advance(uint64_t ns) {
+	sim_advance(ns);
+	app_process_action();
+}
+
+// Send one SET and return the status of the reply.
+static int set(uint8_t connection, uint16_t mask, const uint32_t *values) {
+	cmd_t cmd = { .opcode = CMD_OP_SET, .mask = mask };
+	uint8_t data[NODE_RX_MAX_SIZE];
+	uint8_t reply[NODE_TX_MAX_SIZE];
+	size_t len, replyLen;
+
+	memcpy(cmd.value, values, sizeof(cmd.value));
+	len = cmd_encode_set(0, &cmd, data, sizeof(data));
+	if (sim_gatt_write(connection, gattdb_node_rx, data, len) != SL_STATUS_OK
+			|| sim_gatt_read(gattdb_node_tx, reply, sizeof(reply), &replyLen)
+					!= SL_STATUS_OK || replyLen <= CMD_HEADER_SIZE) {
+		return -1;
+	}
+	return reply[CMD_HEADER_SIZE];
+}
+
+// Read the device settings back with GET. G is not compared: connecting
+// clears it.
+static bool readBack(uint8_t connection, cmd_settings_t *out) {
+	static const uint8_t get[] = { CMD_PROTO_SOF, CMD_PROTO_VERSION,
+			CMD_OP_GET, 0 };
+	uint8_t data[sizeof(get) + CMD_CRC_SIZE];
+	uint8_t reply[NODE_TX_MAX_SIZE];
+	size_t replyLen;
+	cmd_t state;
+
+	memcpy(data, get, sizeof(get));
+	uint16_t crc = cmd_crc16(data, sizeof(get));
+	data[sizeof(get)] = (uint8_t) crc;
+	data[sizeof(get) + 1] = (uint8_t) (crc >> 8);
+	if (sim_gatt_write(connection, gattdb_node_rx, data, sizeof(data))
+			!= SL_STATUS_OK
+			|| sim_gatt_read(gattdb_node_tx, reply, sizeof(reply), &replyLen)
+					!= SL_STATUS_OK
+			|| replyLen < CMD_HEADER_SIZE + 1 + CMD_CRC_SIZE
+			|| reply[CMD_HEADER_SIZE] != CMD_OK) {
+		return false;
+	}
+	// A STATE frame without its status byte is a SET of every field.
+	reply[2] = CMD_OP_SET;
+	memmove(reply + CMD_HEADER_SIZE, reply + CMD_HEADER_SIZE + 1,
+			replyLen - CMD_HEADER_SIZE - 1 - CMD_CRC_SIZE);
+	replyLen -= 1 + CMD_CRC_SIZE;
+	crc = cmd_crc16(reply, replyLen);
+	reply[replyLen++] = (uint8_t) crc;
+	reply[replyLen++] = (uint8_t) (crc >> 8);
+	if (cmd_decode(reply, replyLen, &state) != CMD_OK) {
+		return false;
+	}
+	cmd_settings_init(out);
+	cmd_apply(&state, out);
+	return true;
+}
+
+static void randomSet(uint16_t *mask, uint32_t *values) {
+	static const uint32_t frequencies[] = { 5, 10, 20, 40, 50, 100 };
+	static const uint32_t widths[] = { 100, 200, 300, 500 };
+
+	*mask = 0;
+	memset(values, 0, CMD_FIELD_COUNT * sizeof(values[0]));
+	do {
+		switch (rnd(6)) {
+		case 0:
+			*mask |= CMD_FIELD_AMPLITUDE;
+			values[0] = rnd(101);
+			break;
+		case 1:
+			*mask |= CMD_FIELD_FREQUENCY;
+			values[1] = frequencies[rnd(6)];
+			break;
+		case 2:
+			*mask |= CMD_FIELD_PULSE_WIDTH;
+			values[2] = widths[rnd(4)];
+			break;
+		case 3:
+			*mask |= CMD_FIELD_GATE;
+			values[3] = rnd(2);
+			break;
+		case 4:
+			*mask |= CMD_FIELD_PHASES;
+			values[5] = 1 + rnd(2);
+			break;
+		default:
+			*mask |= CMD_FIELD_GAP;
+			values[6] = 10 * rnd(6);
+			break;
+		}
+	} while (rnd(3) == 0);
+}
+
+static void reboot(void) {
+	sim_reset();
+	app_init();
+	sim_boot();
+}
+
+int main(int argc, char **argv) {
+	unsigned long sessions = argc > 1 ? strtoul(argv[1], NULL, 0) : 500;
+	if (argc > 2) {
+		rng ^= strtoull(argv[2], NULL, 0) * 0x2545F4914F6CDD1Dull;
+	}
+
+	cmd_settings_t device;      // what the device applied last
+	size_t commands = 0, changes = 0, brownouts = 0, reboots = 0;
+	size_t mismatches = 0;
+	uint64_t worstLossNs = 0;
+
+	cmd_settings_init(&device);
+	sim_nvm3_erase();
+	reboot();
+	for (unsigned long s = 0; s < sessions; s++) {
+		historyLen = 0;
+		remember(&device);
+		uint8_t connection = sim_connect();
+		// Connecting clears G, which is itself a change to store.
+		device.activateOnDisconnect = 0;
+		if (!same(&history[historyLen - 1].settings, &device)) {
+			changes++;
+		}
+		remember(&device);
+
+		// A burst of adjustments, then a few slower ones.
+		size_t burst = 1 + rnd(24), slow = rnd(4);
+		bool brownout = rnd(10) < 3;
+		size_t cut = brownout ? rnd((uint32_t) (burst + slow + 1)) : SIZE_MAX;
+		for (size_t i = 0; i < burst + slow && i != cut; i++) {
+			uint16_t mask;
+			uint32_t values[CMD_FIELD_COUNT];
+			randomSet(&mask, values);
+			cmd_t cmd = { .opcode = CMD_OP_SET, .mask = mask };
+			memcpy(cmd.value, values, sizeof(values));
+			if (set(connection, mask, values) == CMD_OK) {
+				cmd_settings_t next = device;
+				cmd_apply(&cmd, &next);
+				commands++;
+				changes += !same(&next, &device);
+				device = next;
+				remember(&device);
+			}
+			advance(i < burst ? (2 + rnd(150)) * MS : (1000 + rnd(7000)) * MS);
+		}
+
+		if (brownout) {
+			// Power lost at a random moment, without a disconnect.
+			advance(rnd(SETTINGS_STORE_MAX_DELAY_MS + 1000) * MS);
+			uint64_t lostAt = sim_now_ns();
+			reboot();
+			brownouts++;
+
+			cmd_settings_t restored;
+			cmd_settings_init(&restored);
+			settings_store_load(&restored);
+			// Newest state the store may not yet have had to write.
+			size_t oldest = 0;
+			for (size_t i = 0; i < historyLen; i++) {
+				if (history[i].at + SETTINGS_STORE_MAX_DELAY_MS * MS
+						<= lostAt) {
+					oldest = i;
+				}
+			}
+			size_t match = SIZE_MAX;
+			for (size_t i = historyLen; i-- > oldest;) {
+				if (same(&history[i].settings, &restored)) {
+					match = i;
+					break;
+				}
+			}
+			if (match == SIZE_MAX) {
+				mismatches++;
+				printf("session %lu: brown-out restored a state older than "
+						"%u ms\n", s, SETTINGS_STORE_MAX_DELAY_MS);
+			} else if (match + 1 < historyLen
+					&& lostAt - history[match + 1].at > worstLossNs) {
+				worstLossNs = lostAt - history[match + 1].at;
+			}
+			device = restored;
+			continue;
+		}
+
+		sim_disconnect(connection, 0x13);
+		advance(10 * MS);
+		if (rnd(2)) {
+			continue;
+		}
+		// Unplugged later: everything the central left must come back.
+		reboot();
+		reboots++;
+		cmd_settings_t restored, reported;
+		cmd_settings_init(&restored);
+		settings_store_load(&restored);
+		connection = sim_connect();
+		bool read = readBack(connection, &reported);
+		reported.activateOnDisconnect = device.activateOnDisconnect;
+		if (!same(&restored, &device) || !read || !same(&reported, &device)) {
+			mismatches++;
+			printf("session %lu: reboot after disconnect lost settings\n", s);
+		}
+		sim_disconnect(connection, 0x13);
+		advance(10 * MS);
+		device = restored;
+	}
+
+	size_t record = 3 + CMD_STATE_FIELD_COUNT * CMD_VALUE_SIZE;
+	size_t throughBytes = changes * (4 + ((record + 3) & ~(size_t) 3));
+	printf("sessions   %lu, %zu commands applied, %zu changed the settings\n",
+			sessions, commands, changes);
+	printf("nvm3       %zu writes, %zu bytes: %.3f writes per change "
+			"(write-through: %zu writes, %zu bytes)\n", sim_nvm3_writes(),
+			sim_nvm3_bytes(), changes ? (double) sim_nvm3_writes() / changes : 0,
+			changes, throughBytes);
+	printf("brown-outs %zu: newest change lost was %.2f s old (limit %.2f s)\n",
+			brownouts, worstLossNs / 1e9, SETTINGS_STORE_MAX_DELAY_MS / 1e3);
+	printf("reboots    %zu after a disconnect\n", reboots);
+	printf("mismatches %zu\n", mismatches);
+	return mismatches ? 1 : 0;
+}
@@ -0,0 +1,297 @@
+/***************************************************************************//**
+ * @file sim.h
+ * @brief Host simulation of the Bluetooth stack, GATT database and LED.
+ *
+ * The simulation plays the part of the radio and the remote GATT client:
+ * it builds sl_bt_msg_t events the way the stack would and dispatches them
+ * to sl_bt_on_event() in app.c.
+ ******************************************************************************/
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sl_bluetooth.h"
+
+/**
+ * @brief Reset the GATT database, advertiser and LED to power-on state.
+ */
+void sim_reset(void);
+
+/**
+ * @brief Deliver sl_bt_evt_system_boot_id to the application.
+ */
+void sim_boot(void);
+
+/**
+ * @brief Open a connection from a simulated central.
+ *
+ * @return Connection handle passed in the opened event.
+ */
+uint8_t sim_connect(void);
+
+/**
+ * @brief Close a connection with the given HCI reason.
+ */
+void sim_disconnect(uint8_t connection, uint16_t reason);
+
+/**
+ * @brief Let the central answer the connection requests made so far.
+ *
+ * Delivers the MTU exchanged, PHY status, data length and connection
+ * parameters events, granting whatever the application last requested.
+ */
+void sim_negotiate(uint8_t connection);
+
+/**
+ * @brief Perform a remote GATT write and deliver the attribute value event.
+ *
+ * The value is stored in the local database first, as the stack does, so
+ * the application may read it back with sl_bt_gatt_server_read_attribute_value().
+ *
+ * @return SL_STATUS_OK, or an error if the attribute is unknown or too long.
+ */
+sl_status_t sim_gatt_write(uint8_t connection, uint16_t attribute,
+                           const uint8_t *data, size_t len);
+
+/**
+ * @brief Perform a long (prepare + execute) write.
+ *
+ * The whole value is stored, then one attribute value event is delivered
+ * per fragment with the execute write opcode and the fragment's offset,
+ * as the stack reports long writes.
+ */
+sl_status_t sim_gatt_long_write(uint8_t connection, uint16_t attribute,
+		const uint8_t *data, size_t len, size_t fragment);
+
+/**
+ * @brief Deliver writes that arrived in one connection event.
+ *
+ * Each write is dispatched, then app_process_action() runs, as the
+ * superloop does, with sl_bt_event_pending() reporting the writes still
+ * queued behind it.
+ */
+void sim_gatt_write_burst(uint8_t connection, uint16_t attribute,
+		const uint8_t *const data[], const size_t len[], size_t count);
+
+/**
+ * @brief Write a client characteristic configuration descriptor.
+ *
+ * @param[in] flags sl_bt_gatt_server_client_configuration_t value.
+ */
+void sim_subscribe(uint8_t connection, uint16_t characteristic,
+		uint16_t flags);
+
+/**
+ * @brief Confirm the outstanding indication on a characteristic.
+ */
+void sim_confirm(uint8_t connection, uint16_t characteristic);
+
+/**
+ * @brief Notifications received by a connection since sim_reset().
+ */
+size_t sim_notification_count(uint8_t connection);
+
+/**
+ * @brief Indications received by a connection since sim_reset().
+ */
+size_t sim_indication_count(uint8_t connection);
+
+/**
+ * @brief Copy the value of the last notification or indication received.
+ *
+ * @return Number of bytes copied.
+ */
+size_t sim_last_notification(uint8_t connection, uint8_t *data,
+		size_t max_len);
+
+/**
+ * @brief Read an attribute as a remote client would.
+ */
+sl_status_t sim_gatt_read(uint16_t attribute, uint8_t *data, size_t max_len,
+                          size_t *len);
+
+/**
+ * @brief Current LED state, as last driven by the application.
+ */
+bool sim_led_is_on(void);
+
+/**
+ * @brief True while the advertiser has been started and not stopped.
+ */
+bool sim_is_advertising(void);
+
+/**
+ * @brief Interval of the last sl_bt_advertiser_set_timing(), 0.625 ms units.
+ */
+uint32_t sim_advertising_interval(void);
+
+/**
+ * @brief sl_bt_legacy_advertiser_generate_data() calls since sim_reset().
+ */
+size_t sim_advertising_data_generated(void);
+
+/**
+ * @brief Called with every notification or indication the application
+ *        sends, as it goes on air.
+ */
+typedef void (*sim_notification_sink_t)(uint8_t connection,
+		uint16_t characteristic, const uint8_t *value, size_t len);
+
+/**
+ * @brief Install a notification sink, or remove it with NULL. Cleared by
+ *        sim_reset().
+ */
+void sim_set_notification_sink(sim_notification_sink_t fn);
+
+/**
+ * @brief Limit the link layer TX queue.
+ *
+ * At most slots notifications and indications are queued; more are
+ * refused with SL_STATUS_NO_MORE_RESOURCE. Each connection interval sends
+ * per_event of them. 0 slots, the default after sim_reset(), is unlimited.
+ */
+void sim_set_link_budget(size_t slots, size_t per_event);
+
+/**
+ * @brief Monotonic simulation clock in nanoseconds: the host clock plus
+ *        everything skipped with sim_advance().
+ */
+uint64_t sim_now_ns(void);
+
+/**
+ * @brief Move the simulation clock forward and fire the sleeptimer
+ *        timers that expire, as their interrupt would.
+ */
+void sim_advance(uint64_t ns);
+
+/**
+ * @brief Report the sleep and wakeup around a sim_advance() to the power
+ *        manager subscribers (sim_power.c).
+ */
+void sim_power_sleep(void);
+void sim_power_wake(void);
+
+/**
+ * @brief Drop all EM requirements and transition subscribers.
+ */
+void sim_power_reset(void);
+
+/**
+ * @brief True while some module holds an EM1 requirement.
+ */
+bool sim_power_em1_required(void);
+
+/**
+ * @brief EMU_RSTCAUSE_* bits RMU_ResetCauseGet() reports until
+ *        RMU_ResetCauseClear(); EMU_RSTCAUSE_POR at start. sim_reset()
+ *        leaves them alone.
+ */
+void sim_set_reset_cause(uint32_t cause);
+
+/**
+ * @brief One word on the simulated RHS2116 bus.
+ */
+typedef struct {
+	uint64_t ns;            ///< Bus time at chip select, since reset.
+	uint32_t command;
+	uint32_t answer;        ///< Shifted out while the command went in.
+} sim_rhs2116_word_t;
+
+#define SIM_RHS2116_LOG_SIZE      1024
+#define SIM_RHS2116_TRANSFER_NS   2000  // SPIDRV/LDMA setup and CS gap
+
+/**
+ * @brief Power-on register file, empty pipeline and log. Also done by
+ *        sim_reset().
+ */
+void sim_rhs2116_reset(void);
+
+/**
+ * @brief Complete the SPI transfer in progress and every one its callback
+ *        starts, as the DMA interrupts would.
+ *
+ * @return Transfers completed. Also run by sim_advance().
+ */
+size_t sim_rhs2116_run(void);
+
+/**
+ * @brief Synthetic sample the model answers for a channel's n-th CONVERT
+ *        since reset.
+ */
+uint16_t sim_rhs2116_sample(uint8_t channel, uint32_t n);
+
+/**
+ * @brief Answer the next count CONVERTs of a channel from samples, which
+ *        must stay valid meanwhile; NULL stops. Cleared by sim_reset().
+ */
+void sim_rhs2116_play(uint8_t channel, const uint16_t *samples, size_t count);
+
+/**
+ * @brief Current value of an RHS2116 register.
+ */
+uint16_t sim_rhs2116_reg(uint8_t reg);
+
+/**
+ * @brief Words logged since reset, the first SIM_RHS2116_LOG_SIZE kept.
+ */
+size_t sim_rhs2116_log(const sim_rhs2116_word_t **words);
+
+/**
+ * @brief Words sent since reset, and the bus time they took.
+ */
+size_t sim_rhs2116_words(void);
+uint64_t sim_rhs2116_bus_ns(void);
+
+/**
+ * @brief Complete the next transfer with an error.
+ */
+void sim_rhs2116_fail_next(uint32_t status);
+
+/**
+ * @brief Call back the acquisition sweeps due by now (sim_acq_timer.c).
+ *        Also run by sim_advance().
+ */
+void sim_acq_timer_run(void);
+
+/**
+ * @brief Wipe the simulated NVM3 flash. sim_reset() keeps its contents,
+ *        as a reboot does.
+ */
+void sim_nvm3_erase(void);
+
+/**
+ * @brief NVM3 writes and deletes since the flash was erased.
+ */
+size_t sim_nvm3_writes(void);
+
+/**
+ * @brief Flash bytes those writes programmed, headers included.
+ */
+size_t sim_nvm3_bytes(void);
+
+/**
+ * @brief Erase the storage slot and forget the install request. Also done
+ *        by sim_reset(); flash is left alone.
+ */
+void sim_btl_reset(void);
+
+/**
+ * @brief Program the running application: copy an image to flash at
+ *        SIM_APP_OFFSET and fill the rest of the application area with 0xFF.
+ */
+void sim_flash_load(const uint8_t *image, size_t len);
+
+/**
+ * @brief Storage slot contents, up to the last byte written.
+ */
+const uint8_t* sim_btl_slot(size_t *len);
+
+/**
+ * @brief True once bootloader_rebootAndInstall() was called with a slot
+ *        set by bootloader_setImageToBootload().
+ */
+bool sim_btl_install_requested(void);
+
+#endif // SIM_H
@@ -0,0 +1,47 @@
+/***************************************************************************//**
+ * @file sim_acq_timer.c
+ * @brief Host model of the acquisition sweep clock.
+ *
+ * Implements acq_timer.h on the simulation clock. Sweeps that fall due are
+ * called back from sim_advance(), each followed by the SPI transfers it
+ * starts, as the timer and DMA interrupts would interleave on target.
+ ******************************************************************************/
+#include <stddef.h>
+#include <stdint.h>
+
+#include "acq_timer.h"
+#include "sim.h"
+
+static acq_timer_callback_t onSweep;
+static uint32_t rate;
+static uint64_t startNs;
+static uint64_t fired;
+
+sl_status_t acq_timer_start(uint32_t hz, acq_timer_callback_t callback) {
+	if (hz == 0 || callback == NULL) {
+		return SL_STATUS_INVALID_PARAMETER;
+	}
+	onSweep = callback;
+	rate = hz;
+	startNs = sim_now_ns();
+	fired = 0;
+	return SL_STATUS_OK;
+}
+
+void acq_timer_stop(void) {
+	onSweep = NULL;
+}
+
+void sim_acq_timer_run(void) {
+	while (onSweep != NULL) {
+		uint64_t elapsed = sim_now_ns() - startNs;
+		uint64_t due = elapsed / 1000000000ull * rate
+				+ elapsed % 1000000000ull * rate / 1000000000ull;
+		if (fired >= due) {
+			break;
+		}
+		fired++;
+		onSweep();
+		sim_rhs2116_run();
+	}
+}
@@ -0,0 +1,695 @@
+/***************************************************************************//**
+ * @file sim_bt.c
+ * @brief Host simulation of the Bluetooth stack, GATT database and LED.
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "app.h"
+#include "config.h"
+#include "gatt_db.h"
+#include "sim.h"
+#include "sl_bluetooth.h"
+#include "sl_simple_led_instances.h"
+#include "sl_sleeptimer.h"
+#include "sl_spidrv_instances.h"
+
+#define SIM_ATTRIBUTE_MAX_SIZE  255
+// Largest value that fits an attribute value event.
+#define SIM_EVENT_VALUE_MAX_SIZE \
+	(SL_BGAPI_MAX_PAYLOAD_SIZE - sizeof(sl_bt_evt_gatt_server_attribute_value_t))
+
+typedef struct {
+	uint16_t handle;
+	uint16_t max_len;
+	size_t len;
+	uint8_t value[SIM_ATTRIBUTE_MAX_SIZE];
+} sim_attribute_t;
+
+// Mirrors the characteristic sizes in config/btconf/gatt_configuration.btconf
+static sim_attribute_t attributes[] = {
+	{ .handle = gattdb_node_rx, .max_len = NODE_RX_MAX_SIZE },
+	{ .handle = gattdb_node_tx, .max_len = NODE_TX_MAX_SIZE },
+	{ .handle = gattdb_diagnostics, .max_len = DIAGNOSTICS_MAX_SIZE },
+	{ .handle = gattdb_power_report, .max_len = POWER_REPORT_MAX_SIZE },
+	{ .handle = gattdb_acq_stats, .max_len = ACQ_STATS_MAX_SIZE },
+	{ .handle = gattdb_profile, .max_len = PROF_MAX_SIZE },
+	{ .handle = gattdb_ota_delta, .max_len = OTA_DELTA_MAX_SIZE },
+	{ .handle = gattdb_trace, .max_len = TRACE_STREAM_MAX_SIZE },
+	{ .handle = gattdb_boot_report, .max_len = BOOT_REPORT_MAX_SIZE },
+	{ .handle = gattdb_telemetry, .max_len = TELEMETRY_MAX_SIZE },
+};
+
+#define SIM_ATTRIBUTE_COUNT (sizeof(attributes) / sizeof(attributes[0]))
+
+bool sim_log_enable = false;
+const sl_led_t sl_led_led1;
+
+static sl_led_state_t led_state;
+static bool advertising;
+static uint8_t advertising_sets;
+static uint32_t advertising_interval;
+static size_t advertising_data_generated;
+static uint8_t next_connection = 1;
+
+#define SIM_MAX_CONNECTIONS 8
+
+// Notifications and indications received by each simulated client.
+static struct {
+	size_t notifications;
+	size_t indications;
+	size_t len;
+	uint8_t value[SIM_ATTRIBUTE_MAX_SIZE];
+} received[SIM_MAX_CONNECTIONS];
+static size_t pending_events;
+static sim_notification_sink_t sink;
+
+// Notifications the link layer can hold, and send per connection event;
+// 0 slots is unlimited.
+static struct {
+	size_t slots;
+	size_t per_event;
+	size_t queued;
+	uint64_t drained_ns;    // connection events accounted up to here
+} link;
+
+// What the application last asked the central for.
+static struct {
+	uint16_t max_mtu;
+	uint8_t phy;
+	uint16_t tx_octets;
+	uint16_t interval;
+	uint16_t latency;
+	uint16_t timeout;
+} requested;
+
+static sim_attribute_t* find_attribute(uint16_t handle) {
+	for (size_t i = 0; i < SIM_ATTRIBUTE_COUNT; i++) {
+		if (attributes[i].handle == handle) {
+			return &attributes[i];
+		}
+	}
+	return NULL;
+}
+
+static void set_header(sl_bt_msg_t *evt, uint32_t id, size_t len) {
+	evt->header = id | ((uint32_t) (len & 0xff) << 8)
+			| ((uint32_t) (len >> 8) & 0x7);
+}
+
+// Added to the host clock by sim_advance().
+static uint64_t skew_ns;
+// Running sleeptimer timers, fired by sim_advance().
+static sl_sleeptimer_timer_handle_t *timers;
+
+uint64_t sim_now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec
+			+ skew_ns;
+}
+
+void sim_reset(void) {
+	for (size_t i = 0; i < SIM_ATTRIBUTE_COUNT; i++) {
+		attributes[i].len = 0;
+		memset(attributes[i].value, 0, sizeof(attributes[i].value));
+	}
+	led_state = SL_LED_CURRENT_STATE_OFF;
+	advertising = false;
+	advertising_sets = 0;
+	advertising_interval = 0;
+	advertising_data_generated = 0;
+	next_connection = 1;
+	memset(&requested, 0, sizeof(requested));
+	requested.max_mtu = 23;
+	memset(received, 0, sizeof(received));
+	pending_events = 0;
+	sink = NULL;
+	memset(&link, 0, sizeof(link));
+	timers = NULL;
+	sim_power_reset();
+	sim_rhs2116_reset();
+	sim_btl_reset();
+}
+
+void sim_boot(void) {
+	sl_bt_msg_t evt;
+	memset(&evt, 0, sizeof(evt));
+	set_header(&evt, sl_bt_evt_system_boot_id, sizeof(evt.data.evt_system_boot));
+	evt.data.evt_system_boot.major = 7;
+	evt.data.evt_system_boot.minor = 1;
+	sl_bt_on_event(&evt);
+}
+
+uint8_t sim_connect(void) {
+	sl_bt_msg_t evt;
+	memset(&evt, 0, sizeof(evt));
+	set_header(&evt, sl_bt_evt_connection_opened_id,
+			sizeof(evt.data.evt_connection_opened));
+	evt.data.evt_connection_opened.connection = next_connection++;
+	// A connectable legacy advertiser stops once a central connects.
+	advertising = false;
+	sl_bt_on_event(&evt);
+	return evt.data.evt_connection_opened.connection;
+}
+
+void sim_disconnect(uint8_t connection, uint16_t reason) {
+	sl_bt_msg_t evt;
+	memset(&evt, 0, sizeof(evt));
+	set_header(&evt, sl_bt_evt_connection_closed_id,
+			sizeof(evt.data.evt_connection_closed));
+	evt.data.evt_connection_closed.connection = connection;
+	evt.data.evt_connection_closed.reason = reason;
+	sl_bt_on_event(&evt);
+}
+
+void sim_negotiate(uint8_t connection) {
+	sl_bt_msg_t evt;
+
+	// A cooperative central grants everything that was requested.
+	memset(&evt, 0, sizeof(evt));
+	set_header(&evt, sl_bt_evt_gatt_mtu_exchanged_id,
+			sizeof(evt.data.evt_gatt_mtu_exchanged));
+	evt.data.evt_gatt_mtu_exchanged.connection = connection;
+	evt.data.evt_gatt_mtu_exchanged.mtu = requested.max_mtu;
+	sl_bt_on_event(&evt);
+
+	if (requested.phy) {
+		memset(&evt, 0, sizeof(evt));
+		set_header(&evt, sl_bt_evt_connection_phy_status_id,
+				sizeof(evt.data.evt_connection_phy_status));
+		evt.data.evt_connection_phy_status.connection = connection;
+		evt.data.evt_connection_phy_status.phy = (requested.phy & 0x2) ? 2 : 1;
+		sl_bt_on_event(&evt);
+	}
+	if (requested.tx_octets) {
+		memset(&evt, 0, sizeof(evt));
+		set_header(&evt, sl_bt_evt_connection_data_length_id,
+				sizeof(evt.data.evt_connection_data_length));
+		evt.data.evt_connection_data_length.connection = connection;
+		evt.data.evt_connection_data_length.tx_data_len = requested.tx_octets;
+		evt.data.evt_connection_data_length.rx_data_len = requested.tx_octets;
+		sl_bt_on_event(&evt);
+	}
+	if (requested.interval) {
+		memset(&evt, 0, sizeof(evt));
+		set_header(&evt, sl_bt_evt_connection_parameters_id,
+				sizeof(evt.data.evt_connection_parameters));
+		evt.data.evt_connection_parameters.connection = connection;
+		evt.data.evt_connection_parameters.interval = requested.interval;
+		evt.data.evt_connection_parameters.latency = requested.latency;
+		evt.data.evt_connection_parameters.timeout = requested.timeout;
+		sl_bt_on_event(&evt);
+	}
+}
+
+static void dispatch_value(uint8_t connection, uint16_t attribute,
+		uint8_t att_opcode, uint16_t offset, const uint8_t *data, size_t len) {
+	sl_bt_msg_t evt;
+
+	set_header(&evt, sl_bt_evt_gatt_server_attribute_value_id,
+			sizeof(sl_bt_evt_gatt_server_attribute_value_t) + len);
+	evt.data.evt_gatt_server_attribute_value.connection = connection;
+	evt.data.evt_gatt_server_attribute_value.attribute = attribute;
+	evt.data.evt_gatt_server_attribute_value.att_opcode = att_opcode;
+	evt.data.evt_gatt_server_attribute_value.offset = offset;
+	evt.data.evt_gatt_server_attribute_value.value.len = (uint8_t) len;
+	memcpy(evt.data.evt_gatt_server_attribute_value.value.data, data, len);
+	sl_bt_on_event(&evt);
+}
+
+sl_status_t sim_gatt_write(uint8_t connection, uint16_t attribute,
+		const uint8_t *data, size_t len) {
+	sim_attribute_t *attr = find_attribute(attribute);
+
+	if (attr == NULL) {
+		return SL_STATUS_INVALID_HANDLE;
+	}
+	if (len > attr->max_len || len > SIM_EVENT_VALUE_MAX_SIZE) {
+		return SL_STATUS_INVALID_PARAMETER;
+	}
+	memcpy(attr->value, data, len);
+	attr->len = len;
+	dispatch_value(connection, attribute, sl_bt_gatt_write_request, 0, data,
+			len);
+	return SL_STATUS_OK;
+}
+
+sl_status_t sim_gatt_long_write(uint8_t connection, uint16_t attribute,
+		const uint8_t *data, size_t len, size_t fragment) {
+	sim_attribute_t *attr = find_attribute(attribute);
+
+	if (attr == NULL) {
+		return SL_STATUS_INVALID_HANDLE;
+	}
+	if (len > attr->max_len || fragment == 0
+			|| fragment > SIM_EVENT_VALUE_MAX_SIZE) {
+		return SL_STATUS_INVALID_PARAMETER;
+	}
+	// The prepared fragments are committed together by the execute request,
+	// then reported one event each.
+	memcpy(attr->value, data, len);
+	attr->len = len;
+	for (size_t off = 0; off < len; off += fragment) {
+		size_t n = len - off < fragment ? len - off : fragment;
+		dispatch_value(connection, attribute, sl_bt_gatt_execute_write_request,
+				(uint16_t) off, data + off, n);
+	}
+	return SL_STATUS_OK;
+}
+
+void sim_gatt_write_burst(uint8_t connection, uint16_t attribute,
+		const uint8_t *const data[], const size_t len[], size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		// The rest of the burst is still queued in the stack.
+		pending_events = count - 1 - i;
+		sim_gatt_write(connection, attribute, data[i], len[i]);
+		app_process_action();
+	}
+	pending_events = 0;
+}
+
+void sim_subscribe(uint8_t connection, uint16_t characteristic,
+		uint16_t flags) {
+	sl_bt_msg_t evt;
+	memset(&evt, 0, sizeof(evt));
+	set_header(&evt, sl_bt_evt_gatt_server_characteristic_status_id,
+			sizeof(evt.data.evt_gatt_server_characteristic_status));
+	evt.data.evt_gatt_server_characteristic_status.connection = connection;
+	evt.data.evt_gatt_server_characteristic_status.characteristic =
+			characteristic;
+	evt.data.evt_gatt_server_characteristic_status.status_flags =
+			sl_bt_gatt_server_client_config;
+	evt.data.evt_gatt_server_characteristic_status.client_config_flags = flags;
+	sl_bt_on_event(&evt);
+}
+
+void sim_confirm(uint8_t connection, uint16_t characteristic) {
+	sl_bt_msg_t evt;
+	memset(&evt, 0, sizeof(evt));
+	set_header(&evt, sl_bt_evt_gatt_server_characteristic_status_id,
+			sizeof(evt.data.evt_gatt_server_characteristic_status));
+	evt.data.evt_gatt_server_characteristic_status.connection = connection;
+	evt.data.evt_gatt_server_characteristic_status.characteristic =
+			characteristic;
+	evt.data.evt_gatt_server_characteristic_status.status_flags =
+			sl_bt_gatt_server_confirmation;
+	sl_bt_on_event(&evt);
+}
+
+size_t sim_notification_count(uint8_t connection) {
+	return connection < SIM_MAX_CONNECTIONS ?
+			received[connection].notifications : 0;
+}
+
+size_t sim_indication_count(uint8_t connection) {
+	return connection < SIM_MAX_CONNECTIONS ?
+			received[connection].indications : 0;
+}
+
+size_t sim_last_notification(uint8_t connection, uint8_t *data,
+		size_t max_len) {
+	size_t n;
+	if (connection >= SIM_MAX_CONNECTIONS) {
+		return 0;
+	}
+	n = received[connection].len < max_len ? received[connection].len : max_len;
+	memcpy(data, received[connection].value, n);
+	return n;
+}
+
+sl_status_t sim_gatt_read(uint16_t attribute, uint8_t *data, size_t max_len,
+		size_t *len) {
+	return sl_bt_gatt_server_read_attribute_value(attribute, 0, max_len, len,
+			data);
+}
+
+bool sim_led_is_on(void) {
+	return led_state == SL_LED_CURRENT_STATE_ON;
+}
+
+bool sim_is_advertising(void) {
+	return advertising;
+}
+
+uint32_t sim_advertising_interval(void) {
+	return advertising_interval;
+}
+
+size_t sim_advertising_data_generated(void) {
+	return advertising_data_generated;
+}
+
+void sim_set_notification_sink(sim_notification_sink_t fn) {
+	sink = fn;
+}
+
+void sim_set_link_budget(size_t slots, size_t per_event) {
+	link.slots = slots;
+	link.per_event = per_event;
+	link.queued = 0;
+	link.drained_ns = sim_now_ns();
+}
+
+// Empty the TX queue by what the connection events since the last call sent.
+static void drain_link(void) {
+	// Centrals that were not asked otherwise typically pick 30 ms.
+	uint64_t interval_ns = (requested.interval ? requested.interval : 24)
+			* 1250000ull;
+	uint64_t now = sim_now_ns();
+	uint64_t events = (now - link.drained_ns) / interval_ns;
+
+	link.drained_ns += events * interval_ns;
+	if (events * link.per_event >= link.queued) {
+		link.queued = 0;
+	} else {
+		link.queued -= events * link.per_event;
+	}
+}
+
+/*******************************************************************************
+ * Stack commands used by the application.
+ ******************************************************************************/
+
+sl_status_t sl_bt_advertiser_create_set(uint8_t *handle) {
+	*handle = advertising_sets++;
+	return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_advertiser_set_timing(uint8_t advertising_set,
+		uint32_t interval_min, uint32_t interval_max, uint16_t duration,
+		uint8_t maxevents) {
+	(void) duration;
+	(void) maxevents;
+	if (advertising_set >= advertising_sets || interval_min > interval_max
+			|| interval_min < 0x20) {
+		return SL_STATUS_INVALID_PARAMETER;
+	}
+	advertising_interval = interval_max;
+	return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_advertiser_stop(uint8_t advertising_set) {
+	if (advertising_set >= advertising_sets) {
+		return SL_STATUS_INVALID_HANDLE;
+	}
+	advertising = false;
+	return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_legacy_advertiser_generate_data(uint8_t advertising_set,
+		uint8_t discover) {
+	(void) discover;
+	if (advertising_set >= advertising_sets) {
+		return SL_STATUS_INVALID_HANDLE;
+	}
+	advertising_data_generated++;
+	return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_legacy_advertiser_start(uint8_t advertising_set,
+		uint8_t connect) {
+	(void) connect;
+	if (advertising_set >= advertising_sets) {
+		return SL_STATUS_INVALID_HANDLE;
+	}
+	advertising = true;
+	return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_connection_set_preferred_phy(uint8_t connection,
+		uint8_t preferred_phy, uint8_t accepted_phy) {
+	(void) connection;
+	(void) accepted_phy;
+	requested.phy = preferred_phy;
+	return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_connection_set_data_length(uint8_t connection,
+		uint16_t tx_data_len, uint16_t tx_time_us) {
+	(void) connection;
+	(void) tx_time_us;
+	if (tx_data_len < 27 || tx_data_len > 251) {
+		return SL_STATUS_INVALID_PARAMETER;
+	}
+	requested.tx_octets = tx_data_len;
+	return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_connection_set_parameters(uint8_t connection,
+		uint16_t min_interval, uint16_t max_interval, uint16_t latency,
+		uint16_t timeout, uint16_t min_ce_length, uint16_t max_ce_length) {
+	(void) connection;
+	(void) min_ce_length;
+	(void) max_ce_length;
+	if (min_interval < 6 || min_interval > max_interval
+			|| max_interval > 3200) {
+		return SL_STATUS_INVALID_PARAMETER;
+	}
+	// Centrals usually settle on the top of the requested range.
+	requested.interval = max_interval;
+	requested.latency = latency;
+	requested.timeout = timeout;
+	return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_gatt_server_set_max_mtu(uint16_t max_mtu,
+		uint16_t *max_mtu_out) {
+	if (max_mtu < 23 || max_mtu > 250) {
+		return SL_STATUS_INVALID_PARAMETER;
+	}
+	requested.max_mtu = max_mtu;
+	*max_mtu_out = max_mtu;
+	return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_gatt_server_read_attribute_value(uint16_t attribute,
+		uint16_t offset, size_t max_value_size, size_t *value_len,
+		uint8_t *value) {
+	sim_attribute_t *attr = find_attribute(attribute);
+	size_t n;
+
+	if (attr == NULL) {
+		return SL_STATUS_INVALID_HANDLE;
+	}
+	if (offset > attr->len) {
+		return SL_STATUS_INVALID_PARAMETER;
+	}
+	n = attr->len - offset;
+	if (n > max_value_size) {
+		n = max_value_size;
+	}
+	memcpy(value, attr->value + offset, n);
+	*value_len = n;
+	return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_gatt_server_write_attribute_value(uint16_t attribute,
+		uint16_t offset, size_t value_len, const uint8_t *value) {
+	sim_attribute_t *attr = find_attribute(attribute);
+
+	if (attr == NULL) {
+		return SL_STATUS_INVALID_HANDLE;
+	}
+	if ((size_t) offset + value_len > attr->max_len) {
+		return SL_STATUS_INVALID_PARAMETER;
+	}
+	memcpy(attr->value + offset, value, value_len);
+	attr->len = offset + value_len;
+	return SL_STATUS_OK;
+}
+
+static sl_status_t deliver(uint8_t connection, uint16_t characteristic,
+		size_t value_len, const uint8_t *value, bool indication) {
+	if (connection >= SIM_MAX_CONNECTIONS) {
+		return SL_STATUS_INVALID_HANDLE;
+	}
+	if (value_len > SIM_ATTRIBUTE_MAX_SIZE) {
+		return SL_STATUS_INVALID_PARAMETER;
+	}
+	if (link.slots) {
+		drain_link();
+		if (link.queued >= link.slots) {
+			return SL_STATUS_NO_MORE_RESOURCE;
+		}
+		link.queued++;
+	}
+	if (sink) {
+		sink(connection, characteristic, value, value_len);
+	}
+	if (indication) {
+		received[connection].indications++;
+	} else {
+		received[connection].notifications++;
+	}
+	memcpy(received[connection].value, value, value_len);
+	received[connection].len = value_len;
+	return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_gatt_server_send_notification(uint8_t connection,
+		uint16_t characteristic, size_t value_len, const uint8_t *value) {
+	return deliver(connection, characteristic, value_len, value, false);
+}
+
+sl_status_t sl_bt_gatt_server_send_indication(uint8_t connection,
+		uint16_t characteristic, size_t value_len, const uint8_t *value) {
+	return deliver(connection, characteristic, value_len, value, true);
+}
+
+bool sl_bt_event_pending(void) {
+	return pending_events > 0;
+}
+
+/*******************************************************************************
+ * sleeptimer
+ ******************************************************************************/
+
+#define SIM_SLEEPTIMER_HZ 32768u
+
+
+uint32_t sl_sleeptimer_get_timer_frequency(void) {
+	return SIM_SLEEPTIMER_HZ;
+}
+
+uint64_t sl_sleeptimer_get_tick_count64(void) {
+	uint64_t ns = sim_now_ns();
+	return ns / 1000000000ull * SIM_SLEEPTIMER_HZ
+			+ ns % 1000000000ull * SIM_SLEEPTIMER_HZ / 1000000000ull;
+}
+
+uint32_t sl_sleeptimer_get_tick_count(void) {
+	return (uint32_t) sl_sleeptimer_get_tick_count64();
+}
+
+uint32_t sl_sleeptimer_ms_to_tick(uint16_t time_ms) {
+	return (uint32_t) (((uint64_t) time_ms * SIM_SLEEPTIMER_HZ + 999) / 1000);
+}
+
+static uint64_t ms_to_ticks(uint32_t ms) {
+	return ((uint64_t) ms * SIM_SLEEPTIMER_HZ + 999) / 1000;
+}
+
+static void unlink_timer(sl_sleeptimer_timer_handle_t *handle) {
+	for (sl_sleeptimer_timer_handle_t **p = &timers; *p; p = &(*p)->next) {
+		if (*p == handle) {
+			*p = handle->next;
+			handle->next = NULL;
+			return;
+		}
+	}
+}
+
+static sl_status_t start_timer(sl_sleeptimer_timer_handle_t *handle,
+		uint32_t timeout_ms, sl_sleeptimer_timer_callback_t callback,
+		void *callback_data, uint8_t priority, uint16_t option_flags,
+		bool periodic) {
+	if (handle == NULL) {
+		return SL_STATUS_NULL_POINTER;
+	}
+	unlink_timer(handle);
+	handle->callback = callback;
+	handle->callback_data = callback_data;
+	handle->priority = priority;
+	handle->option_flags = option_flags;
+	handle->timeout_periodic = periodic ? timeout_ms : 0;
+	handle->due = sl_sleeptimer_get_tick_count64() + ms_to_ticks(timeout_ms);
+	handle->next = timers;
+	timers = handle;
+	return SL_STATUS_OK;
+}
+
+sl_status_t sl_sleeptimer_start_timer_ms(sl_sleeptimer_timer_handle_t *handle,
+		uint32_t timeout_ms, sl_sleeptimer_timer_callback_t callback,
+		void *callback_data, uint8_t priority, uint16_t option_flags) {
+	return start_timer(handle, timeout_ms, callback, callback_data, priority,
+			option_flags, false);
+}
+
+sl_status_t sl_sleeptimer_start_periodic_timer_ms(
+		sl_sleeptimer_timer_handle_t *handle, uint32_t timeout_ms,
+		sl_sleeptimer_timer_callback_t callback, void *callback_data,
+		uint8_t priority, uint16_t option_flags) {
+	return start_timer(handle, timeout_ms, callback, callback_data, priority,
+			option_flags, true);
+}
+
+sl_status_t sl_sleeptimer_stop_timer(sl_sleeptimer_timer_handle_t *handle) {
+	bool running;
+	sl_sleeptimer_is_timer_running(handle, &running);
+	if (!running) {
+		return SL_STATUS_INVALID_STATE;
+	}
+	unlink_timer(handle);
+	return SL_STATUS_OK;
+}
+
+sl_status_t sl_sleeptimer_is_timer_running(
+		sl_sleeptimer_timer_handle_t *handle, bool *running) {
+	*running = false;
+	for (sl_sleeptimer_timer_handle_t *t = timers; t; t = t->next) {
+		if (t == handle) {
+			*running = true;
+		}
+	}
+	return SL_STATUS_OK;
+}
+
+void sim_advance(uint64_t ns) {
+	// SPI transfers take microseconds; they are done before the skip.
+	sim_rhs2116_run();
+	// Nothing runs while time is skipped; the first due timer wakes us.
+	sim_power_sleep();
+	skew_ns += ns;
+	sim_power_wake();
+	// Sweeps that fell due while time was skipped, in order.
+	sim_acq_timer_run();
+	// Fire expired timers one at a time; callbacks may restart timers.
+	for (;;) {
+		uint64_t now = sl_sleeptimer_get_tick_count64();
+		sl_sleeptimer_timer_handle_t *due = NULL;
+		for (sl_sleeptimer_timer_handle_t *t = timers; t; t = t->next) {
+			if (t->due <= now && (due == NULL || t->due < due->due)) {
+				due = t;
+			}
+		}
+		if (due == NULL) {
+			break;
+		}
+		unlink_timer(due);
+		if (due->timeout_periodic) {
+			due->due += ms_to_ticks(due->timeout_periodic);
+			due->next = timers;
+			timers = due;
+		}
+		if (due->callback) {
+			due->callback(due, due->callback_data);
+		}
+	}
+}
+
+/*******************************************************************************
+ * simple_led
+ ******************************************************************************/
+
+void sl_led_turn_on(const sl_led_t *led_handle) {
+	(void) led_handle;
+	led_state = SL_LED_CURRENT_STATE_ON;
+}
+
+void sl_led_turn_off(const sl_led_t *led_handle) {
+	(void) led_handle;
+	led_state = SL_LED_CURRENT_STATE_OFF;
+}
+
+void sl_led_toggle(const sl_led_t *led_handle) {
+	(void) led_handle;
+	led_state = !led_state;
+}
+
+sl_led_state_t sl_led_get_state(const sl_led_t *led_handle) {
+	(void) led_handle;
+	return led_state;
+}
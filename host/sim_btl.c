@@ -0,0 +1,136 @@
+/***************************************************************************//**
+ * @file sim_btl.c
+ * @brief Host model of internal flash and the bootloader storage slot.
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "btl_interface.h"
+#include "byteorder.h"
+#include "em_device.h"
+#include "gbl.h"
+#include "sim.h"
+
+#define SIM_SLOT_SIZE   0x3A000u        // slot 0 of the BGM220P layout
+#define SIM_PAGE_SIZE   8192u
+
+uint8_t sim_flash[SIM_FLASH_SIZE];
+SCB_Type sim_scb = { .VTOR = (uintptr_t) sim_flash + SIM_APP_OFFSET };
+
+static uint8_t slot[SIM_SLOT_SIZE];
+static size_t high;             // end of the highest write
+static int32_t bootSlot = -1;
+static bool installRequested;
+
+void sim_btl_reset(void) {
+	memset(slot, 0xFF, sizeof(slot));
+	high = 0;
+	bootSlot = -1;
+	installRequested = false;
+}
+
+void sim_flash_load(const uint8_t *image, size_t len) {
+	memset(sim_flash + SIM_APP_OFFSET, 0xFF, SIM_FLASH_SIZE - SIM_APP_OFFSET);
+	memcpy(sim_flash + SIM_APP_OFFSET, image, len);
+}
+
+const uint8_t* sim_btl_slot(size_t *len) {
+	*len = high;
+	return slot;
+}
+
+bool sim_btl_install_requested(void) {
+	return installRequested;
+}
+
+int32_t bootloader_init(void) {
+	return BOOTLOADER_OK;
+}
+
+int32_t bootloader_getStorageSlotInfo(uint32_t slotId,
+		BootloaderStorageSlot_t *info) {
+	if (slotId != 0) {
+		return BOOTLOADER_ERROR_STORAGE_INVALID_SLOT;
+	}
+	info->address = SIM_FLASH_SIZE - SIM_SLOT_SIZE;
+	info->length = SIM_SLOT_SIZE;
+	return BOOTLOADER_OK;
+}
+
+int32_t bootloader_eraseStorageSlot(uint32_t slotId) {
+	if (slotId != 0) {
+		return BOOTLOADER_ERROR_STORAGE_INVALID_SLOT;
+	}
+	memset(slot, 0xFF, sizeof(slot));
+	high = 0;
+	return BOOTLOADER_OK;
+}
+
+int32_t bootloader_eraseWriteStorage(uint32_t slotId, uint32_t offset,
+		uint8_t *buffer, size_t length) {
+	if (slotId != 0) {
+		return BOOTLOADER_ERROR_STORAGE_INVALID_SLOT;
+	}
+	if ((offset | length) & 3 || offset + length > SIM_SLOT_SIZE) {
+		return BOOTLOADER_ERROR_STORAGE_INVALID_ADDRESS;
+	}
+	for (size_t i = 0; i < length; i++) {
+		// Pages are erased as a write reaches their start; flash can only
+		// clear bits.
+		if ((offset + i) % SIM_PAGE_SIZE == 0) {
+			memset(slot + offset + i, 0xFF, SIM_PAGE_SIZE);
+		}
+		slot[offset + i] &= buffer[i];
+	}
+	if (offset + length > high) {
+		high = offset + length;
+	}
+	return BOOTLOADER_OK;
+}
+
+int32_t bootloader_readStorage(uint32_t slotId, uint32_t offset,
+		uint8_t *buffer, size_t length) {
+	if (slotId != 0) {
+		return BOOTLOADER_ERROR_STORAGE_INVALID_SLOT;
+	}
+	if (offset + length > SIM_SLOT_SIZE) {
+		return BOOTLOADER_ERROR_STORAGE_INVALID_ADDRESS;
+	}
+	memcpy(buffer, slot + offset, length);
+	return BOOTLOADER_OK;
+}
+
+int32_t bootloader_verifyImage(uint32_t slotId,
+		BootloaderParserCallback_t callbackFunction) {
+	size_t off = 0;
+	(void) callbackFunction;
+
+	if (slotId != 0) {
+		return BOOTLOADER_ERROR_STORAGE_INVALID_SLOT;
+	}
+	// The bootloader stops at the end tag; what follows is erased flash.
+	while (off + 8 <= high) {
+		uint32_t id = get_le32(slot + off);
+		off += 8 + (size_t) get_le32(slot + off + 4);
+		if (id == GBL_TAG_END) {
+			break;
+		}
+	}
+	if (off > high || gbl_verify(slot, off, NULL) != GBL_OK) {
+		return BOOTLOADER_ERROR_PARSER_PARSED;
+	}
+	return BOOTLOADER_OK;
+}
+
+int32_t bootloader_setImageToBootload(int32_t slotId) {
+	if (slotId != 0) {
+		return BOOTLOADER_ERROR_STORAGE_INVALID_SLOT;
+	}
+	bootSlot = slotId;
+	return BOOTLOADER_OK;
+}
+
+void bootloader_rebootAndInstall(void) {
+	installRequested = bootSlot >= 0;
+}
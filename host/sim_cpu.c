@@ -0,0 +1,41 @@
+/***************************************************************************//**
+ * @file sim_cpu.c
+ * @brief Host model of the Cortex-M33 cycle counter.
+ ******************************************************************************/
+#include <stdint.h>
+
+#include "em_device.h"
+#include "sim.h"
+
+// HFXO as SYSCLK, the BGM220 default.
+#define SIM_CORE_CLOCK_HZ 38400000u
+
+CoreDebug_Type sim_core_debug;
+static DWT_Type dwt;
+static uint64_t zeroNs;
+static uint32_t zeroCount;
+static uint32_t written;
+
+static uint32_t cycles(uint64_t ns) {
+	return (uint32_t) (ns / 1000000000ull * SIM_CORE_CLOCK_HZ
+			+ ns % 1000000000ull * SIM_CORE_CLOCK_HZ / 1000000000ull);
+}
+
+DWT_Type* sim_dwt(void) {
+	uint64_t now = sim_now_ns();
+	// A write to CYCCNT since the last access restarts the count from it.
+	if (dwt.CYCCNT != written) {
+		zeroNs = now;
+		zeroCount = dwt.CYCCNT;
+	}
+	if ((dwt.CTRL & DWT_CTRL_CYCCNTENA_Msk)
+			&& (sim_core_debug.DEMCR & CoreDebug_DEMCR_TRCENA_Msk)) {
+		dwt.CYCCNT = zeroCount + cycles(now - zeroNs);
+	}
+	written = dwt.CYCCNT;
+	return &dwt;
+}
+
+uint32_t SystemCoreClockGet(void) {
+	return SIM_CORE_CLOCK_HZ;
+}
@@ -0,0 +1,119 @@
+/***************************************************************************//**
+ * @file sim_nvm3.c
+ * @brief Host model of NVM3: a fixed table of objects in RAM.
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nvm3_default.h"
+#include "sim.h"
+
+#define SIM_NVM3_OBJECTS     32
+#define SIM_NVM3_OBJECT_SIZE 256
+// NVM3 writes a new copy of an object on every write: one header word for
+// objects up to this size, two above, then the data padded to words.
+#define SIM_NVM3_SMALL_SIZE  120
+
+typedef struct {
+	bool used;
+	nvm3_ObjectKey_t key;
+	size_t len;
+	uint8_t data[SIM_NVM3_OBJECT_SIZE];
+} sim_nvm3_object_t;
+
+struct nvm3_Handle {
+	sim_nvm3_object_t objects[SIM_NVM3_OBJECTS];
+	size_t writes;
+	size_t bytes;
+};
+
+static nvm3_Handle_t defaultInstance;
+nvm3_Handle_t *nvm3_defaultHandle = &defaultInstance;
+
+static sim_nvm3_object_t* find(nvm3_Handle_t *h, nvm3_ObjectKey_t key) {
+	for (size_t i = 0; i < SIM_NVM3_OBJECTS; i++) {
+		if (h->objects[i].used && h->objects[i].key == key) {
+			return &h->objects[i];
+		}
+	}
+	return NULL;
+}
+
+void sim_nvm3_erase(void) {
+	memset(&defaultInstance, 0, sizeof(defaultInstance));
+}
+
+size_t sim_nvm3_writes(void) {
+	return defaultInstance.writes;
+}
+
+size_t sim_nvm3_bytes(void) {
+	return defaultInstance.bytes;
+}
+
+Ecode_t nvm3_writeData(nvm3_Handle_t *h, nvm3_ObjectKey_t key,
+		const void *value, size_t len) {
+	sim_nvm3_object_t *o;
+
+	if (key > NVM3_KEY_MASK) {
+		return ECODE_NVM3_ERR_KEY_INVALID;
+	}
+	if (len > SIM_NVM3_OBJECT_SIZE) {
+		return ECODE_NVM3_ERR_OBJECT_SIZE_NOT_SUPPORTED;
+	}
+	o = find(h, key);
+	for (size_t i = 0; o == NULL && i < SIM_NVM3_OBJECTS; i++) {
+		if (!h->objects[i].used) {
+			o = &h->objects[i];
+			o->used = true;
+			o->key = key;
+		}
+	}
+	if (o == NULL) {
+		return ECODE_NVM3_ERR_STORAGE_FULL;
+	}
+	memcpy(o->data, value, len);
+	o->len = len;
+	h->writes++;
+	h->bytes += (len > SIM_NVM3_SMALL_SIZE ? 8 : 4) + ((len + 3) & ~(size_t) 3);
+	return ECODE_NVM3_OK;
+}
+
+Ecode_t nvm3_readData(nvm3_Handle_t *h, nvm3_ObjectKey_t key, void *value,
+		size_t len) {
+	sim_nvm3_object_t *o = find(h, key);
+
+	if (o == NULL) {
+		return ECODE_NVM3_ERR_KEY_NOT_FOUND;
+	}
+	if (len > o->len) {
+		return ECODE_NVM3_ERR_READ_DATA_SIZE;
+	}
+	memcpy(value, o->data, len);
+	return ECODE_NVM3_OK;
+}
+
+Ecode_t nvm3_getObjectInfo(nvm3_Handle_t *h, nvm3_ObjectKey_t key,
+		uint32_t *type, size_t *len) {
+	sim_nvm3_object_t *o = find(h, key);
+
+	if (o == NULL) {
+		return ECODE_NVM3_ERR_KEY_NOT_FOUND;
+	}
+	*type = NVM3_OBJECTTYPE_DATA;
+	*len = o->len;
+	return ECODE_NVM3_OK;
+}
+
+Ecode_t nvm3_deleteObject(nvm3_Handle_t *h, nvm3_ObjectKey_t key) {
+	sim_nvm3_object_t *o = find(h, key);
+
+	if (o == NULL) {
+		return ECODE_NVM3_ERR_KEY_NOT_FOUND;
+	}
+	o->used = false;
+	h->writes++;
+	h->bytes += 4;
+	return ECODE_NVM3_OK;
+}
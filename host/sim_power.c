@@ -0,0 +1,102 @@
+/***************************************************************************//**
+ * @file sim_power.c
+ * @brief Host model of the power manager.
+ *
+ * The device is taken to sleep for every stretch of time skipped with
+ * sim_advance(): it enters EM1 if a requirement is held, EM2 otherwise,
+ * and returns to EM0 when the skip ends, as a wakeup interrupt would.
+ ******************************************************************************/
+#include <stddef.h>
+#include <stdint.h>
+
+#include "em_rmu.h"
+#include "sim.h"
+#include "sl_power_manager.h"
+
+static unsigned int em1Requirements;
+static sl_power_manager_em_transition_event_handle_t *subscribers;
+static sl_power_manager_em_t sleepMode = SL_POWER_MANAGER_EM0;
+static uint32_t resetCause = EMU_RSTCAUSE_POR;
+
+static uint32_t enteringEvent(sl_power_manager_em_t em) {
+	return (uint32_t) SL_POWER_MANAGER_EVENT_TRANSITION_ENTERING_EM0 << (2 * em);
+}
+
+static void transition(sl_power_manager_em_t from, sl_power_manager_em_t to) {
+	for (sl_power_manager_em_transition_event_handle_t *h = subscribers; h;
+			h = h->next) {
+		if (h->info->event_mask & enteringEvent(to)) {
+			h->info->on_event(from, to);
+		}
+	}
+}
+
+void sl_power_manager_add_em_requirement(sl_power_manager_em_t em) {
+	if (em == SL_POWER_MANAGER_EM1) {
+		em1Requirements++;
+	}
+}
+
+void sl_power_manager_remove_em_requirement(sl_power_manager_em_t em) {
+	if (em == SL_POWER_MANAGER_EM1 && em1Requirements) {
+		em1Requirements--;
+	}
+}
+
+void sl_power_manager_subscribe_em_transition_event(
+		sl_power_manager_em_transition_event_handle_t *event_handle,
+		const sl_power_manager_em_transition_event_info_t *event_info) {
+	sl_power_manager_unsubscribe_em_transition_event(event_handle);
+	event_handle->info = event_info;
+	event_handle->next = subscribers;
+	subscribers = event_handle;
+}
+
+void sl_power_manager_unsubscribe_em_transition_event(
+		sl_power_manager_em_transition_event_handle_t *event_handle) {
+	for (sl_power_manager_em_transition_event_handle_t **p = &subscribers; *p;
+			p = &(*p)->next) {
+		if (*p == event_handle) {
+			*p = event_handle->next;
+			return;
+		}
+	}
+}
+
+void sl_power_manager_sleep(void) {
+	// Nothing to wait for on the host; time only moves with sim_advance().
+}
+
+void sim_power_sleep(void) {
+	sleepMode = em1Requirements ? SL_POWER_MANAGER_EM1 : SL_POWER_MANAGER_EM2;
+	transition(SL_POWER_MANAGER_EM0, sleepMode);
+}
+
+void sim_power_wake(void) {
+	if (sleepMode != SL_POWER_MANAGER_EM0) {
+		transition(sleepMode, SL_POWER_MANAGER_EM0);
+		sleepMode = SL_POWER_MANAGER_EM0;
+	}
+}
+
+void sim_power_reset(void) {
+	em1Requirements = 0;
+	subscribers = NULL;
+	sleepMode = SL_POWER_MANAGER_EM0;
+}
+
+bool sim_power_em1_required(void) {
+	return em1Requirements != 0;
+}
+
+void sim_set_reset_cause(uint32_t cause) {
+	resetCause = cause;
+}
+
+uint32_t RMU_ResetCauseGet(void) {
+	return resetCause;
+}
+
+void RMU_ResetCauseClear(void) {
+	resetCause = 0;
+}
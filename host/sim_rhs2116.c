@@ -0,0 +1,187 @@
+/***************************************************************************//**
+ * @file sim_rhs2116.c
+ * @brief Host model of an RHS2116 on the SPIDRV instance.
+ *
+ * Implements SPIDRV_MTransfer() for sl_spidrv_spi_inst_handle against a
+ * register file with the chip's two-word answer pipeline. Every transfer is
+ * one chip-select cycle and must be exactly one 32-bit command. Bus time is
+ * accounted at RHS2116_SPI_BITRATE plus a fixed per-transfer cost, and each
+ * word is logged so command sequences and their timing can be checked.
+ *
+ * CONVERT answers a synthetic recording: a slow sine of a different
+ * frequency on each channel plus a little noise, around mid-scale, so
+ * compression sees data of realistic entropy. sim_rhs2116_play() replaces
+ * one channel with a recording for a while.
+ ******************************************************************************/
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "byteorder.h"
+#include "config.h"
+#include "rhs2116.h"
+#include "sim.h"
+#include "spidrv.h"
+
+struct SPIDRV_HandleData {
+	int unused;
+};
+
+static SPIDRV_HandleData_t instance;
+SPIDRV_Handle_t sl_spidrv_spi_inst_handle = &instance;
+
+static uint16_t regs[256];
+static uint32_t pipeline[RHS2116_PIPELINE_DEPTH];
+static sim_rhs2116_word_t bus[SIM_RHS2116_LOG_SIZE];
+static size_t wordCount;
+static uint64_t busNs;
+static Ecode_t injectError;
+static uint32_t conversions[RHS2116_CHANNELS];
+
+// A recording answered on one channel instead of the synthetic signal.
+static struct {
+	const uint16_t *samples;
+	size_t count;
+	uint8_t channel;
+	uint32_t from;          // conversion that answers samples[0]
+} playing;
+
+// A transfer started but not completed yet.
+static struct {
+	bool active;
+	SPIDRV_Callback_t callback;
+	Ecode_t status;
+} pending;
+
+static bool isRom(uint8_t reg) {
+	return reg >= RHS2116_REG_INTAN_0;
+}
+
+// Execute a command and return the answer it will produce.
+static uint32_t execute(uint32_t command) {
+	uint8_t reg = (uint8_t) (command >> 16);
+	uint16_t data = (uint16_t) command;
+
+	switch (command & 0xC0000000u) {
+	case RHS2116_CMD_WRITE:
+		if (!isRom(reg)) {
+			regs[reg] = data;
+		}
+		return RHS2116_CMD_WRITE_ANSWER | data;
+	case RHS2116_CMD_READ:
+		return regs[reg];
+	case RHS2116_CMD_CONVERT: {
+		uint8_t channel = reg & 0x0F;
+		uint32_t n = conversions[channel]++;
+		if (playing.samples && channel == playing.channel
+				&& n - playing.from < playing.count) {
+			return playing.samples[n - playing.from];
+		}
+		return sim_rhs2116_sample(channel, n);
+	}
+	default:
+		// CALIBRATE and CLEAR are not modelled.
+		return 0;
+	}
+}
+
+uint16_t sim_rhs2116_sample(uint8_t channel, uint32_t n) {
+	// About 40 uV of signal and 3 uV of noise at 0.195 uV per LSB.
+	double phase = 2.0 * M_PI * (7.0 * (channel + 1)) * n / 1000.0;
+	uint32_t h = (n * 16u + channel) * 2654435761u;
+	int noise = (int) ((h ^ (h >> 15)) & 0x1F) - 16;
+	return (uint16_t) (32768 + lround(200.0 * sin(phase)) + noise);
+}
+
+void sim_rhs2116_reset(void) {
+	memset(regs, 0, sizeof(regs));
+	regs[RHS2116_REG_INTAN_0] = ('I' << 8) | 'N';
+	regs[RHS2116_REG_INTAN_1] = ('T' << 8) | 'A';
+	regs[RHS2116_REG_INTAN_2] = 'N' << 8;
+	regs[RHS2116_REG_CHIP_ID] = RHS2116_CHIP_ID;
+	memset(pipeline, 0, sizeof(pipeline));
+	memset(conversions, 0, sizeof(conversions));
+	memset(&playing, 0, sizeof(playing));
+	wordCount = 0;
+	busNs = 0;
+	injectError = ECODE_EMDRV_SPIDRV_OK;
+	pending.active = false;
+}
+
+Ecode_t SPIDRV_MTransfer(SPIDRV_Handle_t handle, const void *txBuffer,
+		void *rxBuffer, int count, SPIDRV_Callback_t callback) {
+	if (handle != &instance) {
+		return ECODE_EMDRV_SPIDRV_ILLEGAL_HANDLE;
+	}
+	if (pending.active) {
+		return ECODE_EMDRV_SPIDRV_BUSY;
+	}
+	// The chip latches one command per chip-select cycle.
+	if (count != RHS2116_WORD_SIZE || txBuffer == NULL || rxBuffer == NULL) {
+		return ECODE_EMDRV_SPIDRV_PARAM_ERROR;
+	}
+
+	uint32_t command = get_be32(txBuffer);
+	uint32_t answer = pipeline[0];
+	memmove(pipeline, pipeline + 1, sizeof(pipeline) - sizeof(pipeline[0]));
+	pipeline[RHS2116_PIPELINE_DEPTH - 1] = execute(command);
+	put_be32(rxBuffer, answer);
+
+	if (wordCount < SIM_RHS2116_LOG_SIZE) {
+		bus[wordCount].ns = busNs;
+		bus[wordCount].command = command;
+		bus[wordCount].answer = answer;
+	}
+	wordCount++;
+	busNs += 32ull * 1000000000ull / RHS2116_SPI_BITRATE
+			+ SIM_RHS2116_TRANSFER_NS;
+
+	pending.active = true;
+	pending.callback = callback;
+	pending.status = injectError;
+	injectError = ECODE_EMDRV_SPIDRV_OK;
+	return ECODE_EMDRV_SPIDRV_OK;
+}
+
+size_t sim_rhs2116_run(void) {
+	size_t n = 0;
+	// Each completion may start the next transfer.
+	while (pending.active) {
+		pending.active = false;
+		n++;
+		if (pending.callback) {
+			pending.callback(&instance, pending.status, RHS2116_WORD_SIZE);
+		}
+	}
+	return n;
+}
+
+void sim_rhs2116_play(uint8_t channel, const uint16_t *samples, size_t count) {
+	playing.samples = samples;
+	playing.count = count;
+	playing.channel = channel;
+	playing.from = conversions[channel & 0x0F];
+}
+
+uint16_t sim_rhs2116_reg(uint8_t reg) {
+	return regs[reg];
+}
+
+size_t sim_rhs2116_log(const sim_rhs2116_word_t **words) {
+	*words = bus;
+	return wordCount < SIM_RHS2116_LOG_SIZE ? wordCount : SIM_RHS2116_LOG_SIZE;
+}
+
+size_t sim_rhs2116_words(void) {
+	return wordCount;
+}
+
+uint64_t sim_rhs2116_bus_ns(void) {
+	return busNs;
+}
+
+void sim_rhs2116_fail_next(uint32_t status) {
+	injectError = status;
+}
@@ -0,0 +1,104 @@
+/***************************************************************************//**
+ * @file sim_stim.c
+ * @brief Host model of the stimulation pulse engine.
+ *
+ * Implements stim.h on top of stim_schedule.c. Instead of driving a timer,
+ * pulses are derived from the host clock and the compiled segment table the
+ * hardware would play, so app.c sees the engine behave as on target.
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "power.h"
+#include "sim.h"
+#include "stim.h"
+#include "telemetry.h"
+
+// EM01GRPACLK on the BGM220 runs from the 38.4 MHz HFXO.
+#define SIM_STIM_CLOCK_HZ       38400000u
+#define SIM_STIM_COUNTER_MAX    0xFFFFFFFFu
+// STIM_COUNTER is the 16-bit TIMER1: one overflow per finite train.
+#define SIM_STIM_TRAIN_MAX      0x10000u
+
+static const stim_schedule_t *schedule;
+static uint32_t trainLength;
+static bool running;
+static uint64_t startNs;
+static uint32_t delivered;
+
+static uint32_t modelPulses(void) {
+	uint64_t elapsed = sim_now_ns() - startNs;
+	// ns to timer ticks, split so long runs cannot overflow.
+	uint64_t rate = SIM_STIM_CLOCK_HZ / schedule->prescale;
+	uint64_t ticks = elapsed / 1000000000ull * rate
+			+ elapsed % 1000000000ull * rate / 1000000000ull;
+	uint32_t n = stim_schedule_pulses_at(schedule, ticks);
+
+	if (trainLength && n >= trainLength) {
+		return trainLength;
+	}
+	return n;
+}
+
+void stim_init(void) {
+	running = false;
+	delivered = 0;
+}
+
+uint32_t stim_clock_hz(void) {
+	return SIM_STIM_CLOCK_HZ;
+}
+
+uint32_t stim_counter_max(void) {
+	return SIM_STIM_COUNTER_MAX;
+}
+
+uint32_t stim_train_max(void) {
+	return SIM_STIM_TRAIN_MAX;
+}
+
+sl_status_t stim_start(const stim_schedule_t *s, uint32_t pulses) {
+	if (s->count == 0 || s->clock_hz != SIM_STIM_CLOCK_HZ) {
+		return SL_STATUS_INVALID_PARAMETER;
+	}
+	if (pulses > SIM_STIM_TRAIN_MAX) {
+		return SL_STATUS_INVALID_RANGE;
+	}
+	stim_stop();
+	schedule = s;
+	trainLength = pulses;
+	delivered = 0;
+	startNs = sim_now_ns();
+	power_hold(POWER_CLIENT_STIM);
+	telemetry_train_started(s, pulses);
+	running = true;
+	return SL_STATUS_OK;
+}
+
+void stim_stop(void) {
+	if (running) {
+		delivered = modelPulses();
+		telemetry_train_ended(delivered);
+	}
+	running = false;
+	power_release(POWER_CLIENT_STIM);
+}
+
+bool stim_is_running(void) {
+	return running;
+}
+
+uint32_t stim_pulses_delivered(void) {
+	return running ? modelPulses() : delivered;
+}
+
+const stim_schedule_t* stim_get_schedule(void) {
+	return schedule;
+}
+
+void stim_process_action(void) {
+	if (running && trainLength && modelPulses() >= trainLength) {
+		stim_stop();
+	}
+}
@@ -0,0 +1,211 @@
+/***************************************************************************//**
+ * @file stim_check.c
+ * @brief Check the stimulation timing math and schedule compiler against
+ *        hand-computed tick counts.
+ *
+ *   stim_check
+ *
+ * Runs stim_timing_compute() and stim_schedule_compile() at 38.4 MHz on a
+ * 32-bit and a 16-bit counter and compares prescalers, TOP and compare
+ * values, the segment table of bursts with a rest, the edge model and the
+ * pulse count model with values worked out by hand, then checks that
+ * patterns outside the limits of stim_schedule.h are rejected, also by
+ * stim_schedule_check() for one left unconfigured. Prints one
+ * line per check and exits non-zero if any differs.
+ ******************************************************************************/
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "stim_schedule.h"
+#include "stim_timing.h"
+
+#define CLOCK_HZ        38400000u
+#define COUNTER_32      UINT32_MAX
+#define COUNTER_16      0xFFFFu
+
+static int failures;
+
+static void check(const char *what, bool ok) {
+	printf("%-44s %s\n", what, ok ? "ok" : "FAILED");
+	failures += !ok;
+}
+
+static void checkValue(const char *what, uint64_t value, uint64_t expected) {
+	bool ok = value == expected;
+
+	if (ok) {
+		printf("%-44s ok\n", what);
+	} else {
+		printf("%-44s FAILED: %" PRIu64 ", expected %" PRIu64 "\n", what,
+				value, expected);
+	}
+	failures += !ok;
+}
+
+static sl_status_t compile(uint32_t frequency, uint32_t width,
+		uint32_t phases, uint32_t gap, uint32_t burst, uint32_t rest,
+		uint32_t counterMax, stim_schedule_t *s) {
+	stim_pattern_t p = {
+		.amplitude = 100, .frequency = frequency, .pulseWidth = width,
+		.phases = phases, .interphaseGap = gap, .burstCount = burst,
+		.burstRest = rest,
+	};
+	return stim_schedule_compile(&p, CLOCK_HZ, counterMax, s);
+}
+
+static void checkTiming(void) {
+	stim_timing_t t;
+	stim_edge_t edges[6];
+
+	// 38.4 MHz / 20 Hz fits 32 bits undivided: 1 920 000 ticks.
+	check("20 Hz/200 us, 32-bit: accepted",
+			stim_timing_compute(CLOCK_HZ, COUNTER_32, 20, 200, &t)
+					== SL_STATUS_OK);
+	checkValue("  prescale", t.prescale, 1);
+	checkValue("  top", t.top, 1919999);
+	checkValue("  compare", t.compare, 7680);
+	checkValue("  period, ns", stim_timing_period_ns(&t), 50000000);
+	checkValue("  width, ns", stim_timing_width_ns(&t), 200000);
+
+	// 16 bits need ceil(38.4e6 / (20 x 65536)) = 30: 64 000 ticks of 781 ns.
+	check("20 Hz/200 us, 16-bit: accepted",
+			stim_timing_compute(CLOCK_HZ, COUNTER_16, 20, 200, &t)
+					== SL_STATUS_OK);
+	checkValue("  prescale", t.prescale, 30);
+	checkValue("  top", t.top, 63999);
+	checkValue("  compare", t.compare, 256);
+	checkValue("  period, ns", stim_timing_period_ns(&t), 50000000);
+
+	// 7 Hz is 5 485 714.29 ticks; edges come from whole tick counts.
+	stim_timing_compute(CLOCK_HZ, COUNTER_32, 7, 100, &t);
+	checkValue("7 Hz: top", t.top, 5485713);
+	size_t n = stim_timing_edges(&t, 3, edges, 6);
+	checkValue("  edges", n, 6);
+	checkValue("  third rise, ns", edges[4].time_ns,
+			stim_timing_ticks_to_ns(&t, 2ull * 5485714));
+	checkValue("  third fall, ns", edges[5].time_ns,
+			stim_timing_ticks_to_ns(&t, 2ull * 5485714 + 3840));
+
+	check("1 Hz on an 8-bit counter: rejected",
+			stim_timing_compute(CLOCK_HZ, 0xFF, 1, 100, &t)
+					== SL_STATUS_INVALID_RANGE);
+	check("pulse as long as the period: rejected",
+			stim_timing_compute(CLOCK_HZ, COUNTER_32, 1000, 1000, &t)
+					== SL_STATUS_INVALID_RANGE);
+}
+
+static void checkSchedule(void) {
+	stim_schedule_t s;
+	stim_edge_t edges[8];
+
+	// Biphasic 100 Hz, 100 us phases, 50 us gap: 3840 + 1920 ticks, then
+	// phase B and the rest of the 384 000 tick period.
+	check("biphasic 100 Hz/100 us/50 us gap: accepted",
+			compile(100, 100, 2, 50, 0, 0, COUNTER_32, &s) == SL_STATUS_OK);
+	checkValue("  segments", s.count, 2);
+	checkValue("  [0] top", s.top[0], 5759);
+	checkValue("  [0] a", s.cc[0][0], 3840);
+	checkValue("  [1] top", s.top[1], 378239);
+	checkValue("  [1] b", s.cc[1][1], 3840);
+	checkValue("  loop ticks", s.loopTicks, 384000);
+	size_t n = stim_schedule_edges(&s, 2, edges, 8);
+	checkValue("  edges", n, 8);
+	checkValue("  A fall, ns", edges[1].time_ns, 100000);
+	checkValue("  B rise, ns", edges[2].time_ns, 150000);
+	checkValue("  B fall, ns", edges[3].time_ns, 250000);
+	checkValue("  next A rise, ns", edges[4].time_ns, 10000000);
+
+	// Burst of 3 at 1 kHz with a 2 ms rest folded into the last segment.
+	check("burst 3 at 1 kHz, 2 ms rest: accepted",
+			compile(1000, 100, 1, 0, 3, 2000, COUNTER_32, &s)
+					== SL_STATUS_OK);
+	checkValue("  segments", s.count, 3);
+	checkValue("  [1] top", s.top[1], 38399);
+	checkValue("  [2] top", s.top[2], 115199);
+	checkValue("  pulses per loop", s.pulsesPerLoop, 3);
+	checkValue("  loop ticks", s.loopTicks, 192000);
+	checkValue("  pulses at 38400 + 3839", stim_schedule_pulses_at(&s,
+			38400 + 3839), 1);
+	checkValue("  pulses at 38400 + 3840", stim_schedule_pulses_at(&s,
+			38400 + 3840), 2);
+	checkValue("  pulses at 2 loops + 3840", stim_schedule_pulses_at(&s,
+			2 * 192000 + 3840), 7);
+	checkValue("  loops for 7 pulses", stim_schedule_loops_for_pulses(&s, 7),
+			3);
+
+	// A 10 ms rest does not fit 16 bits: 65 536 ticks, then low segments
+	// of 5 x 65 536 and 29 184.
+	check("burst 2, 10 ms rest, 16-bit: accepted",
+			compile(1000, 100, 1, 0, 2, 10000, COUNTER_16, &s)
+					== SL_STATUS_OK);
+	checkValue("  segments", s.count, 8);
+	checkValue("  [1] top", s.top[1], 65535);
+	checkValue("  [1] a", s.cc[0][1], 3840);
+	checkValue("  [6] top", s.top[6], 65535);
+	checkValue("  [7] top", s.top[7], 29183);
+	checkValue("  [7] a", s.cc[0][7], 0);
+	checkValue("  loop ticks", s.loopTicks, 460800);
+
+	// 38 400 + 76 800 ticks is one more than the counter holds: 115 198
+	// ticks, then a 2-tick pause rather than a 1-tick segment with TOP 0.
+	check("burst 1, 2 ms rest, one tick over: accepted",
+			compile(1000, 100, 1, 0, 1, 2000, 115198, &s) == SL_STATUS_OK);
+	checkValue("  segments", s.count, 2);
+	checkValue("  [0] top", s.top[0], 115197);
+	checkValue("  [1] top", s.top[1], 1);
+	checkValue("  loop ticks", s.loopTicks, 115200);
+}
+
+static void checkRejected(void) {
+	stim_schedule_t s;
+	stim_pattern_t p = {
+		.amplitude = STIM_AMPLITUDE_MAX + 1, .frequency = 20,
+		.pulseWidth = 200, .phases = 1,
+	};
+
+	check("amplitude over STIM_AMPLITUDE_MAX: rejected",
+			stim_schedule_compile(&p, CLOCK_HZ, COUNTER_32, &s)
+					== SL_STATUS_INVALID_PARAMETER);
+	p.frequency = 0;
+	check("  and while F0 leaves it unconfigured",
+			stim_schedule_check(&p) == SL_STATUS_INVALID_PARAMETER);
+	p.amplitude = STIM_AMPLITUDE_MAX;
+	check("F0 within the other limits: passes the check",
+			stim_schedule_check(&p) == SL_STATUS_OK);
+	check("10 kHz/50 us biphasic, no gap: rejected",
+			compile(10000, 50, 2, 0, 0, 0, COUNTER_32, &s)
+					== SL_STATUS_INVALID_RANGE);
+	check("10 kHz/50 us monophasic: accepted",
+			compile(10000, 50, 1, 0, 0, 0, COUNTER_32, &s) == SL_STATUS_OK);
+	check("frequency 0: rejected",
+			compile(0, 200, 1, 0, 0, 0, COUNTER_32, &s)
+					== SL_STATUS_INVALID_PARAMETER);
+	check("frequency over STIM_FREQUENCY_MAX: rejected",
+			compile(STIM_FREQUENCY_MAX + 1, 10, 1, 0, 0, 0, COUNTER_32, &s)
+					== SL_STATUS_INVALID_PARAMETER);
+	check("width under STIM_PULSE_WIDTH_MIN: rejected",
+			compile(20, STIM_PULSE_WIDTH_MIN - 1, 1, 0, 0, 0, COUNTER_32, &s)
+					== SL_STATUS_INVALID_PARAMETER);
+	check("3 phases: rejected",
+			compile(20, 200, 3, 0, 0, 0, COUNTER_32, &s)
+					== SL_STATUS_INVALID_PARAMETER);
+	check("burst over STIM_BURST_MAX: rejected",
+			compile(20, 200, 1, 0, STIM_BURST_MAX + 1, 0, COUNTER_32, &s)
+					== SL_STATUS_INVALID_PARAMETER);
+	check("rest over STIM_BURST_REST_MAX: rejected",
+			compile(20, 200, 1, 0, 2, STIM_BURST_REST_MAX + 1, COUNTER_32, &s)
+					== SL_STATUS_INVALID_PARAMETER);
+}
+
+int main(void) {
+	checkTiming();
+	checkSchedule();
+	checkRejected();
+
+	if (failures) {
+		printf("%d unexpected result%s\n", failures, failures == 1 ? "" : "s");
+		return 1;
+	}
+	return 0;
+}
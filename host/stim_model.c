@@ -0,0 +1,129 @@
+/***************************************************************************//**
+ * @file stim_model.c
+ * @brief Print the timer configuration and edge schedule for a pulse train.
+ *
+ *   stim_model <frequency_hz> <pulse_width_us> [pulses] [clock_hz] [bits]
+ *   stim_model -s <frequency_hz> <pulse_width_us> [phases] [gap_us]
+ *              [burst] [rest_us] [loops]
+ *
+ * Shows what stim_timing_compute() programs into the timer, the resulting
+ * period and width, their error against the request, and the edge times of
+ * the first pulses as the hardware would produce them.
+ *
+ * With -s, prints the segment table stim_schedule_compile() builds for the
+ * pattern at 38.4 MHz on a 32-bit timer, and the edges of the first loops.
+ ******************************************************************************/
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stim_schedule.h"
+#include "stim_timing.h"
+
+#define MODEL_MAX_PULSES 64
+#define MODEL_MAX_EDGES  256
+
+static int modelSchedule(int argc, char **argv) {
+	static stim_edge_t edges[MODEL_MAX_EDGES];
+	stim_schedule_t s;
+	stim_pattern_t p = { .phases = 1 };
+	uint32_t loops = 1;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: stim_model -s <frequency_hz> <pulse_width_us> "
+				"[phases] [gap_us] [burst] [rest_us] [loops]\n");
+		return 1;
+	}
+	p.frequency = strtoul(argv[0], NULL, 0);
+	p.pulseWidth = strtoul(argv[1], NULL, 0);
+	if (argc > 2) {
+		p.phases = strtoul(argv[2], NULL, 0);
+	}
+	if (argc > 3) {
+		p.interphaseGap = strtoul(argv[3], NULL, 0);
+	}
+	if (argc > 4) {
+		p.burstCount = strtoul(argv[4], NULL, 0);
+	}
+	if (argc > 5) {
+		p.burstRest = strtoul(argv[5], NULL, 0);
+	}
+	if (argc > 6) {
+		loops = strtoul(argv[6], NULL, 0);
+	}
+
+	sl_status_t sc = stim_schedule_compile(&p, 38400000u, UINT32_MAX, &s);
+	if (sc != SL_STATUS_OK) {
+		printf("rejected: status 0x%04x\n", (unsigned) sc);
+		return 2;
+	}
+	printf("prescale=%" PRIu32 " segments=%u pulses/loop=%u loop=%" PRIu64
+			" ticks\n", s.prescale, s.count, s.pulsesPerLoop, s.loopTicks);
+	for (uint16_t i = 0; i < s.count; i++) {
+		printf("  [%2u] top=%10" PRIu32 " a=%10" PRIu32 " b=%10" PRIu32 "\n",
+				i, s.top[i], s.cc[0][i], s.cc[1][i]);
+	}
+	size_t n = stim_schedule_edges(&s, loops, edges, MODEL_MAX_EDGES);
+	for (size_t i = 0; i < n; i++) {
+		printf("%10" PRIu64 " ns %c %s\n", edges[i].time_ns,
+				'A' + edges[i].phase, edges[i].level ? "rise" : "fall");
+	}
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	stim_timing_t t;
+	stim_edge_t edges[2 * MODEL_MAX_PULSES];
+	uint32_t frequency, width, pulses = 4, clock = 38400000u, bits = 32;
+
+	if (argc > 1 && strcmp(argv[1], "-s") == 0) {
+		return modelSchedule(argc - 2, argv + 2);
+	}
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s <frequency_hz> <pulse_width_us> [pulses] "
+				"[clock_hz] [counter_bits]\n", argv[0]);
+		return 1;
+	}
+	frequency = strtoul(argv[1], NULL, 0);
+	width = strtoul(argv[2], NULL, 0);
+	if (argc > 3) {
+		pulses = strtoul(argv[3], NULL, 0);
+	}
+	if (argc > 4) {
+		clock = strtoul(argv[4], NULL, 0);
+	}
+	if (argc > 5) {
+		bits = strtoul(argv[5], NULL, 0);
+	}
+	if (pulses > MODEL_MAX_PULSES) {
+		pulses = MODEL_MAX_PULSES;
+	}
+
+	uint32_t counter_max = bits >= 32 ? UINT32_MAX : (1u << bits) - 1;
+	sl_status_t sc = stim_timing_compute(clock, counter_max, frequency, width,
+			&t);
+	if (sc != SL_STATUS_OK) {
+		printf("rejected: status 0x%04x\n", (unsigned) sc);
+		return 2;
+	}
+
+	uint64_t period = stim_timing_period_ns(&t);
+	uint64_t pw = stim_timing_width_ns(&t);
+	double wantPeriod = 1e9 / frequency;
+	double wantWidth = width * 1e3;
+	printf("prescale=%" PRIu32 " top=%" PRIu32 " compare=%" PRIu32 "\n",
+			t.prescale, t.top, t.compare);
+	printf("period=%" PRIu64 " ns (error %+.1f ns)\n", period,
+			(double) period - wantPeriod);
+	printf("width=%" PRIu64 " ns (error %+.1f ns)\n", pw,
+			(double) pw - wantWidth);
+
+	size_t n = stim_timing_edges(&t, pulses, edges,
+			sizeof(edges) / sizeof(edges[0]));
+	for (size_t i = 0; i < n; i++) {
+		printf("%10" PRIu64 " ns %s\n", edges[i].time_ns,
+				edges[i].level ? "rise" : "fall");
+	}
+	return 0;
+}
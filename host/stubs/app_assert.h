@@ -0,0 +1,30 @@
+/***************************************************************************//**
+ * @file app_assert.h
+ * @brief Host stand-in for the app_assert component.
+ ******************************************************************************/
+#ifndef APP_ASSERT_H
+#define APP_ASSERT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "sl_status.h"
+
+#define app_assert_status(sc)                                          \
+  do {                                                                 \
+    if ((sc) != SL_STATUS_OK) {                                        \
+      fprintf(stderr, "%s:%d: assertion failed, status 0x%04x\n",      \
+              __FILE__, __LINE__, (unsigned)(sc));                     \
+      abort();                                                         \
+    }                                                                  \
+  } while (0)
+
+#define app_assert(expr, ...)                                          \
+  do {                                                                 \
+    if (!(expr)) {                                                     \
+      fprintf(stderr, "%s:%d: assertion failed: ", __FILE__, __LINE__);\
+      fprintf(stderr, __VA_ARGS__);                                    \
+      abort();                                                         \
+    }                                                                  \
+  } while (0)
+
+#endif // APP_ASSERT_H
@@ -0,0 +1,23 @@
+/***************************************************************************//**
+ * @file app_log.h
+ * @brief Host stand-in for the app_log component.
+ *
+ * Log output goes to stdout only when sim_log_enable is set, so benchmarks
+ * are not dominated by terminal I/O.
+ ******************************************************************************/
+#ifndef APP_LOG_H
+#define APP_LOG_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+extern bool sim_log_enable;
+
+#define app_log(...)                                                   \
+  do { if (sim_log_enable) { printf(__VA_ARGS__); } } while (0)
+#define app_log_debug(...)    app_log("[D] " __VA_ARGS__)
+#define app_log_info(...)     app_log("[I] " __VA_ARGS__)
+#define app_log_warning(...)  app_log("[W] " __VA_ARGS__)
+#define app_log_error(...)    app_log("[E] " __VA_ARGS__)
+
+#endif // APP_LOG_H
@@ -0,0 +1,40 @@
+/***************************************************************************//**
+ * @file btl_interface.h
+ * @brief Host stand-in for the Gecko bootloader application interface.
+ *
+ * One storage slot in RAM; sim_btl.c verifies what is written to it with
+ * gbl.h and records the install request (see sim.h).
+ ******************************************************************************/
+#ifndef BTL_INTERFACE_H
+#define BTL_INTERFACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BOOTLOADER_OK                           0L
+#define BOOTLOADER_ERROR_STORAGE_INVALID_SLOT   0x0502L
+#define BOOTLOADER_ERROR_STORAGE_INVALID_ADDRESS 0x0504L
+#define BOOTLOADER_ERROR_PARSER_PARSED          0x0401L
+
+typedef struct {
+	uint32_t address;
+	uint32_t length;
+} BootloaderStorageSlot_t;
+
+typedef void (*BootloaderParserCallback_t)(uint32_t address, uint8_t *data,
+		size_t length, void *context);
+
+int32_t bootloader_init(void);
+int32_t bootloader_getStorageSlotInfo(uint32_t slotId,
+		BootloaderStorageSlot_t *slot);
+int32_t bootloader_eraseStorageSlot(uint32_t slotId);
+int32_t bootloader_eraseWriteStorage(uint32_t slotId, uint32_t offset,
+		uint8_t *buffer, size_t length);
+int32_t bootloader_readStorage(uint32_t slotId, uint32_t offset,
+		uint8_t *buffer, size_t length);
+int32_t bootloader_verifyImage(uint32_t slotId,
+		BootloaderParserCallback_t callbackFunction);
+int32_t bootloader_setImageToBootload(int32_t slotId);
+void bootloader_rebootAndInstall(void);
+
+#endif // BTL_INTERFACE_H
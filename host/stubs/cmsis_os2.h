@@ -0,0 +1,71 @@
+/***************************************************************************//**
+ * @file cmsis_os2.h
+ * @brief Host stand-in for the CMSIS-RTOS2 calls tasks.c makes.
+ *
+ * Declarations only, with the types and values of the real header: the
+ * host build compiles the kernel path of tasks.c to keep it building, but
+ * does not link or run it.
+ ******************************************************************************/
+#ifndef CMSIS_OS2_H
+#define CMSIS_OS2_H
+
+#include <stdint.h>
+
+#define osWaitForever           0xFFFFFFFFu
+#define osFlagsWaitAny          0x00000000u
+
+typedef void *osThreadId_t;
+typedef void (*osThreadFunc_t)(void *argument);
+
+typedef enum {
+	osOK = 0,
+	osError = -1,
+} osStatus_t;
+
+typedef enum {
+	osKernelInactive = 0,
+	osKernelReady = 1,
+	osKernelRunning = 2,
+	osKernelLocked = 3,
+	osKernelSuspended = 4,
+	osKernelError = -1,
+} osKernelState_t;
+
+typedef enum {
+	osPriorityNone = 0,
+	osPriorityIdle = 1,
+	osPriorityLow = 8,
+	osPriorityBelowNormal = 16,
+	osPriorityNormal = 24,
+	osPriorityAboveNormal = 32,
+	osPriorityHigh = 40,
+	osPriorityRealtime = 48,
+	osPriorityISR = 56,
+	osPriorityError = -1,
+} osPriority_t;
+
+typedef struct {
+	const char *name;
+	uint32_t attr_bits;
+	void *cb_mem;
+	uint32_t cb_size;
+	void *stack_mem;
+	uint32_t stack_size;
+	osPriority_t priority;
+	uint32_t tz_module;
+	uint32_t reserved;
+} osThreadAttr_t;
+
+osKernelState_t osKernelGetState(void);
+uint32_t osKernelGetTickCount(void);
+uint32_t osKernelGetTickFreq(void);
+osThreadId_t osThreadNew(osThreadFunc_t func, void *argument,
+		const osThreadAttr_t *attr);
+osThreadId_t osThreadGetId(void);
+uint32_t osThreadGetStackSpace(osThreadId_t thread_id);
+uint32_t osThreadFlagsSet(osThreadId_t thread_id, uint32_t flags);
+uint32_t osThreadFlagsWait(uint32_t flags, uint32_t options,
+		uint32_t timeout);
+osStatus_t osDelay(uint32_t ticks);
+
+#endif // CMSIS_OS2_H
@@ -0,0 +1,15 @@
+/***************************************************************************//**
+ * @file ecode.h
+ * @brief Host stand-in for the emdrv error code type.
+ ******************************************************************************/
+#ifndef ECODE_H
+#define ECODE_H
+
+#include <stdint.h>
+
+typedef uint32_t Ecode_t;
+
+#define ECODE_OK                            0u
+#define ECODE_EMDRV_SPIDRV_BASE             0x00002000u
+
+#endif // ECODE_H
@@ -0,0 +1,13 @@
+/***************************************************************************//**
+ * @file em_common.h
+ * @brief Host stand-in for the emlib common macros.
+ ******************************************************************************/
+#ifndef EM_COMMON_H
+#define EM_COMMON_H
+
+#define SL_WEAK         __attribute__((weak))
+#define SL_UNUSED       __attribute__((unused))
+#define SL_ATTRIBUTE_PACKED __attribute__((packed))
+#define PACKSTRUCT(s)   s __attribute__((packed))
+
+#endif // EM_COMMON_H
@@ -0,0 +1,17 @@
+/***************************************************************************//**
+ * @file em_core.h
+ * @brief Host stand-in for the emlib critical section macros.
+ *
+ * The simulation has no interrupts; sleeptimer callbacks and transition
+ * events run from sim_advance() on the caller's thread.
+ ******************************************************************************/
+#ifndef EM_CORE_H
+#define EM_CORE_H
+
+#define CORE_DECLARE_IRQ_STATE  int irqState_ = 0
+#define CORE_ENTER_ATOMIC()     ((void) irqState_)
+#define CORE_EXIT_ATOMIC()      ((void) irqState_)
+#define CORE_ENTER_CRITICAL()   ((void) irqState_)
+#define CORE_EXIT_CRITICAL()    ((void) irqState_)
+
+#endif // EM_CORE_H
@@ -0,0 +1,69 @@
+/***************************************************************************//**
+ * @file em_device.h
+ * @brief Host stand-in for the CMSIS core registers the firmware uses.
+ *
+ * DWT->CYCCNT counts at SystemCoreClockGet() from the simulation clock, so
+ * profiled code reports host time scaled to target cycles (sim_cpu.c).
+ * Flash is a host array with the application at SIM_APP_OFFSET, where
+ * SCB->VTOR points (sim_btl.c). The DSP intrinsics dsp.c uses with
+ * DSP_SIMD are modelled in C with the instructions' exact arithmetic.
+ ******************************************************************************/
+#ifndef EM_DEVICE_H
+#define EM_DEVICE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+	uint32_t CTRL;
+	uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct {
+	uint32_t DEMCR;
+} CoreDebug_Type;
+
+#define DWT_CTRL_CYCCNTENA_Msk          0x00000001u
+#define CoreDebug_DEMCR_TRCENA_Msk      0x01000000u
+
+// Refreshes CYCCNT on every access.
+DWT_Type* sim_dwt(void);
+extern CoreDebug_Type sim_core_debug;
+
+#define DWT             (sim_dwt())
+#define CoreDebug       (&sim_core_debug)
+
+uint32_t SystemCoreClockGet(void);
+
+typedef struct {
+	uintptr_t VTOR;         // a host address, not a 32-bit register
+} SCB_Type;
+
+#define SIM_FLASH_SIZE  0x80000u        // BGM220P, 512 KB
+#define SIM_APP_OFFSET  0x12000u        // after the bootloader
+
+extern uint8_t sim_flash[SIM_FLASH_SIZE];
+extern SCB_Type sim_scb;
+
+#define SCB             (&sim_scb)
+#define FLASH_BASE      ((uintptr_t) sim_flash)
+#define FLASH_SIZE      SIM_FLASH_SIZE
+
+// Pack the low halfword of a with b shifted left by s (PKHBT).
+#define __PKHBT(a, b, s) \
+	((((uint32_t) (a)) & 0x0000FFFFu) | ((((uint32_t) (b)) << (s)) & 0xFFFF0000u))
+
+// Dual signed 16 x 16 multiply, both products added to a 64-bit sum (SMLALD).
+static inline uint64_t __SMLALD(uint32_t a, uint32_t b, uint64_t acc) {
+	int64_t lo = (int64_t) (int16_t) a * (int16_t) b;
+	int64_t hi = (int64_t) (int16_t) (a >> 16) * (int16_t) (b >> 16);
+	return acc + (uint64_t) (lo + hi);
+}
+
+// Signed saturation to a width of bits (SSAT).
+static inline int32_t __SSAT(int32_t v, uint32_t bits) {
+	int32_t max = (int32_t) ((1u << (bits - 1)) - 1);
+	return v > max ? max : v < -max - 1 ? -max - 1 : v;
+}
+
+#endif // EM_DEVICE_H
@@ -0,0 +1,29 @@
+/***************************************************************************//**
+ * @file em_rmu.h
+ * @brief Host stand-in for the emlib reset management unit API.
+ *
+ * The reset cause is set with sim_set_reset_cause() (sim_power.c).
+ ******************************************************************************/
+#ifndef EM_RMU_H
+#define EM_RMU_H
+
+#include <stdint.h>
+
+// EMU->RSTCAUSE bits, series 2.
+#define EMU_RSTCAUSE_POR        0x00000001UL
+#define EMU_RSTCAUSE_PIN        0x00000002UL
+#define EMU_RSTCAUSE_EM4        0x00000004UL
+#define EMU_RSTCAUSE_WDOG0      0x00000008UL
+#define EMU_RSTCAUSE_WDOG1      0x00000010UL
+#define EMU_RSTCAUSE_LOCKUP     0x00000020UL
+#define EMU_RSTCAUSE_SYSREQ     0x00000040UL
+#define EMU_RSTCAUSE_DVDDBOD    0x00000080UL
+#define EMU_RSTCAUSE_DVDDLEBOD  0x00000100UL
+#define EMU_RSTCAUSE_DECBOD     0x00000200UL
+#define EMU_RSTCAUSE_AVDDBOD    0x00000400UL
+#define EMU_RSTCAUSE_IOVDD0BOD  0x00000800UL
+
+uint32_t RMU_ResetCauseGet(void);
+void RMU_ResetCauseClear(void);
+
+#endif // EM_RMU_H
@@ -0,0 +1,23 @@
+/***************************************************************************//**
+ * @file gatt_db.h
+ * @brief Host stand-in for the GATT database generated from the .btconf.
+ *
+ * Handle values are arbitrary; sim_bt.c owns the matching attribute table.
+ ******************************************************************************/
+#ifndef GATT_DB_H
+#define GATT_DB_H
+
+#define gattdb_node_rx                          21
+#define gattdb_node_tx                          23
+#define gattdb_diagnostics                      25
+#define gattdb_power_report                     27
+#define gattdb_acq_stream                       29
+#define gattdb_acq_stats                        31
+#define gattdb_dlog                             33
+#define gattdb_profile                          35
+#define gattdb_ota_delta                        37
+#define gattdb_trace                            39
+#define gattdb_boot_report                      41
+#define gattdb_telemetry                        43
+
+#endif // GATT_DB_H
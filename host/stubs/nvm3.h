@@ -0,0 +1,41 @@
+/***************************************************************************//**
+ * @file nvm3.h
+ * @brief Host stand-in for the NVM3 data storage driver (subset).
+ *
+ * Objects are kept in RAM by sim_nvm3.c; sim_reset() does not clear them,
+ * so a simulated reboot keeps its data like the flash would.
+ ******************************************************************************/
+#ifndef NVM3_H
+#define NVM3_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ecode.h"
+
+typedef uint32_t nvm3_ObjectKey_t;
+
+typedef struct nvm3_Handle nvm3_Handle_t;
+
+#define ECODE_NVM3_OK                       0x00000000u
+#define ECODE_NVM3_ERR_BASE                 0xF0000000u
+#define ECODE_NVM3_ERR_STORAGE_FULL         (ECODE_NVM3_ERR_BASE | 0x0Au)
+#define ECODE_NVM3_ERR_OBJECT_SIZE_NOT_SUPPORTED (ECODE_NVM3_ERR_BASE | 0x0Bu)
+#define ECODE_NVM3_ERR_KEY_INVALID          (ECODE_NVM3_ERR_BASE | 0x0Du)
+#define ECODE_NVM3_ERR_KEY_NOT_FOUND        (ECODE_NVM3_ERR_BASE | 0x0Eu)
+#define ECODE_NVM3_ERR_READ_DATA_SIZE       (ECODE_NVM3_ERR_BASE | 0x10u)
+
+#define NVM3_OBJECTTYPE_DATA                0u
+#define NVM3_OBJECTTYPE_COUNTER             1u
+
+#define NVM3_KEY_MASK                       0x000FFFFFu
+#define NVM3_MAX_OBJECT_SIZE                4096u
+
+Ecode_t nvm3_writeData(nvm3_Handle_t *h, nvm3_ObjectKey_t key,
+                       const void *value, size_t len);
+Ecode_t nvm3_readData(nvm3_Handle_t *h, nvm3_ObjectKey_t key, void *value,
+                      size_t len);
+Ecode_t nvm3_getObjectInfo(nvm3_Handle_t *h, nvm3_ObjectKey_t key,
+                           uint32_t *type, size_t *len);
+Ecode_t nvm3_deleteObject(nvm3_Handle_t *h, nvm3_ObjectKey_t key);
+
+#endif // NVM3_H
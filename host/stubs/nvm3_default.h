@@ -0,0 +1,12 @@
+/***************************************************************************//**
+ * @file nvm3_default.h
+ * @brief Host stand-in for the nvm3_default component.
+ ******************************************************************************/
+#ifndef NVM3_DEFAULT_H
+#define NVM3_DEFAULT_H
+
+#include "nvm3.h"
+
+extern nvm3_Handle_t *nvm3_defaultHandle;
+
+#endif // NVM3_DEFAULT_H
@@ -0,0 +1,226 @@
+/***************************************************************************//**
+ * @file sl_bluetooth.h
+ * @brief Host stand-in for the Bluetooth stack API (sl_bt_api.h subset).
+ *
+ * Message IDs, event layouts and command signatures mirror Gecko SDK 4.4 so
+ * that app.c compiles unmodified. Commands are implemented by sim_bt.c.
+ ******************************************************************************/
+#ifndef SL_BLUETOOTH_H
+#define SL_BLUETOOTH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "em_common.h"
+#include "sl_status.h"
+
+#define SL_BGAPI_MAX_PAYLOAD_SIZE 256
+
+#define SL_BT_MSG_ID(HDR)   ((HDR) & 0xffff00f8)
+#define SL_BT_MSG_LEN(HDR)  ((((HDR) & 0x7) << 8) | (((HDR) & 0xff00) >> 8))
+
+#define sl_bt_evt_system_boot_id                         0x000100a0
+#define sl_bt_evt_connection_opened_id                   0x000600a0
+#define sl_bt_evt_connection_closed_id                   0x010600a0
+#define sl_bt_evt_connection_parameters_id               0x020600a0
+#define sl_bt_evt_connection_phy_status_id               0x040600a0
+#define sl_bt_evt_connection_data_length_id              0x090600a0
+#define sl_bt_evt_gatt_mtu_exchanged_id                  0x000900a0
+#define sl_bt_evt_gatt_server_attribute_value_id         0x000a00a0
+#define sl_bt_evt_gatt_server_characteristic_status_id   0x030a00a0
+
+typedef struct {
+  uint8_t addr[6];
+} bd_addr;
+
+typedef struct {
+  uint8_t len;
+  uint8_t data[];
+} uint8array;
+
+PACKSTRUCT(struct sl_bt_evt_system_boot_s {
+  uint16_t major;
+  uint16_t minor;
+  uint16_t patch;
+  uint16_t build;
+  uint32_t bootloader;
+  uint16_t hw;
+  uint32_t hash;
+});
+typedef struct sl_bt_evt_system_boot_s sl_bt_evt_system_boot_t;
+
+PACKSTRUCT(struct sl_bt_evt_connection_opened_s {
+  bd_addr  address;
+  uint8_t  address_type;
+  uint8_t  master;
+  uint8_t  connection;
+  uint8_t  bonding;
+  uint8_t  advertiser;
+  uint16_t sync;
+});
+typedef struct sl_bt_evt_connection_opened_s sl_bt_evt_connection_opened_t;
+
+PACKSTRUCT(struct sl_bt_evt_connection_closed_s {
+  uint16_t reason;
+  uint8_t  connection;
+});
+typedef struct sl_bt_evt_connection_closed_s sl_bt_evt_connection_closed_t;
+
+PACKSTRUCT(struct sl_bt_evt_connection_parameters_s {
+  uint8_t  connection;
+  uint16_t interval;
+  uint16_t latency;
+  uint16_t timeout;
+  uint8_t  security_mode;
+  uint16_t txsize;
+});
+typedef struct sl_bt_evt_connection_parameters_s sl_bt_evt_connection_parameters_t;
+
+PACKSTRUCT(struct sl_bt_evt_connection_phy_status_s {
+  uint8_t connection;
+  uint8_t phy;
+});
+typedef struct sl_bt_evt_connection_phy_status_s sl_bt_evt_connection_phy_status_t;
+
+PACKSTRUCT(struct sl_bt_evt_connection_data_length_s {
+  uint8_t  connection;
+  uint16_t tx_data_len;
+  uint16_t tx_time_us;
+  uint16_t rx_data_len;
+  uint16_t rx_time_us;
+});
+typedef struct sl_bt_evt_connection_data_length_s sl_bt_evt_connection_data_length_t;
+
+PACKSTRUCT(struct sl_bt_evt_gatt_mtu_exchanged_s {
+  uint8_t  connection;
+  uint16_t mtu;
+});
+typedef struct sl_bt_evt_gatt_mtu_exchanged_s sl_bt_evt_gatt_mtu_exchanged_t;
+
+PACKSTRUCT(struct sl_bt_evt_gatt_server_attribute_value_s {
+  uint8_t    connection;
+  uint16_t   attribute;
+  uint8_t    att_opcode;
+  uint16_t   offset;
+  uint8array value;
+});
+typedef struct sl_bt_evt_gatt_server_attribute_value_s sl_bt_evt_gatt_server_attribute_value_t;
+
+PACKSTRUCT(struct sl_bt_evt_gatt_server_characteristic_status_s {
+  uint8_t  connection;
+  uint16_t characteristic;
+  uint8_t  status_flags;
+  uint16_t client_config_flags;
+  uint16_t client_config;
+});
+typedef struct sl_bt_evt_gatt_server_characteristic_status_s sl_bt_evt_gatt_server_characteristic_status_t;
+
+PACKSTRUCT(struct sl_bt_msg {
+  uint32_t header;
+  union {
+    uint8_t handle;
+    sl_bt_evt_system_boot_t                       evt_system_boot;
+    sl_bt_evt_connection_opened_t                 evt_connection_opened;
+    sl_bt_evt_connection_closed_t                 evt_connection_closed;
+    sl_bt_evt_connection_parameters_t             evt_connection_parameters;
+    sl_bt_evt_connection_phy_status_t             evt_connection_phy_status;
+    sl_bt_evt_connection_data_length_t            evt_connection_data_length;
+    sl_bt_evt_gatt_mtu_exchanged_t                evt_gatt_mtu_exchanged;
+    sl_bt_evt_gatt_server_attribute_value_t       evt_gatt_server_attribute_value;
+    sl_bt_evt_gatt_server_characteristic_status_t evt_gatt_server_characteristic_status;
+    uint8_t payload[SL_BGAPI_MAX_PAYLOAD_SIZE];
+  } data;
+});
+typedef struct sl_bt_msg sl_bt_msg_t;
+
+typedef enum {
+  sl_bt_advertiser_non_discoverable     = 0x0,
+  sl_bt_advertiser_limited_discoverable = 0x1,
+  sl_bt_advertiser_general_discoverable = 0x2,
+  sl_bt_advertiser_broadcast            = 0x3,
+  sl_bt_advertiser_user_data            = 0x4
+} sl_bt_advertiser_discovery_mode_t;
+
+typedef enum {
+  sl_bt_legacy_advertiser_non_connectable = 0x0,
+  sl_bt_legacy_advertiser_connectable     = 0x2,
+  sl_bt_legacy_advertiser_scannable       = 0x3
+} sl_bt_legacy_advertiser_connection_mode_t;
+
+typedef enum {
+  sl_bt_gatt_server_disable                     = 0x0,
+  sl_bt_gatt_server_notification                = 0x1,
+  sl_bt_gatt_server_indication                  = 0x2,
+  sl_bt_gatt_server_notification_and_indication = 0x3
+} sl_bt_gatt_server_client_configuration_t;
+
+typedef enum {
+  sl_bt_gatt_write_request         = 0x12,
+  sl_bt_gatt_prepare_write_request = 0x16,
+  sl_bt_gatt_execute_write_request = 0x18,
+  sl_bt_gatt_write_command         = 0x52
+} sl_bt_gatt_att_opcode_t;
+
+typedef enum {
+  sl_bt_gatt_server_client_config = 0x1,
+  sl_bt_gatt_server_confirmation  = 0x2
+} sl_bt_gatt_server_characteristic_status_flag_t;
+
+sl_status_t sl_bt_advertiser_create_set(uint8_t *handle);
+sl_status_t sl_bt_advertiser_set_timing(uint8_t advertising_set,
+                                        uint32_t interval_min,
+                                        uint32_t interval_max,
+                                        uint16_t duration,
+                                        uint8_t maxevents);
+sl_status_t sl_bt_advertiser_stop(uint8_t advertising_set);
+sl_status_t sl_bt_legacy_advertiser_generate_data(uint8_t advertising_set,
+                                                  uint8_t discover);
+sl_status_t sl_bt_legacy_advertiser_start(uint8_t advertising_set,
+                                          uint8_t connect);
+
+sl_status_t sl_bt_connection_set_preferred_phy(uint8_t connection,
+                                               uint8_t preferred_phy,
+                                               uint8_t accepted_phy);
+sl_status_t sl_bt_connection_set_data_length(uint8_t connection,
+                                             uint16_t tx_data_len,
+                                             uint16_t tx_time_us);
+sl_status_t sl_bt_connection_set_parameters(uint8_t connection,
+                                            uint16_t min_interval,
+                                            uint16_t max_interval,
+                                            uint16_t latency,
+                                            uint16_t timeout,
+                                            uint16_t min_ce_length,
+                                            uint16_t max_ce_length);
+
+sl_status_t sl_bt_gatt_server_set_max_mtu(uint16_t max_mtu,
+                                          uint16_t *max_mtu_out);
+sl_status_t sl_bt_gatt_server_read_attribute_value(uint16_t attribute,
+                                                   uint16_t offset,
+                                                   size_t max_value_size,
+                                                   size_t *value_len,
+                                                   uint8_t *value);
+sl_status_t sl_bt_gatt_server_write_attribute_value(uint16_t attribute,
+                                                    uint16_t offset,
+                                                    size_t value_len,
+                                                    const uint8_t *value);
+sl_status_t sl_bt_gatt_server_send_notification(uint8_t connection,
+                                                uint16_t characteristic,
+                                                size_t value_len,
+                                                const uint8_t *value);
+sl_status_t sl_bt_gatt_server_send_indication(uint8_t connection,
+                                              uint16_t characteristic,
+                                              size_t value_len,
+                                              const uint8_t *value);
+
+/**
+ * True if the stack has events waiting to be processed.
+ */
+bool sl_bt_event_pending(void);
+
+/**
+ * Application event handler, called by the stack for every event. On target
+ * sl_bt_process_event() dispatches to it; on the host sim_bt.c does.
+ */
+void sl_bt_on_event(sl_bt_msg_t *evt);
+
+#endif // SL_BLUETOOTH_H
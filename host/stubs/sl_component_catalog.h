@@ -0,0 +1,12 @@
+/***************************************************************************//**
+ * @file sl_component_catalog.h
+ * @brief Host stand-in for the generated component catalog.
+ *
+ * The host build has no iostream, so dlog.c drains over GATT only.
+ ******************************************************************************/
+#ifndef SL_COMPONENT_CATALOG_H
+#define SL_COMPONENT_CATALOG_H
+
+#define SL_CATALOG_POWER_MANAGER_PRESENT
+
+#endif // SL_COMPONENT_CATALOG_H
@@ -0,0 +1,25 @@
+/***************************************************************************//**
+ * @file sl_simple_led.h
+ * @brief Host stand-in for the simple_led component.
+ ******************************************************************************/
+#ifndef SL_SIMPLE_LED_H
+#define SL_SIMPLE_LED_H
+
+#include <stdint.h>
+
+typedef uint8_t sl_led_state_t;
+
+#define SL_LED_CURRENT_STATE_OFF 0U
+#define SL_LED_CURRENT_STATE_ON  1U
+
+typedef struct {
+  sl_led_state_t state;
+  uint32_t toggles;
+} sl_led_t;
+
+void sl_led_turn_on(const sl_led_t *led_handle);
+void sl_led_turn_off(const sl_led_t *led_handle);
+void sl_led_toggle(const sl_led_t *led_handle);
+sl_led_state_t sl_led_get_state(const sl_led_t *led_handle);
+
+#endif // SL_SIMPLE_LED_H
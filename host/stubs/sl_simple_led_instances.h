@@ -0,0 +1,15 @@
+/***************************************************************************//**
+ * @file sl_simple_led_instances.h
+ * @brief Host stand-in for the generated simple_led instances.
+ ******************************************************************************/
+#ifndef SL_SIMPLE_LED_INSTANCES_H
+#define SL_SIMPLE_LED_INSTANCES_H
+
+#include "sl_simple_led.h"
+
+extern const sl_led_t sl_led_led1;
+
+#define SL_SIMPLE_LED_COUNT        1
+#define SL_SIMPLE_LED_INSTANCE(n)  (&sl_led_led1)
+
+#endif // SL_SIMPLE_LED_INSTANCES_H
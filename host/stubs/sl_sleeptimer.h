@@ -0,0 +1,50 @@
+/***************************************************************************//**
+ * @file sl_sleeptimer.h
+ * @brief Host stand-in for the sleeptimer service.
+ *
+ * Ticks run at the 32.768 kHz rate of the target's LFXO and are derived
+ * from the simulation clock in sim_bt.c. Timers fire from sim_advance(),
+ * in place of the sleeptimer interrupt.
+ ******************************************************************************/
+#ifndef SL_SLEEPTIMER_H
+#define SL_SLEEPTIMER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sl_status.h"
+
+typedef struct sl_sleeptimer_timer_handle sl_sleeptimer_timer_handle_t;
+
+typedef void (*sl_sleeptimer_timer_callback_t)(
+    sl_sleeptimer_timer_handle_t *handle, void *data);
+
+struct sl_sleeptimer_timer_handle {
+  void *callback_data;
+  uint8_t priority;
+  uint16_t option_flags;
+  struct sl_sleeptimer_timer_handle *next;
+  sl_sleeptimer_timer_callback_t callback;
+  uint32_t timeout_periodic;
+  uint64_t due;                // host: tick the timer expires at
+};
+
+uint32_t sl_sleeptimer_get_timer_frequency(void);
+uint32_t sl_sleeptimer_get_tick_count(void);
+uint64_t sl_sleeptimer_get_tick_count64(void);
+uint32_t sl_sleeptimer_ms_to_tick(uint16_t time_ms);
+
+sl_status_t sl_sleeptimer_start_timer_ms(sl_sleeptimer_timer_handle_t *handle,
+                                         uint32_t timeout_ms,
+                                         sl_sleeptimer_timer_callback_t callback,
+                                         void *callback_data,
+                                         uint8_t priority,
+                                         uint16_t option_flags);
+sl_status_t sl_sleeptimer_start_periodic_timer_ms(
+    sl_sleeptimer_timer_handle_t *handle, uint32_t timeout_ms,
+    sl_sleeptimer_timer_callback_t callback, void *callback_data,
+    uint8_t priority, uint16_t option_flags);
+sl_status_t sl_sleeptimer_stop_timer(sl_sleeptimer_timer_handle_t *handle);
+sl_status_t sl_sleeptimer_is_timer_running(sl_sleeptimer_timer_handle_t *handle,
+                                           bool *running);
+
+#endif // SL_SLEEPTIMER_H
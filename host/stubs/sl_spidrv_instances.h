@@ -0,0 +1,12 @@
+/***************************************************************************//**
+ * @file sl_spidrv_instances.h
+ * @brief Host stand-in for the generated SPIDRV instances.
+ ******************************************************************************/
+#ifndef SL_SPIDRV_INSTANCES_H
+#define SL_SPIDRV_INSTANCES_H
+
+#include "spidrv.h"
+
+extern SPIDRV_Handle_t sl_spidrv_spi_inst_handle;
+
+#endif // SL_SPIDRV_INSTANCES_H
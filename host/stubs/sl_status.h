@@ -0,0 +1,35 @@
+/***************************************************************************//**
+ * @file sl_status.h
+ * @brief Host stand-in for the Gecko SDK status codes.
+ ******************************************************************************/
+#ifndef SL_STATUS_H
+#define SL_STATUS_H
+
+#include <stdint.h>
+
+typedef uint32_t sl_status_t;
+
+#define SL_STATUS_OK                    ((sl_status_t)0x0000)
+#define SL_STATUS_FAIL                  ((sl_status_t)0x0001)
+#define SL_STATUS_INVALID_STATE         ((sl_status_t)0x0002)
+#define SL_STATUS_NOT_READY             ((sl_status_t)0x0003)
+#define SL_STATUS_BUSY                  ((sl_status_t)0x0004)
+#define SL_STATUS_IN_PROGRESS           ((sl_status_t)0x0005)
+#define SL_STATUS_ABORT                 ((sl_status_t)0x0006)
+#define SL_STATUS_TIMEOUT               ((sl_status_t)0x0007)
+#define SL_STATUS_PERMISSION            ((sl_status_t)0x0008)
+#define SL_STATUS_NOT_SUPPORTED         ((sl_status_t)0x000F)
+#define SL_STATUS_NOT_INITIALIZED       ((sl_status_t)0x0011)
+#define SL_STATUS_NO_MORE_RESOURCE      ((sl_status_t)0x001A)
+#define SL_STATUS_EMPTY                 ((sl_status_t)0x001B)
+#define SL_STATUS_FULL                  ((sl_status_t)0x001C)
+#define SL_STATUS_WOULD_OVERFLOW        ((sl_status_t)0x001D)
+#define SL_STATUS_INVALID_PARAMETER     ((sl_status_t)0x0021)
+#define SL_STATUS_NULL_POINTER          ((sl_status_t)0x0022)
+#define SL_STATUS_INVALID_HANDLE        ((sl_status_t)0x0025)
+#define SL_STATUS_INVALID_RANGE         ((sl_status_t)0x0028)
+#define SL_STATUS_INVALID_SIGNATURE     ((sl_status_t)0x002C)
+#define SL_STATUS_NOT_FOUND             ((sl_status_t)0x002D)
+#define SL_STATUS_IO                    ((sl_status_t)0x002F)
+
+#endif // SL_STATUS_H
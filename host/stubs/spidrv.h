@@ -0,0 +1,31 @@
+/***************************************************************************//**
+ * @file spidrv.h
+ * @brief Host stand-in for the SPIDRV driver (subset).
+ *
+ * Transfers go to the RHS2116 model in sim_rhs2116.c. They complete from
+ * sim_advance() or sim_rhs2116_run(), the way the DMA completion interrupt
+ * would on target.
+ ******************************************************************************/
+#ifndef SPIDRV_H
+#define SPIDRV_H
+
+#include "ecode.h"
+
+#define ECODE_EMDRV_SPIDRV_OK               ECODE_OK
+#define ECODE_EMDRV_SPIDRV_ILLEGAL_HANDLE   (ECODE_EMDRV_SPIDRV_BASE | 0x01u)
+#define ECODE_EMDRV_SPIDRV_PARAM_ERROR      (ECODE_EMDRV_SPIDRV_BASE | 0x03u)
+#define ECODE_EMDRV_SPIDRV_BUSY             (ECODE_EMDRV_SPIDRV_BASE | 0x04u)
+#define ECODE_EMDRV_SPIDRV_ABORTED          (ECODE_EMDRV_SPIDRV_BASE | 0x06u)
+
+typedef struct SPIDRV_HandleData SPIDRV_HandleData_t;
+typedef SPIDRV_HandleData_t *SPIDRV_Handle_t;
+
+typedef void (*SPIDRV_Callback_t)(struct SPIDRV_HandleData *handle,
+                                  Ecode_t transferStatus,
+                                  int itemsTransferred);
+
+Ecode_t SPIDRV_MTransfer(SPIDRV_Handle_t handle, const void *txBuffer,
+                         void *rxBuffer, int count,
+                         SPIDRV_Callback_t callback);
+
+#endif // SPIDRV_H
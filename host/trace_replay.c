@@ -0,0 +1,406 @@
+/***************************************************************************//**
+ * @file trace_replay.c
+ * @brief Replay a Bluetooth event trace (trace.h) through the host
+ *        simulation build, or capture one from a simulated session.
+ *
+ *   trace_replay [--max] file
+ *   trace_replay --capture [file]
+ *
+ * Replay boots the application on erased NVM3, without a boot event of its
+ * own, and hands every event of the trace to sl_bt_on_event(), storing
+ * written values in the GATT database first as the stack does. Between
+ * events the simulation clock moves by the recorded gap, running the
+ * superloop every ms; with --max the events follow each other with one
+ * superloop pass in between. Either way the clock then runs on for
+ * REPLAY_SETTLE_MS so that deferred work such as the settings store
+ * finishes.
+ *
+ * Prints the handling time of each event ID and the final state: the
+ * settings stored, the stimulation engine, the sessions and a CRC-32 of
+ * every nodeTx reply sent, which a replay of the same trace on the same
+ * firmware always reproduces.
+ *
+ * --capture runs a short scripted session instead, prints the same reply
+ * CRC, then reads the trace out over the trace characteristic from a
+ * second central and saves it to file (default trace.bin).
+ ******************************************************************************/
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "app.h"
+#include "byteorder.h"
+#include "cmd_proto.h"
+#include "config.h"
+#include "crc32.h"
+#include "gatt_db.h"
+#include "session.h"
+#include "settings_store.h"
+#include "sim.h"
+#include "stim.h"
+#include "trace.h"
+
+#define REPLAY_MAX_SIZE     (1u << 24)
+#define REPLAY_MAX_IDS      32
+#define REPLAY_STEP_NS      1000000ull  // 1 ms
+#define REPLAY_SETTLE_MS    (SETTINGS_STORE_MAX_DELAY_MS + 1000)
+
+typedef struct {
+	uint32_t id;
+	uint32_t count;
+	uint64_t totalNs;
+	uint64_t maxNs;
+} event_time_t;
+
+static event_time_t times[REPLAY_MAX_IDS];
+static size_t timeCount;
+static uint32_t replies;
+static uint32_t replyCrc;
+static FILE *out;
+static size_t traceBytes;
+
+static const struct {
+	uint32_t id;
+	const char *name;
+} names[] = {
+	{ sl_bt_evt_system_boot_id, "system_boot" },
+	{ sl_bt_evt_connection_opened_id, "connection_opened" },
+	{ sl_bt_evt_connection_closed_id, "connection_closed" },
+	{ sl_bt_evt_connection_parameters_id, "connection_parameters" },
+	{ sl_bt_evt_connection_phy_status_id, "connection_phy_status" },
+	{ sl_bt_evt_connection_data_length_id, "connection_data_length" },
+	{ sl_bt_evt_gatt_mtu_exchanged_id, "gatt_mtu_exchanged" },
+	{ sl_bt_evt_gatt_server_attribute_value_id, "attribute_value" },
+	{ sl_bt_evt_gatt_server_characteristic_status_id, "characteristic_status" },
+};
+
+static uint64_t nowNs(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static void onNotification(uint8_t connection, uint16_t characteristic,
+		const uint8_t *value, size_t len) {
+	if (characteristic == gattdb_node_tx) {
+		replyCrc = crc32(replyCrc, &connection, 1);
+		replyCrc = crc32(replyCrc, value, len);
+		replies++;
+	} else if (characteristic == gattdb_trace && out != NULL) {
+		fwrite(value, 1, len, out);
+		traceBytes += len;
+	}
+}
+
+static void run(uint64_t ms) {
+	for (uint64_t i = 0; i < ms; i++) {
+		sim_advance(REPLAY_STEP_NS);
+		app_process_action();
+	}
+}
+
+static void account(uint32_t id, uint64_t ns) {
+	size_t i = 0;
+
+	while (i < timeCount && times[i].id != id) {
+		i++;
+	}
+	if (i == timeCount) {
+		if (timeCount == REPLAY_MAX_IDS) {
+			return;
+		}
+		times[timeCount++].id = id;
+	}
+	times[i].count++;
+	times[i].totalNs += ns;
+	if (ns > times[i].maxNs) {
+		times[i].maxNs = ns;
+	}
+}
+
+static const sl_bt_evt_gatt_server_attribute_value_t* written(
+		const sl_bt_msg_t *evt) {
+	if (SL_BT_MSG_ID(evt->header) != sl_bt_evt_gatt_server_attribute_value_id) {
+		return NULL;
+	}
+	return &evt->data.evt_gatt_server_attribute_value;
+}
+
+static void store(const sl_bt_evt_gatt_server_attribute_value_t *av) {
+	// Unknown attributes are left to the handlers.
+	sl_bt_gatt_server_write_attribute_value(av->attribute, av->offset,
+			av->value.len, av->value.data);
+}
+
+static void dispatch(sl_bt_msg_t *evt) {
+	uint32_t id = SL_BT_MSG_ID(evt->header);
+	uint64_t start = nowNs();
+	sl_bt_on_event(evt);
+	account(id, nowNs() - start);
+}
+
+static void printState(void) {
+	cmd_settings_t settings;
+	char text[64];
+
+	sl_status_t sc = settings_store_load(&settings);
+	if (sc == SL_STATUS_OK) {
+		cmd_format_ascii(&settings, text, sizeof(text));
+		printf("settings stored: %s\n", text);
+	} else {
+		printf("settings stored: none (0x%04x)\n", (unsigned int) sc);
+	}
+	printf("stimulation: %s, %" PRIu32 " pulses delivered\n",
+			stim_is_running() ? "running" : "stopped", stim_pulses_delivered());
+	printf("sessions: %zu, controller %u; advertising %s\n", session_count(),
+			session_controller(), sim_is_advertising() ? "on" : "off");
+	printf("nodeTx replies: %" PRIu32 ", crc32 0x%08" PRIx32 "\n", replies,
+			replyCrc);
+	printf("nvm3: %zu writes, %zu bytes\n", sim_nvm3_writes(),
+			sim_nvm3_bytes());
+}
+
+static void printTimes(uint64_t wallNs, uint32_t events) {
+	printf("%-24s %8s %10s %10s\n", "event", "count", "mean us", "max us");
+	for (size_t i = 0; i < timeCount; i++) {
+		const char *name = NULL;
+		char hex[16];
+		for (size_t j = 0; j < sizeof(names) / sizeof(names[0]); j++) {
+			if (names[j].id == times[i].id) {
+				name = names[j].name;
+			}
+		}
+		if (name == NULL) {
+			snprintf(hex, sizeof(hex), "0x%08" PRIx32, times[i].id);
+			name = hex;
+		}
+		printf("%-24s %8" PRIu32 " %10.2f %10.2f\n", name, times[i].count,
+				times[i].totalNs / 1000.0 / times[i].count,
+				times[i].maxNs / 1000.0);
+	}
+	printf("%" PRIu32 " events in %.3f ms, %.0f events/s\n", events,
+			wallNs / 1e6, wallNs ? events * 1e9 / wallNs : 0.0);
+}
+
+// Parse the record at pos; returns the position after it, or 0 if it is
+// not whole.
+static size_t parse(const uint8_t *trace, size_t pos, size_t len,
+		uint64_t *delta, sl_bt_msg_t *evt) {
+	unsigned int shift = 0;
+	uint8_t byte;
+
+	*delta = 0;
+	do {
+		if (pos == len || shift >= 7 * TRACE_DELTA_MAX_SIZE) {
+			return 0;
+		}
+		byte = trace[pos++];
+		*delta |= (uint64_t) (byte & 0x7F) << shift;
+		shift += 7;
+	} while (byte & 0x80);
+	if (pos + 4 > len) {
+		return 0;
+	}
+	evt->header = get_le32(trace + pos);
+	size_t n = SL_BT_MSG_LEN(evt->header);
+	if (n > sizeof(evt->data) || pos + 4 + n > len) {
+		return 0;
+	}
+	memcpy(&evt->data, trace + pos + 4, n);
+	return pos + 4 + n;
+}
+
+// The stack has the whole value of a long write in the database before it
+// reports the first fragment; store the fragments that follow at.
+static size_t storeLongWrite(const uint8_t *trace, size_t at, size_t len,
+		const sl_bt_evt_gatt_server_attribute_value_t *first) {
+	sl_bt_msg_t evt;
+	uint64_t delta;
+	size_t next;
+
+	store(first);
+	while ((next = parse(trace, at, len, &delta, &evt)) != 0) {
+		const sl_bt_evt_gatt_server_attribute_value_t *av = written(&evt);
+		if (av == NULL || av->att_opcode != sl_bt_gatt_execute_write_request
+				|| av->attribute != first->attribute
+				|| av->connection != first->connection || av->offset == 0) {
+			break;
+		}
+		store(av);
+		at = next;
+	}
+	return at;
+}
+
+static int replay(const char *path, bool max) {
+	static uint8_t trace[REPLAY_MAX_SIZE];
+	FILE *in = fopen(path, "rb");
+	size_t len;
+
+	if (in == NULL) {
+		perror(path);
+		return 1;
+	}
+	len = fread(trace, 1, sizeof(trace), in);
+	fclose(in);
+	if (len < TRACE_HEADER_SIZE || get_le32(trace) != TRACE_MAGIC
+			|| trace[4] != TRACE_VERSION) {
+		fprintf(stderr, "%s: not a version %d trace\n", path, TRACE_VERSION);
+		return 1;
+	}
+	uint32_t hz = get_le32(trace + 8);
+	if (hz == 0) {
+		fprintf(stderr, "%s: no timer frequency\n", path);
+		return 1;
+	}
+	if (trace[5] & TRACE_FLAG_TRUNCATED) {
+		printf("%s: truncated, the buffer filled while recording\n", path);
+	}
+
+	sim_nvm3_erase();
+	sim_reset();
+	app_init();
+	sim_set_notification_sink(onNotification);
+
+	size_t pos = TRACE_HEADER_SIZE;
+	size_t stored = pos;        // long write fragments stored up to here
+	uint32_t events = 0;
+	uint64_t start = nowNs();
+	while (pos < len) {
+		sl_bt_msg_t evt;
+		uint64_t delta;
+		size_t next = parse(trace, pos, len, &delta, &evt);
+		if (next == 0) {
+			break;
+		}
+		pos = next;
+
+		if (max) {
+			app_process_action();
+		} else {
+			uint64_t ns = delta * 1000000000ull / hz;
+			for (; ns > REPLAY_STEP_NS; ns -= REPLAY_STEP_NS) {
+				sim_advance(REPLAY_STEP_NS);
+				app_process_action();
+			}
+			sim_advance(ns);
+			app_process_action();
+		}
+		if (events == 0
+				&& SL_BT_MSG_ID(evt.header) != sl_bt_evt_system_boot_id) {
+			printf("%s: does not start at boot, replaying from a fresh one\n",
+					path);
+			sim_boot();
+		}
+		const sl_bt_evt_gatt_server_attribute_value_t *av = written(&evt);
+		if (av && av->att_opcode == sl_bt_gatt_execute_write_request) {
+			if (pos > stored) {
+				stored = storeLongWrite(trace, pos, len, av);
+			}
+		} else if (av) {
+			store(av);
+		}
+		dispatch(&evt);
+		events++;
+	}
+	uint64_t wall = nowNs() - start;
+	if (pos < len) {
+		printf("%s: %zu bytes after the last whole event ignored\n", path,
+				len - pos);
+	}
+	run(REPLAY_SETTLE_MS);
+
+	printf("replayed %s at %s speed\n", path, max ? "maximum" : "recorded");
+	printTimes(wall, events);
+	printState();
+	return 0;
+}
+
+static void set(uint8_t connection, uint16_t mask, const uint32_t *values,
+		size_t fragment) {
+	cmd_t cmd = { .opcode = CMD_OP_SET, .mask = mask };
+	uint8_t data[NODE_RX_MAX_SIZE];
+
+	memcpy(cmd.value, values, sizeof(cmd.value));
+	size_t len = cmd_encode_set(0, &cmd, data, sizeof(data));
+	if (fragment) {
+		sim_gatt_long_write(connection, gattdb_node_rx, data, len, fragment);
+	} else {
+		sim_gatt_write(connection, gattdb_node_rx, data, len);
+	}
+}
+
+static int capture(const char *path) {
+	static const char legacy[] = "_A150,F10,P300";
+	uint32_t values[CMD_FIELD_COUNT] = { 0 };
+
+	sim_nvm3_erase();
+	sim_reset();
+	app_init();
+	sim_set_notification_sink(onNotification);
+	sim_boot();
+	run(20);
+
+	uint8_t conn = sim_connect();
+	sim_negotiate(conn);
+	sim_subscribe(conn, gattdb_node_tx, sl_bt_gatt_server_notification);
+	run(30);
+	values[0] = 100;
+	values[1] = 20;
+	values[2] = 200;
+	set(conn, CMD_FIELD_AMPLITUDE | CMD_FIELD_FREQUENCY
+			| CMD_FIELD_PULSE_WIDTH, values, 0);
+	run(50);
+	values[1] = 40;
+	set(conn, CMD_FIELD_FREQUENCY, values, 8);
+	run(50);
+	sim_gatt_write(conn, gattdb_node_rx, (const uint8_t*) legacy,
+			sizeof(legacy) - 1);
+	sim_subscribe(conn, gattdb_acq_stream, sl_bt_gatt_server_notification);
+	run(200);
+	sim_subscribe(conn, gattdb_acq_stream, 0);
+	values[3] = 1;
+	set(conn, CMD_FIELD_GATE, values, 0);
+	run(20);
+	sim_disconnect(conn, 0x13);
+	run(100);
+	printf("captured session: nodeTx replies %" PRIu32 ", crc32 0x%08" PRIx32
+			"\n", replies, replyCrc);
+
+	out = fopen(path, "wb");
+	if (out == NULL) {
+		perror(path);
+		return 1;
+	}
+	conn = sim_connect();
+	sim_negotiate(conn);
+	sim_subscribe(conn, gattdb_trace, sl_bt_gatt_server_notification);
+	run(20);
+	fclose(out);
+	out = NULL;
+
+	trace_stats_t stats;
+	trace_get_stats(&stats);
+	printf("trace: %" PRIu32 " events, %" PRIu32 " bytes, %" PRIu32
+			" dropped; %zu bytes to %s\n", stats.events, stats.bytes,
+			stats.dropped, traceBytes, path);
+	return traceBytes == TRACE_HEADER_SIZE + stats.bytes ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+	if (argc >= 2 && strcmp(argv[1], "--capture") == 0) {
+		return capture(argc > 2 ? argv[2] : "trace.bin");
+	}
+	if (argc == 3 && strcmp(argv[1], "--max") == 0) {
+		return replay(argv[2], true);
+	}
+	if (argc == 2) {
+		return replay(argv[1], false);
+	}
+	fprintf(stderr, "usage: %s [--max] file\n       %s --capture [file]\n",
+			argv[0], argv[0]);
+	return 1;
+}
@@ -30,6 +30,7 @@
 #include "sl_component_catalog.h"
 #include "sl_system_init.h"
 #include "app.h"
+#include "prof.h"
 #if defined(SL_CATALOG_POWER_MANAGER_PRESENT)
 #include "sl_power_manager.h"
 #endif // SL_CATALOG_POWER_MANAGER_PRESENT
@@ -55,12 +56,14 @@ int main(void)
   sl_system_kernel_start();
 #else // SL_CATALOG_KERNEL_PRESENT
   while (1) {
+    PROF_BEGIN(loopStart);
     // Do not remove this call: Silicon Labs components process action routine
     // must be called from the super loop.
     sl_system_process_action();
 
     // Application process.
     app_process_action();
+    PROF_END(PROF_SUPERLOOP, loopStart);
 
 #if defined(SL_CATALOG_POWER_MANAGER_PRESENT)
     // Let the CPU go to sleep if the system allows it.
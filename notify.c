@@ -0,0 +1,250 @@
+/***************************************************************************//**
+ * @file notify.c
+ * @brief Coalesced GATT notifications and indications.
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "config.h"
+#include "dlog.h"
+#include "notify.h"
+#include "sl_bluetooth.h"
+
+#define NOTIFY_NO_CONNECTION 0
+
+typedef struct {
+	uint16_t characteristic; // 0 if unused
+	uint16_t len;
+	uint8_t value[NOTIFY_MAX_VALUE_SIZE];
+} notify_slot_t;
+
+typedef struct {
+	uint8_t connection;      // NOTIFY_NO_CONNECTION if unused
+	uint8_t notifyMask;      // slots with notifications enabled
+	uint8_t indicateMask;    // slots with indications enabled
+	uint8_t dirtyMask;       // slots changed since last sent
+	uint8_t confirmMask;     // slots with an indication awaiting confirmation
+} notify_client_t;
+
+_Static_assert(NOTIFY_MAX_CHARACTERISTICS <= 8,
+		"slot masks are 8 bits wide");
+
+static notify_slot_t slots[NOTIFY_MAX_CHARACTERISTICS];
+static notify_client_t clients[NOTIFY_MAX_CONNECTIONS];
+
+static int findSlot(uint16_t characteristic) {
+	for (int i = 0; i < NOTIFY_MAX_CHARACTERISTICS; i++) {
+		if (slots[i].characteristic == characteristic) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static notify_client_t* findClient(uint8_t connection, bool create) {
+	notify_client_t *free = NULL;
+	for (int i = 0; i < NOTIFY_MAX_CONNECTIONS; i++) {
+		if (clients[i].connection == connection) {
+			return &clients[i];
+		}
+		if (free == NULL && clients[i].connection == NOTIFY_NO_CONNECTION) {
+			free = &clients[i];
+		}
+	}
+	if (create && free != NULL) {
+		memset(free, 0, sizeof(*free));
+		free->connection = connection;
+		return free;
+	}
+	return NULL;
+}
+
+static void updateSubscription(
+		const sl_bt_evt_gatt_server_characteristic_status_t *status) {
+	int slot = findSlot(status->characteristic);
+	if (slot < 0) {
+		return;
+	}
+	uint8_t bit = (uint8_t) (1u << slot);
+
+	if (status->status_flags == sl_bt_gatt_server_confirmation) {
+		notify_client_t *client = findClient(status->connection, false);
+		if (client != NULL) {
+			client->confirmMask &= (uint8_t) ~bit;
+		}
+		return;
+	}
+	if (status->status_flags != sl_bt_gatt_server_client_config) {
+		return;
+	}
+
+	notify_client_t *client = findClient(status->connection,
+			status->client_config_flags != sl_bt_gatt_server_disable);
+	if (client == NULL) {
+		if (status->client_config_flags != sl_bt_gatt_server_disable) {
+			DLOG(DLOG_NOTIFY_NO_ROOM, status->connection);
+		}
+		return;
+	}
+	client->notifyMask &= (uint8_t) ~bit;
+	client->indicateMask &= (uint8_t) ~bit;
+	client->confirmMask &= (uint8_t) ~bit;
+	if (status->client_config_flags & sl_bt_gatt_server_notification) {
+		client->notifyMask |= bit;
+	} else if (status->client_config_flags & sl_bt_gatt_server_indication) {
+		client->indicateMask |= bit;
+	}
+	// A new subscriber gets the current state straight away.
+	if (slots[slot].len) {
+		client->dirtyMask |= bit;
+	} else {
+		client->dirtyMask &= (uint8_t) ~bit;
+	}
+}
+
+void notify_init(void) {
+	memset(slots, 0, sizeof(slots));
+	memset(clients, 0, sizeof(clients));
+}
+
+sl_status_t notify_register(uint16_t characteristic) {
+	int slot = findSlot(characteristic);
+	if (slot < 0) {
+		slot = findSlot(0);
+		if (slot < 0) {
+			return SL_STATUS_NO_MORE_RESOURCE;
+		}
+		slots[slot].characteristic = characteristic;
+		slots[slot].len = 0;
+	}
+	return SL_STATUS_OK;
+}
+
+void notify_on_event(const sl_bt_msg_t *evt) {
+	switch (SL_BT_MSG_ID(evt->header)) {
+	case sl_bt_evt_gatt_server_characteristic_status_id:
+		updateSubscription(&evt->data.evt_gatt_server_characteristic_status);
+		break;
+
+	case sl_bt_evt_connection_closed_id: {
+		notify_client_t *client = findClient(
+				evt->data.evt_connection_closed.connection, false);
+		if (client != NULL) {
+			client->connection = NOTIFY_NO_CONNECTION;
+		}
+		break;
+	}
+
+	default:
+		break;
+	}
+}
+
+sl_status_t notify_publish(uint16_t characteristic, const uint8_t *value,
+		size_t len) {
+	if (len > NOTIFY_MAX_VALUE_SIZE) {
+		return SL_STATUS_INVALID_PARAMETER;
+	}
+	int slot = findSlot(characteristic);
+	if (slot < 0) {
+		return SL_STATUS_NOT_FOUND;
+	}
+	memcpy(slots[slot].value, value, len);
+	slots[slot].len = (uint16_t) len;
+
+	uint8_t bit = (uint8_t) (1u << slot);
+	for (int i = 0; i < NOTIFY_MAX_CONNECTIONS; i++) {
+		if ((clients[i].notifyMask | clients[i].indicateMask) & bit) {
+			clients[i].dirtyMask |= bit;
+		}
+	}
+	return SL_STATUS_OK;
+}
+
+sl_status_t notify_send_to(uint8_t connection, uint16_t characteristic,
+		const uint8_t *value, size_t len) {
+	int slot = findSlot(characteristic);
+	notify_client_t *client = findClient(connection, false);
+	sl_status_t sc;
+
+	if (slot < 0 || client == NULL) {
+		return SL_STATUS_NOT_FOUND;
+	}
+	uint8_t bit = (uint8_t) (1u << slot);
+	if (client->notifyMask & bit) {
+		return sl_bt_gatt_server_send_notification(connection, characteristic,
+				len, value);
+	}
+	if (!(client->indicateMask & bit)) {
+		return SL_STATUS_NOT_FOUND;
+	}
+	if (client->confirmMask & bit) {
+		return SL_STATUS_BUSY;
+	}
+	sc = sl_bt_gatt_server_send_indication(connection, characteristic, len,
+			value);
+	if (sc == SL_STATUS_OK) {
+		client->confirmMask |= bit;
+	}
+	return sc;
+}
+
+void notify_process_action(void) {
+	// More writes from the same connection event may still be queued;
+	// wait for them so only the final state goes out.
+	if (sl_bt_event_pending()) {
+		return;
+	}
+
+	for (int i = 0; i < NOTIFY_MAX_CONNECTIONS; i++) {
+		notify_client_t *client = &clients[i];
+		// Indications wait for the previous one to be confirmed.
+		uint8_t ready = client->dirtyMask
+				& (client->notifyMask
+						| (client->indicateMask & ~client->confirmMask));
+		if (client->connection == NOTIFY_NO_CONNECTION || ready == 0) {
+			continue;
+		}
+		for (int s = 0; s < NOTIFY_MAX_CHARACTERISTICS; s++) {
+			uint8_t bit = (uint8_t) (1u << s);
+			sl_status_t sc;
+			if (!(ready & bit)) {
+				continue;
+			}
+			if (client->notifyMask & bit) {
+				sc = sl_bt_gatt_server_send_notification(client->connection,
+						slots[s].characteristic, slots[s].len, slots[s].value);
+			} else {
+				sc = sl_bt_gatt_server_send_indication(client->connection,
+						slots[s].characteristic, slots[s].len, slots[s].value);
+				if (sc == SL_STATUS_OK) {
+					client->confirmMask |= bit;
+				}
+			}
+			if (sc == SL_STATUS_OK) {
+				client->dirtyMask &= (uint8_t) ~bit;
+			} else if (sc != SL_STATUS_NO_MORE_RESOURCE) {
+				// Out of TX buffers is retried next pass; anything else is not.
+				client->dirtyMask &= (uint8_t) ~bit;
+				DLOG(DLOG_NOTIFY_FAILED, client->connection, sc);
+			}
+		}
+	}
+}
+
+size_t notify_subscribers(uint16_t characteristic) {
+	int slot = findSlot(characteristic);
+	size_t n = 0;
+	if (slot < 0) {
+		return 0;
+	}
+	for (int i = 0; i < NOTIFY_MAX_CONNECTIONS; i++) {
+		if (clients[i].connection != NOTIFY_NO_CONNECTION
+				&& ((clients[i].notifyMask | clients[i].indicateMask)
+						& (1u << slot))) {
+			n++;
+		}
+	}
+	return n;
+}
@@ -0,0 +1,77 @@
+/***************************************************************************//**
+ * @file notify.h
+ * @brief Coalesced GATT notifications and indications.
+ *
+ * Tracks which connections have enabled notifications or indications on
+ * each characteristic registered with notify_register(); subscriptions to
+ * any other characteristic are left to the module that sends on it.
+ * notify_publish() only stores the latest
+ * value and marks it dirty; notify_process_action() sends it once the
+ * stack has no more events queued, so a burst of writes delivered in one
+ * connection event produces a single notification per subscriber, carrying
+ * the final state. Indications are sent one at a time per connection and
+ * the next waits for the client's confirmation.
+ ******************************************************************************/
+#ifndef NOTIFY_H
+#define NOTIFY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sl_bluetooth.h"
+#include "sl_status.h"
+
+/**
+ * @brief Forget all subscribers and values. Call once.
+ */
+void notify_init(void);
+
+/**
+ * @brief Track subscriptions to a characteristic this module publishes.
+ *        Call after notify_init(), before the first connection.
+ *
+ * @return SL_STATUS_OK, also if already registered, or
+ *         SL_STATUS_NO_MORE_RESOURCE if NOTIFY_MAX_CHARACTERISTICS are
+ *         registered.
+ */
+sl_status_t notify_register(uint16_t characteristic);
+
+/**
+ * @brief Pass every stack event. Tracks subscriptions, confirmations and
+ *        closed connections.
+ */
+void notify_on_event(const sl_bt_msg_t *evt);
+
+/**
+ * @brief Set the value subscribers of a characteristic should receive.
+ *
+ * The previous value, if not yet sent, is replaced.
+ *
+ * @return SL_STATUS_OK, SL_STATUS_INVALID_PARAMETER if the value exceeds
+ *         NOTIFY_MAX_VALUE_SIZE, or SL_STATUS_NOT_FOUND if the
+ *         characteristic is not registered.
+ */
+sl_status_t notify_publish(uint16_t characteristic, const uint8_t *value,
+		size_t len);
+
+/**
+ * @brief Send a value to one subscriber now, bypassing the coalesced
+ *        value the others receive. For replies meant for a single client.
+ *
+ * @return The stack's status, SL_STATUS_NOT_FOUND if the connection is not
+ *         subscribed, or SL_STATUS_BUSY while an indication to it awaits
+ *         confirmation.
+ */
+sl_status_t notify_send_to(uint8_t connection, uint16_t characteristic,
+		const uint8_t *value, size_t len);
+
+/**
+ * @brief Send pending values. Call from the superloop.
+ */
+void notify_process_action(void);
+
+/**
+ * @brief Number of connections subscribed to a characteristic.
+ */
+size_t notify_subscribers(uint16_t characteristic);
+
+#endif // NOTIFY_H
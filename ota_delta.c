@@ -0,0 +1,334 @@
+/***************************************************************************//**
+ * @file ota_delta.c
+ * @brief Delta OTA: rebuild an update from a patch against the running image.
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "btl_interface.h"
+#include "byteorder.h"
+#include "config.h"
+#include "dlog.h"
+#include "em_device.h"
+#include "gatt_db.h"
+#include "ota_delta.h"
+#include "ota_patch.h"
+#include "session.h"
+#include "sl_bluetooth.h"
+#include "sl_sleeptimer.h"
+
+#define OTA_DELTA_NO_CONNECTION 0
+#define OTA_DELTA_FIFO_MASK     (OTA_DELTA_FIFO_SIZE - 1u)
+
+_Static_assert((OTA_DELTA_FIFO_SIZE & OTA_DELTA_FIFO_MASK) == 0,
+		"OTA_DELTA_FIFO_SIZE must be a power of two");
+
+static ota_delta_state_t state;
+static ota_delta_status_t status;
+static uint16_t detail;
+
+// Patch bytes received and consumed since BEGIN; the FIFO holds the
+// difference.
+static uint32_t received;
+static uint32_t consumed;
+static bool commitRequested;
+
+static uint8_t connection = OTA_DELTA_NO_CONNECTION;    // updating
+static uint8_t subscriber = OTA_DELTA_NO_CONNECTION;
+static bool reportDue;
+static volatile bool rebootDue;
+
+#ifdef gattdb_ota_delta
+static ota_patch_t patch;
+static BootloaderStorageSlot_t slot;
+static int32_t storageError;
+static uint8_t fifo[OTA_DELTA_FIFO_SIZE];
+static sl_sleeptimer_timer_handle_t rebootTimer;
+
+static void onRebootTimer(sl_sleeptimer_timer_handle_t *handle, void *data) {
+	(void) handle;
+	(void) data;
+	rebootDue = true;
+}
+
+static void fail(ota_delta_status_t why, uint16_t what) {
+	state = OTA_DELTA_STATE_FAILED;
+	status = why;
+	detail = what;
+	reportDue = true;
+	DLOG(DLOG_OTA_DELTA_FAILED, why, what, consumed);
+}
+
+// Write rebuilt GBL bytes to the slot, erasing pages as they are reached.
+// Flash takes whole words, so the final write is padded with 0xFF.
+static bool writeSlot(uint32_t offset, const uint8_t *data, size_t len,
+		void *ctx) {
+	(void) ctx;
+	size_t whole = len & ~(size_t) 3;
+	uint8_t last[4];
+
+	storageError = BOOTLOADER_OK;
+	if (offset + len > slot.length) {
+		return false;
+	}
+	if (whole) {
+		storageError = bootloader_eraseWriteStorage(OTA_DELTA_SLOT, offset,
+				(uint8_t*) data, whole);
+	}
+	if (storageError == BOOTLOADER_OK && whole < len) {
+		memset(last, 0xFF, sizeof(last));
+		memcpy(last, data + whole, len - whole);
+		storageError = bootloader_eraseWriteStorage(OTA_DELTA_SLOT,
+				offset + (uint32_t) whole, last, sizeof(last));
+	}
+	return storageError == BOOTLOADER_OK;
+}
+
+static void patchFailed(ota_patch_status_t sc) {
+	if (sc == OTA_PATCH_ERR_WRITE) {
+		fail(OTA_DELTA_ERR_STORAGE, (uint16_t) storageError);
+	} else {
+		fail(OTA_DELTA_ERR_PATCH, (uint16_t) sc);
+	}
+}
+
+static void begin(uint8_t conn) {
+	// The running application is the base: from its vector table to the
+	// end of flash, of which the patch header says how much is used.
+	uintptr_t image = (uintptr_t) SCB->VTOR;
+	int32_t rc;
+
+	sl_sleeptimer_stop_timer(&rebootTimer);
+	rebootDue = false;
+	connection = conn;
+	received = consumed = 0;
+	commitRequested = false;
+	state = OTA_DELTA_STATE_RECEIVING;
+	status = OTA_DELTA_OK;
+	detail = 0;
+	reportDue = true;
+
+	ota_patch_init(&patch, (const uint8_t*) image,
+			(uint32_t) (FLASH_BASE + FLASH_SIZE - image), writeSlot, NULL);
+	bootloader_init();
+	rc = bootloader_getStorageSlotInfo(OTA_DELTA_SLOT, &slot);
+	if (rc != BOOTLOADER_OK) {
+		fail(OTA_DELTA_ERR_STORAGE, (uint16_t) rc);
+		return;
+	}
+	DLOG(DLOG_OTA_DELTA_BEGIN, conn, slot.length);
+}
+
+static void append(const uint8_t *data, size_t len) {
+	if (len > OTA_DELTA_FIFO_SIZE - (received - consumed)) {
+		fail(OTA_DELTA_ERR_OVERFLOW, (uint16_t) len);
+		return;
+	}
+	for (size_t i = 0; i < len; i++) {
+		fifo[(received + i) & OTA_DELTA_FIFO_MASK] = data[i];
+	}
+	received += (uint32_t) len;
+}
+
+static void handleWrite(uint8_t conn, const uint8_t *data, size_t len) {
+	if (len == 0) {
+		return;
+	}
+	// Observers may watch an update but not start, feed or stop one.
+	if (session_role(conn) != SESSION_ROLE_CONTROLLER) {
+		DLOG(DLOG_SESSION_WRITE_DENIED, gattdb_ota_delta, conn);
+		return;
+	}
+	switch (data[0]) {
+	case OTA_DELTA_OP_BEGIN:
+		begin(conn);
+		if (state == OTA_DELTA_STATE_RECEIVING) {
+			append(data + 1, len - 1);
+		}
+		break;
+
+	case OTA_DELTA_OP_DATA:
+		if (state != OTA_DELTA_STATE_RECEIVING || commitRequested) {
+			if (state != OTA_DELTA_STATE_FAILED) {
+				fail(OTA_DELTA_ERR_STATE, data[0]);
+			}
+			break;
+		}
+		append(data + 1, len - 1);
+		break;
+
+	case OTA_DELTA_OP_COMMIT:
+		if (state == OTA_DELTA_STATE_RECEIVING) {
+			commitRequested = true;
+		} else if (state != OTA_DELTA_STATE_FAILED) {
+			fail(OTA_DELTA_ERR_STATE, data[0]);
+		}
+		break;
+
+	case OTA_DELTA_OP_ABORT:
+		if (state == OTA_DELTA_STATE_RECEIVING) {
+			DLOG(DLOG_OTA_DELTA_ABORTED, consumed);
+		}
+		sl_sleeptimer_stop_timer(&rebootTimer);
+		state = OTA_DELTA_STATE_IDLE;
+		status = OTA_DELTA_OK;
+		detail = 0;
+		reportDue = true;
+		break;
+
+	default:
+		fail(OTA_DELTA_ERR_STATE, data[0]);
+		break;
+	}
+}
+
+// The whole patch is applied: check the rebuilt GBL and arm the install.
+static void complete(void) {
+	ota_patch_status_t sc = ota_patch_finish(&patch);
+	int32_t rc;
+
+	if (sc != OTA_PATCH_OK) {
+		patchFailed(sc);
+		return;
+	}
+	rc = bootloader_verifyImage(OTA_DELTA_SLOT, NULL);
+	if (rc == BOOTLOADER_OK) {
+		rc = bootloader_setImageToBootload(OTA_DELTA_SLOT);
+	}
+	if (rc != BOOTLOADER_OK) {
+		fail(OTA_DELTA_ERR_IMAGE, (uint16_t) rc);
+		return;
+	}
+	state = OTA_DELTA_STATE_DONE;
+	reportDue = true;
+	DLOG(DLOG_OTA_DELTA_DONE, ota_patch_target_size(&patch), consumed);
+	// Leave time for the status notification to go out.
+	sl_sleeptimer_start_timer_ms(&rebootTimer, OTA_DELTA_REBOOT_DELAY_MS,
+			onRebootTimer, NULL, 0, 0);
+}
+
+static void apply(void) {
+	uint32_t queued = received - consumed;
+	uint32_t at = consumed & OTA_DELTA_FIFO_MASK;
+	size_t n = queued < OTA_DELTA_FIFO_SIZE - at ?
+			queued : OTA_DELTA_FIFO_SIZE - at;
+	size_t used = 0;
+	ota_patch_status_t sc;
+
+	if (n == 0 && !ota_patch_pending(&patch)) {
+		if (commitRequested) {
+			complete();
+		}
+		return;
+	}
+	sc = ota_patch_feed(&patch, fifo + at, n, &used, OTA_DELTA_STEP_BYTES);
+	if (used) {
+		consumed += (uint32_t) used;
+		reportDue = true;
+	}
+	if (sc != OTA_PATCH_OK) {
+		patchFailed(sc);
+	} else if (ota_patch_target_size(&patch) > slot.length) {
+		fail(OTA_DELTA_ERR_STORAGE, 0);
+	}
+}
+
+static void report(void) {
+	uint8_t value[OTA_DELTA_STATUS_SIZE];
+	sl_status_t sc;
+
+	// Further writes may be queued; report once they are taken in.
+	if (!reportDue || subscriber == OTA_DELTA_NO_CONNECTION
+			|| sl_bt_event_pending()) {
+		return;
+	}
+	value[0] = (uint8_t) state;
+	value[1] = (uint8_t) status;
+	put_le16(value + 2, detail);
+	put_le32(value + 4, consumed);
+	sc = sl_bt_gatt_server_send_notification(subscriber, gattdb_ota_delta,
+			sizeof(value), value);
+	// Out of TX buffers is retried next pass.
+	if (sc != SL_STATUS_NO_MORE_RESOURCE) {
+		reportDue = false;
+	}
+}
+#endif // gattdb_ota_delta
+
+void ota_delta_init(void) {
+	state = OTA_DELTA_STATE_IDLE;
+	status = OTA_DELTA_OK;
+	detail = 0;
+	received = consumed = 0;
+	commitRequested = false;
+	connection = subscriber = OTA_DELTA_NO_CONNECTION;
+	reportDue = false;
+	rebootDue = false;
+}
+
+void ota_delta_on_event(const sl_bt_msg_t *evt) {
+#ifdef gattdb_ota_delta
+	switch (SL_BT_MSG_ID(evt->header)) {
+	case sl_bt_evt_gatt_server_characteristic_status_id: {
+		const sl_bt_evt_gatt_server_characteristic_status_t *cs =
+				&evt->data.evt_gatt_server_characteristic_status;
+		if (cs->characteristic != gattdb_ota_delta
+				|| cs->status_flags != sl_bt_gatt_server_client_config) {
+			break;
+		}
+		if (cs->client_config_flags & sl_bt_gatt_server_notification) {
+			subscriber = cs->connection;
+			reportDue = true;
+		} else if (cs->connection == subscriber) {
+			subscriber = OTA_DELTA_NO_CONNECTION;
+		}
+		break;
+	}
+
+	case sl_bt_evt_gatt_server_attribute_value_id: {
+		const sl_bt_evt_gatt_server_attribute_value_t *av =
+				&evt->data.evt_gatt_server_attribute_value;
+		if (av->attribute == gattdb_ota_delta) {
+			handleWrite(av->connection, av->value.data, av->value.len);
+		}
+		break;
+	}
+
+	case sl_bt_evt_connection_closed_id: {
+		uint8_t conn = evt->data.evt_connection_closed.connection;
+		if (conn == subscriber) {
+			subscriber = OTA_DELTA_NO_CONNECTION;
+		}
+		// An update needs its central; a verified one installs regardless.
+		if (conn == connection && state == OTA_DELTA_STATE_RECEIVING) {
+			DLOG(DLOG_OTA_DELTA_ABORTED, consumed);
+			state = OTA_DELTA_STATE_IDLE;
+		}
+		break;
+	}
+
+	default:
+		break;
+	}
+#else
+	(void) evt;
+#endif
+}
+
+void ota_delta_process_action(void) {
+#ifdef gattdb_ota_delta
+	if (state == OTA_DELTA_STATE_RECEIVING) {
+		apply();
+	}
+	report();
+	if (rebootDue) {
+		rebootDue = false;
+		bootloader_rebootAndInstall();
+	}
+#endif
+}
+
+ota_delta_state_t ota_delta_state(void) {
+	return state;
+}
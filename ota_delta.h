@@ -0,0 +1,91 @@
+/***************************************************************************//**
+ * @file ota_delta.h
+ * @brief Delta OTA: rebuild an update from a patch against the running image.
+ *
+ * A full in-place update sends the whole application GBL. When the central
+ * knows which release a device runs, it can send a patch made with
+ * host/ota_diff instead, which is usually a small fraction of the GBL.
+ * The patch is applied by ota_patch.h against the running application,
+ * read in place from flash at the vector table, and the new GBL is written
+ * straight into bootloader storage slot 0. The engine checks the CRC of
+ * the rebuilt GBL, the bootloader then verifies it as it would a GBL sent
+ * in full, and the device reboots into the bootloader to install it.
+ *
+ * Each write to the ota_delta characteristic is an opcode followed by its
+ * payload. Only the session controller may write; writes from observers
+ * are ignored, so they cannot disturb an update in progress:
+ *
+ *   OTA_DELTA_OP_BEGIN   start of the patch, may be empty; restarts any
+ *                        update in progress
+ *   OTA_DELTA_OP_DATA    next piece of the patch
+ *   OTA_DELTA_OP_COMMIT  the patch is complete; verify and install
+ *   OTA_DELTA_OP_ABORT   drop the update
+ *
+ * Writes land in a FIFO of OTA_DELTA_FIFO_SIZE bytes that the superloop
+ * drains at OTA_DELTA_STEP_BYTES of flash per pass. The central keeps no
+ * more than OTA_DELTA_FIFO_SIZE bytes beyond the consumed count it was
+ * last notified; a write that does not fit fails the update.
+ *
+ * Status notification, little-endian:
+ *
+ *   offset  size  field
+ *   0       1     ota_delta_state_t
+ *   1       1     ota_delta_status_t
+ *   2       2     detail: ota_patch_status_t, or the bootloader error
+ *   4       4     patch bytes consumed
+ *
+ * On OTA_DELTA_STATE_FAILED nothing is installed and the running image is
+ * untouched; the central falls back to sending the full GBL with the
+ * standard in-place OTA, which rewrites the slot from the start.
+ ******************************************************************************/
+#ifndef OTA_DELTA_H
+#define OTA_DELTA_H
+
+#include <stdint.h>
+#include "sl_bluetooth.h"
+
+#define OTA_DELTA_OP_BEGIN      0x01
+#define OTA_DELTA_OP_DATA       0x02
+#define OTA_DELTA_OP_COMMIT     0x03
+#define OTA_DELTA_OP_ABORT      0x04
+
+#define OTA_DELTA_STATUS_SIZE   8
+
+typedef enum {
+	OTA_DELTA_STATE_IDLE = 0,
+	OTA_DELTA_STATE_RECEIVING,
+	OTA_DELTA_STATE_DONE,       ///< Verified; rebooting to install.
+	OTA_DELTA_STATE_FAILED,
+} ota_delta_state_t;
+
+typedef enum {
+	OTA_DELTA_OK = 0,
+	OTA_DELTA_ERR_STATE,        ///< Opcode not valid now, or unknown.
+	OTA_DELTA_ERR_PATCH,        ///< Engine error, in detail.
+	OTA_DELTA_ERR_OVERFLOW,     ///< Write did not fit the FIFO.
+	OTA_DELTA_ERR_STORAGE,      ///< Slot too small, or a write failed.
+	OTA_DELTA_ERR_IMAGE,        ///< The bootloader rejected the GBL.
+} ota_delta_status_t;
+
+/**
+ * @brief Reset to idle.
+ */
+void ota_delta_init(void);
+
+/**
+ * @brief Handle ota_delta writes, subscriptions and disconnects.
+ */
+void ota_delta_on_event(const sl_bt_msg_t *evt);
+
+/**
+ * @brief Apply queued patch data and report progress. Call from the
+ *        superloop.
+ */
+void ota_delta_process_action(void);
+
+/**
+ * @brief Current state.
+ */
+ota_delta_state_t ota_delta_state(void);
+
+#endif // OTA_DELTA_H
@@ -0,0 +1,283 @@
+/***************************************************************************//**
+ * @file ota_patch.c
+ * @brief Streaming engine that rebuilds an update from a delta patch.
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "byteorder.h"
+#include "crc32.h"
+#include "ota_patch.h"
+
+// Varint fields of the operations, in the order they arrive.
+enum {
+	FIELD_LEN = 0,
+	FIELD_OFFSET,
+	FIELD_RUNS,
+	FIELD_SKIP,
+	FIELD_COUNT,
+	FIELD_NONE,             // all fields in, writing target
+};
+
+static inline size_t min_size(size_t a, size_t b) {
+	return a < b ? a : b;
+}
+
+static bool flush(ota_patch_t *p) {
+	if (p->outLen == 0) {
+		return true;
+	}
+	p->crc = crc32(p->crc, p->out, p->outLen);
+	if (!p->write(p->written - p->outLen, p->out, p->outLen, p->ctx)) {
+		p->status = OTA_PATCH_ERR_WRITE;
+		return false;
+	}
+	p->outLen = 0;
+	return true;
+}
+
+static void emit(ota_patch_t *p, const uint8_t *data, size_t n) {
+	while (n && p->status == OTA_PATCH_OK) {
+		size_t take = min_size(n, OTA_PATCH_BUFFER_SIZE - p->outLen);
+		memcpy(p->out + p->outLen, data, take);
+		p->outLen += (uint32_t) take;
+		p->written += (uint32_t) take;
+		data += take;
+		n -= take;
+		if (p->outLen == OTA_PATCH_BUFFER_SIZE) {
+			flush(p);
+		}
+	}
+}
+
+static void parseHeader(ota_patch_t *p) {
+	const uint8_t *h = p->header;
+	uint32_t baseCrc = get_le32(h + 12);
+
+	p->baseSize = get_le32(h + 8);
+	p->targetSize = get_le32(h + 16);
+	p->targetCrc = get_le32(h + 20);
+	if (get_le32(h) != OTA_PATCH_MAGIC || h[4] != OTA_PATCH_VERSION) {
+		p->status = OTA_PATCH_ERR_HEADER;
+	} else if (p->baseSize > p->baseMax
+			|| crc32(0, p->base, p->baseSize) != baseCrc) {
+		p->status = OTA_PATCH_ERR_BASE;
+	}
+}
+
+// Start reading varint fields, from first to the last of the operation.
+static void readFields(ota_patch_t *p, uint8_t first) {
+	p->field = first;
+	p->shift = 0;
+	p->value = 0;
+}
+
+static uint8_t lastField(uint8_t op, uint8_t field) {
+	if (field >= FIELD_SKIP) {
+		return FIELD_COUNT;
+	}
+	switch (op) {
+	case OTA_PATCH_OP_COPY:
+		return FIELD_OFFSET;
+	case OTA_PATCH_OP_PATCH:
+		return FIELD_RUNS;
+	default:
+		return FIELD_LEN;
+	}
+}
+
+// A varint field is complete in p->value.
+static void storeField(ota_patch_t *p) {
+	uint32_t v = p->value;
+
+	switch (p->field) {
+	case FIELD_LEN:
+		if (v == 0 || v > p->targetSize - p->written) {
+			p->status = OTA_PATCH_ERR_FORMAT;
+		}
+		p->len = v;
+		break;
+	case FIELD_OFFSET: {
+		int64_t src = (int64_t) p->next + (int32_t) ((v >> 1) ^ (0u - (v & 1)));
+		if (src < 0 || src + p->len > p->baseSize) {
+			p->status = OTA_PATCH_ERR_FORMAT;
+			break;
+		}
+		p->src = (uint32_t) src;
+		p->next = p->src + p->len;
+		break;
+	}
+	case FIELD_RUNS:
+		p->runs = v;
+		break;
+	case FIELD_SKIP:
+		p->gap = v;
+		break;
+	case FIELD_COUNT:
+		if (v == 0 || (uint64_t) p->gap + v > p->len) {
+			p->status = OTA_PATCH_ERR_FORMAT;
+		}
+		p->runLeft = v;
+		p->runs--;
+		break;
+	default:
+		break;
+	}
+	p->field = p->field == lastField(p->op, p->field) ? FIELD_NONE : p->field + 1;
+	p->shift = 0;
+	p->value = 0;
+}
+
+void ota_patch_init(ota_patch_t *patch, const uint8_t *base, uint32_t base_max,
+		ota_patch_write_fn_t write, void *ctx) {
+	memset(patch, 0, sizeof(*patch));
+	patch->base = base;
+	patch->baseMax = base_max;
+	patch->write = write;
+	patch->ctx = ctx;
+}
+
+ota_patch_status_t ota_patch_feed(ota_patch_t *patch, const uint8_t *data,
+		size_t len, size_t *used, size_t budget) {
+	ota_patch_t *p = patch;
+	const uint8_t *in = data;
+	const uint8_t *end = data + len;
+	size_t produced = 0;
+
+	while (p->status == OTA_PATCH_OK) {
+		if (p->headerLen < OTA_PATCH_HEADER_SIZE) {
+			size_t n = min_size((size_t) (end - in),
+					OTA_PATCH_HEADER_SIZE - p->headerLen);
+			if (n == 0) {
+				break;
+			}
+			memcpy(p->header + p->headerLen, in, n);
+			p->headerLen += (uint32_t) n;
+			in += n;
+			if (p->headerLen == OTA_PATCH_HEADER_SIZE) {
+				parseHeader(p);
+			}
+			continue;
+		}
+
+		if (p->op == 0) {
+			if (in == end) {
+				break;
+			}
+			if (p->written == p->targetSize) {
+				// Nothing may follow the last operation.
+				p->status = OTA_PATCH_ERR_FORMAT;
+				break;
+			}
+			p->op = *in++;
+			if (p->op < OTA_PATCH_OP_COPY || p->op > OTA_PATCH_OP_LITERAL) {
+				p->status = OTA_PATCH_ERR_FORMAT;
+				break;
+			}
+			p->runs = p->gap = p->runLeft = 0;
+			readFields(p, FIELD_LEN);
+			continue;
+		}
+
+		if (p->field != FIELD_NONE) {
+			if (in == end) {
+				break;
+			}
+			uint8_t b = *in++;
+			if (p->shift == 28 && (b & 0xF0)) {
+				p->status = OTA_PATCH_ERR_FORMAT;
+				break;
+			}
+			p->value |= (uint32_t) (b & 0x7F) << p->shift;
+			p->shift += 7;
+			if (!(b & 0x80)) {
+				storeField(p);
+			}
+			continue;
+		}
+
+		if (p->len == 0) {
+			if (p->runs || p->runLeft) {
+				p->status = OTA_PATCH_ERR_FORMAT;
+				break;
+			}
+			p->op = 0;
+			continue;
+		}
+		if (produced >= budget) {
+			break;
+		}
+
+		size_t room = budget - produced;
+		size_t n;
+		if (p->op == OTA_PATCH_OP_LITERAL
+				|| (p->op == OTA_PATCH_OP_PATCH && p->runLeft && p->gap == 0)) {
+			// New bytes from the patch; in a run they replace base bytes.
+			n = min_size(min_size(p->op == OTA_PATCH_OP_LITERAL ?
+					p->len : p->runLeft, room), (size_t) (end - in));
+			if (n == 0) {
+				break;
+			}
+			emit(p, in, n);
+			in += n;
+			if (p->op == OTA_PATCH_OP_PATCH) {
+				p->runLeft -= (uint32_t) n;
+				p->src += (uint32_t) n;
+			}
+		} else if (p->op == OTA_PATCH_OP_PATCH && p->runLeft == 0 && p->runs) {
+			readFields(p, FIELD_SKIP);
+			continue;
+		} else {
+			// Base bytes: a COPY, or a PATCH up to its next run or its end.
+			bool toRun = p->op == OTA_PATCH_OP_PATCH && p->runLeft;
+			n = min_size(toRun ? p->gap : p->len, room);
+			emit(p, p->base + p->src, n);
+			p->src += (uint32_t) n;
+			if (toRun) {
+				p->gap -= (uint32_t) n;
+			}
+		}
+		p->len -= (uint32_t) n;
+		produced += n;
+	}
+
+	if (used != NULL) {
+		*used = (size_t) (in - data);
+	}
+	return p->status;
+}
+
+bool ota_patch_pending(const ota_patch_t *patch) {
+	const ota_patch_t *p = patch;
+
+	if (p->status != OTA_PATCH_OK || p->op == 0 || p->field != FIELD_NONE
+			|| p->len == 0) {
+		return false;
+	}
+	return p->op == OTA_PATCH_OP_COPY
+			|| (p->op == OTA_PATCH_OP_PATCH
+					&& (p->runLeft ? p->gap != 0 : p->runs == 0));
+}
+
+ota_patch_status_t ota_patch_finish(ota_patch_t *patch) {
+	ota_patch_t *p = patch;
+
+	if (p->status != OTA_PATCH_OK) {
+		return p->status;
+	}
+	if (p->headerLen < OTA_PATCH_HEADER_SIZE || p->op != 0
+			|| p->written != p->targetSize) {
+		p->status = OTA_PATCH_ERR_TARGET;
+		return p->status;
+	}
+	if (flush(p) && p->crc != p->targetCrc) {
+		p->status = OTA_PATCH_ERR_TARGET;
+	}
+	return p->status;
+}
+
+uint32_t ota_patch_target_size(const ota_patch_t *patch) {
+	return patch->headerLen == OTA_PATCH_HEADER_SIZE ? patch->targetSize : 0;
+}
@@ -0,0 +1,143 @@
+/***************************************************************************//**
+ * @file ota_patch.h
+ * @brief Streaming engine that rebuilds an update from a delta patch.
+ *
+ * A patch describes a target file (the new GBL) in terms of a base image
+ * (the application that is running, read in place from flash), so an
+ * update only carries what changed. The engine is fed the patch in pieces
+ * of any size and writes the target strictly in order through a callback,
+ * a buffer at a time, so it can rebuild straight into a download slot.
+ * host/ota_diff produces patches.
+ *
+ * Patch, multi-byte header fields little-endian:
+ *
+ *   offset  size  field
+ *   0       4     OTA_PATCH_MAGIC, "MCDP"
+ *   4       1     OTA_PATCH_VERSION
+ *   5       3     reserved, 0
+ *   8       4     base size
+ *   12      4     base CRC-32
+ *   16      4     target size
+ *   20      4     target CRC-32
+ *   24            operations, until target size bytes have been written
+ *
+ * Operations start with an opcode byte; numbers are LEB128 varints and
+ * offsets zigzag coded. Each base offset is relative to where the previous
+ * COPY or PATCH ended, so runs of code that moved together cost one byte.
+ *
+ *   COPY     len, offset          len base bytes
+ *   PATCH    len, offset, runs,   len base bytes with runs replaced; each
+ *            runs x (skip, n,     run skips from the end of the previous
+ *            n bytes)             one and carries its n new bytes
+ *   LITERAL  len, len bytes       new bytes
+ *
+ * PATCH covers code that moved and had its branch and address constants
+ * changed by the relink, which is most of the difference between builds.
+ ******************************************************************************/
+#ifndef OTA_PATCH_H
+#define OTA_PATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define OTA_PATCH_MAGIC         0x5044434Du     // "MCDP"
+#define OTA_PATCH_VERSION       1
+#define OTA_PATCH_HEADER_SIZE   24
+#define OTA_PATCH_BUFFER_SIZE   256             // output write size
+
+#define OTA_PATCH_OP_COPY       0x01
+#define OTA_PATCH_OP_PATCH      0x02
+#define OTA_PATCH_OP_LITERAL    0x03
+
+typedef enum {
+	OTA_PATCH_OK = 0,
+	OTA_PATCH_ERR_HEADER,       ///< Not a patch, or an unknown version.
+	OTA_PATCH_ERR_BASE,         ///< Base is not the image the patch is for.
+	OTA_PATCH_ERR_FORMAT,       ///< Bad opcode, varint or range.
+	OTA_PATCH_ERR_WRITE,        ///< The write callback failed.
+	OTA_PATCH_ERR_TARGET,       ///< Target incomplete or CRC mismatch.
+} ota_patch_status_t;
+
+/**
+ * @brief Write target bytes at offset; offsets only grow.
+ *
+ * @return false to stop with OTA_PATCH_ERR_WRITE.
+ */
+typedef bool (*ota_patch_write_fn_t)(uint32_t offset, const uint8_t *data,
+		size_t len, void *ctx);
+
+/**
+ * @brief Engine state. Treat as opaque.
+ */
+typedef struct {
+	const uint8_t *base;
+	uint32_t baseMax;
+	ota_patch_write_fn_t write;
+	void *ctx;
+	ota_patch_status_t status;
+	uint8_t header[OTA_PATCH_HEADER_SIZE];
+	uint32_t headerLen;
+	uint32_t baseSize;
+	uint32_t targetSize;
+	uint32_t targetCrc;
+	// Operation being decoded
+	uint8_t op;
+	uint8_t field;          // varint being read
+	uint8_t shift;
+	uint32_t value;
+	uint32_t len;           // bytes of the operation left to write
+	uint32_t src;           // next base offset
+	uint32_t runs;          // PATCH runs not started
+	uint32_t gap;           // base bytes before the current run
+	uint32_t runLeft;       // new bytes left in the current run
+	uint32_t next;          // base offset the next operation is relative to
+	// Output
+	uint8_t out[OTA_PATCH_BUFFER_SIZE];
+	uint32_t outLen;
+	uint32_t written;       // target bytes produced, buffered or not
+	uint32_t crc;
+} ota_patch_t;
+
+/**
+ * @brief Start rebuilding a target.
+ *
+ * @param[in] base Base image; the patch header says how much of it is used.
+ * @param[in] base_max Bytes readable at base.
+ */
+void ota_patch_init(ota_patch_t *patch, const uint8_t *base, uint32_t base_max,
+		ota_patch_write_fn_t write, void *ctx);
+
+/**
+ * @brief Apply the next piece of the patch, writing at most budget bytes
+ *        of target.
+ *
+ * A COPY can produce much more than it consumes. The engine stops after
+ * about budget bytes, keeping its place, so flash writes can be spread
+ * over several calls; call again with the unconsumed rest, or with no
+ * data while ota_patch_pending() is true.
+ *
+ * @param[out] used Bytes of data consumed.
+ * @return OTA_PATCH_OK or the first error; after an error every call
+ *         returns it.
+ */
+ota_patch_status_t ota_patch_feed(ota_patch_t *patch, const uint8_t *data,
+		size_t len, size_t *used, size_t budget);
+
+/**
+ * @brief True while the engine has target bytes to write that need no
+ *        more patch data.
+ */
+bool ota_patch_pending(const ota_patch_t *patch);
+
+/**
+ * @brief Flush the target and check its size and CRC.
+ */
+ota_patch_status_t ota_patch_finish(ota_patch_t *patch);
+
+/**
+ * @brief Target size from the header, 0 until the header is in.
+ */
+uint32_t ota_patch_target_size(const ota_patch_t *patch);
+
+#endif // OTA_PATCH_H
@@ -0,0 +1,247 @@
+/***************************************************************************//**
+ * @file power.c
+ * @brief Energy mode requirements, residency counters and a charge estimate.
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "byteorder.h"
+#include "config.h"
+#include "dlog.h"
+#include "em_core.h"
+#include "gatt_db.h"
+#include "power.h"
+#include "sl_power_manager.h"
+#include "sl_sleeptimer.h"
+
+#ifdef gattdb_power_report
+_Static_assert(POWER_REPORT_MAX_SIZE >= POWER_REPORT_SIZE,
+		"power report characteristic must hold the record");
+#endif
+
+// Typical current of each state; the radio and engine add to the EM state.
+// Advertising depends on the interval, see power_advertising().
+static uint32_t stateNa[POWER_STATE_COUNT] = {
+	[POWER_STATE_EM0] = POWER_EM0_NA,
+	[POWER_STATE_EM1] = POWER_EM1_NA,
+	[POWER_STATE_EM2] = POWER_EM2_NA,
+	[POWER_STATE_STIM] = POWER_STIM_NA,
+	[POWER_STATE_CONNECTED] = POWER_CONNECTED_NA,
+};
+
+static uint64_t bootTick;
+static uint64_t stateTicks[POWER_STATE_COUNT];
+// Charge of the closed spans, nA x ticks. Below 2^64 for over a decade.
+static uint64_t chargeNaTicks;
+static uint64_t stateSince[POWER_STATE_COUNT];
+static uint8_t activeStates;
+static uint8_t holders;
+static uint8_t connections;
+static sl_power_manager_em_transition_event_handle_t transitionHandle;
+static sl_sleeptimer_timer_handle_t reportTimer;
+static volatile bool reportDue;
+
+_Static_assert(POWER_STATE_COUNT <= 8, "state mask is 8 bits wide");
+
+// Call with interrupts masked.
+static void setState(power_state_t state, bool on, uint64_t now) {
+	uint8_t bit = (uint8_t) (1u << state);
+	if (on == !!(activeStates & bit)) {
+		return;
+	}
+	if (on) {
+		stateSince[state] = now;
+		activeStates |= bit;
+	} else {
+		stateTicks[state] += now - stateSince[state];
+		chargeNaTicks += (now - stateSince[state]) * stateNa[state];
+		activeStates &= (uint8_t) ~bit;
+	}
+}
+
+static void setStateAtomic(power_state_t state, bool on) {
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_ATOMIC();
+	setState(state, on, sl_sleeptimer_get_tick_count64());
+	CORE_EXIT_ATOMIC();
+}
+
+static power_state_t emState(sl_power_manager_em_t em) {
+	switch (em) {
+	case SL_POWER_MANAGER_EM0:
+		return POWER_STATE_EM0;
+	case SL_POWER_MANAGER_EM1:
+		return POWER_STATE_EM1;
+	default:
+		return POWER_STATE_EM2;
+	}
+}
+
+// Called by the power manager with interrupts masked.
+static void onTransition(sl_power_manager_em_t from, sl_power_manager_em_t to) {
+	uint64_t now = sl_sleeptimer_get_tick_count64();
+	setState(emState(from), false, now);
+	setState(emState(to), true, now);
+}
+
+static void onReportTimer(sl_sleeptimer_timer_handle_t *handle, void *data) {
+	(void) handle;
+	(void) data;
+	reportDue = true;
+}
+
+static void publish(void) {
+#ifdef gattdb_power_report
+	uint8_t record[POWER_REPORT_SIZE];
+	size_t len = power_encode(record, sizeof(record));
+	sl_status_t sc = sl_bt_gatt_server_write_attribute_value(
+			gattdb_power_report, 0, len, record);
+	if (sc != SL_STATUS_OK) {
+		DLOG(DLOG_POWER_REPORT_FAILED, sc);
+	}
+#endif
+}
+
+void power_init(void) {
+	static const sl_power_manager_em_transition_event_info_t transitions = {
+		.event_mask = SL_POWER_MANAGER_EVENT_TRANSITION_ENTERING_EM0
+				| SL_POWER_MANAGER_EVENT_TRANSITION_ENTERING_EM1
+				| SL_POWER_MANAGER_EVENT_TRANSITION_ENTERING_EM2
+				| SL_POWER_MANAGER_EVENT_TRANSITION_ENTERING_EM3,
+		.on_event = onTransition,
+	};
+
+	memset(stateTicks, 0, sizeof(stateTicks));
+	chargeNaTicks = 0;
+	activeStates = 0;
+	holders = 0;
+	connections = 0;
+	reportDue = false;
+	bootTick = sl_sleeptimer_get_tick_count64();
+	// app_init() runs in EM0.
+	setState(POWER_STATE_EM0, true, bootTick);
+	sl_power_manager_subscribe_em_transition_event(&transitionHandle,
+			&transitions);
+}
+
+void power_hold(power_client_t client) {
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_ATOMIC();
+	if (!(holders & client)) {
+		holders |= client;
+		sl_power_manager_add_em_requirement(SL_POWER_MANAGER_EM1);
+		if (client == POWER_CLIENT_STIM) {
+			setState(POWER_STATE_STIM, true, sl_sleeptimer_get_tick_count64());
+		}
+	}
+	CORE_EXIT_ATOMIC();
+}
+
+void power_release(power_client_t client) {
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_ATOMIC();
+	if (holders & client) {
+		holders &= (uint8_t) ~client;
+		sl_power_manager_remove_em_requirement(SL_POWER_MANAGER_EM1);
+		if (client == POWER_CLIENT_STIM) {
+			setState(POWER_STATE_STIM, false, sl_sleeptimer_get_tick_count64());
+		}
+	}
+	CORE_EXIT_ATOMIC();
+}
+
+void power_advertising(uint16_t interval) {
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_ATOMIC();
+	uint64_t now = sl_sleeptimer_get_tick_count64();
+	// Close the span at the old interval before the current changes.
+	setState(POWER_STATE_ADVERTISING, false, now);
+	if (interval) {
+		// nC per event over interval x 625 us.
+		stateNa[POWER_STATE_ADVERTISING] = (uint32_t) ((uint64_t)
+				POWER_ADV_EVENT_NC * 1600 / interval);
+		setState(POWER_STATE_ADVERTISING, true, now);
+	}
+	CORE_EXIT_ATOMIC();
+}
+
+void power_on_event(const sl_bt_msg_t *evt) {
+	switch (SL_BT_MSG_ID(evt->header)) {
+	case sl_bt_evt_connection_opened_id:
+		connections++;
+		setStateAtomic(POWER_STATE_CONNECTED, true);
+		publish();
+		sl_sleeptimer_start_periodic_timer_ms(&reportTimer,
+				POWER_REPORT_INTERVAL_MS, onReportTimer, NULL, 0, 0);
+		break;
+
+	case sl_bt_evt_connection_closed_id:
+		if (connections) {
+			connections--;
+		}
+		if (connections == 0) {
+			setStateAtomic(POWER_STATE_CONNECTED, false);
+			sl_sleeptimer_stop_timer(&reportTimer);
+			reportDue = false;
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+void power_process_action(void) {
+	if (reportDue) {
+		reportDue = false;
+		publish();
+	}
+}
+
+void power_get(power_stats_t *stats) {
+	uint64_t ticks[POWER_STATE_COUNT];
+	uint64_t now;
+	uint32_t hz = sl_sleeptimer_get_timer_frequency();
+	CORE_DECLARE_IRQ_STATE;
+
+	CORE_ENTER_ATOMIC();
+	now = sl_sleeptimer_get_tick_count64();
+	uint64_t charge = chargeNaTicks;
+	for (int i = 0; i < POWER_STATE_COUNT; i++) {
+		ticks[i] = stateTicks[i];
+		if (activeStates & (1u << i)) {
+			ticks[i] += now - stateSince[i];
+			charge += (now - stateSince[i]) * stateNa[i];
+		}
+	}
+	stats->holders = holders;
+	CORE_EXIT_ATOMIC();
+
+	for (int i = 0; i < POWER_STATE_COUNT; i++) {
+		stats->residencyMs[i] = ticks[i] * 1000 / hz;
+	}
+	uint64_t uptime = now - bootTick;
+	stats->uptimeMs = uptime * 1000 / hz;
+	stats->chargeNah = charge / ((uint64_t) hz * 3600);
+	stats->averageNa = uptime ? (uint32_t) (charge / uptime) : 0;
+}
+
+size_t power_encode(uint8_t *out, size_t size) {
+	power_stats_t stats;
+
+	if (size < POWER_REPORT_SIZE) {
+		return 0;
+	}
+	power_get(&stats);
+	memset(out, 0, POWER_REPORT_SIZE);
+	out[0] = POWER_REPORT_VERSION;
+	out[1] = stats.holders;
+	put_le32(out + 4, (uint32_t) stats.uptimeMs);
+	for (int i = 0; i < POWER_STATE_COUNT; i++) {
+		put_le32(out + 8 + 4 * i, (uint32_t) stats.residencyMs[i]);
+	}
+	put_le32(out + 32, (uint32_t) stats.chargeNah);
+	put_le32(out + 36, stats.averageNa);
+	return POWER_REPORT_SIZE;
+}
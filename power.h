@@ -0,0 +1,121 @@
+/***************************************************************************//**
+ * @file power.h
+ * @brief Energy mode requirements, residency counters and a charge estimate.
+ *
+ * The device sleeps in EM2 whenever nothing needs the high-frequency
+ * clocks. Modules that do (the pulse engine while a train runs) hold an
+ * EM1 requirement through power_hold() only for as long as they need it.
+ *
+ * Time spent in each energy mode is taken from the power manager's
+ * transition events, and time with a pulse train running, advertising or
+ * connected from the pulse engine, adv_policy.c and stack events. Weighted
+ * with the typical currents in config.h this gives an estimate of the
+ * charge drawn since boot, published on the power report characteristic
+ * when the GATT database has one.
+ ******************************************************************************/
+#ifndef POWER_H
+#define POWER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sl_bluetooth.h"
+
+/**
+ * Modules that can hold an EM1 requirement. Bit flags; each module holds
+ * at most one requirement however often it calls power_hold().
+ */
+typedef enum {
+	POWER_CLIENT_STIM = 0x01,   ///< Pulse engine timers and LDMA.
+	POWER_CLIENT_RHS2116 = 0x02, ///< SPI transfers to the RHS2116.
+	POWER_CLIENT_ACQ = 0x04,    ///< Acquisition sweep clock.
+	POWER_CLIENT_DLOG = 0x08,   ///< Log bytes in the VCOM USART.
+	POWER_CLIENT_TRACE = 0x10,  ///< Trace bytes in the VCOM USART.
+} power_client_t;
+
+/**
+ * Power report record, little-endian:
+ *
+ *   offset  size  field
+ *   0       1     POWER_REPORT_VERSION
+ *   1       1     power_client_t mask of the current EM1 holders
+ *   2       2     reserved
+ *   4       4     time since boot, ms
+ *   8       4     time in EM0, ms
+ *   12      4     time in EM1, ms
+ *   16      4     time in EM2, ms
+ *   20      4     time with a pulse train running, ms
+ *   24      4     time advertising, ms
+ *   28      4     time connected, ms
+ *   32      4     estimated charge since boot, nAh
+ *   36      4     estimated average current since boot, nA
+ *
+ * Times wrap after 49 days.
+ */
+#define POWER_REPORT_VERSION    1
+#define POWER_REPORT_SIZE       40
+
+typedef enum {
+	POWER_STATE_EM0 = 0,
+	POWER_STATE_EM1,
+	POWER_STATE_EM2,
+	POWER_STATE_STIM,
+	POWER_STATE_ADVERTISING,
+	POWER_STATE_CONNECTED,
+	POWER_STATE_COUNT,
+} power_state_t;
+
+typedef struct {
+	uint64_t uptimeMs;
+	uint64_t residencyMs[POWER_STATE_COUNT];
+	uint64_t chargeNah;     ///< Estimated charge since boot.
+	uint32_t averageNa;     ///< chargeNah over uptimeMs.
+	uint8_t holders;        ///< power_client_t mask.
+} power_stats_t;
+
+/**
+ * @brief Start the counters and subscribe to energy mode transitions.
+ *        Call once, before any other power function.
+ */
+void power_init(void);
+
+/**
+ * @brief Keep the device in EM1 or above for a client. Interrupt safe.
+ */
+void power_hold(power_client_t client);
+
+/**
+ * @brief Drop a client's EM1 requirement. Interrupt safe.
+ */
+void power_release(power_client_t client);
+
+/**
+ * @brief Record that advertising started at an interval (0.625 ms units),
+ *        or stopped if interval is 0.
+ */
+void power_advertising(uint16_t interval);
+
+/**
+ * @brief Pass every stack event; tracks connections and refreshes the
+ *        report while a central is connected.
+ */
+void power_on_event(const sl_bt_msg_t *evt);
+
+/**
+ * @brief Publish the report when its refresh timer has expired. Call from
+ *        the superloop.
+ */
+void power_process_action(void);
+
+/**
+ * @brief Counters and estimate up to now.
+ */
+void power_get(power_stats_t *stats);
+
+/**
+ * @brief Encode the power report record.
+ *
+ * @return POWER_REPORT_SIZE, or 0 if out is too small.
+ */
+size_t power_encode(uint8_t *out, size_t size);
+
+#endif // POWER_H
@@ -0,0 +1,280 @@
+/***************************************************************************//**
+ * @file prof.c
+ * @brief Cycle-count profiler for the event handler and superloop.
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "byteorder.h"
+#include "config.h"
+#include "dlog.h"
+#include "em_core.h"
+#include "gatt_db.h"
+#include "prof.h"
+#include "session.h"
+#include "sl_sleeptimer.h"
+
+#if PROF_ENABLE
+
+#define PROF_NO_CONNECTION      0xFF
+
+#ifdef gattdb_profile
+_Static_assert(PROF_MAX_SIZE >= PROF_RECORD_SIZE,
+		"profile characteristic must hold the record");
+#endif
+
+static prof_stats_t regions[PROF_REGION_COUNT];
+// Events in the order first seen.
+static prof_stats_t events[PROF_MAX_EVENTS];
+static size_t eventCount;
+
+static uint8_t connection = PROF_NO_CONNECTION;
+static sl_sleeptimer_timer_handle_t reportTimer;
+static volatile bool reportDue;
+// Next record of the report in progress: regions, then events.
+static size_t cursor;
+static bool reporting;
+
+static void clear(prof_stats_t *s, uint32_t key) {
+	memset(s, 0, sizeof(*s));
+	s->key = key;
+	s->min = UINT32_MAX;
+}
+
+static inline unsigned int bucket(uint32_t cycles) {
+	if (cycles < (1u << PROF_HIST_SHIFT)) {
+		return 0;
+	}
+	unsigned int b = 32u - (unsigned int) __builtin_clz(cycles)
+			- PROF_HIST_SHIFT;
+	return b < PROF_HIST_BUCKETS ? b : PROF_HIST_BUCKETS - 1;
+}
+
+static prof_stats_t* find(uint8_t kind, uint32_t key) {
+	if (kind == PROF_KIND_REGION) {
+		return key < PROF_REGION_COUNT ? &regions[key] : NULL;
+	}
+	for (size_t i = 0; i < eventCount; i++) {
+		if (events[i].key == key) {
+			return &events[i];
+		}
+	}
+	if (eventCount == PROF_MAX_EVENTS) {
+		return NULL;
+	}
+	clear(&events[eventCount], key);
+	return &events[eventCount++];
+}
+
+static void onReportTimer(sl_sleeptimer_timer_handle_t *handle, void *data) {
+	(void) handle;
+	(void) data;
+	reportDue = true;
+}
+
+void prof_init(void) {
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	prof_reset();
+	connection = PROF_NO_CONNECTION;
+	reportDue = false;
+	reporting = false;
+}
+
+void prof_reset(void) {
+	for (size_t i = 0; i < PROF_REGION_COUNT; i++) {
+		clear(&regions[i], (uint32_t) i);
+	}
+	eventCount = 0;
+	cursor = 0;
+}
+
+void prof_record(uint8_t kind, uint32_t key, uint32_t cycles) {
+	// The tasks of the kernel build record concurrently.
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_ATOMIC();
+	prof_stats_t *s = find(kind, key);
+	if (s == NULL) {
+		CORE_EXIT_ATOMIC();
+		return;
+	}
+	s->count++;
+	s->total += cycles;
+	if (cycles < s->min) {
+		s->min = cycles;
+	}
+	if (cycles > s->max) {
+		s->max = cycles;
+	}
+	uint16_t *h = &s->hist[bucket(cycles)];
+	if (*h != UINT16_MAX) {
+		(*h)++;
+	}
+	CORE_EXIT_ATOMIC();
+}
+
+bool prof_get(uint8_t kind, size_t index, prof_stats_t *stats) {
+	const prof_stats_t *s;
+
+	if (kind == PROF_KIND_REGION) {
+		if (index >= PROF_REGION_COUNT) {
+			return false;
+		}
+		s = &regions[index];
+	} else {
+		if (index >= eventCount) {
+			return false;
+		}
+		s = &events[index];
+	}
+	if (s->count == 0) {
+		return false;
+	}
+	*stats = *s;
+	return true;
+}
+
+size_t prof_encode(uint8_t kind, size_t index, uint8_t *out, size_t size) {
+	prof_stats_t s;
+
+	if (size < PROF_RECORD_SIZE || !prof_get(kind, index, &s)) {
+		return 0;
+	}
+	out[0] = PROF_RECORD_VERSION;
+	out[1] = kind;
+	put_le16(out + 2, (uint16_t) (SystemCoreClockGet() / 1000000u));
+	put_le32(out + 4, s.key);
+	put_le32(out + 8, s.count);
+	put_le32(out + 12, s.min);
+	put_le32(out + 16, s.max);
+	put_le32(out + 20, (uint32_t) (s.total / s.count));
+	for (size_t i = 0; i < PROF_HIST_BUCKETS; i++) {
+		put_le16(out + 24 + 2 * i, s.hist[i]);
+	}
+	return PROF_RECORD_SIZE;
+}
+
+void prof_on_event(const sl_bt_msg_t *evt) {
+#ifdef gattdb_profile
+	switch (SL_BT_MSG_ID(evt->header)) {
+	case sl_bt_evt_gatt_server_characteristic_status_id: {
+		const sl_bt_evt_gatt_server_characteristic_status_t *status =
+				&evt->data.evt_gatt_server_characteristic_status;
+		if (status->characteristic != gattdb_profile
+				|| status->status_flags != sl_bt_gatt_server_client_config) {
+			break;
+		}
+		if (status->client_config_flags & sl_bt_gatt_server_notification) {
+			connection = status->connection;
+			sl_sleeptimer_start_periodic_timer_ms(&reportTimer,
+					PROF_REPORT_INTERVAL_MS, onReportTimer, NULL, 0, 0);
+		} else if (status->connection == connection) {
+			connection = PROF_NO_CONNECTION;
+			sl_sleeptimer_stop_timer(&reportTimer);
+			reporting = false;
+		}
+		break;
+	}
+
+	case sl_bt_evt_gatt_server_attribute_value_id: {
+		const sl_bt_evt_gatt_server_attribute_value_t *av =
+				&evt->data.evt_gatt_server_attribute_value;
+		if (av->attribute != gattdb_profile) {
+			break;
+		}
+		if (session_role(av->connection) == SESSION_ROLE_CONTROLLER) {
+			prof_reset();
+		} else {
+			DLOG(DLOG_SESSION_WRITE_DENIED, gattdb_profile, av->connection);
+		}
+		break;
+	}
+
+	case sl_bt_evt_connection_closed_id:
+		if (evt->data.evt_connection_closed.connection == connection) {
+			connection = PROF_NO_CONNECTION;
+			sl_sleeptimer_stop_timer(&reportTimer);
+			reporting = false;
+		}
+		break;
+
+	default:
+		break;
+	}
+#else
+	(void) evt;
+#endif
+}
+
+void prof_process_action(void) {
+#ifdef gattdb_profile
+	uint8_t record[PROF_RECORD_SIZE];
+
+	if (reportDue) {
+		reportDue = false;
+		reporting = true;
+		cursor = 0;
+	}
+	while (reporting && connection != PROF_NO_CONNECTION) {
+		size_t len;
+		if (cursor < PROF_REGION_COUNT) {
+			len = prof_encode(PROF_KIND_REGION, cursor, record, sizeof(record));
+		} else if (cursor < PROF_REGION_COUNT + eventCount) {
+			len = prof_encode(PROF_KIND_EVENT, cursor - PROF_REGION_COUNT,
+					record, sizeof(record));
+		} else {
+			reporting = false;
+			break;
+		}
+		if (len) {
+			sl_status_t sc = sl_bt_gatt_server_send_notification(connection,
+					gattdb_profile, len, record);
+			if (sc == SL_STATUS_NO_MORE_RESOURCE) {
+				break;
+			}
+		}
+		cursor++;
+	}
+#endif
+}
+
+#else // PROF_ENABLE
+
+void prof_init(void) {
+}
+
+void prof_record(uint8_t kind, uint32_t key, uint32_t cycles) {
+	(void) kind;
+	(void) key;
+	(void) cycles;
+}
+
+void prof_reset(void) {
+}
+
+void prof_on_event(const sl_bt_msg_t *evt) {
+	(void) evt;
+}
+
+void prof_process_action(void) {
+}
+
+bool prof_get(uint8_t kind, size_t index, prof_stats_t *stats) {
+	(void) kind;
+	(void) index;
+	(void) stats;
+	return false;
+}
+
+size_t prof_encode(uint8_t kind, size_t index, uint8_t *out, size_t size) {
+	(void) kind;
+	(void) index;
+	(void) out;
+	(void) size;
+	return 0;
+}
+
+#endif // PROF_ENABLE
@@ -0,0 +1,141 @@
+/***************************************************************************//**
+ * @file prof.h
+ * @brief Cycle-count profiler for the event handler and superloop.
+ *
+ * With PROF_ENABLE set in config.h, instrumented code reads the Cortex-M33
+ * DWT cycle counter on entry and exit and adds the difference to the
+ * statistics of a region, or of a Bluetooth event ID: count, minimum,
+ * maximum, mean, and a histogram with one power-of-two bucket per octave.
+ * Times are inclusive, so an event handled inside a superloop iteration
+ * counts for both. With PROF_ENABLE at 0 the macros compile to nothing.
+ *
+ * While a central has notifications enabled on the profile characteristic,
+ * every PROF_REPORT_INTERVAL_MS each region and event in use is sent as one
+ * record; writing any value to the characteristic clears the statistics.
+ * The record needs an ATT MTU of at least PROF_RECORD_SIZE + 3.
+ * prof_report.py renders the records and compares them with a baseline.
+ *
+ * Record, little-endian:
+ *
+ *   offset  size  field
+ *   0       1     PROF_RECORD_VERSION
+ *   1       1     PROF_KIND_REGION or PROF_KIND_EVENT
+ *   2       2     core clock, MHz
+ *   4       4     prof_region_t, or SL_BT_MSG_ID() of the event
+ *   8       4     count
+ *   12      4     minimum, cycles
+ *   16      4     maximum, cycles
+ *   20      4     mean, cycles
+ *   24      2n    histogram: bucket 0 counts below 2^PROF_HIST_SHIFT
+ *                 cycles, bucket i from 2^(PROF_HIST_SHIFT + i - 1), the
+ *                 last one everything above; saturates at 65535
+ ******************************************************************************/
+#ifndef PROF_H
+#define PROF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+#include "sl_bluetooth.h"
+
+#define PROF_RECORD_VERSION     1
+#define PROF_KIND_REGION        0
+#define PROF_KIND_EVENT         1
+#define PROF_HIST_BUCKETS       16
+#define PROF_HIST_SHIFT         6       // bucket 0: under 64 cycles
+#define PROF_RECORD_SIZE        (24 + 2 * PROF_HIST_BUCKETS)
+
+typedef enum {
+	PROF_SUPERLOOP = 0,     ///< One main.c loop iteration, without sleep.
+	PROF_APP_PROCESS,       ///< app_process_action().
+	PROF_BT_EVENT,          ///< sl_bt_on_event(), any event.
+	PROF_NODE_RX,           ///< handleNodeRxChange().
+	PROF_ACQ_PROCESS,       ///< acq_process_action().
+	PROF_DETECT,            ///< One block through every armed detector.
+	PROF_REGION_COUNT,
+} prof_region_t;
+
+typedef struct {
+	uint32_t key;           ///< prof_region_t or event ID.
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t total;
+	uint16_t hist[PROF_HIST_BUCKETS];
+} prof_stats_t;
+
+#if PROF_ENABLE
+
+#include "em_device.h"
+
+#define PROF_CYCLES()           (DWT->CYCCNT)
+
+/**
+ * @brief Start timing; declares the variable that holds the start count.
+ */
+#define PROF_BEGIN(start)       uint32_t start = PROF_CYCLES()
+
+/**
+ * @brief Account the cycles since PROF_BEGIN(start) to a region.
+ */
+#define PROF_END(region, start) \
+	prof_record(PROF_KIND_REGION, (region), PROF_CYCLES() - (start))
+
+/**
+ * @brief Account the cycles since PROF_BEGIN(start) to a Bluetooth event.
+ */
+#define PROF_END_EVENT(id, start) \
+	prof_record(PROF_KIND_EVENT, (id), PROF_CYCLES() - (start))
+
+#else
+
+#define PROF_BEGIN(start)
+#define PROF_END(region, start)         ((void) 0)
+#define PROF_END_EVENT(id, start)       ((void) 0)
+
+#endif // PROF_ENABLE
+
+/**
+ * @brief Start the cycle counter and clear the statistics. Does nothing
+ *        without PROF_ENABLE.
+ */
+void prof_init(void);
+
+/**
+ * @brief Add one measurement. Call through the macros.
+ */
+void prof_record(uint8_t kind, uint32_t key, uint32_t cycles);
+
+/**
+ * @brief Clear the statistics.
+ */
+void prof_reset(void);
+
+/**
+ * @brief Pass every stack event; tracks the subscription to the profile
+ *        characteristic and resets on a write to it from the controller.
+ */
+void prof_on_event(const sl_bt_msg_t *evt);
+
+/**
+ * @brief Send the records when the report is due. Call from the superloop.
+ */
+void prof_process_action(void);
+
+/**
+ * @brief Statistics of a region, or of the n-th event seen.
+ *
+ * @return false if that region or event has no measurements.
+ */
+bool prof_get(uint8_t kind, size_t index, prof_stats_t *stats);
+
+/**
+ * @brief Encode the record of a region or the n-th event seen.
+ *
+ * @return PROF_RECORD_SIZE, or 0 if out is too small or there are no
+ *         measurements.
+ */
+size_t prof_encode(uint8_t kind, size_t index, uint8_t *out, size_t size);
+
+#endif // PROF_H
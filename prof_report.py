@@ -0,0 +1,154 @@
+#!/usr/bin/env python3
+"""Render profile records (prof.h) and compare them with a baseline.
+
+Reads records from a file (for example captured with host/build/prof_dump or
+saved from profile characteristic notifications) or stdin with '-'. Region
+names and the histogram layout come from prof.h, so render with the header
+of the firmware that sent the records; event names from the sl_bt_evt_*_id defines of a
+Bluetooth API header (the host stub by default; pass the SDK's sl_bt_api.h
+for a full table). The last record of each region or event wins, so a
+capture spanning several reports shows the latest one.
+
+    python3 prof_report.py prof.bin
+    python3 prof_report.py prof.bin --save base.json
+    python3 prof_report.py prof.bin --baseline base.json --threshold 10
+"""
+import argparse
+import json
+import re
+import struct
+import sys
+from pathlib import Path
+
+HERE = Path(__file__).resolve().parent
+VERSION = 1
+HEADER = struct.Struct('<BBHIIIII')
+KINDS = {0: 'region', 1: 'event'}
+REGION_RE = re.compile(r'typedef enum \{(.*?)\} prof_region_t;', re.S)
+EVENT_RE = re.compile(r'#define\s+sl_bt_evt_(\w+)_id\s+(0x[0-9a-fA-F]+)')
+
+
+def load_layout(path):
+    """Region names, histogram buckets and shift from prof.h."""
+    text = Path(path).read_text()
+    match = REGION_RE.search(text)
+    if not match:
+        sys.exit(f'no prof_region_t in {path}')
+    names = re.findall(r'^\s*PROF_(\w+)', match.group(1), re.M)
+    value = lambda name: int(re.search(rf'#define\s+{name}\s+(\d+)', text).group(1))
+    return ([n.lower() for n in names if n != 'REGION_COUNT'],
+            value('PROF_HIST_BUCKETS'), value('PROF_HIST_SHIFT'))
+
+
+def load_events(path):
+    try:
+        text = Path(path).read_text()
+    except OSError:
+        return {}
+    return {int(value, 16): name for name, value in EVENT_RE.findall(text)}
+
+
+def parse(data, buckets, shift):
+    """Yield one dict per record."""
+    size = HEADER.size + 2 * buckets
+    for off in range(0, len(data) - size + 1, size):
+        version, kind, mhz, key, count, lo, hi, mean = HEADER.unpack_from(data, off)
+        if version != VERSION or kind not in KINDS:
+            print(f'# record at {off} skipped', file=sys.stderr)
+            continue
+        hist = struct.unpack_from(f'<{buckets}H', data, off + HEADER.size)
+        yield dict(kind=KINDS[kind], key=key, mhz=mhz, count=count, min=lo,
+                   max=hi, mean=mean, hist=list(hist), shift=shift)
+    if len(data) % size:
+        print(f'# {len(data) % size} trailing bytes ignored', file=sys.stderr)
+
+
+def label(rec, regions, events):
+    if rec['kind'] == 'region':
+        key = rec['key']
+        return regions[key] if key < len(regions) else f'region {key}'
+    return events.get(rec['key'], f"0x{rec['key']:08x}")
+
+
+def bucket_range(i, shift, last):
+    lo = 0 if i == 0 else 1 << (shift + i - 1)
+    return f'{lo}+' if i == last else f'{lo}-{(1 << (shift + i)) - 1}'
+
+
+def show(records, regions, events, hist):
+    print(f"{'':36} {'count':>8} {'min':>8} {'mean':>8} {'max':>8}  cycles")
+    for rec in records:
+        us = lambda c: c / rec['mhz'] if rec['mhz'] else 0.0
+        name = f"{rec['kind'][0]} {label(rec, regions, events)}"
+        print(f"{name:36} {rec['count']:8} {rec['min']:8} {rec['mean']:8} "
+              f"{rec['max']:8}  ({us(rec['mean']):.1f} us mean, "
+              f"{us(rec['max']):.1f} us max)")
+        if not hist or not rec['count']:
+            continue
+        peak = max(rec['hist'])
+        last = len(rec['hist']) - 1
+        for i, n in enumerate(rec['hist']):
+            if n:
+                bar = '#' * max(1, round(40 * n / peak))
+                print(f"{'':6}{bucket_range(i, rec['shift'], last):>14} "
+                      f"{n:7} {bar}")
+
+
+def compare(records, baseline, threshold, regions, events):
+    """Print mean and max changes; return the regressions."""
+    regressions = []
+    print(f"\n{'':36} {'mean':>16} {'max':>16}  vs baseline")
+    for rec in records:
+        base = baseline.get(f"{rec['kind']}:{rec['key']}")
+        if base is None or not base['mean']:
+            continue
+        cells = []
+        for field in ('mean', 'max'):
+            change = 100.0 * (rec[field] - base[field]) / max(base[field], 1)
+            cells.append(f'{base[field]}->{rec[field]} {change:+.0f}%')
+            if change > threshold:
+                regressions.append((label(rec, regions, events), field, change))
+        name = f"{rec['kind'][0]} {label(rec, regions, events)}"
+        print(f'{name:36} {cells[0]:>16} {cells[1]:>16}')
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('input', nargs='?', default='-',
+                        help="record file, or '-' for stdin")
+    parser.add_argument('--prof-h', default=HERE / 'prof.h',
+                        help='record layout (default: prof.h next to this script)')
+    parser.add_argument('--events', default=HERE / 'host' / 'stubs' / 'sl_bluetooth.h',
+                        help='header with sl_bt_evt_*_id defines')
+    parser.add_argument('--no-hist', action='store_true', help='omit histograms')
+    parser.add_argument('--save', metavar='JSON', help='write the records as a baseline')
+    parser.add_argument('--baseline', metavar='JSON', help='compare with a saved baseline')
+    parser.add_argument('--threshold', type=float, default=10.0,
+                        help='percent growth of mean or max counted as a regression')
+    args = parser.parse_args()
+
+    data = sys.stdin.buffer.read() if args.input == '-' else Path(args.input).read_bytes()
+    regions, buckets, shift = load_layout(args.prof_h)
+    latest = {}
+    for rec in parse(data, buckets, shift):
+        latest[(rec['kind'], rec['key'])] = rec
+    if not latest:
+        sys.exit('no profile records')
+    records = sorted(latest.values(), key=lambda r: (r['kind'] != 'region', r['key']))
+    events = load_events(args.events)
+
+    if args.save:
+        Path(args.save).write_text(json.dumps(
+            {f"{r['kind']}:{r['key']}": r for r in records}, indent=1))
+    show(records, regions, events, not args.no_hist)
+    if args.baseline:
+        baseline = json.loads(Path(args.baseline).read_text())
+        regressions = compare(records, baseline, args.threshold, regions, events)
+        for name, field, change in regressions:
+            print(f'REGRESSION {name} {field} {change:+.1f}%', file=sys.stderr)
+        sys.exit(1 if regressions else 0)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,145 @@
+/***************************************************************************//**
+ * @file protocol.c
+ * @brief Stimulation protocols and their NVM3 store.
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "byteorder.h"
+#include "config.h"
+#include "nvm3_default.h"
+#include "protocol.h"
+
+// One NVM3 object per slot, plus one for the autorun setting.
+#define PROTOCOL_KEY(slot)      (PROTOCOL_NVM3_KEY_BASE + (slot))
+#define PROTOCOL_KEY_AUTORUN    (PROTOCOL_NVM3_KEY_BASE + PROTOCOL_SLOTS)
+
+static sl_status_t fromEcode(Ecode_t ec) {
+	switch (ec) {
+	case ECODE_NVM3_OK:
+		return SL_STATUS_OK;
+	case ECODE_NVM3_ERR_KEY_NOT_FOUND:
+		return SL_STATUS_NOT_FOUND;
+	default:
+		return SL_STATUS_FAIL;
+	}
+}
+
+sl_status_t protocol_decode(const uint8_t *data, size_t len,
+		protocol_t *protocol) {
+	if (len < PROTOCOL_NAME_SIZE + 1) {
+		return SL_STATUS_INVALID_PARAMETER;
+	}
+	uint8_t count = data[PROTOCOL_NAME_SIZE];
+	if (count == 0 || count > PROTOCOL_MAX_EPOCHS
+			|| len != PROTOCOL_NAME_SIZE + 1u + count * PROTOCOL_EPOCH_SIZE) {
+		return SL_STATUS_INVALID_PARAMETER;
+	}
+
+	memcpy(protocol->name, data, PROTOCOL_NAME_SIZE);
+	protocol->name[PROTOCOL_NAME_SIZE] = '\0';
+	protocol->epochCount = count;
+	const uint8_t *p = data + PROTOCOL_NAME_SIZE + 1;
+	for (uint8_t i = 0; i < count; i++, p += PROTOCOL_EPOCH_SIZE) {
+		protocol_epoch_t *e = &protocol->epochs[i];
+		e->amplitude = get_le32(p);
+		e->frequency = get_le32(p + 4);
+		e->pulseWidth = get_le32(p + 8);
+		e->durationMs = get_le32(p + 12);
+		e->gapMs = get_le32(p + 16);
+	}
+	return SL_STATUS_OK;
+}
+
+size_t protocol_encode(const protocol_t *protocol, uint8_t *out, size_t size) {
+	uint8_t count = protocol->epochCount;
+	size_t len = PROTOCOL_NAME_SIZE + 1u + count * PROTOCOL_EPOCH_SIZE;
+
+	if (count == 0 || count > PROTOCOL_MAX_EPOCHS || size < len) {
+		return 0;
+	}
+	memset(out, 0, PROTOCOL_NAME_SIZE);
+	strncpy((char*) out, protocol->name, PROTOCOL_NAME_SIZE);
+	out[PROTOCOL_NAME_SIZE] = count;
+	uint8_t *p = out + PROTOCOL_NAME_SIZE + 1;
+	for (uint8_t i = 0; i < count; i++, p += PROTOCOL_EPOCH_SIZE) {
+		const protocol_epoch_t *e = &protocol->epochs[i];
+		put_le32(p, e->amplitude);
+		put_le32(p + 4, e->frequency);
+		put_le32(p + 8, e->pulseWidth);
+		put_le32(p + 12, e->durationMs);
+		put_le32(p + 16, e->gapMs);
+	}
+	return len;
+}
+
+sl_status_t protocol_store_save(uint8_t slot, const protocol_t *protocol) {
+	uint8_t record[PROTOCOL_RECORD_MAX_SIZE];
+	size_t len;
+
+	if (slot >= PROTOCOL_SLOTS) {
+		return SL_STATUS_INVALID_PARAMETER;
+	}
+	len = protocol_encode(protocol, record, sizeof(record));
+	if (len == 0) {
+		return SL_STATUS_INVALID_PARAMETER;
+	}
+	return fromEcode(
+			nvm3_writeData(nvm3_defaultHandle, PROTOCOL_KEY(slot), record, len));
+}
+
+sl_status_t protocol_store_load(uint8_t slot, protocol_t *protocol) {
+	uint8_t record[PROTOCOL_RECORD_MAX_SIZE];
+	uint32_t type;
+	size_t len;
+	Ecode_t ec;
+
+	if (slot >= PROTOCOL_SLOTS) {
+		return SL_STATUS_INVALID_PARAMETER;
+	}
+	ec = nvm3_getObjectInfo(nvm3_defaultHandle, PROTOCOL_KEY(slot), &type,
+			&len);
+	if (ec != ECODE_NVM3_OK) {
+		return fromEcode(ec);
+	}
+	if (type != NVM3_OBJECTTYPE_DATA || len > sizeof(record)) {
+		return SL_STATUS_FAIL;
+	}
+	ec = nvm3_readData(nvm3_defaultHandle, PROTOCOL_KEY(slot), record, len);
+	if (ec != ECODE_NVM3_OK) {
+		return fromEcode(ec);
+	}
+	return protocol_decode(record, len, protocol) == SL_STATUS_OK ?
+			SL_STATUS_OK : SL_STATUS_FAIL;
+}
+
+void protocol_store_get_autorun(protocol_autorun_t *autorun) {
+	uint8_t raw[2];
+
+	if (nvm3_readData(nvm3_defaultHandle, PROTOCOL_KEY_AUTORUN, raw,
+			sizeof(raw)) != ECODE_NVM3_OK || raw[0] >= PROTOCOL_SLOTS) {
+		autorun->slot = PROTOCOL_NO_SLOT;
+		autorun->triggers = 0;
+		return;
+	}
+	autorun->slot = raw[0];
+	autorun->triggers = raw[1];
+}
+
+sl_status_t protocol_store_set_autorun(const protocol_autorun_t *autorun) {
+	uint8_t raw[2] = { autorun->slot, autorun->triggers };
+
+	if (autorun->slot == PROTOCOL_NO_SLOT) {
+		Ecode_t ec = nvm3_deleteObject(nvm3_defaultHandle,
+				PROTOCOL_KEY_AUTORUN);
+		return ec == ECODE_NVM3_ERR_KEY_NOT_FOUND ? SL_STATUS_OK : fromEcode(ec);
+	}
+	if (autorun->slot >= PROTOCOL_SLOTS) {
+		return SL_STATUS_INVALID_PARAMETER;
+	}
+	return fromEcode(
+			nvm3_writeData(nvm3_defaultHandle, PROTOCOL_KEY_AUTORUN, raw,
+					sizeof(raw)));
+}
@@ -0,0 +1,106 @@
+/***************************************************************************//**
+ * @file protocol.h
+ * @brief Stimulation protocols and their NVM3 store.
+ *
+ * A protocol is a named sequence of epochs. Each epoch stimulates with its
+ * own A/F/P for a duration, then pauses for a gap before the next epoch.
+ * Protocols live in NVM3 slots so they survive reset and can run without a
+ * connected host (see sequencer.h).
+ *
+ * Wire and storage record, all multi-byte values little-endian:
+ *
+ *   offset  size  field
+ *   0       12    name, NUL padded
+ *   12      1     epoch count, 1 .. PROTOCOL_MAX_EPOCHS
+ *   13      20n   epochs: amplitude, frequency (Hz), pulse width (us),
+ *                 duration (ms), gap (ms), one uint32 each
+ *
+ * The CMD_OP_PROTOCOL_WRITE payload is the slot number followed by the
+ * record. The CMD_OP_PROTOCOL_RUN payload is the slot number and a
+ * protocol_trigger_t mask.
+ ******************************************************************************/
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sl_status.h"
+
+#define PROTOCOL_NAME_SIZE      12
+#define PROTOCOL_MAX_EPOCHS     8
+#define PROTOCOL_SLOTS          4
+#define PROTOCOL_NO_SLOT        0xFF
+#define PROTOCOL_EPOCH_SIZE     20
+#define PROTOCOL_RECORD_MAX_SIZE \
+	(PROTOCOL_NAME_SIZE + 1 + PROTOCOL_MAX_EPOCHS * PROTOCOL_EPOCH_SIZE)
+
+typedef enum {
+	PROTOCOL_TRIGGER_NOW = 0x01,        ///< Start immediately.
+	PROTOCOL_TRIGGER_BOOT = 0x02,       ///< Start after every reset.
+	PROTOCOL_TRIGGER_DISCONNECT = 0x04, ///< Start when the central leaves.
+} protocol_trigger_t;
+
+typedef struct {
+	uint32_t amplitude;
+	uint32_t frequency;     ///< Hz
+	uint32_t pulseWidth;    ///< us
+	uint32_t durationMs;    ///< Stimulation time.
+	uint32_t gapMs;         ///< Pause before the next epoch.
+} protocol_epoch_t;
+
+typedef struct {
+	char name[PROTOCOL_NAME_SIZE + 1];  ///< NUL terminated.
+	uint8_t epochCount;
+	protocol_epoch_t epochs[PROTOCOL_MAX_EPOCHS];
+} protocol_t;
+
+/**
+ * @brief Which protocol starts by itself, and when.
+ */
+typedef struct {
+	uint8_t slot;           ///< PROTOCOL_NO_SLOT for none.
+	uint8_t triggers;       ///< PROTOCOL_TRIGGER_BOOT / _DISCONNECT.
+} protocol_autorun_t;
+
+/**
+ * @brief Decode a record.
+ *
+ * @return SL_STATUS_OK, or SL_STATUS_INVALID_PARAMETER if the length does
+ *         not match the epoch count or the count is out of range.
+ */
+sl_status_t protocol_decode(const uint8_t *data, size_t len,
+		protocol_t *protocol);
+
+/**
+ * @brief Encode a record.
+ *
+ * @return Record length, or 0 if out is too small or the epoch count is
+ *         out of range.
+ */
+size_t protocol_encode(const protocol_t *protocol, uint8_t *out, size_t size);
+
+/**
+ * @brief Store a protocol in a slot, replacing what was there.
+ */
+sl_status_t protocol_store_save(uint8_t slot, const protocol_t *protocol);
+
+/**
+ * @brief Load a protocol from a slot.
+ *
+ * @return SL_STATUS_OK, SL_STATUS_NOT_FOUND for an empty slot, or
+ *         SL_STATUS_INVALID_PARAMETER for a bad slot number.
+ */
+sl_status_t protocol_store_load(uint8_t slot, protocol_t *protocol);
+
+/**
+ * @brief Read the autorun setting. Defaults to none.
+ */
+void protocol_store_get_autorun(protocol_autorun_t *autorun);
+
+/**
+ * @brief Persist the autorun setting.
+ */
+sl_status_t protocol_store_set_autorun(const protocol_autorun_t *autorun);
+
+#endif // PROTOCOL_H
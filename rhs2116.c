@@ -0,0 +1,256 @@
+/***************************************************************************//**
+ * @file rhs2116.c
+ * @brief Intan RHS2116 stimulator/amplifier driver on SPIDRV.
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "byteorder.h"
+#include "dlog.h"
+#include "em_core.h"
+#include "power.h"
+#include "rhs2116.h"
+#include "tasks.h"
+
+static SPIDRV_Handle_t spi;
+// Submitted batches; the head is on the bus.
+static rhs2116_batch_t *pendingHead;
+static rhs2116_batch_t *pendingTail;
+// Finished batches waiting for rhs2116_process_action().
+static rhs2116_batch_t *doneHead;
+static rhs2116_batch_t *doneTail;
+
+static rhs2116_batch_t idBatch;
+static uint16_t idRegs[4];
+static rhs2116_callback_t idCallback;
+static volatile bool identifying;  // idBatch queued or on the bus
+
+static void onWord(struct SPIDRV_HandleData *handle, Ecode_t status,
+		int items);
+
+static sl_status_t append(rhs2116_batch_t *batch, uint32_t word,
+		uint16_t *dest) {
+	if (batch->count >= RHS2116_BATCH_MAX) {
+		return SL_STATUS_FULL;
+	}
+	put_be32(batch->tx[batch->count], word);
+	batch->dest[batch->count] = dest;
+	batch->count++;
+	return SL_STATUS_OK;
+}
+
+static uint16_t words(const rhs2116_batch_t *batch) {
+	return (uint16_t) (batch->count + RHS2116_PIPELINE_DEPTH);
+}
+
+// Called with interrupts masked or from the transfer interrupt.
+static void sendWord(rhs2116_batch_t *batch) {
+	Ecode_t ec = SPIDRV_MTransfer(spi, batch->tx[batch->sent],
+			batch->rx[batch->sent], RHS2116_WORD_SIZE, onWord);
+	if (ec != ECODE_EMDRV_SPIDRV_OK) {
+		batch->status = SL_STATUS_IO;
+		// Report from the superloop like any other completion.
+		onWord(spi, ec, 0);
+	}
+}
+
+// Answers arrive RHS2116_PIPELINE_DEPTH words after their command.
+static void collect(rhs2116_batch_t *batch) {
+	for (uint16_t i = 0; i < batch->count; i++) {
+		uint32_t command = get_be32(batch->tx[i]);
+		uint32_t answer = get_be32(batch->rx[i + RHS2116_PIPELINE_DEPTH]);
+		if (batch->dest[i] != NULL) {
+			*batch->dest[i] = (uint16_t) answer;
+		} else if ((command & RHS2116_CMD_READ) == RHS2116_CMD_WRITE
+				&& answer != (RHS2116_CMD_WRITE_ANSWER | (command & 0xFFFFu))) {
+			batch->status = SL_STATUS_FAIL;
+		}
+	}
+}
+
+// SPIDRV completion, from the LDMA interrupt.
+static void onWord(struct SPIDRV_HandleData *handle, Ecode_t status,
+		int items) {
+	(void) handle;
+	(void) items;
+	rhs2116_batch_t *batch = pendingHead;
+
+	if (batch == NULL) {
+		return;
+	}
+	if (status != ECODE_EMDRV_SPIDRV_OK) {
+		batch->status = SL_STATUS_IO;
+	} else if (++batch->sent < words(batch)) {
+		sendWord(batch);
+		return;
+	} else {
+		collect(batch);
+	}
+
+	// Retire the batch and start the next one.
+	pendingHead = batch->next;
+	if (pendingHead == NULL) {
+		pendingTail = NULL;
+	}
+	batch->next = NULL;
+	if (doneTail) {
+		doneTail->next = batch;
+	} else {
+		doneHead = batch;
+	}
+	doneTail = batch;
+	tasks_wake(TASKS_ACQ);
+	if (pendingHead) {
+		sendWord(pendingHead);
+	} else {
+		power_release(POWER_CLIENT_RHS2116);
+	}
+}
+
+static void onIdentified(rhs2116_batch_t *batch, sl_status_t status,
+		void *context) {
+	if (status == SL_STATUS_OK
+			&& (idRegs[0] != (('I' << 8) | 'N') || idRegs[1] != (('T' << 8) | 'A')
+					|| idRegs[2] != ('N' << 8)
+					|| idRegs[3] != RHS2116_CHIP_ID)) {
+		status = SL_STATUS_NOT_FOUND;
+	}
+	if (status == SL_STATUS_OK) {
+		DLOG(DLOG_RHS2116_FOUND);
+	} else {
+		DLOG(DLOG_RHS2116_NOT_FOUND, status, idRegs[3]);
+	}
+	identifying = false;
+	if (idCallback) {
+		idCallback(batch, status, context);
+	}
+}
+
+sl_status_t rhs2116_init(SPIDRV_Handle_t handle, rhs2116_callback_t callback,
+		void *context) {
+	spi = handle;
+	pendingHead = pendingTail = NULL;
+	doneHead = doneTail = NULL;
+	identifying = false;
+	return rhs2116_identify(callback, context);
+}
+
+sl_status_t rhs2116_identify(rhs2116_callback_t callback, void *context) {
+	static const uint8_t romRegs[] = {
+		RHS2116_REG_INTAN_0, RHS2116_REG_INTAN_1, RHS2116_REG_INTAN_2,
+		RHS2116_REG_CHIP_ID,
+	};
+
+	if (identifying) {
+		return SL_STATUS_BUSY;
+	}
+	idCallback = callback;
+	rhs2116_batch_init(&idBatch);
+	for (size_t i = 0; i < sizeof(romRegs); i++) {
+		rhs2116_batch_read(&idBatch, romRegs[i], &idRegs[i]);
+	}
+	// Set first: the callback may run in the acquisition task at once.
+	identifying = true;
+	sl_status_t sc = rhs2116_submit(&idBatch, onIdentified, context);
+	if (sc != SL_STATUS_OK) {
+		identifying = false;
+	}
+	return sc;
+}
+
+void rhs2116_batch_init(rhs2116_batch_t *batch) {
+	batch->count = 0;
+	batch->sent = 0;
+	batch->status = SL_STATUS_OK;
+	batch->callback = NULL;
+	batch->context = NULL;
+	batch->next = NULL;
+}
+
+sl_status_t rhs2116_batch_write(rhs2116_batch_t *batch, uint8_t reg,
+		uint16_t value, uint32_t flags) {
+	return append(batch,
+			RHS2116_CMD_WRITE | (flags & (RHS2116_FLAG_U | RHS2116_FLAG_M))
+					| ((uint32_t) reg << 16) | value, NULL);
+}
+
+sl_status_t rhs2116_batch_read(rhs2116_batch_t *batch, uint8_t reg,
+		uint16_t *value) {
+	if (value == NULL) {
+		return SL_STATUS_NULL_POINTER;
+	}
+	return append(batch, RHS2116_CMD_READ | ((uint32_t) reg << 16), value);
+}
+
+sl_status_t rhs2116_batch_convert(rhs2116_batch_t *batch, uint8_t channel,
+		uint16_t *sample) {
+	if (sample == NULL) {
+		return SL_STATUS_NULL_POINTER;
+	}
+	if (channel >= RHS2116_CHANNELS) {
+		return SL_STATUS_INVALID_PARAMETER;
+	}
+	return append(batch, RHS2116_CMD_CONVERT | ((uint32_t) channel << 16),
+			sample);
+}
+
+sl_status_t rhs2116_submit(rhs2116_batch_t *batch, rhs2116_callback_t callback,
+		void *context) {
+	if (spi == NULL) {
+		return SL_STATUS_INVALID_STATE;
+	}
+	if (batch->count == 0) {
+		return SL_STATUS_INVALID_PARAMETER;
+	}
+	// Reading the chip ID is harmless and clocks out the last answers.
+	for (uint16_t i = batch->count; i < words(batch); i++) {
+		put_be32(batch->tx[i],
+				RHS2116_CMD_READ | ((uint32_t) RHS2116_REG_CHIP_ID << 16));
+	}
+	batch->sent = 0;
+	batch->status = SL_STATUS_OK;
+	batch->callback = callback;
+	batch->context = context;
+	batch->next = NULL;
+
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_ATOMIC();
+	if (pendingTail) {
+		pendingTail->next = batch;
+		pendingTail = batch;
+	} else {
+		pendingHead = pendingTail = batch;
+		// USART and LDMA stop in EM2.
+		power_hold(POWER_CLIENT_RHS2116);
+		sendWord(batch);
+	}
+	CORE_EXIT_ATOMIC();
+	return SL_STATUS_OK;
+}
+
+bool rhs2116_busy(void) {
+	return pendingHead != NULL || doneHead != NULL;
+}
+
+void rhs2116_process_action(void) {
+	for (;;) {
+		CORE_DECLARE_IRQ_STATE;
+		CORE_ENTER_ATOMIC();
+		rhs2116_batch_t *batch = doneHead;
+		if (batch) {
+			doneHead = batch->next;
+			if (doneHead == NULL) {
+				doneTail = NULL;
+			}
+			batch->next = NULL;
+		}
+		CORE_EXIT_ATOMIC();
+		if (batch == NULL) {
+			break;
+		}
+		if (batch->callback) {
+			batch->callback(batch, batch->status, batch->context);
+		}
+	}
+}
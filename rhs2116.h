@@ -0,0 +1,154 @@
+/***************************************************************************//**
+ * @file rhs2116.h
+ * @brief Intan RHS2116 stimulator/amplifier driver on SPIDRV.
+ *
+ * The chip takes 32-bit commands, MSB first, one per chip-select cycle, and
+ * answers each command two words later. Register accesses are therefore
+ * collected in a batch and sent back to back: every word is its own
+ * DMA-backed SPIDRV transfer (the chip latches on the rising edge of CS),
+ * the next one started from the previous one's completion interrupt. Two
+ * dummy reads at the end of the batch clock out the last answers, so the
+ * pipeline costs two words per batch rather than per read.
+ *
+ * The CPU never waits on the bus. A finished batch is handed back through
+ * its callback from rhs2116_process_action(), with every read result
+ * filled in and every write checked against the chip's echo.
+ *
+ * Command words (datasheet, "SPI Command Words"):
+ *
+ *   CONVERT(C)   00 U M D H 0000 C[5:0] 0x0000  answer DC[9:0] AC[15:0]
+ *   WRITE(R, D)  10 U M 0000 R[7:0] D[15:0]   answer 0xFFFF D[15:0]
+ *   READ(R)      11 0 M 0000 R[7:0] 0x0000    answer 0x0000 D[15:0]
+ *
+ * U triggers an update of the stimulation registers, M clears the
+ * compliance monitor. A CONVERT answer carries the channel's AC amplifier
+ * sample in the low 16 bits, offset binary unless D is set.
+ ******************************************************************************/
+#ifndef RHS2116_H
+#define RHS2116_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sl_spidrv_instances.h"
+#include "sl_status.h"
+
+// Registers used by the driver itself.
+#define RHS2116_REG_INTAN_0         251     // ROM: 'I' 'N'
+#define RHS2116_REG_INTAN_1         252     // ROM: 'T' 'A'
+#define RHS2116_REG_INTAN_2         253     // ROM: 'N' 0
+#define RHS2116_REG_CHIP_ID         255     // ROM
+#define RHS2116_CHIP_ID             32
+
+#define RHS2116_CHANNELS            16
+
+#define RHS2116_CMD_CONVERT         0x00000000u
+#define RHS2116_CMD_WRITE           0x80000000u
+#define RHS2116_CMD_READ            0xC0000000u
+#define RHS2116_FLAG_U              0x20000000u
+#define RHS2116_FLAG_M              0x10000000u
+#define RHS2116_CMD_WRITE_ANSWER    0xFFFF0000u
+
+// Words that must follow the last command to receive its answer.
+#define RHS2116_PIPELINE_DEPTH      2
+#define RHS2116_BATCH_MAX           32      // commands per batch
+#define RHS2116_WORD_SIZE           4
+
+typedef struct rhs2116_batch rhs2116_batch_t;
+
+/**
+ * @brief Batch completion.
+ *
+ * @param[in] status SL_STATUS_OK, SL_STATUS_IO if the bus failed, or
+ *                   SL_STATUS_FAIL if a write was not echoed.
+ */
+typedef void (*rhs2116_callback_t)(rhs2116_batch_t *batch, sl_status_t status,
+		void *context);
+
+/**
+ * Caller-owned transaction. Must stay valid from rhs2116_submit() until its
+ * callback has run.
+ */
+struct rhs2116_batch {
+	uint8_t tx[RHS2116_BATCH_MAX + RHS2116_PIPELINE_DEPTH][RHS2116_WORD_SIZE];
+	uint8_t rx[RHS2116_BATCH_MAX + RHS2116_PIPELINE_DEPTH][RHS2116_WORD_SIZE];
+	uint16_t *dest[RHS2116_BATCH_MAX];  ///< READ/CONVERT results.
+	uint16_t count;                     ///< Commands, without the flush.
+	uint16_t sent;                      ///< Words on the bus so far.
+	sl_status_t status;
+	rhs2116_callback_t callback;
+	void *context;
+	rhs2116_batch_t *next;              ///< Submission queue.
+};
+
+/**
+ * @brief Bind the driver to a SPIDRV instance (master, 8-bit frames, MSB
+ *        first, mode 0, chip select driven by SPIDRV) and queue a batch
+ *        that checks the ROM for "INTAN" and the chip ID.
+ *
+ * @param[in] callback Result of the identification, may be NULL.
+ */
+sl_status_t rhs2116_init(SPIDRV_Handle_t spi, rhs2116_callback_t callback,
+		void *context);
+
+/**
+ * @brief Queue the identification batch again, for a chip that was not
+ *        powered up yet at rhs2116_init().
+ *
+ * @return SL_STATUS_OK, SL_STATUS_BUSY while the last identification has
+ *         not completed, or an error from rhs2116_submit().
+ */
+sl_status_t rhs2116_identify(rhs2116_callback_t callback, void *context);
+
+/**
+ * @brief Empty a batch.
+ */
+void rhs2116_batch_init(rhs2116_batch_t *batch);
+
+/**
+ * @brief Append a register write.
+ *
+ * @param[in] flags 0, or RHS2116_FLAG_U / RHS2116_FLAG_M.
+ * @return SL_STATUS_OK, or SL_STATUS_FULL.
+ */
+sl_status_t rhs2116_batch_write(rhs2116_batch_t *batch, uint8_t reg,
+		uint16_t value, uint32_t flags);
+
+/**
+ * @brief Append a register read; value is written on completion.
+ *
+ * @return SL_STATUS_OK, or SL_STATUS_FULL.
+ */
+sl_status_t rhs2116_batch_read(rhs2116_batch_t *batch, uint8_t reg,
+		uint16_t *value);
+
+/**
+ * @brief Append a conversion; the channel's AC sample is written on
+ *        completion.
+ *
+ * @return SL_STATUS_OK, SL_STATUS_FULL, or SL_STATUS_INVALID_PARAMETER
+ *         for a channel out of range.
+ */
+sl_status_t rhs2116_batch_convert(rhs2116_batch_t *batch, uint8_t channel,
+		uint16_t *sample);
+
+/**
+ * @brief Queue a batch. Batches run one after another in submission order.
+ *
+ * @return SL_STATUS_OK, SL_STATUS_INVALID_STATE before rhs2116_init(), or
+ *         SL_STATUS_INVALID_PARAMETER for an empty batch.
+ */
+sl_status_t rhs2116_submit(rhs2116_batch_t *batch, rhs2116_callback_t callback,
+		void *context);
+
+/**
+ * @brief True while a batch is queued, on the bus, or awaiting its
+ *        callback.
+ */
+bool rhs2116_busy(void);
+
+/**
+ * @brief Run the callbacks of finished batches. Call from the superloop.
+ */
+void rhs2116_process_action(void);
+
+#endif // RHS2116_H
@@ -0,0 +1,166 @@
+/***************************************************************************//**
+ * @file sequencer.c
+ * @brief Runs a stored stimulation protocol epoch by epoch without a host.
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "dlog.h"
+#include "sequencer.h"
+#include "sl_sleeptimer.h"
+#include "stim.h"
+#include "stim_schedule.h"
+#include "tasks.h"
+
+typedef enum {
+	SEQ_IDLE = 0,
+	SEQ_STIM,
+	SEQ_GAP,
+} seq_state_t;
+
+static protocol_t protocol;
+static stim_schedule_t schedule;
+static seq_state_t state;
+static uint8_t slot = PROTOCOL_NO_SLOT;
+static uint8_t epoch;
+static sl_sleeptimer_timer_handle_t gapTimer;
+static volatile bool gapDone;
+
+static void onGapTimer(sl_sleeptimer_timer_handle_t *handle, void *data) {
+	(void) handle;
+	(void) data;
+	gapDone = true;
+	tasks_wake(TASKS_STIM);
+}
+
+static sl_status_t compileEpoch(const protocol_epoch_t *e,
+		stim_schedule_t *out, uint32_t *pulses) {
+	stim_pattern_t pattern = {
+		.amplitude = e->amplitude,
+		.frequency = e->frequency,
+		.pulseWidth = e->pulseWidth,
+		.phases = 1,
+	};
+	sl_status_t sc = stim_schedule_compile(&pattern, stim_clock_hz(),
+			stim_counter_max(), out);
+	if (sc != SL_STATUS_OK) {
+		return sc;
+	}
+	uint64_t n = ((uint64_t) e->durationMs * e->frequency + 500) / 1000;
+	// The engine counts a finite train in one run of its pulse counter.
+	if (n == 0 || n > stim_train_max()) {
+		return SL_STATUS_INVALID_RANGE;
+	}
+	*pulses = (uint32_t) n;
+	return SL_STATUS_OK;
+}
+
+// Start the current epoch; ends the protocol if it cannot be played.
+static void startEpoch(void) {
+	uint32_t pulses;
+	sl_status_t sc = compileEpoch(&protocol.epochs[epoch], &schedule, &pulses);
+	if (sc == SL_STATUS_OK) {
+		sc = stim_start(&schedule, pulses);
+	}
+	if (sc != SL_STATUS_OK) {
+		DLOG(DLOG_PROTOCOL_EPOCH_FAILED, slot, epoch, sc);
+		sequencer_stop();
+		return;
+	}
+	DLOG(DLOG_PROTOCOL_EPOCH, slot, epoch, pulses);
+	state = SEQ_STIM;
+}
+
+sl_status_t sequencer_validate(const protocol_t *p) {
+	stim_schedule_t scratch;
+	uint32_t pulses;
+
+	for (uint8_t i = 0; i < p->epochCount; i++) {
+		sl_status_t sc = compileEpoch(&p->epochs[i], &scratch, &pulses);
+		if (sc != SL_STATUS_OK) {
+			return sc;
+		}
+	}
+	return SL_STATUS_OK;
+}
+
+sl_status_t sequencer_start(uint8_t s) {
+	protocol_t p;
+	sl_status_t sc = protocol_store_load(s, &p);
+	if (sc != SL_STATUS_OK) {
+		return sc;
+	}
+	sc = sequencer_validate(&p);
+	if (sc != SL_STATUS_OK) {
+		return sc;
+	}
+
+	sequencer_stop();
+	protocol = p;
+	slot = s;
+	epoch = 0;
+	startEpoch();
+	return state == SEQ_IDLE ? SL_STATUS_FAIL : SL_STATUS_OK;
+}
+
+void sequencer_stop(void) {
+	if (state != SEQ_IDLE) {
+		sl_sleeptimer_stop_timer(&gapTimer);
+		stim_stop();
+	}
+	state = SEQ_IDLE;
+	slot = PROTOCOL_NO_SLOT;
+	gapDone = false;
+}
+
+bool sequencer_is_running(void) {
+	return state != SEQ_IDLE;
+}
+
+bool sequencer_position(uint8_t *s, uint8_t *e) {
+	if (state == SEQ_IDLE) {
+		return false;
+	}
+	*s = slot;
+	*e = epoch;
+	return true;
+}
+
+void sequencer_process_action(void) {
+	switch (state) {
+	case SEQ_STIM:
+		if (stim_is_running()) {
+			break;
+		}
+		// Train finished in hardware.
+		if (epoch + 1 >= protocol.epochCount) {
+			DLOG(DLOG_PROTOCOL_DONE, slot);
+			sequencer_stop();
+			break;
+		}
+		gapDone = false;
+		if (protocol.epochs[epoch].gapMs == 0) {
+			epoch++;
+			startEpoch();
+			break;
+		}
+		state = SEQ_GAP;
+		if (sl_sleeptimer_start_timer_ms(&gapTimer,
+				protocol.epochs[epoch].gapMs, onGapTimer, NULL, 0, 0)
+				!= SL_STATUS_OK) {
+			sequencer_stop();
+		}
+		break;
+
+	case SEQ_GAP:
+		if (gapDone) {
+			gapDone = false;
+			epoch++;
+			startEpoch();
+		}
+		break;
+
+	default:
+		break;
+	}
+}
@@ -0,0 +1,56 @@
+/***************************************************************************//**
+ * @file sequencer.h
+ * @brief Runs a stored stimulation protocol epoch by epoch without a host.
+ *
+ * Each epoch is compiled once when it starts and played by the pulse
+ * engine as a finite train of duration x frequency pulses, so the epoch
+ * length is counted in hardware. The gap that follows is timed by the
+ * sleeptimer. All transitions happen in sequencer_process_action().
+ ******************************************************************************/
+#ifndef SEQUENCER_H
+#define SEQUENCER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "protocol.h"
+#include "sl_status.h"
+
+/**
+ * @brief Check that every epoch of a protocol can be produced by the
+ *        pulse engine.
+ *
+ * @return SL_STATUS_OK, or the stim_schedule_compile() error of the first
+ *         epoch that cannot, or SL_STATUS_INVALID_RANGE for a duration
+ *         that yields no pulse or more than stim_train_max().
+ */
+sl_status_t sequencer_validate(const protocol_t *protocol);
+
+/**
+ * @brief Load a protocol from its slot and start the first epoch,
+ *        replacing any protocol or train already running.
+ */
+sl_status_t sequencer_start(uint8_t slot);
+
+/**
+ * @brief Stop the protocol and its pulse train.
+ */
+void sequencer_stop(void);
+
+/**
+ * @brief True while a protocol is running.
+ */
+bool sequencer_is_running(void);
+
+/**
+ * @brief Slot and epoch index of the running protocol.
+ *
+ * @return false if no protocol is running.
+ */
+bool sequencer_position(uint8_t *slot, uint8_t *epoch);
+
+/**
+ * @brief Advance the protocol. Call from the superloop.
+ */
+void sequencer_process_action(void);
+
+#endif // SEQUENCER_H
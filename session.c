@@ -0,0 +1,132 @@
+/***************************************************************************//**
+ * @file session.c
+ * @brief Connection table with controller and observer roles.
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "config.h"
+#include "dlog.h"
+#include "session.h"
+
+static session_t sessions[SESSION_MAX_CONNECTIONS];
+
+static session_t* find(uint8_t connection) {
+	if (connection == SESSION_NO_CONNECTION) {
+		return NULL;
+	}
+	for (int i = 0; i < SESSION_MAX_CONNECTIONS; i++) {
+		if (sessions[i].connection == connection) {
+			return &sessions[i];
+		}
+	}
+	return NULL;
+}
+
+void session_init(void) {
+	memset(sessions, 0, sizeof(sessions));
+}
+
+session_role_t session_open(uint8_t connection) {
+	session_t *s = find(connection);
+
+	if (s == NULL) {
+		for (int i = 0; s == NULL && i < SESSION_MAX_CONNECTIONS; i++) {
+			if (sessions[i].connection == SESSION_NO_CONNECTION) {
+				s = &sessions[i];
+			}
+		}
+		if (s == NULL) {
+			DLOG(DLOG_SESSION_NO_ROOM, connection);
+			return SESSION_ROLE_NONE;
+		}
+	}
+	memset(s, 0, sizeof(*s));
+	s->connection = connection;
+	s->role = session_controller() == SESSION_NO_CONNECTION ?
+			SESSION_ROLE_CONTROLLER : SESSION_ROLE_OBSERVER;
+	DLOG(DLOG_SESSION_OPENED, connection, s->role);
+	return s->role;
+}
+
+session_role_t session_close(uint8_t connection) {
+	session_t *s = find(connection);
+	session_role_t role;
+
+	if (s == NULL) {
+		return SESSION_ROLE_NONE;
+	}
+	role = s->role;
+	memset(s, 0, sizeof(*s));
+	return role;
+}
+
+session_role_t session_role(uint8_t connection) {
+	const session_t *s = find(connection);
+	return s != NULL ? s->role : SESSION_ROLE_NONE;
+}
+
+sl_status_t session_request(uint8_t connection, uint8_t action) {
+	session_t *s = find(connection);
+	uint8_t controller = session_controller();
+
+	if (s == NULL) {
+		return SL_STATUS_NOT_FOUND;
+	}
+	switch (action) {
+	case SESSION_CLAIM:
+		if (controller != SESSION_NO_CONNECTION && controller != connection) {
+			return SL_STATUS_PERMISSION;
+		}
+		s->role = SESSION_ROLE_CONTROLLER;
+		break;
+
+	case SESSION_RELEASE:
+		if (controller != connection) {
+			return SL_STATUS_PERMISSION;
+		}
+		s->role = SESSION_ROLE_OBSERVER;
+		break;
+
+	default:
+		return SL_STATUS_INVALID_PARAMETER;
+	}
+	DLOG(DLOG_SESSION_ROLE, connection, s->role);
+	return SL_STATUS_OK;
+}
+
+void session_count_command(uint8_t connection, bool rejected) {
+	session_t *s = find(connection);
+	if (s != NULL) {
+		s->commands++;
+		if (rejected) {
+			s->rejected++;
+		}
+	}
+}
+
+uint8_t session_controller(void) {
+	for (int i = 0; i < SESSION_MAX_CONNECTIONS; i++) {
+		if (sessions[i].connection != SESSION_NO_CONNECTION
+				&& sessions[i].role == SESSION_ROLE_CONTROLLER) {
+			return sessions[i].connection;
+		}
+	}
+	return SESSION_NO_CONNECTION;
+}
+
+size_t session_count(void) {
+	size_t n = 0;
+	for (int i = 0; i < SESSION_MAX_CONNECTIONS; i++) {
+		if (sessions[i].connection != SESSION_NO_CONNECTION) {
+			n++;
+		}
+	}
+	return n;
+}
+
+const session_t* session_get(uint8_t connection) {
+	return find(connection);
+}
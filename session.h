@@ -0,0 +1,105 @@
+/***************************************************************************//**
+ * @file session.h
+ * @brief Connection table with controller and observer roles.
+ *
+ * Up to SESSION_MAX_CONNECTIONS centrals can be attached at once, for
+ * example a rig controller and a monitoring tablet. Each connection has a
+ * session in the table. At most one session is the controller: the first
+ * central to connect while there is none. All others are observers.
+ *
+ * Only the controller may change the device: stimulation settings,
+ * protocols, the advertising policy, firmware updates through ota_delta
+ * and resetting the profiler statistics. Observers may read the state with
+ * CMD_OP_GET, and they receive every state change the controller makes.
+ * An observer can take control with CMD_OP_SESSION when no controller is
+ * attached, or after the controller releases it. When the controller
+ * disconnects, nobody has control until a central claims it or a new
+ * central connects.
+ *
+ * CMD_OP_SESSION payload: one session_action_t. The reply is a STATE frame
+ * whose status is CMD_OK, or CMD_ERR_PERMISSION if another central holds
+ * control.
+ ******************************************************************************/
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+#include "sl_status.h"
+
+#define SESSION_NO_CONNECTION   0
+
+typedef enum {
+	SESSION_ROLE_NONE = 0,      ///< Not in the table.
+	SESSION_ROLE_CONTROLLER,
+	SESSION_ROLE_OBSERVER,
+} session_role_t;
+
+typedef enum {
+	SESSION_CLAIM = 0x01,       ///< Become the controller.
+	SESSION_RELEASE = 0x02,     ///< Give up control, stay as an observer.
+} session_action_t;
+
+typedef struct {
+	uint8_t connection;         ///< SESSION_NO_CONNECTION if unused.
+	session_role_t role;
+	uint32_t commands;          ///< nodeRx commands received.
+	uint32_t rejected;          ///< Commands refused for lack of control.
+} session_t;
+
+/**
+ * @brief Empty the table. Call once.
+ */
+void session_init(void);
+
+/**
+ * @brief Add a connection. It becomes the controller if nobody else is.
+ *
+ * @return The role given, SESSION_ROLE_NONE if the table is full.
+ */
+session_role_t session_open(uint8_t connection);
+
+/**
+ * @brief Remove a connection.
+ *
+ * @return The role it had.
+ */
+session_role_t session_close(uint8_t connection);
+
+/**
+ * @brief Role of a connection, SESSION_ROLE_NONE if unknown.
+ */
+session_role_t session_role(uint8_t connection);
+
+/**
+ * @brief Claim or release control for a connection.
+ *
+ * @return SL_STATUS_OK, SL_STATUS_PERMISSION if another connection is the
+ *         controller, SL_STATUS_NOT_FOUND for an unknown connection, or
+ *         SL_STATUS_INVALID_PARAMETER for an unknown action.
+ */
+sl_status_t session_request(uint8_t connection, uint8_t action);
+
+/**
+ * @brief Count a command from a connection, and whether it was refused.
+ */
+void session_count_command(uint8_t connection, bool rejected);
+
+/**
+ * @brief Connection of the controller, SESSION_NO_CONNECTION if none.
+ */
+uint8_t session_controller(void);
+
+/**
+ * @brief Number of connections in the table.
+ */
+size_t session_count(void);
+
+/**
+ * @brief Session of a connection, NULL if unknown.
+ */
+const session_t* session_get(uint8_t connection);
+
+#endif // SESSION_H
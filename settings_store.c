@@ -0,0 +1,220 @@
+/***************************************************************************//**
+ * @file settings_store.c
+ * @brief Stimulation settings kept in NVM3 across resets.
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "byteorder.h"
+#include "config.h"
+#include "dlog.h"
+#include "nvm3_default.h"
+#include "settings_store.h"
+#include "sl_sleeptimer.h"
+#include "tasks.h"
+
+_Static_assert(SETTINGS_STORE_QUIET_MS <= SETTINGS_STORE_MAX_DELAY_MS,
+		"SETTINGS_STORE_QUIET_MS must not exceed SETTINGS_STORE_MAX_DELAY_MS");
+
+// Last record written to, or read from, NVM3.
+static uint8_t stored[SETTINGS_STORE_RECORD_MAX_SIZE];
+static size_t storedLen;
+// Newest record not yet written.
+static uint8_t pending[SETTINGS_STORE_RECORD_MAX_SIZE];
+static size_t pendingLen;
+static bool dirty;
+static uint64_t dirtySince;     // sleeptimer tick of the first pending change
+
+static sl_sleeptimer_timer_handle_t commitTimer;
+static volatile bool commitDue;
+static settings_store_stats_t stats;
+
+static void onCommitTimer(sl_sleeptimer_timer_handle_t *handle, void *data) {
+	(void) handle;
+	(void) data;
+	commitDue = true;
+	tasks_wake(TASKS_CONTROL);
+}
+
+static bool sameAs(const uint8_t *record, size_t len, const uint8_t *other,
+		size_t otherLen) {
+	return len == otherLen && memcmp(record, other, len) == 0;
+}
+
+// Wait for a pause in the writes, but not past the deadline of the oldest
+// pending change.
+static void armCommit(void) {
+	uint64_t elapsed = (sl_sleeptimer_get_tick_count64() - dirtySince) * 1000u
+			/ sl_sleeptimer_get_timer_frequency();
+	uint32_t left = elapsed >= SETTINGS_STORE_MAX_DELAY_MS ?
+			0 : SETTINGS_STORE_MAX_DELAY_MS - (uint32_t) elapsed;
+	uint32_t wait = left < SETTINGS_STORE_QUIET_MS ?
+			left : SETTINGS_STORE_QUIET_MS;
+
+	sl_sleeptimer_stop_timer(&commitTimer);
+	if (wait == 0 || sl_sleeptimer_start_timer_ms(&commitTimer, wait,
+			onCommitTimer, NULL, 0, 0) != SL_STATUS_OK) {
+		commitDue = true;
+	}
+}
+
+static sl_status_t commit(void) {
+	Ecode_t ec;
+
+	commitDue = false;
+	if (!dirty) {
+		return SL_STATUS_OK;
+	}
+	if (sameAs(pending, pendingLen, stored, storedLen)) {
+		// Changed and changed back before the commit.
+		stats.unchanged++;
+		dirty = false;
+		return SL_STATUS_OK;
+	}
+	ec = nvm3_writeData(nvm3_defaultHandle, SETTINGS_STORE_NVM3_KEY, pending,
+			pendingLen);
+	if (ec != ECODE_NVM3_OK) {
+		stats.failures++;
+		DLOG(DLOG_SETTINGS_STORE_FAILED, ec);
+		// Try again after another quiet period.
+		dirtySince = sl_sleeptimer_get_tick_count64();
+		armCommit();
+		return SL_STATUS_FAIL;
+	}
+	memcpy(stored, pending, pendingLen);
+	storedLen = pendingLen;
+	stats.commits++;
+	dirty = false;
+	return SL_STATUS_OK;
+}
+
+void settings_store_init(void) {
+	sl_sleeptimer_stop_timer(&commitTimer);
+	storedLen = pendingLen = 0;
+	dirty = false;
+	commitDue = false;
+	memset(&stats, 0, sizeof(stats));
+}
+
+size_t settings_store_encode(const cmd_settings_t *settings, uint8_t *out,
+		size_t size) {
+	const uint32_t values[CMD_FIELD_COUNT] = {
+		[0] = settings->amplitude,
+		[1] = settings->frequency,
+		[2] = settings->pulseWidth,
+		[3] = settings->activateOnDisconnect,
+		[5] = settings->phases,
+		[6] = settings->interphaseGap,
+		[8] = settings->burstCount,
+		[9] = settings->burstRest,
+	};
+	uint8_t *p = out + 3;
+
+	if (size < SETTINGS_STORE_RECORD_MAX_SIZE) {
+		return 0;
+	}
+	out[0] = SETTINGS_STORE_VERSION;
+	put_le16(out + 1, CMD_FIELD_STATE);
+	for (uint8_t i = 0; i < CMD_FIELD_COUNT; i++) {
+		if (CMD_FIELD_STATE & (1u << i)) {
+			put_le32(p, values[i]);
+			p += CMD_VALUE_SIZE;
+		}
+	}
+	return (size_t) (p - out);
+}
+
+sl_status_t settings_store_decode(const uint8_t *record, size_t len,
+		cmd_settings_t *settings) {
+	cmd_t cmd = { .format = CMD_FORMAT_BINARY, .opcode = CMD_OP_SET };
+	size_t need = 3;
+
+	if (len < 3) {
+		return SL_STATUS_INVALID_PARAMETER;
+	}
+	if (record[0] != SETTINGS_STORE_VERSION) {
+		return SL_STATUS_NOT_SUPPORTED;
+	}
+	uint16_t mask = get_le16(record + 1);
+	for (uint8_t i = 0; i < 16; i++) {
+		if (!(mask & (1u << i))) {
+			continue;
+		}
+		if (need + CMD_VALUE_SIZE > len) {
+			return SL_STATUS_INVALID_PARAMETER;
+		}
+		// Fields this release does not know are skipped.
+		if (i < CMD_FIELD_COUNT && (CMD_FIELD_STATE & (1u << i))) {
+			cmd.value[i] = get_le32(record + need);
+			cmd.mask |= (uint16_t) (1u << i);
+		}
+		need += CMD_VALUE_SIZE;
+	}
+	if (need != len) {
+		return SL_STATUS_INVALID_PARAMETER;
+	}
+	cmd_apply(&cmd, settings);
+	return SL_STATUS_OK;
+}
+
+sl_status_t settings_store_load(cmd_settings_t *settings) {
+	uint8_t record[SETTINGS_STORE_RECORD_MAX_SIZE];
+	uint32_t type;
+	size_t len;
+	Ecode_t ec;
+
+	ec = nvm3_getObjectInfo(nvm3_defaultHandle, SETTINGS_STORE_NVM3_KEY,
+			&type, &len);
+	if (ec == ECODE_NVM3_ERR_KEY_NOT_FOUND) {
+		return SL_STATUS_NOT_FOUND;
+	}
+	if (ec != ECODE_NVM3_OK || type != NVM3_OBJECTTYPE_DATA
+			|| len > sizeof(record)
+			|| nvm3_readData(nvm3_defaultHandle, SETTINGS_STORE_NVM3_KEY,
+					record, len) != ECODE_NVM3_OK) {
+		return SL_STATUS_INVALID_PARAMETER;
+	}
+	cmd_settings_t restored = *settings;
+	sl_status_t sc = settings_store_decode(record, len, &restored);
+	if (sc != SL_STATUS_OK) {
+		return sc;
+	}
+	*settings = restored;
+	// Saving the same state again writes nothing.
+	storedLen = settings_store_encode(settings, stored, sizeof(stored));
+	return SL_STATUS_OK;
+}
+
+void settings_store_save(const cmd_settings_t *settings) {
+	uint8_t record[SETTINGS_STORE_RECORD_MAX_SIZE];
+	size_t len = settings_store_encode(settings, record, sizeof(record));
+
+	if (dirty ? sameAs(record, len, pending, pendingLen)
+			: sameAs(record, len, stored, storedLen)) {
+		return;
+	}
+	memcpy(pending, record, len);
+	pendingLen = len;
+	stats.saves++;
+	if (!dirty) {
+		dirty = true;
+		dirtySince = sl_sleeptimer_get_tick_count64();
+	}
+	armCommit();
+}
+
+sl_status_t settings_store_flush(void) {
+	sl_sleeptimer_stop_timer(&commitTimer);
+	return commit();
+}
+
+void settings_store_process_action(void) {
+	if (commitDue) {
+		commit();
+	}
+}
+
+void settings_store_get_stats(settings_store_stats_t *out) {
+	*out = stats;
+}
@@ -0,0 +1,100 @@
+/***************************************************************************//**
+ * @file settings_store.h
+ * @brief Stimulation settings kept in NVM3 across resets.
+ *
+ * The settings last applied over nodeRx (amplitude, frequency, pulse width,
+ * G and the rest of cmd_settings_t) are restored on the first superloop
+ * pass, and at the latest before the boot event starts advertising, so a
+ * reset or brown-out comes back with the state the central left.
+ *
+ * Commands arrive in bursts while a central sets up a session. Instead of
+ * one flash write per command, settings_store_save() only notes the new
+ * state; it is committed once writes pause for SETTINGS_STORE_QUIET_MS,
+ * and at the latest SETTINGS_STORE_MAX_DELAY_MS after the first change
+ * that was not yet stored. A state equal to the stored one is not written
+ * again. A reset inside that window loses the uncommitted changes, so
+ * settings_store_flush() commits at once where it matters, for example
+ * when the central leaves with G set.
+ *
+ * Storage record, little-endian:
+ *
+ *   offset  size  field
+ *   0       1     SETTINGS_STORE_VERSION
+ *   1       2     field mask, CMD_FIELD_* bits
+ *   3       4n    one uint32 per set bit, in bit order
+ *
+ * A restored record is applied as a SET command on top of the defaults, so
+ * fields added by a later release take their defaults from a record that
+ * lacks them, and bits this release does not know are skipped.
+ ******************************************************************************/
+#ifndef SETTINGS_STORE_H
+#define SETTINGS_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cmd_proto.h"
+#include "sl_status.h"
+
+#define SETTINGS_STORE_VERSION          1
+#define SETTINGS_STORE_RECORD_MAX_SIZE  (3 + CMD_FIELD_COUNT * CMD_VALUE_SIZE)
+
+typedef struct {
+	uint32_t saves;         ///< Changes passed to settings_store_save().
+	uint32_t commits;       ///< NVM3 writes.
+	uint32_t unchanged;     ///< Commits skipped, state equal to the stored.
+	uint32_t failures;      ///< NVM3 writes that failed; retried.
+} settings_store_stats_t;
+
+/**
+ * @brief Forget any pending state and clear the statistics.
+ */
+void settings_store_init(void);
+
+/**
+ * @brief Apply the stored record on top of settings.
+ *
+ * @return SL_STATUS_OK, SL_STATUS_NOT_FOUND if nothing is stored,
+ *         SL_STATUS_NOT_SUPPORTED for a record of a newer version, or
+ *         SL_STATUS_INVALID_PARAMETER for a malformed one. settings is
+ *         left alone unless SL_STATUS_OK.
+ */
+sl_status_t settings_store_load(cmd_settings_t *settings);
+
+/**
+ * @brief Note the settings now applied; committed later.
+ */
+void settings_store_save(const cmd_settings_t *settings);
+
+/**
+ * @brief Commit pending settings now.
+ *
+ * @return SL_STATUS_OK if nothing is pending any more.
+ */
+sl_status_t settings_store_flush(void);
+
+/**
+ * @brief Commit when due. Call from the superloop.
+ */
+void settings_store_process_action(void);
+
+/**
+ * @brief Copy the statistics since settings_store_init().
+ */
+void settings_store_get_stats(settings_store_stats_t *stats);
+
+/**
+ * @brief Encode settings as a storage record.
+ *
+ * @return Record length, or 0 if size is too small.
+ */
+size_t settings_store_encode(const cmd_settings_t *settings, uint8_t *out,
+		size_t size);
+
+/**
+ * @brief Apply a storage record on top of settings; see
+ *        settings_store_load() for the status.
+ */
+sl_status_t settings_store_decode(const uint8_t *record, size_t len,
+		cmd_settings_t *settings);
+
+#endif // SETTINGS_STORE_H
@@ -0,0 +1,50 @@
+/***************************************************************************//**
+ * @file spsc.c
+ * @brief Lock-free single-producer, single-consumer queue of fixed slots.
+ ******************************************************************************/
+#include <string.h>
+
+#include "spsc.h"
+
+void spsc_init(spsc_t *q, void *slots, uint16_t size, uint16_t count) {
+	q->slots = slots;
+	q->size = size;
+	q->mask = (uint16_t) (count - 1u);
+	atomic_init(&q->head, 0);
+	atomic_init(&q->tail, 0);
+}
+
+bool spsc_push(spsc_t *q, const void *item, size_t len) {
+	uint32_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+	uint32_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+
+	if (len > q->size || head - tail > q->mask) {
+		return false;
+	}
+	memcpy(q->slots + (size_t) (head & q->mask) * q->size, item, len);
+	// The consumer sees the slot filled before it sees the new head.
+	atomic_store_explicit(&q->head, head + 1, memory_order_release);
+	return true;
+}
+
+void* spsc_front(spsc_t *q) {
+	uint32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	uint32_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+
+	if (head == tail) {
+		return NULL;
+	}
+	return q->slots + (size_t) (tail & q->mask) * q->size;
+}
+
+void spsc_pop(spsc_t *q) {
+	uint32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+	// The producer may reuse the slot once it sees the new tail.
+	atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+}
+
+size_t spsc_count(spsc_t *q) {
+	return atomic_load_explicit(&q->head, memory_order_acquire)
+			- atomic_load_explicit(&q->tail, memory_order_acquire);
+}
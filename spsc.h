@@ -0,0 +1,61 @@
+/***************************************************************************//**
+ * @file spsc.h
+ * @brief Lock-free single-producer, single-consumer queue of fixed slots.
+ *
+ * One context pushes and one other context pops, for example an interrupt
+ * and a task, or two tasks; neither ever blocks or masks interrupts. The
+ * producer owns the head index and the consumer the tail. Each publishes
+ * with a release store after touching the slots, and reads the other's
+ * index with an acquire load.
+ *
+ * The caller provides the slot memory: count slots of size bytes each,
+ * count a power of two. spsc_front() gives the oldest slot in place, so
+ * large items such as Bluetooth events are copied once, on push.
+ ******************************************************************************/
+#ifndef SPSC_H
+#define SPSC_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+	uint8_t *slots;
+	uint16_t size;              ///< Bytes per slot.
+	uint16_t mask;              ///< Slot count - 1.
+	_Atomic uint32_t head;      ///< Items pushed; written by the producer.
+	_Atomic uint32_t tail;      ///< Items popped; written by the consumer.
+} spsc_t;
+
+/**
+ * @brief Set up an empty queue over count slots of size bytes.
+ */
+void spsc_init(spsc_t *q, void *slots, uint16_t size, uint16_t count);
+
+/**
+ * @brief Copy an item into the next free slot. Producer only.
+ *
+ * @param[in] len Bytes to copy, at most the slot size.
+ * @return false if the queue is full or the item too large.
+ */
+bool spsc_push(spsc_t *q, const void *item, size_t len);
+
+/**
+ * @brief Oldest item, left in the queue. Consumer only.
+ *
+ * @return The slot, or NULL if the queue is empty.
+ */
+void* spsc_front(spsc_t *q);
+
+/**
+ * @brief Release the slot returned by spsc_front(). Consumer only.
+ */
+void spsc_pop(spsc_t *q);
+
+/**
+ * @brief Items queued; exact from either end, a snapshot otherwise.
+ */
+size_t spsc_count(spsc_t *q);
+
+#endif // SPSC_H
@@ -0,0 +1,279 @@
+/***************************************************************************//**
+ * @file stim.c
+ * @brief Hardware-timed stimulation pulse engine (EFR32 series 2).
+ *
+ * STIM_TIMER runs in PWM mode with CC1 routed to the phase A pin and CC2 to
+ * the phase B pin: each output is set on overflow and cleared on compare.
+ * COIST makes the first pulse start with the timer.
+ *
+ * Segment 0 of the schedule is written to TOP/CC and segment 1 to the
+ * buffered TOPB/OCB registers before the timer starts. From then on three
+ * LDMA channels, all triggered by the timer's overflow, each write the next
+ * entry of their table (top, cc A, cc B) into the buffer while the current
+ * segment plays, wrapping back to segment 0 at the end of the table.
+ *
+ * The output of the last phase is sent over PRS to clock STIM_COUNTER, so
+ * it counts completed pulses. For a finite train the counter's TOP is the
+ * pulse count minus one; its overflow fires on the falling edge of the last
+ * pulse and, again over PRS, hits the STIM_TIMER CC0 input whose rise
+ * action stops the timer before the next pulse.
+ *
+ * Each train is reported to telemetry.h when it starts and, from the CPU
+ * side, when it is stopped or its end has been processed.
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "em_cmu.h"
+#include "em_gpio.h"
+#include "em_ldma.h"
+#include "em_prs.h"
+#include "em_timer.h"
+
+#include "config.h"
+#include "power.h"
+#include "stim.h"
+#include "tasks.h"
+#include "telemetry.h"
+
+#define STIM_DMA_CHANNELS (1 + STIM_PHASE_COUNT)
+
+static const stim_schedule_t *schedule;
+static uint32_t trainLength;
+static volatile bool running;
+static volatile bool finished;
+static volatile uint32_t counterWraps;
+static volatile uint32_t delivered;
+static bool reported;           // started and not yet ended in telemetry.h
+
+static const uint32_t dmaChannels[STIM_DMA_CHANNELS] = {
+	STIM_LDMA_CH_TOP, STIM_LDMA_CH_CC_A, STIM_LDMA_CH_CC_B
+};
+// Per channel: entries 2 .. n-1 once, then entries 0 .. n-1 forever.
+static LDMA_Descriptor_t dmaDesc[STIM_DMA_CHANNELS][2];
+
+static uint32_t countPulses(void) {
+	return counterWraps * (TIMER_MaxCount(STIM_COUNTER) + 1u)
+			+ TIMER_CounterGet(STIM_COUNTER);
+}
+
+static void stopTimers(void) {
+	TIMER_Enable(STIM_TIMER, false);
+	TIMER_Enable(STIM_COUNTER, false);
+	for (int i = 0; i < STIM_DMA_CHANNELS; i++) {
+		LDMA_StopTransfer(dmaChannels[i]);
+	}
+	// Hand the pins back to GPIO, which holds them low.
+	GPIO->TIMERROUTE[TIMER_NUM(STIM_TIMER)].ROUTEEN = 0;
+}
+
+static void startDma(const stim_schedule_t *s) {
+	LDMA_TransferCfg_t cfg = LDMA_TRANSFER_CFG_PERIPHERAL(STIM_LDMA_SIGNAL);
+	volatile uint32_t *regs[STIM_DMA_CHANNELS] = {
+		&STIM_TIMER->TOPB, &STIM_TIMER->CC[1].OCB, &STIM_TIMER->CC[2].OCB
+	};
+	const uint32_t *tables[STIM_DMA_CHANNELS] = {
+		s->top, s->cc[0], s->cc[1]
+	};
+
+	for (int i = 0; i < STIM_DMA_CHANNELS; i++) {
+		LDMA_Descriptor_t *d = dmaDesc[i];
+		d[0] = (LDMA_Descriptor_t) LDMA_DESCRIPTOR_LINKREL_M2P_WORD(
+				&tables[i][2], regs[i], s->count - 2, 1);
+		d[1] = (LDMA_Descriptor_t) LDMA_DESCRIPTOR_LINKREL_M2P_WORD(
+				&tables[i][0], regs[i], s->count, 0);
+		LDMA_StartTransfer(dmaChannels[i], &cfg, s->count > 2 ? &d[0] : &d[1]);
+	}
+}
+
+void stim_init(void) {
+	CMU_ClockEnable(cmuClock_GPIO, true);
+	CMU_ClockEnable(cmuClock_PRS, true);
+	CMU_ClockEnable(STIM_TIMER_CLOCK, true);
+	CMU_ClockEnable(STIM_COUNTER_CLOCK, true);
+
+	GPIO_PinModeSet(STIM_OUT_PORT, STIM_OUT_PIN, gpioModePushPull, 0);
+	GPIO_PinModeSet(STIM_OUT_B_PORT, STIM_OUT_B_PIN, gpioModePushPull, 0);
+	GPIO->TIMERROUTE[TIMER_NUM(STIM_TIMER)].CC1ROUTE =
+			((uint32_t) STIM_OUT_PORT << _GPIO_TIMER_CC1ROUTE_PORT_SHIFT)
+					| ((uint32_t) STIM_OUT_PIN << _GPIO_TIMER_CC1ROUTE_PIN_SHIFT);
+	GPIO->TIMERROUTE[TIMER_NUM(STIM_TIMER)].CC2ROUTE =
+			((uint32_t) STIM_OUT_B_PORT << _GPIO_TIMER_CC2ROUTE_PORT_SHIFT)
+					| ((uint32_t) STIM_OUT_B_PIN
+							<< _GPIO_TIMER_CC2ROUTE_PIN_SHIFT);
+
+	// Counter overflow (last pulse done) stops the pulse timer.
+	PRS_ConnectSignal(STIM_PRS_CH_STOP, prsTypeAsync, STIM_PRS_SIGNAL_STOP);
+
+	// The SDK's dmadrv/ldma components may already have done this.
+	LDMA_Init_t ldmaInit = LDMA_INIT_DEFAULT;
+	LDMA_Init(&ldmaInit);
+
+	NVIC_ClearPendingIRQ(STIM_COUNTER_IRQn);
+	NVIC_EnableIRQ(STIM_COUNTER_IRQn);
+}
+
+uint32_t stim_clock_hz(void) {
+	return CMU_ClockFreqGet(STIM_TIMER_CLOCK);
+}
+
+uint32_t stim_counter_max(void) {
+	return TIMER_MaxCount(STIM_TIMER);
+}
+
+uint32_t stim_train_max(void) {
+	return TIMER_MaxCount(STIM_COUNTER) + 1u;
+}
+
+sl_status_t stim_start(const stim_schedule_t *s, uint32_t pulses) {
+	if (s->count == 0 || s->clock_hz != stim_clock_hz()) {
+		return SL_STATUS_INVALID_PARAMETER;
+	}
+	if (pulses > stim_train_max()) {
+		return SL_STATUS_INVALID_RANGE;
+	}
+
+	stim_stop();
+	schedule = s;
+	trainLength = pulses;
+	counterWraps = 0;
+	delivered = 0;
+
+	// Falling edge of every pulse on the last phase clocks the pulse counter,
+	// so the count is of completed pulses and the overflow of a finite train
+	// comes as its last pulse ends, not as it starts.
+	bool biphasic = false;
+	for (uint16_t i = 0; i < s->count; i++) {
+		biphasic |= s->cc[1][i] != 0;
+	}
+	PRS_ConnectSignal(STIM_PRS_CH_PULSE, prsTypeAsync,
+			biphasic ? STIM_PRS_SIGNAL_PULSE_B : STIM_PRS_SIGNAL_PULSE);
+
+	// Pulse counter, clocked by CC1 input edges taken from PRS.
+	TIMER_InitCC_TypeDef countIn = TIMER_INITCC_DEFAULT;
+	countIn.mode = timerCCModeCapture;
+	countIn.edge = timerEdgeFalling;
+	countIn.prsInput = true;
+	countIn.prsSel = STIM_PRS_CH_PULSE;
+	countIn.prsInputType = timerPrsInputAsyncPulse;
+	TIMER_InitCC(STIM_COUNTER, 1, &countIn);
+
+	TIMER_Init_TypeDef counterInit = TIMER_INIT_DEFAULT;
+	counterInit.enable = false;
+	counterInit.clkSel = timerClkSelCC1;
+	TIMER_Init(STIM_COUNTER, &counterInit);
+	TIMER_TopSet(STIM_COUNTER,
+			trainLength ? trainLength - 1 : TIMER_MaxCount(STIM_COUNTER));
+	TIMER_CounterSet(STIM_COUNTER, 0);
+	TIMER_IntClear(STIM_COUNTER, TIMER_IF_OF);
+	TIMER_IntEnable(STIM_COUNTER, TIMER_IF_OF);
+
+	// Pulse timer: CC0 is the PRS stop input, CC1/CC2 the PWM outputs.
+	TIMER_InitCC_TypeDef stopIn = TIMER_INITCC_DEFAULT;
+	stopIn.mode = timerCCModeCapture;
+	stopIn.edge = timerEdgeRising;
+	stopIn.prsInput = true;
+	stopIn.prsSel = STIM_PRS_CH_STOP;
+	stopIn.prsInputType = timerPrsInputAsyncPulse;
+	TIMER_InitCC(STIM_TIMER, 0, &stopIn);
+
+	TIMER_InitCC_TypeDef pwm = TIMER_INITCC_DEFAULT;
+	pwm.mode = timerCCModePWM;
+	pwm.coist = true;
+	TIMER_InitCC(STIM_TIMER, 1, &pwm);
+	TIMER_InitCC(STIM_TIMER, 2, &pwm);
+
+	TIMER_Init_TypeDef timerInit = TIMER_INIT_DEFAULT;
+	timerInit.enable = false;
+	timerInit.prescale = (TIMER_Prescale_TypeDef) (s->prescale - 1);
+	timerInit.riseAction =
+			trainLength ? timerInputActionStop : timerInputActionNone;
+	TIMER_Init(STIM_TIMER, &timerInit);
+
+	// Segment 0 active, segment 1 buffered for the first wrap.
+	uint16_t next = s->count > 1 ? 1 : 0;
+	TIMER_TopSet(STIM_TIMER, s->top[0]);
+	TIMER_CompareSet(STIM_TIMER, 1, s->cc[0][0]);
+	TIMER_CompareSet(STIM_TIMER, 2, s->cc[1][0]);
+	TIMER_TopBufSet(STIM_TIMER, s->top[next]);
+	TIMER_CompareBufSet(STIM_TIMER, 1, s->cc[0][next]);
+	TIMER_CompareBufSet(STIM_TIMER, 2, s->cc[1][next]);
+	TIMER_CounterSet(STIM_TIMER, 0);
+	if (s->count > 1) {
+		startDma(s);
+	}
+
+	GPIO->TIMERROUTE[TIMER_NUM(STIM_TIMER)].ROUTEEN = GPIO_TIMER_ROUTEEN_CC1PEN
+			| (biphasic ? GPIO_TIMER_ROUTEEN_CC2PEN : 0);
+
+	// TIMER and LDMA stop in EM2; keep EM1 until the train ends.
+	power_hold(POWER_CLIENT_STIM);
+	telemetry_train_started(s, pulses);
+	reported = true;
+	running = true;
+	TIMER_Enable(STIM_COUNTER, true);
+	TIMER_Enable(STIM_TIMER, true);
+	return SL_STATUS_OK;
+}
+
+void stim_stop(void) {
+	stopTimers();
+	if (running) {
+		delivered = countPulses();
+	}
+	running = false;
+	finished = false;
+	power_release(POWER_CLIENT_STIM);
+	if (reported) {
+		reported = false;
+		telemetry_train_ended(delivered);
+	}
+}
+
+bool stim_is_running(void) {
+	return running;
+}
+
+uint32_t stim_pulses_delivered(void) {
+	return running ? countPulses() : delivered;
+}
+
+const stim_schedule_t* stim_get_schedule(void) {
+	return schedule;
+}
+
+void stim_process_action(void) {
+	if (finished) {
+		finished = false;
+		stopTimers();
+		if (reported) {
+			reported = false;
+			telemetry_train_ended(delivered);
+		}
+	}
+}
+
+/***************************************************************************//**
+ * Pulse counter overflow: the last pulse of a finite train has ended, or the
+ * count of a continuous train wrapped.
+ ******************************************************************************/
+void STIM_COUNTER_IRQHandler(void) {
+	uint32_t flags = TIMER_IntGetEnabled(STIM_COUNTER);
+	TIMER_IntClear(STIM_COUNTER, flags);
+
+	if (flags & TIMER_IF_OF) {
+		if (trainLength) {
+			// STIM_TIMER was already stopped through PRS, between pulses;
+			// release the pins now rather than when the task gets to it.
+			GPIO->TIMERROUTE[TIMER_NUM(STIM_TIMER)].ROUTEEN = 0;
+			delivered = trainLength;
+			running = false;
+			finished = true;
+			power_release(POWER_CLIENT_STIM);
+			tasks_wake(TASKS_STIM);
+		} else {
+			counterWraps++;
+		}
+	}
+}
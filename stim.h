@@ -0,0 +1,85 @@
+/***************************************************************************//**
+ * @file stim.h
+ * @brief Hardware-timed stimulation pulse engine.
+ *
+ * Pulses are generated by a TIMER in PWM mode and routed straight to the
+ * stimulation pins, so every edge is produced by the timer hardware. A
+ * schedule with more than one segment (stim_schedule.h) is streamed into
+ * the timer's buffered TOP/CC registers by LDMA on each counter wrap. A
+ * second TIMER counts completed pulses through PRS and, for finite trains,
+ * stops the pulse timer through PRS after the last one. The CPU is only
+ * involved when a train is started, stopped, or finishes.
+ ******************************************************************************/
+#ifndef STIM_H
+#define STIM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sl_status.h"
+#include "stim_schedule.h"
+
+/**
+ * @brief Configure clocks, GPIO routing and PRS channels. Call once.
+ */
+void stim_init(void);
+
+/**
+ * @brief Timer input clock, for stim_schedule_compile().
+ */
+uint32_t stim_clock_hz(void);
+
+/**
+ * @brief Largest value the pulse timer can count to, for
+ *        stim_schedule_compile().
+ */
+uint32_t stim_counter_max(void);
+
+/**
+ * @brief Most pulses a finite train can have: the range of the pulse
+ *        counter.
+ */
+uint32_t stim_train_max(void);
+
+/**
+ * @brief Play a compiled schedule, replacing any train already running.
+ *
+ * The schedule is read by DMA while the train runs and must stay valid and
+ * unchanged until stim_stop() or the train finishes.
+ *
+ * @param[in] schedule Table from stim_schedule_compile(), compiled for
+ *                     stim_clock_hz() and stim_counter_max().
+ * @param[in] pulses Pulses to deliver, 0 to run until stopped.
+ * @return SL_STATUS_OK, SL_STATUS_INVALID_PARAMETER for an empty table or
+ *         one compiled for another clock, or SL_STATUS_INVALID_RANGE if
+ *         pulses exceeds stim_train_max().
+ */
+sl_status_t stim_start(const stim_schedule_t *schedule, uint32_t pulses);
+
+/**
+ * @brief Stop the pulse train and drive the output low.
+ */
+void stim_stop(void);
+
+/**
+ * @brief True while a pulse train is running.
+ */
+bool stim_is_running(void);
+
+/**
+ * @brief Pulses completed since the current train started.
+ */
+uint32_t stim_pulses_delivered(void);
+
+/**
+ * @brief Schedule of the current or last train, NULL if none was started.
+ */
+const stim_schedule_t* stim_get_schedule(void);
+
+/**
+ * @brief Process engine events. Call from the superloop.
+ *
+ * Finishes the bookkeeping for a finite train that ended in hardware.
+ */
+void stim_process_action(void);
+
+#endif // STIM_H
@@ -0,0 +1,223 @@
+/***************************************************************************//**
+ * @file stim_schedule.c
+ * @brief Compile stimulation parameters into a timer segment table.
+ *
+ * Monophasic pulse, one segment:
+ *   [ top = period - 1, A = width, B = 0 ]
+ *
+ * Biphasic pulse, two segments:
+ *   [ top = width + gap - 1, A = width, B = 0 ]
+ *   [ top = period - width - gap - 1, A = 0, B = width ]
+ *
+ * A burst repeats the pulse segments burstCount times and lengthens the
+ * last segment by burstRest, splitting the pause into extra low segments
+ * when it does not fit the counter.
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "stim_schedule.h"
+
+typedef struct {
+	size_t offset;
+	uint32_t min;
+	uint32_t max;
+	bool unset;         // 0 means unconfigured rather than out of range
+} stim_limit_t;
+
+static const stim_limit_t limits[] = {
+	{ offsetof(stim_pattern_t, amplitude), 0, STIM_AMPLITUDE_MAX, false },
+	{ offsetof(stim_pattern_t, frequency), STIM_FREQUENCY_MIN,
+			STIM_FREQUENCY_MAX, true },
+	{ offsetof(stim_pattern_t, pulseWidth), STIM_PULSE_WIDTH_MIN,
+			STIM_PULSE_WIDTH_MAX, true },
+	{ offsetof(stim_pattern_t, phases), 1, STIM_PHASE_COUNT, false },
+	{ offsetof(stim_pattern_t, interphaseGap), 0, STIM_GAP_MAX, false },
+	{ offsetof(stim_pattern_t, burstCount), 0, STIM_BURST_MAX, false },
+	{ offsetof(stim_pattern_t, burstRest), 0, STIM_BURST_REST_MAX, false },
+};
+
+// A full biphasic burst plus one extra segment for the pause must fit.
+_Static_assert(STIM_BURST_MAX * STIM_PHASE_COUNT + 1
+		<= STIM_SCHEDULE_MAX_SEGMENTS,
+		"STIM_SCHEDULE_MAX_SEGMENTS too small for STIM_BURST_MAX");
+_Static_assert(STIM_SCHEDULE_MAX_SEGMENTS <= UINT16_MAX,
+		"segment count is stored in 16 bits");
+
+static sl_status_t checkLimits(const stim_pattern_t *pattern,
+		bool allowUnset) {
+	for (size_t i = 0; i < sizeof(limits) / sizeof(limits[0]); i++) {
+		uint32_t v = *(const uint32_t*) ((const uint8_t*) pattern
+				+ limits[i].offset);
+		if (v == 0 && allowUnset && limits[i].unset) {
+			continue;
+		}
+		if (v < limits[i].min || v > limits[i].max) {
+			return SL_STATUS_INVALID_PARAMETER;
+		}
+	}
+	return SL_STATUS_OK;
+}
+
+sl_status_t stim_schedule_check(const stim_pattern_t *pattern) {
+	return checkLimits(pattern, true);
+}
+
+// Append a segment of the given length; false if the table is full.
+static bool addSegment(stim_schedule_t *s, uint64_t ticks, uint32_t ccA,
+		uint32_t ccB) {
+	if (s->count >= STIM_SCHEDULE_MAX_SEGMENTS) {
+		return false;
+	}
+	s->top[s->count] = (uint32_t) (ticks - 1);
+	s->cc[0][s->count] = ccA;
+	s->cc[1][s->count] = ccB;
+	s->count++;
+	s->loopTicks += ticks;
+	return true;
+}
+
+sl_status_t stim_schedule_compile(const stim_pattern_t *pattern,
+		uint32_t clock_hz, uint32_t counter_max, stim_schedule_t *schedule) {
+	stim_timing_t t;
+	stim_schedule_t s;
+	sl_status_t sc;
+
+	sc = checkLimits(pattern, false);
+	if (sc != SL_STATUS_OK) {
+		return sc;
+	}
+	sc = stim_timing_compute(clock_hz, counter_max, pattern->frequency,
+			pattern->pulseWidth, &t);
+	if (sc != SL_STATUS_OK) {
+		return sc;
+	}
+
+	uint64_t period = (uint64_t) t.top + 1;
+	uint64_t width = t.compare;
+	uint64_t gap = stim_timing_us_to_ticks(clock_hz, t.prescale,
+			pattern->interphaseGap);
+	uint64_t rest = stim_timing_us_to_ticks(clock_hz, t.prescale,
+			pattern->burstRest);
+	uint32_t pulses = pattern->burstCount > 1 ? pattern->burstCount : 1;
+	bool biphasic = pattern->phases == 2;
+
+	// Phase B needs room, and the last segment of a pulse needs a low tick.
+	if (biphasic && 2 * width + gap >= period) {
+		return SL_STATUS_INVALID_RANGE;
+	}
+
+	s.clock_hz = clock_hz;
+	s.prescale = t.prescale;
+	s.amplitude = pattern->amplitude;
+	s.count = 0;
+	s.pulsesPerLoop = (uint16_t) pulses;
+	s.loopTicks = 0;
+
+	for (uint32_t i = 0; i < pulses; i++) {
+		bool last = (i == pulses - 1);
+		uint64_t tail = period - (biphasic ? width + gap : 0);
+		uint64_t extra = last ? rest : 0;
+
+		if (biphasic && !addSegment(&s, width + gap, (uint32_t) width, 0)) {
+			return SL_STATUS_INVALID_RANGE;
+		}
+		// Fill the tail segment as far as the counter allows.
+		uint64_t first = tail + extra;
+		if (first > (uint64_t) counter_max + 1) {
+			first = (uint64_t) counter_max + 1;
+			// Same rule as the pause below: no one-tick remainder.
+			if (tail + extra - first == 1) {
+				first--;
+			}
+		}
+		if (!addSegment(&s, first, biphasic ? 0 : (uint32_t) width,
+				biphasic ? (uint32_t) width : 0)) {
+			return SL_STATUS_INVALID_RANGE;
+		}
+		// Remaining pause as all-low segments.
+		for (uint64_t left = tail + extra - first; left > 0;) {
+			uint64_t chunk = left;
+			if (chunk > (uint64_t) counter_max + 1) {
+				chunk = (uint64_t) counter_max + 1;
+			}
+			// Never leave a one-tick remainder; TOP must be at least 1.
+			if (left - chunk == 1) {
+				chunk--;
+			}
+			if (!addSegment(&s, chunk, 0, 0)) {
+				return SL_STATUS_INVALID_RANGE;
+			}
+			left -= chunk;
+		}
+	}
+
+	*schedule = s;
+	return SL_STATUS_OK;
+}
+
+uint32_t stim_schedule_loops_for_pulses(const stim_schedule_t *schedule,
+		uint32_t pulses) {
+	return (pulses + schedule->pulsesPerLoop - 1) / schedule->pulsesPerLoop;
+}
+
+// The phase whose falling edge completes a pulse.
+static inline int lastPhase(const stim_schedule_t *schedule) {
+	for (uint16_t i = 0; i < schedule->count; i++) {
+		if (schedule->cc[1][i]) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+uint32_t stim_schedule_pulses_at(const stim_schedule_t *schedule,
+		uint64_t ticks) {
+	uint64_t loops = ticks / schedule->loopTicks;
+	uint64_t rem = ticks % schedule->loopTicks;
+	uint64_t pulses = loops * schedule->pulsesPerLoop;
+	int phase = lastPhase(schedule);
+	uint64_t start = 0;
+
+	for (uint16_t i = 0; i < schedule->count && start <= rem; i++) {
+		uint32_t cc = schedule->cc[phase][i];
+		if (cc && start + cc <= rem) {
+			pulses++;
+		}
+		start += (uint64_t) schedule->top[i] + 1;
+	}
+	return pulses > UINT32_MAX ? UINT32_MAX : (uint32_t) pulses;
+}
+
+size_t stim_schedule_edges(const stim_schedule_t *schedule, uint32_t loops,
+		stim_edge_t *edges, size_t max_edges) {
+	stim_timing_t t = { .clock_hz = schedule->clock_hz, .prescale =
+			schedule->prescale };
+	uint64_t start = 0;
+	size_t n = 0;
+
+	for (uint32_t loop = 0; loop < loops; loop++) {
+		for (uint16_t i = 0; i < schedule->count; i++) {
+			uint64_t len = (uint64_t) schedule->top[i] + 1;
+			for (uint8_t phase = 0; phase < STIM_PHASE_COUNT; phase++) {
+				uint64_t cc = schedule->cc[phase][i];
+				if (cc == 0) {
+					continue;
+				}
+				if (n + 2 > max_edges) {
+					return n;
+				}
+				edges[n].time_ns = stim_timing_ticks_to_ns(&t, start);
+				edges[n].phase = phase;
+				edges[n++].level = 1;
+				edges[n].time_ns = stim_timing_ticks_to_ns(&t,
+						start + (cc < len ? cc : len));
+				edges[n].phase = phase;
+				edges[n++].level = 0;
+			}
+			start += len;
+		}
+	}
+	return n;
+}
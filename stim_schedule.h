@@ -0,0 +1,111 @@
+/***************************************************************************//**
+ * @file stim_schedule.h
+ * @brief Compile stimulation parameters into a timer segment table.
+ *
+ * A schedule is a list of segments. Each segment is one period of the
+ * pulse timer in PWM mode: it lasts top + 1 ticks, and phase output i is
+ * high from the start of the segment until the counter reaches cc[i]
+ * (0 keeps it low, top + 1 keeps it high). The engine streams the table
+ * into the timer's buffered TOP/CC registers, so nothing is computed per
+ * edge at run time.
+ *
+ * Segments are stored as separate arrays per register so each can be fed
+ * by its own DMA channel with a unit source stride.
+ ******************************************************************************/
+#ifndef STIM_SCHEDULE_H
+#define STIM_SCHEDULE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sl_status.h"
+#include "stim_timing.h"
+
+#define STIM_PHASE_COUNT            2
+#define STIM_SCHEDULE_MAX_SEGMENTS  48
+
+// Parameter limits, checked by stim_schedule_check() and
+// stim_schedule_compile().
+#define STIM_AMPLITUDE_MAX          255      // RHS2116 stimulation DAC code
+#define STIM_FREQUENCY_MIN          1        // Hz
+#define STIM_FREQUENCY_MAX          10000    // Hz
+#define STIM_PULSE_WIDTH_MIN        10       // us
+#define STIM_PULSE_WIDTH_MAX        50000    // us
+#define STIM_GAP_MAX                10000    // us
+#define STIM_BURST_MAX              16       // pulses per burst
+#define STIM_BURST_REST_MAX         60000000 // us
+
+/**
+ * @brief Requested stimulation pattern.
+ */
+typedef struct {
+	uint32_t amplitude;     ///< Stimulation DAC code.
+	uint32_t frequency;     ///< Pulse rate within a burst, Hz.
+	uint32_t pulseWidth;    ///< Width of each phase, us.
+	uint32_t phases;        ///< 1 monophasic, 2 biphasic (phase A then B).
+	uint32_t interphaseGap; ///< Gap between phase A and B, us.
+	uint32_t burstCount;    ///< Pulses per burst; 0 or 1 for a plain train.
+	uint32_t burstRest;     ///< Extra pause after each burst, us.
+} stim_pattern_t;
+
+/**
+ * @brief Compiled segment table.
+ */
+typedef struct {
+	uint32_t clock_hz;                 ///< Timer input clock.
+	uint32_t prescale;                 ///< Clock divider.
+	uint32_t amplitude;                ///< Copied from the pattern.
+	uint16_t count;                    ///< Segments in the table.
+	uint16_t pulsesPerLoop;            ///< Pulses in one pass of the table.
+	uint64_t loopTicks;                ///< Ticks in one pass of the table.
+	uint32_t top[STIM_SCHEDULE_MAX_SEGMENTS];
+	uint32_t cc[STIM_PHASE_COUNT][STIM_SCHEDULE_MAX_SEGMENTS];
+} stim_schedule_t;
+
+/**
+ * @brief Check every field of a pattern against its limit.
+ *
+ * A frequency or pulse width of 0 passes: it leaves stimulation
+ * unconfigured, and stim_schedule_compile() rejects it.
+ *
+ * @return SL_STATUS_OK or SL_STATUS_INVALID_PARAMETER.
+ */
+sl_status_t stim_schedule_check(const stim_pattern_t *pattern);
+
+/**
+ * @brief Validate a pattern and build its segment table.
+ *
+ * Tick counts are derived once from the same prescaler so every period
+ * is an exact integer number of ticks and pulses do not drift.
+ *
+ * @param[in] pattern Requested pattern.
+ * @param[in] clock_hz Timer input clock.
+ * @param[in] counter_max Largest value the timer counter can hold.
+ * @param[out] schedule Result. Unchanged on error.
+ * @return SL_STATUS_OK, SL_STATUS_INVALID_PARAMETER if a field is outside
+ *         its limit, or SL_STATUS_INVALID_RANGE if the phases do not fit
+ *         the period or the table would be too long.
+ */
+sl_status_t stim_schedule_compile(const stim_pattern_t *pattern,
+		uint32_t clock_hz, uint32_t counter_max, stim_schedule_t *schedule);
+
+/**
+ * @brief Number of table passes needed to deliver at least pulses pulses.
+ */
+uint32_t stim_schedule_loops_for_pulses(const stim_schedule_t *schedule,
+		uint32_t pulses);
+
+/**
+ * @brief Pulses completed after the given number of ticks of a run.
+ */
+uint32_t stim_schedule_pulses_at(const stim_schedule_t *schedule,
+		uint64_t ticks);
+
+/**
+ * @brief Model the output edges of a schedule played loops times.
+ *
+ * @return Number of edges written to edges.
+ */
+size_t stim_schedule_edges(const stim_schedule_t *schedule, uint32_t loops,
+		stim_edge_t *edges, size_t max_edges);
+
+#endif // STIM_SCHEDULE_H
@@ -0,0 +1,96 @@
+/***************************************************************************//**
+ * @file stim_timing.c
+ * @brief Timer tick math and edge model for the stimulation pulse engine.
+ ******************************************************************************/
+#include <stddef.h>
+#include <stdint.h>
+
+#include "stim_timing.h"
+
+// Round-to-nearest a / b for b > 0.
+static inline uint64_t div_round(uint64_t a, uint64_t b) {
+	return (a + b / 2) / b;
+}
+
+sl_status_t stim_timing_compute(uint32_t clock_hz, uint32_t counter_max,
+		uint32_t frequency_hz, uint32_t pulse_width_us,
+		stim_timing_t *timing) {
+	uint64_t period_ticks;
+	uint64_t width_ticks;
+	uint32_t prescale;
+
+	if (clock_hz == 0 || frequency_hz == 0 || pulse_width_us == 0) {
+		return SL_STATUS_INVALID_PARAMETER;
+	}
+
+	// Smallest divider for which the period fits: ceil(clock / (f * (max+1)))
+	uint64_t span = (uint64_t) frequency_hz * ((uint64_t) counter_max + 1);
+	prescale = (uint32_t) ((clock_hz + span - 1) / span);
+	if (prescale == 0) {
+		prescale = 1;
+	}
+	if (prescale > STIM_TIMING_MAX_PRESCALE) {
+		return SL_STATUS_INVALID_RANGE;
+	}
+
+	period_ticks = div_round(clock_hz, (uint64_t) prescale * frequency_hz);
+	if (period_ticks > (uint64_t) counter_max + 1) {
+		// Rounding up pushed the period past the counter; use the next divider.
+		if (++prescale > STIM_TIMING_MAX_PRESCALE) {
+			return SL_STATUS_INVALID_RANGE;
+		}
+		period_ticks = div_round(clock_hz, (uint64_t) prescale * frequency_hz);
+	}
+	width_ticks = stim_timing_us_to_ticks(clock_hz, prescale, pulse_width_us);
+
+	// Need at least one tick high and one tick low per period.
+	if (period_ticks < 2 || width_ticks == 0 || width_ticks >= period_ticks) {
+		return SL_STATUS_INVALID_RANGE;
+	}
+
+	timing->clock_hz = clock_hz;
+	timing->prescale = prescale;
+	timing->top = (uint32_t) (period_ticks - 1);
+	timing->compare = (uint32_t) width_ticks;
+	return SL_STATUS_OK;
+}
+
+uint64_t stim_timing_us_to_ticks(uint32_t clock_hz, uint32_t prescale,
+		uint32_t us) {
+	return div_round((uint64_t) us * clock_hz, (uint64_t) prescale * 1000000u);
+}
+
+uint64_t stim_timing_ticks_to_ns(const stim_timing_t *timing, uint64_t ticks) {
+	// Split into whole seconds and remainder so long trains cannot overflow.
+	uint64_t t = ticks * timing->prescale;
+	uint64_t seconds = t / timing->clock_hz;
+	uint64_t rem = t % timing->clock_hz;
+	return seconds * 1000000000ull
+			+ div_round(rem * 1000000000ull, timing->clock_hz);
+}
+
+uint64_t stim_timing_period_ns(const stim_timing_t *timing) {
+	return stim_timing_ticks_to_ns(timing, (uint64_t) timing->top + 1);
+}
+
+uint64_t stim_timing_width_ns(const stim_timing_t *timing) {
+	return stim_timing_ticks_to_ns(timing, timing->compare);
+}
+
+size_t stim_timing_edges(const stim_timing_t *timing, uint32_t pulses,
+		stim_edge_t *edges, size_t max_edges) {
+	uint64_t period = (uint64_t) timing->top + 1;
+	size_t n = 0;
+
+	for (uint32_t i = 0; i < pulses && n + 2 <= max_edges; i++) {
+		uint64_t start = (uint64_t) i * period;
+		edges[n].time_ns = stim_timing_ticks_to_ns(timing, start);
+		edges[n].phase = 0;
+		edges[n++].level = 1;
+		edges[n].time_ns = stim_timing_ticks_to_ns(timing,
+				start + timing->compare);
+		edges[n].phase = 0;
+		edges[n++].level = 0;
+	}
+	return n;
+}
@@ -0,0 +1,94 @@
+/***************************************************************************//**
+ * @file stim_timing.h
+ * @brief Timer tick math and edge model for the stimulation pulse engine.
+ *
+ * Pure integer code with no hardware dependencies, shared by the EFR32
+ * engine in stim.c and the host build.
+ ******************************************************************************/
+#ifndef STIM_TIMING_H
+#define STIM_TIMING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sl_status.h"
+
+/**
+ * @brief Timer configuration for one pulse train.
+ *
+ * The counter runs at clock_hz / prescale and wraps after top + 1 ticks.
+ * The output is high from the wrap until the counter reaches compare.
+ */
+typedef struct {
+	uint32_t clock_hz;   ///< Timer input clock.
+	uint32_t prescale;   ///< Clock divider, 1 .. STIM_TIMING_MAX_PRESCALE.
+	uint32_t top;        ///< Period in ticks, minus one.
+	uint32_t compare;    ///< Pulse width in ticks.
+} stim_timing_t;
+
+/**
+ * @brief One output transition.
+ */
+typedef struct {
+	uint64_t time_ns;    ///< Time since the train started.
+	uint8_t phase;       ///< Output the edge occurs on.
+	uint8_t level;       ///< Output level after the edge.
+} stim_edge_t;
+
+#define STIM_TIMING_MAX_PRESCALE 1024
+
+/**
+ * @brief Choose prescaler, top and compare for a pulse train.
+ *
+ * Picks the smallest prescaler whose period fits the counter, which gives
+ * the finest pulse-width resolution. Tick counts are rounded to nearest.
+ *
+ * @param[in] clock_hz Timer input clock.
+ * @param[in] counter_max Largest value the counter can hold.
+ * @param[in] frequency_hz Pulse repetition rate.
+ * @param[in] pulse_width_us Pulse width.
+ * @param[out] timing Result.
+ * @return SL_STATUS_OK, SL_STATUS_INVALID_PARAMETER for a zero rate or
+ *         width, or SL_STATUS_INVALID_RANGE if the pulse does not fit the
+ *         period or the period does not fit the counter.
+ */
+sl_status_t stim_timing_compute(uint32_t clock_hz, uint32_t counter_max,
+		uint32_t frequency_hz, uint32_t pulse_width_us,
+		stim_timing_t *timing);
+
+/**
+ * @brief Convert a tick count to nanoseconds.
+ */
+uint64_t stim_timing_ticks_to_ns(const stim_timing_t *timing, uint64_t ticks);
+
+/**
+ * @brief Actual period of the configured train in nanoseconds.
+ */
+uint64_t stim_timing_period_ns(const stim_timing_t *timing);
+
+/**
+ * @brief Actual pulse width of the configured train in nanoseconds.
+ */
+uint64_t stim_timing_width_ns(const stim_timing_t *timing);
+
+/**
+ * @brief Convert a duration in microseconds to ticks, rounded to nearest.
+ */
+uint64_t stim_timing_us_to_ticks(uint32_t clock_hz, uint32_t prescale,
+		uint32_t us);
+
+/**
+ * @brief Model the edges the timer produces for the first pulses of a train.
+ *
+ * Edge times are computed from absolute tick counts, as the hardware counts
+ * them, so they accumulate no rounding error over the train.
+ *
+ * @param[in] timing Train configuration.
+ * @param[in] pulses Number of pulses to model.
+ * @param[out] edges Two entries per pulse: rising then falling.
+ * @param[in] max_edges Capacity of edges.
+ * @return Number of edges written.
+ */
+size_t stim_timing_edges(const stim_timing_t *timing, uint32_t pulses,
+		stim_edge_t *edges, size_t max_edges);
+
+#endif // STIM_TIMING_H
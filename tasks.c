@@ -0,0 +1,251 @@
+/***************************************************************************//**
+ * @file tasks.c
+ * @brief Prioritized tasks for the kernel build.
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sl_component_catalog.h"
+#include "tasks.h"
+
+#if defined(SL_CATALOG_KERNEL_PRESENT)
+
+#include <stdatomic.h>
+
+#include "app.h"
+#include "cmsis_os2.h"
+#include "config.h"
+#include "dlog.h"
+#include "em_device.h"
+#include "spsc.h"
+
+#define TASKS_FLAG_WAKE         0x0001u
+#define TASKS_FLAG_DONE         0x0002u
+#define TASKS_CALL_QUEUE_LENGTH 2       // one call in flight, from control
+
+_Static_assert((TASKS_EVENT_QUEUE_LENGTH & (TASKS_EVENT_QUEUE_LENGTH - 1)) == 0,
+		"TASKS_EVENT_QUEUE_LENGTH must be a power of two");
+
+typedef struct {
+	tasks_call_fn_t fn;
+	void *arg;
+	sl_status_t *result;
+	osThreadId_t caller;
+} tasks_call_t;
+
+// An event with the largest payload the stack delivers.
+typedef union {
+	sl_bt_msg_t msg;
+	uint8_t bytes[sizeof(uint32_t) + SL_BGAPI_MAX_PAYLOAD_SIZE];
+} tasks_event_t;
+
+typedef struct {
+	osThreadId_t thread;
+	spsc_t calls;
+	tasks_call_t callSlots[TASKS_CALL_QUEUE_LENGTH];
+	_Atomic uint32_t wokenAt;   ///< Cycle count of the pending wake, 0 if none.
+	tasks_stats_t stats;
+} task_t;
+
+static task_t tasks[TASKS_COUNT];
+static spsc_t events;
+static tasks_event_t eventSlots[TASKS_EVENT_QUEUE_LENGTH];
+static uint32_t lastReport;
+
+static uint32_t msToTicks(uint32_t ms) {
+	uint32_t ticks = (uint32_t) ((uint64_t) ms * osKernelGetTickFreq() / 1000u);
+	return ticks ? ticks : 1;
+}
+
+static void wake(tasks_id_t id) {
+	task_t *t = &tasks[id];
+	uint32_t none = 0;
+
+	// The first wake since the task last ran starts the latency clock;
+	// 0 means none pending, so a count of 0 is taken as 1.
+	atomic_compare_exchange_strong(&t->wokenAt, &none, DWT->CYCCNT | 1u);
+	if (t->thread != NULL) {
+		osThreadFlagsSet(t->thread, TASKS_FLAG_WAKE);
+	}
+}
+
+static void waitWake(tasks_id_t id, uint32_t timeout) {
+	task_t *t = &tasks[id];
+
+	osThreadFlagsWait(TASKS_FLAG_WAKE, osFlagsWaitAny, timeout);
+	uint32_t since = atomic_exchange(&t->wokenAt, 0);
+	t->stats.wakes++;
+	if (since) {
+		uint32_t latency = DWT->CYCCNT - since;
+		t->stats.latencyTotal += latency;
+		if (latency > t->stats.latencyMax) {
+			t->stats.latencyMax = latency;
+		}
+	}
+}
+
+static void runCalls(task_t *t) {
+	tasks_call_t *c;
+
+	while ((c = spsc_front(&t->calls)) != NULL) {
+		tasks_call_t call = *c;
+		spsc_pop(&t->calls);
+		*call.result = call.fn(call.arg);
+		osThreadFlagsSet(call.caller, TASKS_FLAG_DONE);
+	}
+}
+
+static void report(void) {
+	uint32_t mhz = SystemCoreClockGet() / 1000000u;
+
+	for (size_t i = 0; i < TASKS_COUNT; i++) {
+		task_t *t = &tasks[i];
+		if (t->thread == NULL) {
+			continue;
+		}
+		uint32_t space = osThreadGetStackSpace(t->thread);
+		if (space < t->stats.stackFree) {
+			t->stats.stackFree = space;
+		}
+		// Other tasks may add a wake meanwhile; a report can miss one.
+		DLOG(DLOG_TASK_STATS, i, t->stats.stackFree,
+				mhz ? t->stats.latencyMax / mhz : t->stats.latencyMax);
+		t->stats.latencyMax = 0;
+	}
+}
+
+static void stimTask(void *arg) {
+	(void) arg;
+	for (;;) {
+		waitWake(TASKS_STIM, osWaitForever);
+		runCalls(&tasks[TASKS_STIM]);
+		app_stim_process_action();
+	}
+}
+
+static void acqTask(void *arg) {
+	(void) arg;
+	for (;;) {
+		waitWake(TASKS_ACQ, msToTicks(TASKS_ACQ_POLL_MS));
+		runCalls(&tasks[TASKS_ACQ]);
+		app_acq_process_action();
+	}
+}
+
+static void controlTask(void *arg) {
+	tasks_event_t *evt;
+
+	(void) arg;
+	lastReport = osKernelGetTickCount();
+	for (;;) {
+		waitWake(TASKS_CONTROL, msToTicks(TASKS_CONTROL_POLL_MS));
+		while ((evt = spsc_front(&events)) != NULL) {
+			app_on_event(&evt->msg);
+			spsc_pop(&events);
+		}
+		app_control_process_action();
+		if (osKernelGetTickCount() - lastReport
+				>= msToTicks(TASKS_REPORT_INTERVAL_MS)) {
+			lastReport = osKernelGetTickCount();
+			report();
+		}
+	}
+}
+
+static void create(tasks_id_t id, osThreadFunc_t fn, const char *name,
+		uint32_t stackSize, osPriority_t priority) {
+	const osThreadAttr_t attr = {
+		.name = name,
+		.stack_size = stackSize,
+		.priority = priority,
+	};
+	task_t *t = &tasks[id];
+
+	spsc_init(&t->calls, t->callSlots, sizeof(tasks_call_t),
+			TASKS_CALL_QUEUE_LENGTH);
+	t->stats.stackFree = stackSize;
+	t->thread = osThreadNew(fn, NULL, &attr);
+	if (t->thread == NULL) {
+		DLOG(DLOG_TASK_NOT_CREATED, id, stackSize);
+	}
+}
+
+void tasks_init(void) {
+	// Latency is timed on the cycle counter, with or without prof.c.
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	spsc_init(&events, eventSlots, sizeof(tasks_event_t),
+			TASKS_EVENT_QUEUE_LENGTH);
+	create(TASKS_STIM, stimTask, "stim", TASKS_STIM_STACK_SIZE,
+			TASKS_STIM_PRIORITY);
+	create(TASKS_ACQ, acqTask, "acq", TASKS_ACQ_STACK_SIZE,
+			TASKS_ACQ_PRIORITY);
+	create(TASKS_CONTROL, controlTask, "control", TASKS_CONTROL_STACK_SIZE,
+			TASKS_CONTROL_PRIORITY);
+}
+
+bool tasks_post_event(const sl_bt_msg_t *evt) {
+	size_t len = sizeof(evt->header) + SL_BT_MSG_LEN(evt->header);
+
+	// The stack's event task is the only producer. Events are never
+	// dropped: a full queue holds up the stack until control catches up.
+	while (!spsc_push(&events, evt, len)) {
+		osDelay(1);
+	}
+	wake(TASKS_CONTROL);
+	return true;
+}
+
+sl_status_t tasks_call(tasks_id_t task, tasks_call_fn_t fn, void *arg) {
+	task_t *t = &tasks[task];
+	sl_status_t result;
+
+	if (osKernelGetState() != osKernelRunning || t->thread == NULL
+			|| osThreadGetId() == t->thread) {
+		return fn(arg);
+	}
+	tasks_call_t call = { fn, arg, &result, osThreadGetId() };
+	while (!spsc_push(&t->calls, &call, sizeof(call))) {
+		osDelay(1);
+	}
+	wake(task);
+	osThreadFlagsWait(TASKS_FLAG_DONE, osFlagsWaitAny, osWaitForever);
+	return result;
+}
+
+void tasks_wake(tasks_id_t task) {
+	wake(task);
+}
+
+bool tasks_get_stats(tasks_id_t task, tasks_stats_t *stats) {
+	*stats = tasks[task].stats;
+	return true;
+}
+
+#else // SL_CATALOG_KERNEL_PRESENT
+
+void tasks_init(void) {
+}
+
+bool tasks_post_event(const sl_bt_msg_t *evt) {
+	(void) evt;
+	return false;
+}
+
+sl_status_t tasks_call(tasks_id_t task, tasks_call_fn_t fn, void *arg) {
+	(void) task;
+	return fn(arg);
+}
+
+void tasks_wake(tasks_id_t task) {
+	(void) task;
+}
+
+bool tasks_get_stats(tasks_id_t task, tasks_stats_t *stats) {
+	(void) task;
+	(void) stats;
+	return false;
+}
+
+#endif // SL_CATALOG_KERNEL_PRESENT
@@ -0,0 +1,94 @@
+/***************************************************************************//**
+ * @file tasks.h
+ * @brief Prioritized tasks for the kernel build.
+ *
+ * Without a kernel, main.c runs everything from the superloop:
+ * app_process_action() after sl_system_process_action(), and
+ * sl_bt_on_event() straight from the stack. Every function here then
+ * reduces to a direct call, so modules use them unconditionally.
+ *
+ * With the FreeRTOS kernel component (SL_CATALOG_KERNEL_PRESENT),
+ * tasks_init() creates three CMSIS-RTOS2 tasks in place of the superloop:
+ *
+ *   TASKS_STIM     stim and sequencer; the pulse counter interrupt and the
+ *                  gap timer wake it. Highest application priority, so the
+ *                  end of a train and epoch changes do not wait behind
+ *                  Bluetooth events or acquisition packing.
+ *   TASKS_ACQ      rhs2116 completions and acquisition framing; woken by
+ *                  finished SPI batches, polled every TASKS_ACQ_POLL_MS for
+ *                  partial frames and TX buffers.
+ *   TASKS_CONTROL  Bluetooth events and everything else in
+ *                  app_control_process_action(), which together keep the
+ *                  superloop's single-threaded view of their state.
+ *
+ * They share nothing by locking. sl_bt_on_event() copies each event into
+ * an spsc.h queue that the control task drains. The control task hands
+ * work on stimulation or acquisition state to the owning task with
+ * tasks_call(), through a queue per task, and waits for the result: the
+ * owner has the higher priority, so it runs the call at once.
+ *
+ * Every TASKS_REPORT_INTERVAL_MS each task logs DLOG_TASK_STATS: the least
+ * stack it has had free since boot and its worst wake-up latency in the
+ * interval, from tasks_wake() or tasks_post_event() to the task running,
+ * on the DWT cycle counter.
+ ******************************************************************************/
+#ifndef TASKS_H
+#define TASKS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sl_bluetooth.h"
+#include "sl_status.h"
+
+typedef enum {
+	TASKS_STIM = 0,
+	TASKS_ACQ,
+	TASKS_CONTROL,
+	TASKS_COUNT,
+} tasks_id_t;
+
+typedef sl_status_t (*tasks_call_fn_t)(void *arg);
+
+typedef struct {
+	uint32_t wakes;             ///< Times the task ran since boot.
+	uint32_t latencyMax;        ///< Worst wake-up since the last report, cycles.
+	uint64_t latencyTotal;      ///< Sum over all wakes, cycles.
+	uint32_t stackFree;         ///< Least stack free since boot, bytes.
+} tasks_stats_t;
+
+/**
+ * @brief Create the tasks if the kernel is present. Call once from
+ *        app_init(), before the kernel starts.
+ */
+void tasks_init(void);
+
+/**
+ * @brief Hand a Bluetooth event to the control task.
+ *
+ * Copies the event and waits only if the queue is full.
+ *
+ * @return false without the kernel; handle the event directly then.
+ */
+bool tasks_post_event(const sl_bt_msg_t *evt);
+
+/**
+ * @brief Run fn(arg) on a task and return its result.
+ *
+ * Calls fn directly without the kernel, before it starts, or from the
+ * task itself. Otherwise only the control task may call this.
+ */
+sl_status_t tasks_call(tasks_id_t task, tasks_call_fn_t fn, void *arg);
+
+/**
+ * @brief Wake a task to run its process action. Safe from interrupts.
+ */
+void tasks_wake(tasks_id_t task);
+
+/**
+ * @brief Statistics of a task.
+ *
+ * @return false without the kernel.
+ */
+bool tasks_get_stats(tasks_id_t task, tasks_stats_t *stats);
+
+#endif // TASKS_H
@@ -0,0 +1,270 @@
+/***************************************************************************//**
+ * @file telemetry.c
+ * @brief What the pulse engine delivered, and over which link.
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "byteorder.h"
+#include "config.h"
+#include "conn_tuning.h"
+#include "dlog.h"
+#include "em_core.h"
+#include "gatt_db.h"
+#include "sl_sleeptimer.h"
+#include "stim.h"
+#include "tasks.h"
+#include "telemetry.h"
+
+#ifdef gattdb_telemetry
+_Static_assert(TELEMETRY_MAX_SIZE >= TELEMETRY_SIZE,
+		"telemetry characteristic must hold the snapshot");
+#endif
+
+// Totals of the trains that ended.
+static telemetry_stats_t totals;
+static uint64_t chargeFc;       // femtocoulombs, no wrap in practice
+static uint64_t stimTicks;
+static uint64_t connectedTicks;
+static uint64_t bootTick;
+
+// The train running now, from telemetry_train_started(). The schedule may
+// be recompiled in place before the train is reported ended, so only what
+// the end needs is kept.
+static bool trainOpen;
+static uint64_t trainStart;
+static uint32_t trainLength;
+static uint64_t trainChargeFc;  // per pulse
+static uint64_t trainLoopTicks;
+static uint16_t trainPulsesPerLoop;
+static uint32_t trainTickHz;    // pulse timer ticks per second
+
+static uint64_t connectionStart;
+static uint64_t lastConnectionTicks;
+
+static sl_sleeptimer_timer_handle_t reportTimer;
+static volatile bool reportDue;
+
+// n x num / den, split so large n cannot overflow.
+static uint64_t scale(uint64_t n, uint64_t num, uint64_t den) {
+	return n / den * num + n % den * num / den;
+}
+
+static uint64_t ticksToMs(uint64_t ticks) {
+	return scale(ticks, 1000, sl_sleeptimer_get_timer_frequency());
+}
+
+static void onReportTimer(sl_sleeptimer_timer_handle_t *handle, void *data) {
+	(void) handle;
+	(void) data;
+	reportDue = true;
+	tasks_wake(TASKS_CONTROL);
+}
+
+static void publish(void) {
+#ifdef gattdb_telemetry
+	uint8_t record[TELEMETRY_SIZE];
+	size_t len = telemetry_encode(record, sizeof(record));
+	sl_status_t sc = sl_bt_gatt_server_write_attribute_value(
+			gattdb_telemetry, 0, len, record);
+	if (sc != SL_STATUS_OK) {
+		DLOG(DLOG_TELEMETRY_FAILED, sc);
+	}
+#endif
+}
+
+void telemetry_init(void) {
+	memset(&totals, 0, sizeof(totals));
+	chargeFc = 0;
+	stimTicks = 0;
+	connectedTicks = 0;
+	lastConnectionTicks = 0;
+	trainOpen = false;
+	reportDue = false;
+	bootTick = sl_sleeptimer_get_tick_count64();
+}
+
+void telemetry_train_started(const stim_schedule_t *schedule,
+		uint32_t pulses) {
+	uint64_t highTicks = 0;
+
+	// Once per train; the table is at most STIM_SCHEDULE_MAX_SEGMENTS long.
+	for (uint16_t i = 0; i < schedule->count; i++) {
+		for (int phase = 0; phase < STIM_PHASE_COUNT; phase++) {
+			highTicks += schedule->cc[phase][i];
+		}
+	}
+	uint64_t highNs = scale(highTicks * schedule->prescale, 1000000000u,
+			schedule->clock_hz);
+	// nA x ns is 10^-18 C.
+	uint64_t perPulse = schedule->pulsesPerLoop ?
+			(uint64_t) schedule->amplitude * TELEMETRY_STEP_NA * highNs
+					/ schedule->pulsesPerLoop / 1000u : 0;
+
+	CORE_DECLARE_IRQ_STATE;
+	CORE_ENTER_ATOMIC();
+	trainStart = sl_sleeptimer_get_tick_count64();
+	trainLength = pulses;
+	trainChargeFc = perPulse;
+	trainLoopTicks = schedule->loopTicks;
+	trainPulsesPerLoop = schedule->pulsesPerLoop;
+	trainTickHz = schedule->clock_hz / schedule->prescale;
+	trainOpen = true;
+	totals.trainsStarted++;
+	CORE_EXIT_ATOMIC();
+}
+
+// Pulses the train should have delivered in ticks of the sleeptimer: the
+// whole table passes that fit, less the slack. Call with interrupts masked.
+static uint64_t expectedPulses(uint64_t ticks) {
+	uint64_t ns = scale(ticks, 1000000000u,
+			sl_sleeptimer_get_timer_frequency());
+	uint64_t slack = (uint64_t) TELEMETRY_SLACK_US * 1000;
+
+	if (ns <= slack || trainLoopTicks == 0) {
+		return 0;
+	}
+	uint64_t timerTicks = scale(ns - slack, trainTickHz, 1000000000u);
+	uint64_t pulses = timerTicks / trainLoopTicks * trainPulsesPerLoop;
+	return trainLength && pulses > trainLength ? trainLength : pulses;
+}
+
+void telemetry_train_ended(uint32_t delivered) {
+	bool ended;
+	uint32_t missed = 0;
+	CORE_DECLARE_IRQ_STATE;
+
+	CORE_ENTER_ATOMIC();
+	ended = trainOpen;
+	if (ended) {
+		uint64_t ran = sl_sleeptimer_get_tick_count64() - trainStart;
+		uint64_t expected = expectedPulses(ran);
+		trainOpen = false;
+		stimTicks += ran;
+		totals.pulses += delivered;
+		chargeFc += delivered * trainChargeFc;
+		if (expected > delivered) {
+			missed = (uint32_t) (expected - delivered);
+			totals.trainsShort++;
+			totals.pulsesMissed += missed;
+		}
+		if (trainLength && delivered >= trainLength) {
+			totals.trainsCompleted++;
+		}
+	}
+	CORE_EXIT_ATOMIC();
+
+	if (!ended) {
+		return;
+	}
+	if (missed) {
+		DLOG(DLOG_TELEMETRY_MISSED, delivered, missed);
+	}
+	reportDue = true;
+	tasks_wake(TASKS_CONTROL);
+}
+
+void telemetry_on_event(const sl_bt_msg_t *evt) {
+	uint64_t now;
+
+	switch (SL_BT_MSG_ID(evt->header)) {
+	case sl_bt_evt_connection_opened_id:
+		now = sl_sleeptimer_get_tick_count64();
+		if (totals.connectionsOpen++ == 0) {
+			connectionStart = now;
+		}
+		totals.connectionsOpened++;
+		publish();
+		sl_sleeptimer_start_periodic_timer_ms(&reportTimer,
+				TELEMETRY_REPORT_INTERVAL_MS, onReportTimer, NULL, 0, 0);
+		break;
+
+	case sl_bt_evt_connection_closed_id:
+		if (totals.connectionsOpen == 0) {
+			break;
+		}
+		if (--totals.connectionsOpen == 0) {
+			now = sl_sleeptimer_get_tick_count64();
+			lastConnectionTicks = now - connectionStart;
+			connectedTicks += lastConnectionTicks;
+			sl_sleeptimer_stop_timer(&reportTimer);
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+void telemetry_process_action(void) {
+	if (reportDue) {
+		reportDue = false;
+		publish();
+	}
+}
+
+void telemetry_get(telemetry_stats_t *stats) {
+	uint64_t stim, charge, pulses, connected, last;
+	bool open;
+	CORE_DECLARE_IRQ_STATE;
+
+	CORE_ENTER_ATOMIC();
+	uint64_t now = sl_sleeptimer_get_tick_count64();
+	*stats = totals;
+	stim = stimTicks;
+	charge = chargeFc;
+	pulses = 0;
+	open = trainOpen;
+	if (open) {
+		stim += now - trainStart;
+		pulses = stim_pulses_delivered();
+		charge += pulses * trainChargeFc;
+	}
+	CORE_EXIT_ATOMIC();
+
+	// Connected from the first connection opened until the last closes.
+	connected = connectedTicks;
+	last = lastConnectionTicks;
+	if (stats->connectionsOpen) {
+		last = now - connectionStart;
+		connected += last;
+	}
+	stats->running = open;
+	stats->pulses += pulses;
+	stats->chargePc = charge / 1000;
+	stats->stimMs = ticksToMs(stim);
+	stats->connectedMs = ticksToMs(connected);
+	stats->lastConnectionMs = ticksToMs(last);
+	stats->uptimeMs = ticksToMs(now - bootTick);
+}
+
+size_t telemetry_encode(uint8_t *out, size_t size) {
+	telemetry_stats_t stats;
+	const conn_tuning_stats_t *link = conn_tuning_get_controller();
+
+	if (size < TELEMETRY_SIZE) {
+		return 0;
+	}
+	telemetry_get(&stats);
+	memset(out, 0, TELEMETRY_SIZE);
+	out[0] = TELEMETRY_VERSION;
+	out[1] = stats.running ? TELEMETRY_FLAG_RUNNING : 0;
+	out[2] = link->phy;
+	out[3] = stats.connectionsOpen;
+	put_le32(out + 4, stats.trainsStarted);
+	put_le32(out + 8, stats.trainsCompleted);
+	put_le32(out + 12, stats.trainsShort);
+	put_le64(out + 16, stats.pulses);
+	put_le64(out + 24, stats.chargePc);
+	put_le32(out + 32, stats.pulsesMissed);
+	put_le32(out + 36, (uint32_t) stats.stimMs);
+	put_le32(out + 40, stats.connectionsOpened);
+	put_le32(out + 44, (uint32_t) stats.connectedMs);
+	put_le32(out + 48, (uint32_t) stats.lastConnectionMs);
+	put_le16(out + 52, link->interval);
+	put_le16(out + 54, link->mtu);
+	put_le32(out + 56, link->maxLatencyUs);
+	put_le32(out + 60, (uint32_t) stats.uptimeMs);
+	return TELEMETRY_SIZE;
+}
@@ -0,0 +1,123 @@
+/***************************************************************************//**
+ * @file telemetry.h
+ * @brief What the pulse engine delivered, and over which link.
+ *
+ * The pulse engine reports the start and end of every train. Pulses are
+ * counted by its hardware counter, so nothing runs per pulse: the charge of
+ * one pulse is worked out from the schedule when the train starts, and the
+ * totals are updated once when it ends. The charge is amplitude x
+ * TELEMETRY_STEP_NA x the time each phase is high; set TELEMETRY_STEP_NA to
+ * the stimulation step size the RHS2116 is configured for.
+ *
+ * At the end of a train the pulses counted are also checked against the
+ * pulses its schedule should have produced in the whole passes of its table
+ * that fit the time it ran, less TELEMETRY_SLACK_US for the start-up and the
+ * sleeptimer resolution. A shortfall is counted as missed pulses: edges
+ * that came late or not at all, for example a pulse counter losing PRS
+ * edges or a stall in the segment DMA.
+ *
+ * The snapshot below is kept in the telemetry characteristic (Read,
+ * TELEMETRY_MAX_SIZE) when the GATT database has one: on every connection,
+ * every TELEMETRY_REPORT_INTERVAL_MS while connected, and after each train.
+ * Little-endian:
+ *
+ *   offset  size  field
+ *   0       1     TELEMETRY_VERSION
+ *   1       1     TELEMETRY_FLAG_* mask
+ *   2       1     PHY (1 = 1M, 2 = 2M, 4 = coded)
+ *   3       1     connections open
+ *   4       4     trains started
+ *   8       4     trains that delivered every pulse they asked for
+ *   12      4     trains with missed pulses
+ *   16      8     pulses delivered
+ *   24      8     charge delivered, pC, both phases
+ *   32      4     pulses missed
+ *   36      4     time with a train running, ms
+ *   40      4     connections opened
+ *   44      4     time connected, ms
+ *   48      4     current or last time connected, ms
+ *   52      2     connection interval, 1.25 ms units
+ *   54      2     ATT MTU
+ *   56      4     worst write-to-apply latency on the connection, us
+ *   60      4     time since boot, ms
+ *
+ * The PHY, interval, MTU and latency are those of the controller's
+ * connection (conn_tuning_get_controller()).
+ *
+ * Counters run since boot and include the train running now. Times wrap
+ * after 49 days.
+ ******************************************************************************/
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sl_bluetooth.h"
+#include "stim_schedule.h"
+
+#define TELEMETRY_VERSION       1
+#define TELEMETRY_SIZE          64
+
+#define TELEMETRY_FLAG_RUNNING  0x01
+
+typedef struct {
+	uint32_t trainsStarted;
+	uint32_t trainsCompleted;
+	uint32_t trainsShort;
+	uint64_t pulses;
+	uint64_t chargePc;
+	uint32_t pulsesMissed;
+	uint64_t stimMs;
+	uint32_t connectionsOpened;
+	uint8_t connectionsOpen;
+	uint64_t connectedMs;
+	uint64_t lastConnectionMs;
+	uint64_t uptimeMs;
+	bool running;
+} telemetry_stats_t;
+
+/**
+ * @brief Zero the counters. Call once, before stim_init().
+ */
+void telemetry_init(void);
+
+/**
+ * @brief A train started; from the pulse engine.
+ *
+ * @param[in] schedule Schedule being played.
+ * @param[in] pulses Pulses asked for, 0 until stopped.
+ */
+void telemetry_train_started(const stim_schedule_t *schedule,
+		uint32_t pulses);
+
+/**
+ * @brief The train from telemetry_train_started() ended, or was stopped;
+ *        from the pulse engine.
+ */
+void telemetry_train_ended(uint32_t delivered);
+
+/**
+ * @brief Pass every stack event; tracks connections and refreshes the
+ *        snapshot while a central is connected.
+ */
+void telemetry_on_event(const sl_bt_msg_t *evt);
+
+/**
+ * @brief Publish the snapshot when due. Call from the superloop.
+ */
+void telemetry_process_action(void);
+
+/**
+ * @brief Counters up to now.
+ */
+void telemetry_get(telemetry_stats_t *stats);
+
+/**
+ * @brief Encode the snapshot.
+ *
+ * @return TELEMETRY_SIZE, or 0 if out is too small.
+ */
+size_t telemetry_encode(uint8_t *out, size_t size);
+
+#endif // TELEMETRY_H
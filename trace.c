@@ -0,0 +1,259 @@
+/***************************************************************************//**
+ * @file trace.c
+ * @brief Bluetooth event trace, for replay on the host.
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "byteorder.h"
+#include "config.h"
+#include "conn_tuning.h"
+#include "dlog.h"
+#include "gatt_db.h"
+#include "power.h"
+#include "sl_component_catalog.h"
+#include "sl_sleeptimer.h"
+#include "trace.h"
+
+#if TRACE_ENABLE
+
+#if TRACE_VCOM && defined(SL_CATALOG_IOSTREAM_USART_PRESENT)
+#include "em_usart.h"
+#include "sl_iostream_usart_vcom_config.h"
+#define TRACE_UART SL_IOSTREAM_USART_VCOM_PERIPHERAL
+#endif
+
+#define TRACE_NO_CONNECTION     0xFF
+#define TRACE_ATT_HEADER_SIZE   3
+#define TRACE_RECORD_MAX_SIZE \
+	(TRACE_DELTA_MAX_SIZE + 4 + SL_BGAPI_MAX_PAYLOAD_SIZE)
+
+_Static_assert(TRACE_BUFFER_SIZE >= TRACE_RECORD_MAX_SIZE,
+		"the trace must hold the largest event");
+
+static uint8_t buffer[TRACE_BUFFER_SIZE];
+static size_t used;
+static bool recording;
+static bool truncated;
+static uint32_t lastTick;
+static trace_stats_t stats;
+
+#ifdef gattdb_trace
+static uint8_t connection = TRACE_NO_CONNECTION;
+static size_t cursor;           // stream bytes sent to the subscriber
+static uint8_t frame[TRACE_STREAM_MAX_SIZE];
+#endif
+#ifdef TRACE_UART
+static size_t uartCursor;
+#endif
+
+static void clear(void) {
+	used = 0;
+	recording = true;
+	truncated = false;
+	lastTick = sl_sleeptimer_get_tick_count();
+	memset(&stats, 0, sizeof(stats));
+#ifdef gattdb_trace
+	cursor = 0;
+#endif
+#ifdef TRACE_UART
+	uartCursor = 0;
+#endif
+}
+
+void trace_init(void) {
+#ifdef gattdb_trace
+	connection = TRACE_NO_CONNECTION;
+#endif
+	clear();
+}
+
+void trace_record(const sl_bt_msg_t *evt) {
+	size_t len = SL_BT_MSG_LEN(evt->header);
+	uint32_t tick = sl_sleeptimer_get_tick_count();
+
+	if (!recording) {
+		stats.dropped++;
+		return;
+	}
+	if (used + TRACE_DELTA_MAX_SIZE + 4 + len > sizeof(buffer)) {
+		// Keep a prefix of the session rather than a gap in it.
+		recording = false;
+		truncated = true;
+		stats.dropped++;
+		DLOG(DLOG_TRACE_FULL, stats.events, (uint32_t) used);
+		return;
+	}
+	uint32_t delta = tick - lastTick;
+	lastTick = tick;
+	do {
+		uint8_t byte = delta & 0x7F;
+		delta >>= 7;
+		buffer[used++] = delta ? byte | 0x80 : byte;
+	} while (delta);
+	put_le32(buffer + used, evt->header);
+	memcpy(buffer + used + 4, &evt->data, len);
+	used += 4 + len;
+	stats.events++;
+	stats.bytes = (uint32_t) used;
+}
+
+size_t trace_read(size_t offset, uint8_t *out, size_t size) {
+	size_t n = 0;
+
+	if (offset < TRACE_HEADER_SIZE) {
+		uint8_t header[TRACE_HEADER_SIZE];
+		put_le32(header, TRACE_MAGIC);
+		header[4] = TRACE_VERSION;
+		header[5] = truncated ? TRACE_FLAG_TRUNCATED : 0;
+		header[6] = header[7] = 0;
+		put_le32(header + 8, sl_sleeptimer_get_timer_frequency());
+		n = TRACE_HEADER_SIZE - offset;
+		n = n < size ? n : size;
+		memcpy(out, header + offset, n);
+		offset += n;
+	}
+	size_t at = offset - TRACE_HEADER_SIZE;
+	if (n < size && at < used) {
+		size_t m = used - at < size - n ? used - at : size - n;
+		memcpy(out + n, buffer + at, m);
+		n += m;
+	}
+	return n;
+}
+
+#ifdef gattdb_trace
+static size_t frameBudget(void) {
+	size_t mtu = conn_tuning_get(connection)->mtu;
+	size_t value = mtu > TRACE_ATT_HEADER_SIZE ?
+			mtu - TRACE_ATT_HEADER_SIZE : 0;
+	return value < TRACE_STREAM_MAX_SIZE ? value : TRACE_STREAM_MAX_SIZE;
+}
+
+static void drainGatt(void) {
+	for (;;) {
+		size_t len = trace_read(cursor, frame, frameBudget());
+		if (len == 0) {
+			return;
+		}
+		sl_status_t sc = sl_bt_gatt_server_send_notification(connection,
+				gattdb_trace, len, frame);
+		if (sc == SL_STATUS_NO_MORE_RESOURCE) {
+			return;
+		}
+		// Sent, or lost with the connection.
+		cursor += len;
+		stats.sent += (uint32_t) len;
+	}
+}
+#endif
+
+#ifdef TRACE_UART
+static void drainUart(void) {
+	uint8_t byte;
+
+	while (USART_StatusGet(TRACE_UART) & USART_STATUS_TXBL) {
+		if (trace_read(uartCursor, &byte, 1) == 0) {
+			break;
+		}
+		TRACE_UART->TXDATA = byte;
+		uartCursor++;
+		stats.sent++;
+	}
+	// The USART stops in EM2; stay up until the last byte is out.
+	if (uartCursor < TRACE_HEADER_SIZE + used
+			|| !(USART_StatusGet(TRACE_UART) & USART_STATUS_TXC)) {
+		power_hold(POWER_CLIENT_TRACE);
+	} else {
+		power_release(POWER_CLIENT_TRACE);
+	}
+}
+#endif
+
+void trace_on_event(const sl_bt_msg_t *evt) {
+#ifdef gattdb_trace
+	switch (SL_BT_MSG_ID(evt->header)) {
+	case sl_bt_evt_gatt_server_characteristic_status_id: {
+		const sl_bt_evt_gatt_server_characteristic_status_t *status =
+				&evt->data.evt_gatt_server_characteristic_status;
+		if (status->characteristic != gattdb_trace
+				|| status->status_flags != sl_bt_gatt_server_client_config) {
+			break;
+		}
+		if (status->client_config_flags & sl_bt_gatt_server_notification) {
+			// The read out is not part of the session being traced.
+			connection = status->connection;
+			recording = false;
+			cursor = 0;
+		} else if (status->connection == connection) {
+			connection = TRACE_NO_CONNECTION;
+		}
+		break;
+	}
+
+	case sl_bt_evt_gatt_server_attribute_value_id:
+		if (evt->data.evt_gatt_server_attribute_value.attribute
+				== gattdb_trace) {
+			clear();
+		}
+		break;
+
+	case sl_bt_evt_connection_closed_id:
+		if (evt->data.evt_connection_closed.connection == connection) {
+			connection = TRACE_NO_CONNECTION;
+		}
+		break;
+
+	default:
+		break;
+	}
+#else
+	(void) evt;
+#endif
+}
+
+void trace_process_action(void) {
+#ifdef gattdb_trace
+	if (connection != TRACE_NO_CONNECTION) {
+		drainGatt();
+	}
+#endif
+#ifdef TRACE_UART
+	drainUart();
+#endif
+}
+
+void trace_get_stats(trace_stats_t *out) {
+	*out = stats;
+}
+
+#else // TRACE_ENABLE
+
+void trace_init(void) {
+}
+
+void trace_record(const sl_bt_msg_t *evt) {
+	(void) evt;
+}
+
+void trace_on_event(const sl_bt_msg_t *evt) {
+	(void) evt;
+}
+
+void trace_process_action(void) {
+}
+
+size_t trace_read(size_t offset, uint8_t *out, size_t size) {
+	(void) offset;
+	(void) out;
+	(void) size;
+	return 0;
+}
+
+void trace_get_stats(trace_stats_t *out) {
+	memset(out, 0, sizeof(*out));
+}
+
+#endif // TRACE_ENABLE
@@ -0,0 +1,100 @@
+/***************************************************************************//**
+ * @file trace.h
+ * @brief Bluetooth event trace, for replay on the host.
+ *
+ * With TRACE_ENABLE set in config.h, every event handed to the application
+ * is appended to a RAM buffer of TRACE_BUFFER_SIZE bytes: the time since
+ * the previous event, the event header and its payload, as the application
+ * received them. Recording starts at trace_init() and stops, without
+ * dropping anything already recorded, when the next event does not fit; the
+ * trace is then marked truncated. With TRACE_ENABLE at 0 the functions do
+ * nothing.
+ *
+ * The trace is read out as a stream, header first:
+ *
+ *   - while a central is subscribed to the trace characteristic (Notify,
+ *     Write, TRACE_STREAM_MAX_SIZE), recording stops, so the read out is
+ *     not part of the trace, and the trace is sent as notifications.
+ *     Writing any value to the characteristic clears the trace and starts
+ *     recording again after that event;
+ *   - with TRACE_VCOM set, it goes to the VCOM USART as it is recorded,
+ *     instead of the deferred log.
+ *
+ * host/trace_replay feeds a trace back through sl_bt_on_event().
+ *
+ * Stream, little-endian:
+ *
+ *   offset  size  field
+ *   0       4     TRACE_MAGIC
+ *   4       1     TRACE_VERSION
+ *   5       1     flags, TRACE_FLAG_TRUNCATED
+ *   6       2     reserved, 0
+ *   8       4     sleeptimer frequency, Hz
+ *   12            records
+ *
+ * Record:
+ *
+ *   offset  size  field
+ *   0       1-5   sleeptimer ticks since the previous record, or since
+ *                 trace_init() for the first, unsigned LEB128
+ *   n       4     event header, SL_BT_MSG_ID() | length
+ *   n + 4   len   payload, SL_BT_MSG_LEN(header) bytes
+ ******************************************************************************/
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sl_bluetooth.h"
+
+#define TRACE_MAGIC             0x5254434Du     // "MCTR"
+#define TRACE_VERSION           1
+#define TRACE_FLAG_TRUNCATED    0x01
+#define TRACE_HEADER_SIZE       12
+#define TRACE_DELTA_MAX_SIZE    5
+
+typedef struct {
+	uint32_t events;        ///< Events recorded.
+	uint32_t dropped;       ///< Events after recording stopped.
+	uint32_t bytes;         ///< Trace bytes, without the stream header.
+	uint32_t sent;          ///< Stream bytes read out.
+} trace_stats_t;
+
+/**
+ * @brief Clear the trace and start recording. Call once, before the boot
+ *        event. Does nothing without TRACE_ENABLE.
+ */
+void trace_init(void);
+
+/**
+ * @brief Append an event. Call first thing when handling an event, in the
+ *        task that calls trace_process_action().
+ */
+void trace_record(const sl_bt_msg_t *evt);
+
+/**
+ * @brief Pass every stack event; tracks the subscription to the trace
+ *        characteristic and clears the trace on a write to it.
+ */
+void trace_on_event(const sl_bt_msg_t *evt);
+
+/**
+ * @brief Send the trace to a subscriber or the USART. Call from the
+ *        superloop.
+ */
+void trace_process_action(void);
+
+/**
+ * @brief Copy stream bytes from offset.
+ *
+ * @return Bytes copied; 0 at the end of the trace so far.
+ */
+size_t trace_read(size_t offset, uint8_t *out, size_t size);
+
+/**
+ * @brief Copy the counters since the trace was last cleared.
+ */
+void trace_get_stats(trace_stats_t *stats);
+
+#endif // TRACE_H